@@ -40,6 +40,7 @@
 #include <nuttx/config.h>
 
 #include <sys/stat.h>
+#include <sys/ioctl.h>
 
 #include <stdint.h>
 #include <string.h>
@@ -48,6 +49,7 @@
 #include <debug.h>
 #include <errno.h>
 
+#include <nuttx/fs/ioctl.h>
 #include <nuttx/binfmt/elf.h>
 
 #include "libelf.h"
@@ -170,6 +172,17 @@ int elf_init(FAR const char *filename, FAR struct elf_loadinfo_s *loadinfo)
       return -errval;
     }
 
+  /* If the file system can map the whole file in place (as ROMFS does on
+   * XIP media), then headers, symbols and relocations can be read straight
+   * from the mapping rather than with lseek() and read().
+   */
+
+  if (ioctl(loadinfo->filfd, FIOC_MMAP,
+            (unsigned long)((uintptr_t)&loadinfo->filbase)) < 0)
+    {
+      loadinfo->filbase = NULL;
+    }
+
   /* Read the ELF ehdr from offset 0 */
 
   ret = elf_read(loadinfo, (FAR uint8_t *)&loadinfo->ehdr, sizeof(Elf32_Ehdr), 0);
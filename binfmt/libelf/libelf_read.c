@@ -117,6 +117,22 @@ int elf_read(FAR struct elf_loadinfo_s *loadinfo, FAR uint8_t *buffer,
 
   bvdbg("Read %ld bytes from offset %ld\n", (long)readsize, (long)offset);
 
+  /* If the file is mapped in place, then just copy the data */
+
+  if (loadinfo->filbase != NULL)
+    {
+      if (offset < 0 || offset > loadinfo->filelen ||
+          readsize > loadinfo->filelen - offset)
+        {
+          bdbg("Unexpected end of file\n");
+          return -ENODATA;
+        }
+
+      memcpy(buffer, &loadinfo->filbase[offset], readsize);
+      elf_dumpreaddata(buffer, readsize);
+      return OK;
+    }
+
   /* Loop until all of the requested data has been read. */
 
   while (readsize > 0)
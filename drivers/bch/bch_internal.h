@@ -52,9 +52,53 @@
  * Pre-processor Definitions
  ****************************************************************************/
 
+/* Configuration ************************************************************/
+/* CONFIG_BCH_NSECTORS - The number of contiguous sectors held in the sector
+ *   cache.  The default, one, is the classic single sector buffer.
+ * CONFIG_BCH_READAHEAD_NSECTORS - The maximum number of sectors read when
+ *   a sequential access misses the cache.  The read-ahead size starts at
+ *   one sector and doubles on each consecutive sequential miss, so an
+ *   occasional access that just crosses a sector boundary does not pay for
+ *   a deep read-ahead.  Non-sequential misses read only the sector that is
+ *   needed.
+ */
+
+#ifndef CONFIG_BCH_NSECTORS
+#  define CONFIG_BCH_NSECTORS 1
+#endif
+
+#if CONFIG_BCH_NSECTORS < 1
+#  error CONFIG_BCH_NSECTORS must be at least one
+#endif
+
+#ifdef CONFIG_BCH_READAHEAD
+#  ifndef CONFIG_BCH_READAHEAD_NSECTORS
+#    define CONFIG_BCH_READAHEAD_NSECTORS CONFIG_BCH_NSECTORS
+#  endif
+#  if CONFIG_BCH_READAHEAD_NSECTORS > CONFIG_BCH_NSECTORS
+#    define BCH_RHSECTORS CONFIG_BCH_NSECTORS
+#  elif CONFIG_BCH_READAHEAD_NSECTORS < 1
+#    define BCH_RHSECTORS 1
+#  else
+#    define BCH_RHSECTORS CONFIG_BCH_READAHEAD_NSECTORS
+#  endif
+#else
+#  define BCH_RHSECTORS 1
+#endif
+
 #define bchlib_semgive(d) sem_post(&(d)->sem)  /* To match bchlib_semtake */
 #define MAX_OPENCNT     (255)                  /* Limit of uint8_t */
 
+/* Address of a sector in the cache.  The sector must be cached. */
+
+#define bchlib_cachebuffer(b,s) \
+  (&(b)->buffer[((s) - (b)->sector) * (b)->sectsize])
+
+/* True if two sector ranges overlap (the same test as rwb_overlap()) */
+
+#define bchlib_overlap(s1,n1,s2,n2) \
+  ((s1) < (s2) + (n2) && (s2) < (s1) + (n1))
+
 /****************************************************************************
  * Public Types
  ****************************************************************************/
@@ -64,12 +108,18 @@ struct bchlib_s
   struct inode *inode; /* I-node of the block driver */
   sem_t    sem;        /* For atomic accesses to this structure */
   size_t   nsectors;   /* Number of sectors supported by the device */
-  size_t   sector;     /* The current sector in the buffer */
+  size_t   sector;     /* The first sector in the buffer */
+  size_t   ncached;    /* Number of valid sectors in the buffer */
+  size_t   dirtyfirst; /* First modified sector in the buffer */
+  size_t   dirtylast;  /* Last modified sector in the buffer */
   uint16_t sectsize;   /* The size of one sector on the device */
   uint8_t  refs;       /* Number of references */
   bool  dirty;         /* Data has been written to the buffer */
   bool  readonly;      /* true:  Only read operations are supported */
-  FAR uint8_t *buffer; /* One sector buffer */
+  FAR uint8_t *buffer; /* CONFIG_BCH_NSECTORS sector buffer */
+#ifdef CONFIG_BCH_READAHEAD
+  uint16_t rhsectors;  /* Current read-ahead size */
+#endif
 
 #if defined(CONFIG_BCH_ENCRYPTION)
   uint8_t   key[CONFIG_BCH_ENCRYPTION_KEY_SIZE];   /* Encryption key */
@@ -97,6 +147,9 @@ EXTERN const struct file_operations bch_fops;
 EXTERN void bchlib_semtake(FAR struct bchlib_s *bch);
 EXTERN int  bchlib_flushsector(FAR struct bchlib_s *bch);
 EXTERN int  bchlib_readsector(FAR struct bchlib_s *bch, size_t sector);
+EXTERN void bchlib_markdirty(FAR struct bchlib_s *bch, size_t sector);
+EXTERN int  bchlib_invalidate(FAR struct bchlib_s *bch, size_t sector,
+                              size_t nsectors);
 
 #undef EXTERN
 #if defined(__cplusplus)
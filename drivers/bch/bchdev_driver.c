@@ -319,11 +319,30 @@ static int bch_ioctl(FAR struct file *filep, int cmd, unsigned long arg)
 
       bchlib_semgive(bch);
     }
+  else if (cmd == BIOC_FLUSH)
+    {
+      /* Write any modified sectors remaining in the cache */
+
+      bchlib_semtake(bch);
+      ret = bchlib_flushsector(bch);
+      bchlib_semgive(bch);
+    }
 #if defined(CONFIG_BCH_ENCRYPTION)
   else if (cmd == DIOC_SETKEY)
     {
-      memcpy(bch->key, (FAR void *)arg, CONFIG_BCH_ENCRYPTION_KEY_SIZE);
-      ret = OK;
+      /* Modified sectors must reach the device under the old key, and
+       * sectors that were decrypted with it must not be used again.
+       */
+
+      bchlib_semtake(bch);
+      ret = bchlib_invalidate(bch, 0, bch->nsectors);
+      if (ret >= 0)
+        {
+          memcpy(bch->key, (FAR void *)arg, CONFIG_BCH_ENCRYPTION_KEY_SIZE);
+          ret = OK;
+        }
+
+      bchlib_semgive(bch);
     }
 #endif
 
@@ -85,32 +85,42 @@ static void bch_xor(uint32_t *R, uint32_t *A, uint32_t *B)
 
 /****************************************************************************
  * Name: bch_cypher
+ *
+ * Description:
+ *   Encrypt or decrypt 'nsectors' sectors of the cache, starting with
+ *   'sector'.
+ *
  ****************************************************************************/
 
 #if defined(CONFIG_BCH_ENCRYPTION)
-static int bch_cypher(FAR struct bchlib_s *bch, int encrypt)
+static int bch_cypher(FAR struct bchlib_s *bch, size_t sector,
+                      size_t nsectors, int encrypt)
 {
   int blocks = bch->sectsize / 16;
-  FAR uint32_t *buffer = (FAR uint32_t *)bch->buffer;
+  FAR uint32_t *buffer = (FAR uint32_t *)bchlib_cachebuffer(bch, sector);
   int i;
 
-  for (i = 0; i < blocks; i++, buffer += 16 / sizeof(uint32_t) )
+  for (; nsectors > 0; nsectors--, sector++)
     {
-      uint32_t T[4];
-      uint32_t X[4] =
-      {
-        bch->sector, 0, 0, i
-      };
-
-      aes_cypher(X, X, 16, NULL, bch->key, CONFIG_BCH_ENCRYPTION_KEY_SIZE,
-                 AES_MODE_ECB, CYPHER_ENCRYPT);
-
-      /* Xor-Encrypt-Xor */
-
-      bch_xor(T, X, buffer);
-      aes_cypher(T, T, 16, NULL, bch->key, CONFIG_BCH_ENCRYPTION_KEY_SIZE,
-                 AES_MODE_ECB, encrypt);
-      bch_xor(buffer, X, T);
+      for (i = 0; i < blocks; i++, buffer += 16 / sizeof(uint32_t) )
+        {
+          uint32_t T[4];
+          uint32_t X[4] =
+          {
+            sector, 0, 0, i
+          };
+
+          aes_cypher(X, X, 16, NULL, bch->key,
+                     CONFIG_BCH_ENCRYPTION_KEY_SIZE, AES_MODE_ECB,
+                     CYPHER_ENCRYPT);
+
+          /* Xor-Encrypt-Xor */
+
+          bch_xor(T, X, buffer);
+          aes_cypher(T, T, 16, NULL, bch->key,
+                     CONFIG_BCH_ENCRYPTION_KEY_SIZE, AES_MODE_ECB, encrypt);
+          bch_xor(buffer, X, T);
+        }
     }
 
   return OK;
@@ -125,7 +135,10 @@ static int bch_cypher(FAR struct bchlib_s *bch, int encrypt)
  * Name: bchlib_flushsector
  *
  * Description:
- *   Flush the current contents of the sector buffer (if dirty)
+ *   Flush the modified sectors in the sector buffer (if dirty).  All
+ *   modified sectors lie between dirtyfirst and dirtylast; that whole range
+ *   is written in one transfer.  Unmodified sectors within the range hold
+ *   the same data as the media, so re-writing them is harmless.
  *
  * Assumptions:
  *   Caller must assume mutual exclusion
@@ -135,6 +148,7 @@ static int bch_cypher(FAR struct bchlib_s *bch, int encrypt)
 int bchlib_flushsector(FAR struct bchlib_s *bch)
 {
   FAR struct inode *inode;
+  size_t nsectors;
   ssize_t ret = OK;
 
   /* Check if the sector has been modified and is out of synch with the
@@ -143,20 +157,27 @@ int bchlib_flushsector(FAR struct bchlib_s *bch)
 
   if (bch->dirty)
     {
-      inode = bch->inode;
+      inode    = bch->inode;
+      nsectors = bch->dirtylast - bch->dirtyfirst + 1;
 
 #if defined(CONFIG_BCH_ENCRYPTION)
       /* Encrypt data as necessary */
 
-      bch_cypher(bch, CYPHER_ENCRYPT);
+      bch_cypher(bch, bch->dirtyfirst, nsectors, CYPHER_ENCRYPT);
 #endif
 
-      /* Write the sector to the media */
+      /* Write the sectors to the media */
 
-      ret = inode->u.i_bops->write(inode, bch->buffer, bch->sector, 1);
+      ret = inode->u.i_bops->write(inode,
+                                   bchlib_cachebuffer(bch, bch->dirtyfirst),
+                                   bch->dirtyfirst, nsectors);
       if (ret < 0)
         {
-          fdbg("Write failed: %d\n");
+          fdbg("Write failed: %d\n", ret);
+        }
+      else
+        {
+          ret = OK;
         }
 
 #if defined(CONFIG_BCH_ENCRYPTION)
@@ -164,10 +185,10 @@ int bchlib_flushsector(FAR struct bchlib_s *bch)
        * TODO: Add configuration switch for extra sector buffer
        */
 
-      bch_cypher(bch, CYPHER_DECRYPT);
+      bch_cypher(bch, bch->dirtyfirst, nsectors, CYPHER_DECRYPT);
 #endif
 
-      /* The sector is now in sync with the media */
+      /* The sectors are now in sync with the media */
 
       bch->dirty = false;
     }
@@ -179,7 +200,15 @@ int bchlib_flushsector(FAR struct bchlib_s *bch)
  * Name: bchlib_readsector
  *
  * Description:
- *   Flush the current contents of the sector buffer (if dirty)
+ *   Make sure that 'sector' is in the sector buffer.  The buffer holds up
+ *   to CONFIG_BCH_NSECTORS contiguous sectors.  A miss on the sector just
+ *   past the cached range is treated as sequential access: the cached
+ *   range is extended if there is room (keeping any modified sectors so
+ *   that they can be written back together) and sectors are read ahead.
+ *   Any other miss flushes the buffer and reads the single sector that is
+ *   needed.
+ *
+ *   On return, the sector data is at bchlib_cachebuffer(bch, sector).
  *
  * Assumptions:
  *   Caller must assume mutual exclusion
@@ -189,25 +218,146 @@ int bchlib_flushsector(FAR struct bchlib_s *bch)
 int bchlib_readsector(FAR struct bchlib_s *bch, size_t sector)
 {
   FAR struct inode *inode;
-  ssize_t ret = OK;
+  size_t nsectors;
+  size_t index;
+  ssize_t ret;
+
+  if (sector >= bch->sector && sector - bch->sector < bch->ncached)
+    {
+      return OK;
+    }
 
-  if (bch->sector != sector)
+  inode = bch->inode;
+  if (sector == bch->sector + bch->ncached)
     {
-      inode = bch->inode;
+      /* Sequential access.  Append to the cached range if it is not full */
 
+#ifdef CONFIG_BCH_READAHEAD
+      if (bch->rhsectors < BCH_RHSECTORS)
+        {
+          bch->rhsectors <<= 1;
+          if (bch->rhsectors > BCH_RHSECTORS)
+            {
+              bch->rhsectors = BCH_RHSECTORS;
+            }
+        }
+
+      nsectors = bch->rhsectors;
+#else
+      nsectors = 1;
+#endif
+      if (bch->ncached < CONFIG_BCH_NSECTORS)
+        {
+          index = bch->ncached;
+        }
+      else
+        {
+          (void)bchlib_flushsector(bch);
+          index = 0;
+        }
+    }
+  else
+    {
       (void)bchlib_flushsector(bch);
-      bch->sector = (size_t)-1;
+      nsectors = 1;
+      index    = 0;
+#ifdef CONFIG_BCH_READAHEAD
+      bch->rhsectors = 1;
+#endif
+    }
 
-      ret = inode->u.i_bops->read(inode, bch->buffer, sector, 1);
-      if (ret < 0)
+  if (index == 0)
+    {
+      bch->sector  = sector;
+      bch->ncached = 0;
+    }
+
+  /* Don't read past the end of the buffer or of the device */
+
+  if (nsectors > CONFIG_BCH_NSECTORS - index)
+    {
+      nsectors = CONFIG_BCH_NSECTORS - index;
+    }
+
+  if (nsectors > bch->nsectors - sector)
+    {
+      nsectors = bch->nsectors - sector;
+    }
+
+  ret = inode->u.i_bops->read(inode, &bch->buffer[index * bch->sectsize],
+                              sector, nsectors);
+  if (ret < 0)
+    {
+      fdbg("Read failed: %d\n", ret);
+      if (index == 0)
         {
-          fdbg("Read failed: %d\n");
+          bch->sector = (size_t)-1;
         }
-      bch->sector = sector;
+
+      return (int)ret;
+    }
+
+  bch->ncached += nsectors;
 #if defined(CONFIG_BCH_ENCRYPTION)
-      bch_cypher(bch, CYPHER_DECRYPT);
+  bch_cypher(bch, sector, nsectors, CYPHER_DECRYPT);
 #endif
+  return OK;
+}
+
+/****************************************************************************
+ * Name: bchlib_markdirty
+ *
+ * Description:
+ *   Mark a cached sector as modified.
+ *
+ * Assumptions:
+ *   Caller must assume mutual exclusion
+ *
+ ****************************************************************************/
+
+void bchlib_markdirty(FAR struct bchlib_s *bch, size_t sector)
+{
+  if (!bch->dirty)
+    {
+      bch->dirtyfirst = sector;
+      bch->dirtylast  = sector;
+      bch->dirty      = true;
     }
-  return (int)ret;
+  else if (sector < bch->dirtyfirst)
+    {
+      bch->dirtyfirst = sector;
+    }
+  else if (sector > bch->dirtylast)
+    {
+      bch->dirtylast = sector;
+    }
+}
+
+/****************************************************************************
+ * Name: bchlib_invalidate
+ *
+ * Description:
+ *   The range of sectors is about to be written directly to the media.
+ *   If any of them are cached, flush the buffer and discard its content.
+ *
+ * Assumptions:
+ *   Caller must assume mutual exclusion
+ *
+ ****************************************************************************/
+
+int bchlib_invalidate(FAR struct bchlib_s *bch, size_t sector,
+                      size_t nsectors)
+{
+  int ret = OK;
+
+  if (bch->ncached > 0 &&
+      bchlib_overlap(bch->sector, bch->ncached, sector, nsectors))
+    {
+      ret          = bchlib_flushsector(bch);
+      bch->sector  = (size_t)-1;
+      bch->ncached = 0;
+    }
+
+  return ret;
 }
 
@@ -115,7 +115,11 @@ ssize_t bchlib_read(FAR void *handle, FAR char *buffer, size_t offset, size_t le
     {
       /* Read the sector into the sector buffer */
 
-      bchlib_readsector(bch, sector);
+      ret = bchlib_readsector(bch, sector);
+      if (ret < 0)
+        {
+          return ret;
+        }
 
       /* Copy the tail end of the sector to the user buffer */
 
@@ -128,7 +132,7 @@ ssize_t bchlib_read(FAR void *handle, FAR char *buffer, size_t offset, size_t le
           nbytes = len;
         }
 
-      memcpy(buffer, &bch->buffer[sectoffset], nbytes);
+      memcpy(buffer, bchlib_cachebuffer(bch, sector) + sectoffset, nbytes);
 
       /* Adjust pointers and counts */
 
@@ -156,6 +160,20 @@ ssize_t bchlib_read(FAR void *handle, FAR char *buffer, size_t offset, size_t le
           nsectors = bch->nsectors - sector;
         }
 
+      /* Modified sectors in the cache must reach the media first */
+
+      if (bch->dirty &&
+          bchlib_overlap(bch->dirtyfirst,
+                         bch->dirtylast - bch->dirtyfirst + 1,
+                         sector, nsectors))
+        {
+          ret = bchlib_flushsector(bch);
+          if (ret < 0)
+            {
+              return ret;
+            }
+        }
+
       ret = bch->inode->u.i_bops->read(bch->inode, (FAR uint8_t *)buffer,
                                        sector, nsectors);
       if (ret < 0)
@@ -185,11 +203,15 @@ ssize_t bchlib_read(FAR void *handle, FAR char *buffer, size_t offset, size_t le
     {
       /* Read the sector into the sector buffer */
 
-      bchlib_readsector(bch, sector);
+      ret = bchlib_readsector(bch, sector);
+      if (ret < 0)
+        {
+          return ret;
+        }
 
       /* Copy the head end of the sector to the user buffer */
 
-      memcpy(buffer, bch->buffer, len);
+      memcpy(buffer, bchlib_cachebuffer(bch, sector), len);
 
       /* Adjust counts */
 
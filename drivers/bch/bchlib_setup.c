@@ -139,10 +139,14 @@ int bchlib_setup(const char *blkdev, bool readonly, FAR void **handle)
   bch->sectsize = geo.geo_sectorsize;
   bch->sector   = (size_t)-1;
   bch->readonly = readonly;
+#ifdef CONFIG_BCH_READAHEAD
+  bch->rhsectors = 1;
+#endif
 
   /* Allocate the sector I/O buffer */
 
-  bch->buffer = (FAR uint8_t *)kmm_malloc(bch->sectsize);
+  bch->buffer = (FAR uint8_t *)
+    kmm_malloc((size_t)bch->sectsize * CONFIG_BCH_NSECTORS);
   if (!bch->buffer)
     {
       fdbg("Failed to allocate sector buffer\n");
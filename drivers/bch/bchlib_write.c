@@ -114,7 +114,11 @@ ssize_t bchlib_write(FAR void *handle, FAR const char *buffer, size_t offset, si
     {
       /* Read the full sector into the sector buffer */
 
-      bchlib_readsector(bch, sector);
+      ret = bchlib_readsector(bch, sector);
+      if (ret < 0)
+        {
+          return ret;
+        }
 
       /* Copy the tail end of the sector from the user buffer */
 
@@ -127,8 +131,8 @@ ssize_t bchlib_write(FAR void *handle, FAR const char *buffer, size_t offset, si
           nbytes = len;
         }
 
-      memcpy(&bch->buffer[sectoffset], buffer, nbytes);
-      bch->dirty = true;
+      memcpy(bchlib_cachebuffer(bch, sector) + sectoffset, buffer, nbytes);
+      bchlib_markdirty(bch, sector);
 
       /* Adjust pointers and counts */
 
@@ -156,6 +160,14 @@ ssize_t bchlib_write(FAR void *handle, FAR const char *buffer, size_t offset, si
           nsectors = bch->nsectors - sector;
         }
 
+      /* Any cached copies of these sectors are about to become stale */
+
+      ret = bchlib_invalidate(bch, sector, nsectors);
+      if (ret < 0)
+        {
+          return ret;
+        }
+
       /* Write the contiguous sectors */
 
       ret = bch->inode->u.i_bops->write(bch->inode, (FAR uint8_t *)buffer,
@@ -187,18 +199,23 @@ ssize_t bchlib_write(FAR void *handle, FAR const char *buffer, size_t offset, si
     {
       /* Read the sector into the sector buffer */
 
-      bchlib_readsector(bch, sector);
+      ret = bchlib_readsector(bch, sector);
+      if (ret < 0)
+        {
+          return ret;
+        }
 
       /* Copy the head end of the sector from the user buffer */
 
-      memcpy(bch->buffer, buffer, len);
-      bch->dirty = true;
+      memcpy(bchlib_cachebuffer(bch, sector), buffer, len);
+      bchlib_markdirty(bch, sector);
 
       /* Adjust counts */
 
       byteswritten += len;
     }
 
+#ifndef CONFIG_BCH_WRITEBEHIND
   /* Finally, flush any cached writes to the device as well */
 
   ret = bchlib_flushsector(bch);
@@ -207,6 +224,7 @@ ssize_t bchlib_write(FAR void *handle, FAR const char *buffer, size_t offset, si
       fdbg("Flush failed: %d\n", ret);
       return ret;
     }
+#endif
 
   return byteswritten;
 }
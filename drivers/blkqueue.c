@@ -0,0 +1,771 @@
+/****************************************************************************
+ * drivers/blkqueue.c
+ *
+ *   Copyright (C) 2016 Gregory Nutt. All rights reserved.
+ *   Author: Gregory Nutt <gnutt@nuttx.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <semaphore.h>
+#include <errno.h>
+#include <debug.h>
+
+#include <nuttx/kmalloc.h>
+#include <nuttx/wqueue.h>
+#include <nuttx/blkqueue.h>
+
+#ifdef CONFIG_DRVR_BLKQUEUE
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Configuration ************************************************************/
+
+#ifndef CONFIG_SCHED_WORKQUEUE
+#  error "Worker thread support is required (CONFIG_SCHED_WORKQUEUE)"
+#endif
+
+#ifndef CONFIG_DRVR_BLKQUEUE_HPWORK
+#  define BLKQ_WORK LPWORK
+#else
+#  define BLKQ_WORK HPWORK
+#endif
+
+#define blkq_semgive(s) sem_post(s)
+
+/* True if two block ranges overlap (the same test as rwb_overlap()) */
+
+#define blkq_overlap(s1,n1,s2,n2) \
+  ((s1) < (s2) + (off_t)(n2) && (s2) < (s1) + (off_t)(n1))
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+/****************************************************************************
+ * Private Function Prototypes
+ ****************************************************************************/
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: blkq_semtake
+ ****************************************************************************/
+
+static void blkq_semtake(FAR sem_t *sem)
+{
+  /* Take the semaphore (perhaps waiting) */
+
+  while (sem_wait(sem) != 0)
+    {
+      /* The only case that an error should occur here is if
+       * the wait was awakened by a signal.
+       */
+
+      ASSERT(get_errno() == EINTR);
+    }
+}
+
+/****************************************************************************
+ * Name: blkq_overlaplist
+ *
+ * Description:
+ *   Return true if any request in the list, up to (but not including)
+ *   'stop', overlaps the block range.
+ *
+ ****************************************************************************/
+
+static bool blkq_overlaplist(FAR struct blkq_req_s *list,
+                             FAR struct blkq_req_s *stop,
+                             off_t startblock, size_t nblocks)
+{
+  for (; list != NULL && list != stop; list = list->flink)
+    {
+      if (blkq_overlap(list->startblock, list->nblocks, startblock, nblocks))
+        {
+          return true;
+        }
+    }
+
+  return false;
+}
+
+/****************************************************************************
+ * Name: blkq_insert
+ *
+ * Description:
+ *   Insert a request into the pending list, sorted by start block.
+ *
+ * Assumptions:
+ *   The caller holds exclsem.
+ *
+ ****************************************************************************/
+
+static void blkq_insert(FAR struct blkqueue_s *blkq,
+                        FAR struct blkq_req_s *req)
+{
+  FAR struct blkq_req_s *prev = NULL;
+  FAR struct blkq_req_s *curr;
+
+  for (curr = blkq->pending;
+       curr != NULL && curr->startblock <= req->startblock;
+       curr = curr->flink)
+    {
+      prev = curr;
+    }
+
+  req->flink = curr;
+  if (prev)
+    {
+      prev->flink = req;
+    }
+  else
+    {
+      blkq->pending = req;
+    }
+}
+
+/****************************************************************************
+ * Name: blkq_release
+ *
+ * Description:
+ *   Move deferred requests that no longer overlap any pending request to
+ *   the pending list.  A deferred request also stays deferred if it
+ *   overlaps an earlier deferred request so that overlapping requests are
+ *   always performed in the order submitted.
+ *
+ * Assumptions:
+ *   The caller holds exclsem.
+ *
+ ****************************************************************************/
+
+static void blkq_release(FAR struct blkqueue_s *blkq)
+{
+  FAR struct blkq_req_s *prev = NULL;
+  FAR struct blkq_req_s *curr;
+  FAR struct blkq_req_s *next;
+
+  for (curr = blkq->deferred; curr != NULL; curr = next)
+    {
+      next = curr->flink;
+      if (blkq_overlaplist(blkq->pending, NULL, curr->startblock,
+                           curr->nblocks) ||
+          blkq_overlaplist(blkq->deferred, curr, curr->startblock,
+                           curr->nblocks))
+        {
+          prev = curr;
+          continue;
+        }
+
+      if (prev)
+        {
+          prev->flink = next;
+        }
+      else
+        {
+          blkq->deferred = next;
+        }
+
+      blkq_insert(blkq, curr);
+    }
+}
+
+/****************************************************************************
+ * Name: blkq_next
+ *
+ * Description:
+ *   Remove the next batch of requests from the pending list.  Requests are
+ *   taken in ascending block order starting from the position of the last
+ *   transfer, wrapping around to the lowest block (C-SCAN).  Following
+ *   requests in the same direction that continue the first one are merged
+ *   into the batch as long as the total fits in the merge buffer.
+ *
+ * Returned Value:
+ *   The first request of the batch (linked through flink) or NULL if
+ *   there are no pending requests.  *nblocks receives the batch size.
+ *
+ * Assumptions:
+ *   The caller holds exclsem.
+ *
+ ****************************************************************************/
+
+static FAR struct blkq_req_s *blkq_next(FAR struct blkqueue_s *blkq,
+                                        FAR size_t *nblocks)
+{
+  FAR struct blkq_req_s *prev = NULL;
+  FAR struct blkq_req_s *first;
+  FAR struct blkq_req_s *last;
+  FAR struct blkq_req_s *curr;
+  size_t total;
+
+  /* Find the first request at or above the head position */
+
+  for (curr = blkq->pending;
+       curr != NULL && curr->startblock < blkq->head;
+       curr = curr->flink)
+    {
+      prev = curr;
+    }
+
+  if (curr == NULL)
+    {
+      /* Wrap around to the lowest block */
+
+      prev = NULL;
+      curr = blkq->pending;
+      if (curr == NULL)
+        {
+          return NULL;
+        }
+    }
+
+  /* Gather the batch.  The pending list is sorted, so the requests that
+   * continue the batch follow it in the list.
+   */
+
+  first = curr;
+  last  = curr;
+  total = curr->nblocks;
+
+  for (curr = curr->flink; curr != NULL; curr = curr->flink)
+    {
+      if (curr->write != first->write ||
+          curr->startblock != last->startblock + (off_t)last->nblocks ||
+          total + curr->nblocks > blkq->maxblocks)
+        {
+          break;
+        }
+
+      last   = curr;
+      total += curr->nblocks;
+    }
+
+  /* Unlink the batch from the pending list */
+
+  if (prev)
+    {
+      prev->flink = last->flink;
+    }
+  else
+    {
+      blkq->pending = last->flink;
+    }
+
+  last->flink = NULL;
+  blkq->head  = first->startblock + total;
+  *nblocks    = total;
+  return first;
+}
+
+/****************************************************************************
+ * Name: blkq_transfer
+ *
+ * Description:
+ *   Perform one batch of requests with a single driver transfer and set the
+ *   result of each request.
+ *
+ ****************************************************************************/
+
+static void blkq_transfer(FAR struct blkqueue_s *blkq,
+                          FAR struct blkq_req_s *batch, size_t nblocks)
+{
+  FAR struct blkq_req_s *req;
+  FAR uint8_t *dest;
+  ssize_t ret;
+  size_t nbytes;
+
+  if (batch->flink == NULL)
+    {
+      /* A single request: Transfer directly to/from the user buffer */
+
+      if (!batch->write)
+        {
+          ret = blkq->read(blkq->dev, batch->buffer, batch->startblock,
+                           nblocks);
+        }
+      else if (blkq->write)
+        {
+          ret = blkq->write(blkq->dev, batch->buffer, batch->startblock,
+                            nblocks);
+        }
+      else
+        {
+          ret = -EACCES;
+        }
+
+      batch->result = ret;
+      blkq->ntransfers++;
+      return;
+    }
+
+  /* A merged batch goes through the merge buffer */
+
+  if (batch->write)
+    {
+      for (dest = blkq->mergebuf, req = batch; req; req = req->flink)
+        {
+          nbytes = req->nblocks * blkq->blocksize;
+          memcpy(dest, req->buffer, nbytes);
+          dest += nbytes;
+        }
+
+      ret = blkq->write ? blkq->write(blkq->dev, blkq->mergebuf,
+                                      batch->startblock, nblocks) : -EACCES;
+    }
+  else
+    {
+      ret = blkq->read(blkq->dev, blkq->mergebuf, batch->startblock,
+                       nblocks);
+    }
+
+  blkq->ntransfers++;
+
+  /* Distribute the result (and the read data) over the requests */
+
+  for (dest = blkq->mergebuf, req = batch; req; req = req->flink)
+    {
+      nbytes = req->nblocks * blkq->blocksize;
+      if (ret < 0)
+        {
+          req->result = ret;
+        }
+      else
+        {
+          off_t done = (off_t)ret - (req->startblock - batch->startblock);
+
+          if (done <= 0)
+            {
+              req->result = -EIO;
+            }
+          else
+            {
+              req->result = done < req->nblocks ? done : req->nblocks;
+              if (!req->write)
+                {
+                  memcpy(req->buffer, dest, req->result * blkq->blocksize);
+                }
+            }
+        }
+
+      dest += nbytes;
+    }
+}
+
+/****************************************************************************
+ * Name: blkq_dispatch
+ *
+ * Description:
+ *   Dispatch pending requests until the queue is empty.  The caller has set
+ *   blkq->running.  The queue lock is released during each transfer so that
+ *   new requests can be submitted (and merged with each other) while the
+ *   device is busy.
+ *
+ ****************************************************************************/
+
+static void blkq_dispatch(FAR struct blkqueue_s *blkq)
+{
+  FAR struct blkq_req_s *batch;
+  FAR struct blkq_req_s *next;
+  size_t nblocks;
+
+  for (; ; )
+    {
+      blkq_semtake(&blkq->exclsem);
+      batch = blkq_next(blkq, &nblocks);
+      if (batch == NULL)
+        {
+          blkq->running = false;
+          blkq_semgive(&blkq->exclsem);
+          return;
+        }
+
+      /* Requests that were waiting for these may now be sorted in.  They
+       * cannot be dispatched before this batch completes because only one
+       * thread dispatches at a time.
+       */
+
+      blkq_release(blkq);
+      blkq_semgive(&blkq->exclsem);
+
+      fvdbg("%s: startblock=%ld nblocks=%d\n",
+            batch->write ? "write" : "read", (long)batch->startblock,
+            (int)nblocks);
+
+      blkq_transfer(blkq, batch, nblocks);
+
+      /* Report completion */
+
+      for (; batch; batch = next)
+        {
+          next = batch->flink;
+          blkq->nrequests++;
+          batch->callback(batch);
+        }
+    }
+}
+
+/****************************************************************************
+ * Name: blkq_worker
+ *
+ * Description:
+ *   Dispatch the queue on the work queue thread, unless some other thread
+ *   is already dispatching it (that thread will empty the queue).
+ *
+ ****************************************************************************/
+
+static void blkq_worker(FAR void *arg)
+{
+  FAR struct blkqueue_s *blkq = (FAR struct blkqueue_s *)arg;
+
+  DEBUGASSERT(blkq != NULL);
+
+  blkq_semtake(&blkq->exclsem);
+  blkq->busy = false;
+  if (blkq->running)
+    {
+      blkq_semgive(&blkq->exclsem);
+      return;
+    }
+
+  blkq->running = true;
+  blkq_semgive(&blkq->exclsem);
+
+  blkq_dispatch(blkq);
+}
+
+/****************************************************************************
+ * Name: blkq_check
+ *
+ * Description:
+ *   Verify that a request is valid for this queue.
+ *
+ ****************************************************************************/
+
+static int blkq_check(FAR struct blkqueue_s *blkq,
+                      FAR struct blkq_req_s *req)
+{
+  if (req->nblocks < 1 || req->startblock < 0 ||
+      req->startblock + req->nblocks > blkq->nblocks)
+    {
+      return -EINVAL;
+    }
+
+  if (req->write && blkq->write == NULL)
+    {
+      return -EACCES;
+    }
+
+  req->result = 0;
+  req->flink  = NULL;
+  return OK;
+}
+
+/****************************************************************************
+ * Name: blkq_enqueue
+ *
+ * Description:
+ *   Add a request to the queue.  The caller holds the queue lock.
+ *
+ ****************************************************************************/
+
+static void blkq_enqueue(FAR struct blkqueue_s *blkq,
+                         FAR struct blkq_req_s *req)
+{
+  if (blkq_overlaplist(blkq->pending, NULL, req->startblock, req->nblocks) ||
+      blkq_overlaplist(blkq->deferred, NULL, req->startblock, req->nblocks))
+    {
+      /* Wait behind the overlapping request: append to the deferred list */
+
+      FAR struct blkq_req_s *tail = blkq->deferred;
+
+      if (tail == NULL)
+        {
+          blkq->deferred = req;
+        }
+      else
+        {
+          while (tail->flink != NULL)
+            {
+              tail = tail->flink;
+            }
+
+          tail->flink = req;
+        }
+    }
+  else
+    {
+      blkq_insert(blkq, req);
+    }
+}
+
+/****************************************************************************
+ * Name: blkq_wakeup
+ *
+ * Description:
+ *   Completion callback used by the synchronous interfaces.
+ *
+ ****************************************************************************/
+
+static void blkq_wakeup(FAR struct blkq_req_s *req)
+{
+  blkq_semgive((FAR sem_t *)req->priv);
+}
+
+/****************************************************************************
+ * Name: blkq_sync
+ *
+ * Description:
+ *   Queue a request and wait for it to complete.
+ *
+ *   The work queue is not used for this:  If no other thread is
+ *   dispatching the queue, the caller dispatches it itself.  Otherwise the
+ *   thread that is dispatching will also perform this request.  Waiting for
+ *   the work queue would deadlock when the caller is itself running on the
+ *   work queue thread (for example, AIO through a file system on the
+ *   device).
+ *
+ ****************************************************************************/
+
+static ssize_t blkq_sync(FAR struct blkqueue_s *blkq, off_t startblock,
+                         size_t nblocks, FAR uint8_t *buffer, bool write)
+{
+  struct blkq_req_s req;
+  sem_t done;
+  int ret;
+
+  sem_init(&done, 0, 0);
+
+  req.startblock = startblock;
+  req.nblocks    = nblocks;
+  req.buffer     = buffer;
+  req.write      = write;
+  req.callback   = blkq_wakeup;
+  req.priv       = &done;
+
+  ret = blkq_check(blkq, &req);
+  if (ret < 0)
+    {
+      sem_destroy(&done);
+      return ret;
+    }
+
+  blkq_semtake(&blkq->exclsem);
+  blkq_enqueue(blkq, &req);
+
+  if (!blkq->running)
+    {
+      /* Dispatch the queue on this thread.  That includes this request. */
+
+      blkq->running = true;
+      blkq_semgive(&blkq->exclsem);
+      blkq_dispatch(blkq);
+    }
+  else
+    {
+      blkq_semgive(&blkq->exclsem);
+    }
+
+  blkq_semtake(&done);
+  sem_destroy(&done);
+  return req.result;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: blkq_initialize
+ ****************************************************************************/
+
+int blkq_initialize(FAR struct blkqueue_s *blkq)
+{
+  /* Sanity checking */
+
+  DEBUGASSERT(blkq != NULL);
+  DEBUGASSERT(blkq->blocksize > 0);
+  DEBUGASSERT(blkq->nblocks > 0);
+  DEBUGASSERT(blkq->read != NULL);
+
+  sem_init(&blkq->exclsem, 0, 1);
+  memset(&blkq->work, 0, sizeof(struct work_s));
+
+  blkq->busy       = false;
+  blkq->running    = false;
+  blkq->head       = 0;
+  blkq->pending    = NULL;
+  blkq->deferred   = NULL;
+  blkq->mergebuf   = NULL;
+  blkq->nrequests  = 0;
+  blkq->ntransfers = 0;
+
+  /* Allocate the merge buffer */
+
+  if (blkq->maxblocks > 0)
+    {
+      blkq->mergebuf = (FAR uint8_t *)
+        kmm_malloc((size_t)blkq->maxblocks * blkq->blocksize);
+      if (!blkq->mergebuf)
+        {
+          fdbg("Merge buffer kmm_malloc(%d) failed\n",
+               blkq->maxblocks * blkq->blocksize);
+          sem_destroy(&blkq->exclsem);
+          return -ENOMEM;
+        }
+    }
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: blkq_uninitialize
+ *
+ * Description:
+ *   Release the queue resources.  The caller must assure that there are no
+ *   outstanding requests.
+ *
+ ****************************************************************************/
+
+void blkq_uninitialize(FAR struct blkqueue_s *blkq)
+{
+  DEBUGASSERT(blkq->pending == NULL && blkq->deferred == NULL);
+
+  (void)work_cancel(BLKQ_WORK, &blkq->work);
+  sem_destroy(&blkq->exclsem);
+
+  if (blkq->mergebuf)
+    {
+      kmm_free(blkq->mergebuf);
+    }
+}
+
+/****************************************************************************
+ * Name: blkq_submit
+ *
+ * Description:
+ *   Queue a transfer request and return immediately.  The request callback
+ *   is called when the transfer completes, by the thread that dispatches
+ *   the queue (usually the worker thread).  The callback must not call
+ *   blkq_read() or blkq_write() on the same queue.
+ *
+ *   Requests are performed in elevator order and adjacent requests are
+ *   merged, but a request that overlaps an earlier request is never
+ *   performed before it.
+ *
+ ****************************************************************************/
+
+int blkq_submit(FAR struct blkqueue_s *blkq, FAR struct blkq_req_s *req)
+{
+  int ret = OK;
+
+  DEBUGASSERT(blkq != NULL && req != NULL && req->callback != NULL);
+
+  ret = blkq_check(blkq, req);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  blkq_semtake(&blkq->exclsem);
+
+  /* Start the worker unless it is already queued or some thread is already
+   * dispatching (that thread will also perform this request).  This is
+   * done before the request is queued so that nothing has to be undone if
+   * it fails.  The worker cannot run before the lock is released.
+   */
+
+  if (!blkq->busy && !blkq->running)
+    {
+      ret = work_queue(BLKQ_WORK, &blkq->work, blkq_worker,
+                       (FAR void *)blkq, 0);
+      if (ret < 0)
+        {
+          fdbg("ERROR: work_queue failed: %d\n", ret);
+          blkq_semgive(&blkq->exclsem);
+          return ret;
+        }
+
+      blkq->busy = true;
+    }
+
+  blkq_enqueue(blkq, req);
+  blkq_semgive(&blkq->exclsem);
+  return OK;
+}
+
+/****************************************************************************
+ * Name: blkq_read
+ *
+ * Description:
+ *   Read blocks through the queue, waiting for completion.  This has the
+ *   semantics of a block driver read method.
+ *
+ ****************************************************************************/
+
+ssize_t blkq_read(FAR struct blkqueue_s *blkq, off_t startblock,
+                  size_t nblocks, FAR uint8_t *buffer)
+{
+  return blkq_sync(blkq, startblock, nblocks, buffer, false);
+}
+
+/****************************************************************************
+ * Name: blkq_write
+ *
+ * Description:
+ *   Write blocks through the queue, waiting for completion.  This has the
+ *   semantics of a block driver write method.
+ *
+ ****************************************************************************/
+
+ssize_t blkq_write(FAR struct blkqueue_s *blkq, off_t startblock,
+                   size_t nblocks, FAR const uint8_t *buffer)
+{
+  return blkq_sync(blkq, startblock, nblocks, (FAR uint8_t *)buffer, true);
+}
+
+#endif /* CONFIG_DRVR_BLKQUEUE */
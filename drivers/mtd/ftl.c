@@ -63,6 +63,12 @@
 #  define FTL_HAVE_RWBUFFER 1
 #endif
 
+#if defined(CONFIG_FS_WRITABLE) && defined(CONFIG_FTL_DISCARD)
+#  define FTL_HAVE_DISCARD 1
+#endif
+
+#define FTL_TESTBIT(m,b) (((m)[(b) >> 5] & (1u << ((b) & 31))) != 0)
+
 /****************************************************************************
  * Private Types
  ****************************************************************************/
@@ -78,6 +84,10 @@ struct ftl_struct_s
 #ifdef CONFIG_FS_WRITABLE
   FAR uint8_t          *eblock;  /* One, in-memory erase block */
 #endif
+#ifdef FTL_HAVE_DISCARD
+  FAR uint32_t       *discarded; /* One bit per R/W block: Content not needed */
+  FAR uint32_t          *erased; /* One bit per R/W block: Left erased */
+#endif
 };
 
 /****************************************************************************
@@ -90,11 +100,21 @@ static ssize_t ftl_reload(FAR void *priv, FAR uint8_t *buffer,
                  off_t startblock, size_t nblocks);
 static ssize_t ftl_read(FAR struct inode *inode, unsigned char *buffer,
                  size_t start_sector, unsigned int nsectors);
+#ifdef FTL_HAVE_DISCARD
+static void    ftl_setbits(FAR uint32_t *map, off_t block, size_t nblocks,
+                 bool set);
+static bool    ftl_allerased(FAR struct ftl_struct_s *dev, off_t block,
+                 size_t nblocks);
+static int     ftl_rmwblocks(FAR struct ftl_struct_s *dev, off_t rwblock,
+                 off_t first, off_t last, bool write);
+#endif
 #ifdef CONFIG_FS_WRITABLE
 static ssize_t ftl_flush(FAR void *priv, FAR const uint8_t *buffer,
                  off_t startblock, size_t nblocks);
 static ssize_t ftl_write(FAR struct inode *inode, const unsigned char *buffer,
                  size_t start_sector, unsigned int nsectors);
+static int     ftl_discard(FAR struct ftl_struct_s *dev,
+                 FAR struct bioc_discard_s *discard);
 #endif
 static int     ftl_geometry(FAR struct inode *inode, struct geometry *geometry);
 static int     ftl_ioctl(FAR struct inode *inode, int cmd, unsigned long arg);
@@ -197,176 +217,304 @@ static ssize_t ftl_read(FAR struct inode *inode, unsigned char *buffer,
 }
 
 /****************************************************************************
- * Name: ftl_flush
+ * Name: ftl_setbits
  *
- * Description: Write the specified number of sectors
+ * Description: Set or clear the bits of a range of blocks in a block bitmap
  *
  ****************************************************************************/
 
-#ifdef CONFIG_FS_WRITABLE
-static ssize_t ftl_flush(FAR void *priv, FAR const uint8_t *buffer,
-                         off_t startblock, size_t nblocks)
+#ifdef FTL_HAVE_DISCARD
+static void ftl_setbits(FAR uint32_t *map, off_t block, size_t nblocks,
+                        bool set)
 {
-  struct ftl_struct_s *dev = (struct ftl_struct_s *)priv;
-  off_t  alignedblock;
-  off_t  mask;
-  off_t  rwblock;
-  off_t  eraseblock;
-  off_t  offset;
-  size_t remaining;
-  size_t nxfrd;
-  int    nbytes;
-  int    ret;
-
-  /* Get the aligned block.  Here is is assumed: (1) The number of R/W blocks
-   * per erase block is a power of 2, and (2) the erase begins with that same
-   * alignment.
-   */
-
-  mask         = dev->blkper - 1;
-  alignedblock = (startblock + mask) & ~mask;
-
-  /* Handle partial erase blocks before the first unaligned block */
-
-  remaining = nblocks;
-  if (alignedblock > startblock)
+  for (; nblocks > 0; block++, nblocks--)
     {
-      /* Check if the write is shorter than to the end of the erase block */
-
-      bool short_write = (remaining < (alignedblock - startblock));
-
-      /* Read the full erase block into the buffer */
-
-      rwblock = startblock & ~mask;
-      nxfrd   = MTD_BREAD(dev->mtd, rwblock, dev->blkper, dev->eblock);
-      if (nxfrd != dev->blkper)
+      if (set)
         {
-          fdbg("Read erase block %d failed: %d\n", rwblock, nxfrd);
-          return -EIO;
+          map[block >> 5] |= (1u << (block & 31));
         }
+      else
+        {
+          map[block >> 5] &= ~(1u << (block & 31));
+        }
+    }
+}
+#endif
 
-      /* Then erase the erase block */
+/****************************************************************************
+ * Name: ftl_allerased
+ *
+ * Description: Return true if all of a range of blocks are known to be erased
+ *
+ ****************************************************************************/
 
-      eraseblock = rwblock / dev->blkper;
-      ret        = MTD_ERASE(dev->mtd, eraseblock, 1);
-      if (ret < 0)
+#ifdef FTL_HAVE_DISCARD
+static bool ftl_allerased(FAR struct ftl_struct_s *dev, off_t block,
+                          size_t nblocks)
+{
+  for (; nblocks > 0; block++, nblocks--)
+    {
+      if (!FTL_TESTBIT(dev->erased, block))
         {
-          fdbg("Erase block=%d failed: %d\n", eraseblock, ret);
-          return ret;
+          return false;
         }
+    }
 
-      /* Copy the user data at the end of the buffered erase block */
+  return true;
+}
+#endif
 
-      offset = (startblock & mask) * dev->geo.blocksize;
+/****************************************************************************
+ * Name: ftl_rmwblocks
+ *
+ * Description:
+ *   Read (before the erase) or write back (after the erase) the blocks of
+ *   the erase block buffered in dev->eblock, in runs of contiguous blocks.
+ *   Blocks first through last-1 receive new data so they are written but
+ *   never read.  Discarded blocks are neither read nor written; after the
+ *   erase they are left erased.
+ *
+ ****************************************************************************/
 
-      if (short_write)
+#ifdef FTL_HAVE_DISCARD
+static int ftl_rmwblocks(FAR struct ftl_struct_s *dev, off_t rwblock,
+                         off_t first, off_t last, bool write)
+{
+  FAR uint8_t *buffer;
+  ssize_t nxfrd;
+  off_t   block;
+  off_t   run;
+  bool    live;
+
+  for (block = 0, run = 0; block <= dev->blkper; block++)
+    {
+      /* Does this block have to be transferred? */
+
+      if (block == dev->blkper)
+        {
+          live = false;
+        }
+      else if (block >= first && block < last)
         {
-          nbytes = remaining * dev->geo.blocksize;
+          live = write;
         }
       else
         {
-          nbytes = dev->geo.erasesize - offset;
+          live = !FTL_TESTBIT(dev->discarded, rwblock + block);
         }
 
-      fvdbg("Copy %d bytes into erase block=%d at offset=%d\n",
-             nbytes, eraseblock, offset);
-
-      memcpy(dev->eblock + offset, buffer, nbytes);
-
-      /* And write the erase block back to flash */
-
-      nxfrd = MTD_BWRITE(dev->mtd, rwblock, dev->blkper, dev->eblock);
-      if (nxfrd != dev->blkper)
+      if (live)
         {
-          fdbg("Write erase block %d failed: %d\n", rwblock, nxfrd);
-          return -EIO;
+          continue;
         }
 
-      /* Then update for amount written */
+      /* No.. transfer the run of blocks that precedes it */
 
-      if (short_write)
+      if (block > run)
         {
-          remaining = 0;
+          buffer = dev->eblock + run * dev->geo.blocksize;
+          if (write)
+            {
+              nxfrd = MTD_BWRITE(dev->mtd, rwblock + run, block - run,
+                                 buffer);
+            }
+          else
+            {
+              nxfrd = MTD_BREAD(dev->mtd, rwblock + run, block - run,
+                                buffer);
+            }
+
+          if (nxfrd != block - run)
+            {
+              fdbg("%s %d blocks at %d failed: %d\n",
+                   write ? "Write" : "Read", block - run, rwblock + run,
+                   nxfrd);
+              return -EIO;
+            }
+
+          if (write)
+            {
+              ftl_setbits(dev->discarded, rwblock + run, block - run, false);
+              ftl_setbits(dev->erased, rwblock + run, block - run, false);
+            }
         }
-      else
+
+      /* A block that is not written back after the erase is left erased */
+
+      if (write && block < dev->blkper)
         {
-          remaining -= dev->blkper - (startblock & mask);
+          ftl_setbits(dev->erased, rwblock + block, 1, true);
         }
 
-      buffer += nbytes;
+      run = block + 1;
     }
 
-  /* How handle full erase pages in the middle */
+  return OK;
+}
+#endif
+
+/****************************************************************************
+ * Name: ftl_flush
+ *
+ * Description: Write the specified number of sectors
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_FS_WRITABLE
+static ssize_t ftl_flush(FAR void *priv, FAR const uint8_t *buffer,
+                         off_t startblock, size_t nblocks)
+{
+  struct ftl_struct_s *dev = (struct ftl_struct_s *)priv;
+  off_t  mask;
+  off_t  rwblock;
+  off_t  eraseblock;
+  off_t  offset;
+  size_t remaining;
+  size_t count;
+  size_t nxfrd;
+  int    nbytes;
+  int    ret;
+
+  /* Here is is assumed: (1) The number of R/W blocks per erase block is a
+   * power of 2, and (2) the erase begins with that same alignment.
+   */
 
-  while (remaining >= dev->blkper)
+  mask      = dev->blkper - 1;
+  remaining = nblocks;
+
+  while (remaining > 0)
     {
-      /* Erase the erase block */
+      /* Get the first R/W block of the erase block that holds startblock,
+       * the offset of startblock in it and the number of blocks to write
+       * there.
+       */
 
-      eraseblock = alignedblock / dev->blkper;
-      ret        = MTD_ERASE(dev->mtd, eraseblock, 1);
-      if (ret < 0)
+      rwblock    = startblock & ~mask;
+      offset     = startblock & mask;
+      eraseblock = rwblock / dev->blkper;
+      count      = dev->blkper - offset;
+
+      if (count > remaining)
         {
-          fdbg("Erase block=%d failed: %d\n", eraseblock, ret);
-          return ret;
+          count = remaining;
         }
 
-      /* Write a full erase back to flash */
+      nbytes = count * dev->geo.blocksize;
 
-      fvdbg("Write %d bytes into erase block=%d at offset=0\n",
-             dev->geo.erasesize, alignedblock);
+#ifdef FTL_HAVE_DISCARD
+      /* If the blocks are still erased, then they can simply be written */
 
-      nxfrd = MTD_BWRITE(dev->mtd, alignedblock, dev->blkper, buffer);
-      if (nxfrd != dev->blkper)
+      if (ftl_allerased(dev, startblock, count))
         {
-          fdbg("Write erase block %d failed: %d\n", alignedblock, nxfrd);
-          return -EIO;
+          fvdbg("Write %d erased blocks at block=%d\n", count, startblock);
+
+          nxfrd = MTD_BWRITE(dev->mtd, startblock, count, buffer);
+          if (nxfrd != count)
+            {
+              fdbg("Write %d blocks at %d failed: %d\n",
+                   count, startblock, nxfrd);
+              return -EIO;
+            }
+
+          ftl_setbits(dev->discarded, startblock, count, false);
+          ftl_setbits(dev->erased, startblock, count, false);
         }
+      else
+#endif
 
-      /* Then update for amount written */
+      /* Handle partial erase blocks */
 
-      alignedblock += dev->blkper;
-      remaining    -= dev->blkper;
-      buffer       += dev->geo.erasesize;
-    }
+      if (count < dev->blkper)
+        {
+          /* Read the full erase block into the buffer (only the blocks
+           * that still matter if discarded blocks are tracked).
+           */
+
+#ifdef FTL_HAVE_DISCARD
+          ret = ftl_rmwblocks(dev, rwblock, offset, offset + count, false);
+          if (ret < 0)
+            {
+              return ret;
+            }
+#else
+          nxfrd = MTD_BREAD(dev->mtd, rwblock, dev->blkper, dev->eblock);
+          if (nxfrd != dev->blkper)
+            {
+              fdbg("Read erase block %d failed: %d\n", rwblock, nxfrd);
+              return -EIO;
+            }
+#endif
 
-  /* Finally, handler any partial blocks after the last full erase block */
+          /* Then erase the erase block */
 
-  if (remaining > 0)
-    {
-      /* Read the full erase block into the buffer */
+          ret = MTD_ERASE(dev->mtd, eraseblock, 1);
+          if (ret < 0)
+            {
+              fdbg("Erase block=%d failed: %d\n", eraseblock, ret);
+              return ret;
+            }
 
-     nxfrd = MTD_BREAD(dev->mtd, alignedblock, dev->blkper, dev->eblock);
-      if (nxfrd != dev->blkper)
-        {
-          fdbg("Read erase block %d failed: %d\n", alignedblock, nxfrd);
-          return -EIO;
-        }
+          /* Copy the user data into the buffered erase block */
 
-      /* Then erase the erase block */
+          fvdbg("Copy %d bytes into erase block=%d at offset=%d\n",
+                 nbytes, eraseblock, offset * dev->geo.blocksize);
 
-      eraseblock = alignedblock / dev->blkper;
-      ret        = MTD_ERASE(dev->mtd, eraseblock, 1);
-      if (ret < 0)
-        {
-          fdbg("Erase block=%d failed: %d\n", eraseblock, ret);
-          return ret;
-        }
+          memcpy(dev->eblock + offset * dev->geo.blocksize, buffer, nbytes);
 
-      /* Copy the user data at the beginning the buffered erase block */
+          /* And write the erase block back to flash */
 
-      nbytes = remaining * dev->geo.blocksize;
-      fvdbg("Copy %d bytes into erase block=%d at offset=0\n",
-             nbytes, alignedblock);
-      memcpy(dev->eblock, buffer, nbytes);
+#ifdef FTL_HAVE_DISCARD
+          ret = ftl_rmwblocks(dev, rwblock, offset, offset + count, true);
+          if (ret < 0)
+            {
+              return ret;
+            }
+#else
+          nxfrd = MTD_BWRITE(dev->mtd, rwblock, dev->blkper, dev->eblock);
+          if (nxfrd != dev->blkper)
+            {
+              fdbg("Write erase block %d failed: %d\n", rwblock, nxfrd);
+              return -EIO;
+            }
+#endif
+        }
 
-      /* And write the erase back to flash */
+      /* Handle full erase blocks */
 
-      nxfrd = MTD_BWRITE(dev->mtd, alignedblock, dev->blkper, dev->eblock);
-      if (nxfrd != dev->blkper)
+      else
         {
-          fdbg("Write erase block %d failed: %d\n", alignedblock, nxfrd);
-          return -EIO;
+          /* Erase the erase block */
+
+          ret = MTD_ERASE(dev->mtd, eraseblock, 1);
+          if (ret < 0)
+            {
+              fdbg("Erase block=%d failed: %d\n", eraseblock, ret);
+              return ret;
+            }
+
+          /* Write a full erase back to flash */
+
+          fvdbg("Write %d bytes into erase block=%d at offset=0\n",
+                 nbytes, eraseblock);
+
+          nxfrd = MTD_BWRITE(dev->mtd, rwblock, dev->blkper, buffer);
+          if (nxfrd != dev->blkper)
+            {
+              fdbg("Write erase block %d failed: %d\n", rwblock, nxfrd);
+              return -EIO;
+            }
+
+#ifdef FTL_HAVE_DISCARD
+          ftl_setbits(dev->discarded, rwblock, dev->blkper, false);
+          ftl_setbits(dev->erased, rwblock, dev->blkper, false);
+#endif
         }
+
+      /* Then update for amount written */
+
+      startblock += count;
+      remaining  -= count;
+      buffer     += nbytes;
     }
 
   return nblocks;
@@ -398,6 +546,65 @@ static ssize_t ftl_write(FAR struct inode *inode, const unsigned char *buffer,
 }
 #endif
 
+/****************************************************************************
+ * Name: ftl_discard
+ *
+ * Description: Forget the content of a range of sectors
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_FS_WRITABLE
+static int ftl_discard(FAR struct ftl_struct_s *dev,
+                       FAR struct bioc_discard_s *discard)
+{
+  size_t nblocks = dev->geo.neraseblocks * dev->blkper;
+#if defined(FTL_HAVE_RWBUFFER) && defined(CONFIG_DRVR_INVALIDATE)
+  int ret;
+#endif
+
+  if (!discard || discard->bd_startsector >= nblocks ||
+      discard->bd_nsectors > nblocks - discard->bd_startsector)
+    {
+      return -EINVAL;
+    }
+
+  fvdbg("sector: %d nsectors: %d\n",
+        discard->bd_startsector, discard->bd_nsectors);
+
+  /* Buffered data for the discarded sectors need not be written or kept */
+
+#if defined(FTL_HAVE_RWBUFFER) && defined(CONFIG_DRVR_INVALIDATE)
+  ret = rwb_invalidate(&dev->rwb, discard->bd_startsector,
+                       discard->bd_nsectors);
+  if (ret < 0)
+    {
+      fdbg("ERROR: rwb_invalidate failed: %d\n", ret);
+      return ret;
+    }
+#endif
+
+  /* Remember that the sectors need not be preserved when their erase
+   * blocks are rewritten.
+   */
+
+#ifdef FTL_HAVE_DISCARD
+  ftl_setbits(dev->discarded, discard->bd_startsector, discard->bd_nsectors,
+              true);
+#endif
+
+  /* Sectors and MTD blocks are the same thing here.  Pass the range on in
+   * case the MTD driver also buffers data.  Discarding is only advisory so
+   * MTD drivers that do not support it are not an error.
+   */
+
+  (void)MTD_IOCTL(dev->mtd, MTDIOC_DISCARD,
+                  (unsigned long)((uintptr_t)discard));
+
+  discard->bd_zeroed = false;
+  return OK;
+}
+#endif
+
 /****************************************************************************
  * Name: ftl_geometry
  *
@@ -451,8 +658,19 @@ static int ftl_ioctl(FAR struct inode *inode, int cmd, unsigned long arg)
   fvdbg("Entry\n");
   DEBUGASSERT(inode && inode->i_private);
 
-  /* Only one block driver ioctl command is supported by this driver (and
-   * that command is just passed on to the MTD driver in a slightly
+  dev = (struct ftl_struct_s *)inode->i_private;
+
+  /* BIOC_DISCARD is handled by this driver */
+
+#ifdef CONFIG_FS_WRITABLE
+  if (cmd == BIOC_DISCARD)
+    {
+      return ftl_discard(dev, (FAR struct bioc_discard_s *)((uintptr_t)arg));
+    }
+#endif
+
+  /* Only one other block driver ioctl command is supported by this driver
+   * (and that command is just passed on to the MTD driver in a slightly
    * different form).
    */
 
@@ -481,7 +699,6 @@ static int ftl_ioctl(FAR struct inode *inode, int cmd, unsigned long arg)
    * to the MTD driver (unchanged).
    */
 
-  dev = (struct ftl_struct_s *)inode->i_private;
   ret = MTD_IOCTL(dev->mtd, cmd, arg);
   if (ret < 0)
     {
@@ -512,6 +729,9 @@ int ftl_initialize(int minor, FAR struct mtd_dev_s *mtd)
 {
   struct ftl_struct_s *dev;
   char devname[16];
+#ifdef FTL_HAVE_DISCARD
+  size_t mapsize;
+#endif
   int ret = -ENOMEM;
 
   /* Sanity check */
@@ -562,6 +782,25 @@ int ftl_initialize(int minor, FAR struct mtd_dev_s *mtd)
       dev->blkper = dev->geo.erasesize / dev->geo.blocksize;
       DEBUGASSERT(dev->blkper * dev->geo.blocksize == dev->geo.erasesize);
 
+      /* Allocate the bitmaps of discarded and erased blocks.  Nothing is
+       * known about the blocks yet.
+       */
+
+#ifdef FTL_HAVE_DISCARD
+      mapsize        = (dev->geo.neraseblocks * dev->blkper + 31) / 32;
+      dev->discarded = (FAR uint32_t *)
+        kmm_zalloc(2 * mapsize * sizeof(uint32_t));
+      if (!dev->discarded)
+        {
+          fdbg("Failed to allocate the discarded block bitmaps\n");
+          kmm_free(dev->eblock);
+          kmm_free(dev);
+          return -ENOMEM;
+        }
+
+      dev->erased    = dev->discarded + mapsize;
+#endif
+
       /* Configure read-ahead/write buffering */
 
 #ifdef FTL_HAVE_RWBUFFER
@@ -173,7 +173,9 @@ const struct procfs_operations part_procfsoperations =
   NULL,                   /* readdir */
   NULL,                   /* rewinddir */
 
-  part_procfs_stat        /* stat */
+  part_procfs_stat,       /* stat */
+
+  NULL                    /* ioctl */
 };
 #endif
 
@@ -456,6 +458,33 @@ static int part_ioctl(FAR struct mtd_dev_s *dev, int cmd, unsigned long arg)
         }
         break;
 
+      case MTDIOC_DISCARD:
+        {
+          FAR struct bioc_discard_s *discard =
+            (FAR struct bioc_discard_s *)((uintptr_t)arg);
+          struct bioc_discard_s parentdiscard;
+          off_t partsize;
+
+          /* The range is relative to the partition.  Check it and offset
+           * it to the partition before passing it on.
+           */
+
+          partsize = priv->neraseblocks * priv->blkpererase;
+          if (discard && discard->bd_startsector < partsize &&
+              discard->bd_nsectors <= partsize - discard->bd_startsector)
+            {
+              parentdiscard.bd_startsector = discard->bd_startsector +
+                                             priv->firstblock;
+              parentdiscard.bd_nsectors    = discard->bd_nsectors;
+              parentdiscard.bd_zeroed      = false;
+
+              ret = priv->parent->ioctl(priv->parent, MTDIOC_DISCARD,
+                                (unsigned long)((uintptr_t)&parentdiscard));
+              discard->bd_zeroed = parentdiscard.bd_zeroed;
+            }
+        }
+        break;
+
       default:
         {
           /* Pass any unhandled ioctl() calls to the underlying driver */
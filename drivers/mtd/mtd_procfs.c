@@ -118,7 +118,9 @@ const struct procfs_operations mtd_procfsoperations =
   NULL,           /* readdir */
   NULL,           /* rewinddir */
 
-  mtd_stat        /* stat */
+  mtd_stat,       /* stat */
+
+  NULL            /* ioctl */
 };
 
 /* MTD registration variables */
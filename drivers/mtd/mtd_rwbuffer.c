@@ -53,6 +53,7 @@
 
 #include <nuttx/kmalloc.h>
 #include <nuttx/rwbuffer.h>
+#include <nuttx/fs/fs.h>
 #include <nuttx/fs/ioctl.h>
 #include <nuttx/mtd/mtd.h>
 
@@ -303,6 +304,36 @@ static int mtd_ioctl(FAR struct mtd_dev_s *dev, int cmd, unsigned long arg)
         }
         break;
 
+      case MTDIOC_DISCARD:
+        {
+          FAR struct bioc_discard_s *discard =
+            (FAR struct bioc_discard_s *)((uintptr_t)arg);
+
+          if (discard)
+            {
+              /* Buffered writes to the discarded blocks need never reach
+               * the media.  Drop them (and any read-ahead data).
+               */
+
+              ret = rwb_invalidate(&priv->rwb, discard->bd_startsector,
+                                   discard->bd_nsectors);
+              if (ret < 0)
+                {
+                  fdbg("ERROR: rwb_invalidate failed: %d\n", ret);
+                  break;
+                }
+
+              /* Then let the lower level MTD driver know, if it cares */
+
+              ret = priv->dev->ioctl(priv->dev, MTDIOC_DISCARD, arg);
+              if (ret == -ENOTTY)
+                {
+                  ret = OK;
+                }
+            }
+        }
+        break;
+
       case MTDIOC_XIPBASE:
       default:
         ret = -ENOTTY; /* Bad command */
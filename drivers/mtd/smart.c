@@ -51,11 +51,15 @@
 #include <string.h>
 #include <debug.h>
 #include <errno.h>
+#include <assert.h>
+#include <semaphore.h>
 
 #include <crc8.h>
 #include <crc16.h>
 #include <crc32.h>
 #include <nuttx/kmalloc.h>
+#include <nuttx/clock.h>
+#include <nuttx/wqueue.h>
 #include <nuttx/fs/fs.h>
 #include <nuttx/fs/ioctl.h>
 #include <nuttx/mtd/mtd.h>
@@ -119,6 +123,91 @@
                                              * other for our use, such as format
                                              * sector, etc. */
 
+#ifdef CONFIG_MTD_SMART_MINIMIZE_RAM
+/* The sector cache is an open-addressed hash table with 50% spare slots so
+ * that probe sequences stay short when it is full.
+ */
+
+#  if CONFIG_MTD_SMART_SECTOR_CACHE_SIZE < 16
+#    error CONFIG_MTD_SMART_SECTOR_CACHE_SIZE must be at least 16
+#  endif
+
+#  define SMART_CACHE_SLOTS       (CONFIG_MTD_SMART_SECTOR_CACHE_SIZE + \
+                                   (CONFIG_MTD_SMART_SECTOR_CACHE_SIZE >> 1))
+#  define SMART_CACHE_EMPTY       0xFFFF  /* Logical number of a free slot */
+#  define SMART_CACHE_REF         0x01    /* CLOCK reference bit */
+#  define SMART_CACHE_DIRTY       0x02    /* Not yet in the map checkpoint */
+#endif
+
+#ifdef CONFIG_MTD_SMART_MAP_CHECKPOINT
+/* Each map chunk sector starts with a signature and its chunk index,
+ * followed by one 16-bit physical sector number per logical sector.
+ */
+
+#  define SMART_MAP_SIG1          'M'
+#  define SMART_MAP_SIG2          'P'
+#  define SMART_MAP_HDRSIZE       4
+
+/* Dirty cache entries are written back to the map when more than three
+ * quarters of the cache is dirty, until only half of it is.
+ */
+
+#  define SMART_MAP_DIRTY_HIGH    (CONFIG_MTD_SMART_SECTOR_CACHE_SIZE * 3 / 4)
+#  define SMART_MAP_DIRTY_LOW     (CONFIG_MTD_SMART_SECTOR_CACHE_SIZE >> 1)
+#endif
+
+#ifdef CONFIG_MTD_SMART_MOUNT_CHECKPOINT
+/* The mount checkpoint is kept in two copies at the end of the device.  The
+ * first MTD block of a copy holds the header, the data follows.  The layout
+ * bits keep a checkpoint from being loaded by a differently built driver.
+ */
+
+#  define SMART_CKPT_MAGIC        "SMCK"
+#  define SMART_CKPT_VERSION      1
+
+#  define SMART_CKPT_MINIMIZE     0x01
+#  define SMART_CKPT_MAPDIR       0x02
+#  define SMART_CKPT_PACKED       0x04
+
+#  ifdef CONFIG_MTD_SMART_MINIMIZE_RAM
+#    ifdef CONFIG_MTD_SMART_MAP_CHECKPOINT
+#      define SMART_CKPT_LAYOUT_MAP SMART_CKPT_MAPDIR
+#    else
+#      define SMART_CKPT_LAYOUT_MAP 0
+#    endif
+#    ifdef CONFIG_MTD_SMART_PACK_COUNTS
+#      define SMART_CKPT_LAYOUT   (SMART_CKPT_MINIMIZE | SMART_CKPT_PACKED | \
+                                   SMART_CKPT_LAYOUT_MAP)
+#    else
+#      define SMART_CKPT_LAYOUT   (SMART_CKPT_MINIMIZE | SMART_CKPT_LAYOUT_MAP)
+#    endif
+#  else
+#    define SMART_CKPT_LAYOUT     0
+#  endif
+
+#  ifndef CONFIG_MTD_SMART_CHECKPOINT_INTERVAL
+#    define CONFIG_MTD_SMART_CHECKPOINT_INTERVAL 0
+#  endif
+#endif
+
+#ifdef CONFIG_MTD_SMART_BGGC
+#  ifndef CONFIG_MTD_SMART_BGGC_IDLE
+#    define CONFIG_MTD_SMART_BGGC_IDLE 100
+#  endif
+#  ifndef CONFIG_MTD_SMART_BGGC_LOWFREE
+#    define CONFIG_MTD_SMART_BGGC_LOWFREE 10
+#  endif
+#  ifndef CONFIG_MTD_SMART_BGGC_HIGHFREE
+#    define CONFIG_MTD_SMART_BGGC_HIGHFREE 20
+#  endif
+
+/* The ages of erase blocks are kept within half of the range of the 16-bit
+ * allocation clock so that they still compare correctly after it wraps.
+ */
+
+#  define SMART_GC_MAXAGE         0x8000
+#endif
+
 #if defined(CONFIG_MTD_SMART_READAHEAD) || (defined(CONFIG_DRVR_WRITABLE) && \
     defined(CONFIG_MTD_SMART_WRITEBUFFER))
 #  define SMART_HAVE_RWBUFFER 1
@@ -190,7 +279,42 @@ struct smart_cache_s
 {
   uint16_t              logical;          /* Logical sector number */
   uint16_t              physical;         /* Associated physical sector */
-  uint16_t              birth;            /* The "birthday" of this entry */
+  uint8_t               flags;            /* SMART_CACHE_* flags */
+};
+#endif
+
+/* Header of a mount checkpoint copy.  The state byte is programmed when the
+ * volume is modified after the checkpoint was written, so it is left out of
+ * the CRC.  The CRC covers the data and then the header from seq on.
+ */
+
+#ifdef CONFIG_MTD_SMART_MOUNT_CHECKPOINT
+struct smart_ckpt_header_s
+{
+  uint8_t               magic[4];         /* SMART_CKPT_MAGIC */
+  uint8_t               state;            /* Erased while the copy is current */
+  uint8_t               version;          /* SMART_CKPT_VERSION */
+  uint8_t               layout;           /* SMART_CKPT_LAYOUT */
+  uint8_t               formatversion;    /* Format version of the volume */
+  uint32_t              crc;              /* CRC-32 of the data and header */
+  uint32_t              seq;              /* Incrementing sequence number */
+  uint32_t              datasize;         /* Number of data bytes */
+  uint16_t              sectorsize;       /* Sector size of the volume */
+  uint16_t              totalsectors;     /* Total number of sectors */
+  uint16_t              neraseblocks;     /* Number of erase blocks */
+  uint16_t              freesectors;      /* Total number of free sectors */
+  uint16_t              releasesectors;   /* Total number of released sectors */
+  uint8_t               namesize;         /* Length of filenames on volume */
+  uint8_t               rootdirentries;   /* Number of root directory entries */
+};
+
+/* Position in the data of a checkpoint copy while it is written or read */
+
+struct smart_ckpt_stream_s
+{
+  off_t                 block;            /* MTD block of the next chunk */
+  uint16_t              fill;             /* Bytes used of dev->rwbuffer */
+  uint32_t              crc;              /* Running CRC-32 of the data */
 };
 #endif
 
@@ -256,11 +380,42 @@ struct smart_struct_s
   FAR uint16_t         *sMap;             /* Virtual to physical sector map */
 #else
   FAR uint8_t          *sBitMap;          /* Virtual sector used bit-map */
-  FAR struct smart_cache_s *sCache;       /* Sector cache */
+  FAR struct smart_cache_s *sCache;       /* Sector cache (hash table) */
   uint16_t              cache_entries;    /* Number of valid entries in the cache */
   uint16_t              cache_lastlog;    /* Keep track of the last sector accessed */
   uint16_t              cache_lastphys;   /* Keep the physical sector number also */
-  uint16_t              cache_nextbirth;  /* Sector cache aging value */
+  uint16_t              cache_hand;       /* CLOCK replacement hand */
+#ifdef CONFIG_MTD_SMART_MAP_CHECKPOINT
+  uint16_t              cache_dirty;      /* Entries not yet in the map checkpoint */
+  FAR uint16_t         *mapdir;           /* Physical sector of each map chunk */
+  uint16_t              mapfirst;         /* Logical sector of map chunk 0 */
+  uint16_t              mapchunks;        /* Number of map chunks */
+  uint16_t              mapentries;       /* Map entries per chunk */
+  bool                  mapvalid;         /* Map checkpoint usable on this volume */
+  bool                  mapbusy;          /* A map chunk is being written */
+#endif
+#endif
+#ifdef CONFIG_MTD_SMART_MOUNT_CHECKPOINT
+  uint32_t              countsize;        /* Bytes of free and release counts */
+  uint32_t              ckptseq;          /* Sequence number of newest copy */
+  uint16_t              ckptfirst;        /* First erase block of the copies */
+  uint16_t              ckptblocks;       /* Erase blocks per copy, 0 if none */
+  uint16_t              ckptmods;         /* Modifications since the last one */
+  uint8_t               ckptslot;         /* Copy holding newest checkpoint */
+  bool                  ckptclean;        /* Newest copy matches the volume */
+  bool                  ckptdirty;        /* Volume changed since last one */
+#endif
+#ifdef CONFIG_MTD_SMART_BGGC
+  sem_t                 exclsem;          /* Serializes requests and the GC */
+  struct work_s         gcwork;           /* Background collection work */
+  FAR uint16_t         *gcstamp;          /* Last allocation in each block */
+  uint32_t              gclast;           /* Time of the last request */
+  uint32_t              gccollected;      /* Blocks collected in background */
+  uint16_t              gcclock;          /* Counts sector allocations */
+  uint16_t              gcidle;           /* Idle time before collecting, ms */
+  uint16_t              gclowfree;        /* Start collecting below this */
+  uint16_t              gchighfree;       /* Stop collecting at this */
+  bool                  gcenable;         /* Background collection enabled */
 #endif
 #ifdef CONFIG_MTD_SMART_SECTOR_ERASE_DEBUG
   FAR uint8_t          *erasecounts;      /* Number of erases for each erase block */
@@ -375,6 +530,17 @@ static int smart_writesector(FAR struct smart_struct_s *dev, unsigned long arg);
 #endif
 static int smart_readsector(FAR struct smart_struct_s *dev, unsigned long arg);
 
+#ifdef CONFIG_MTD_SMART_MINIMIZE_RAM
+static void smart_cache_reset(FAR struct smart_struct_s *dev);
+#endif
+#ifdef CONFIG_MTD_SMART_MAP_CHECKPOINT
+static int smart_map_flush(FAR struct smart_struct_s *dev, uint16_t target);
+#endif
+#ifdef CONFIG_MTD_SMART_MOUNT_CHECKPOINT
+static int smart_ckpt_modify(FAR struct smart_struct_s *dev);
+static int smart_ckpt_write(FAR struct smart_struct_s *dev);
+#endif
+
 #ifdef CONFIG_MTD_SMART_WEAR_LEVEL
 static int smart_read_wearstatus(FAR struct smart_struct_s *dev);
 static int smart_relocate_static_data(FAR struct smart_struct_s *dev, uint16_t block);
@@ -383,6 +549,15 @@ static int smart_relocate_static_data(FAR struct smart_struct_s *dev, uint16_t b
 static int smart_relocate_sector(FAR struct smart_struct_s *dev,
     uint16_t oldsector, uint16_t newsector);
 
+#ifdef CONFIG_MTD_SMART_BGGC
+static void smart_semtake(FAR struct smart_struct_s *dev);
+#  define smart_semgive(d) sem_post(&(d)->exclsem)
+static void smart_gc_worker(FAR void *arg);
+#else
+#  define smart_semtake(d)
+#  define smart_semgive(d)
+#endif
+
 /****************************************************************************
  * Private Data
  ****************************************************************************/
@@ -405,6 +580,30 @@ static const struct block_operations g_bops =
  * Private Functions
  ****************************************************************************/
 
+/****************************************************************************
+ * Name: smart_semtake
+ *
+ * Description: Takes the device semaphore that keeps the background
+ *              collector out of requests.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_MTD_SMART_BGGC
+static void smart_semtake(FAR struct smart_struct_s *dev)
+{
+  /* Take the semaphore (perhaps waiting) */
+
+  while (sem_wait(&dev->exclsem) != 0)
+    {
+      /* The only case that an error should occur here is if
+       * the wait was awakened by a signal.
+       */
+
+      ASSERT(get_errno() == EINTR);
+    }
+}
+#endif
+
 /****************************************************************************
  * Name: smart_open
  *
@@ -427,7 +626,43 @@ static int smart_open(FAR struct inode *inode)
 
 static int smart_close(FAR struct inode *inode)
 {
+#if defined(CONFIG_MTD_SMART_MAP_CHECKPOINT) || \
+    defined(CONFIG_MTD_SMART_MOUNT_CHECKPOINT)
+  FAR struct smart_struct_s *dev;
+#endif
+
   fvdbg("Entry\n");
+
+#if defined(CONFIG_MTD_SMART_MAP_CHECKPOINT) || \
+    defined(CONFIG_MTD_SMART_MOUNT_CHECKPOINT)
+  DEBUGASSERT(inode && inode->i_private);
+
+#ifdef CONFIG_SMARTFS_MULTI_ROOT_DIRS
+  dev = ((FAR struct smart_multiroot_device_s *)inode->i_private)->dev;
+#else
+  dev = (FAR struct smart_struct_s *)inode->i_private;
+#endif
+
+  smart_semtake(dev);
+#endif
+
+#ifdef CONFIG_MTD_SMART_MAP_CHECKPOINT
+  /* Bring the map checkpoint up to date */
+
+  (void)smart_map_flush(dev, 0);
+#endif
+
+#ifdef CONFIG_MTD_SMART_MOUNT_CHECKPOINT
+  /* Save the state of the volume so that the next mount can skip the scan */
+
+  (void)smart_ckpt_write(dev);
+#endif
+
+#if defined(CONFIG_MTD_SMART_MAP_CHECKPOINT) || \
+    defined(CONFIG_MTD_SMART_MOUNT_CHECKPOINT)
+  smart_semgive(dev);
+#endif
+
   return OK;
 }
 
@@ -762,6 +997,7 @@ static ssize_t smart_read(FAR struct inode *inode, unsigned char *buffer,
                           size_t start_sector, unsigned int nsectors)
 {
   FAR struct smart_struct_s *dev;
+  ssize_t ret;
 
   fvdbg("SMART: sector: %d nsectors: %d\n", start_sector, nsectors);
 
@@ -771,7 +1007,11 @@ static ssize_t smart_read(FAR struct inode *inode, unsigned char *buffer,
 #else
   dev = (struct smart_struct_s *)inode->i_private;
 #endif
-  return smart_reload(dev, buffer, start_sector, nsectors);
+
+  smart_semtake(dev);
+  ret = smart_reload(dev, buffer, start_sector, nsectors);
+  smart_semgive(dev);
+  return ret;
 }
 
 /****************************************************************************
@@ -808,6 +1048,17 @@ static ssize_t smart_write(FAR struct inode *inode,
   dev = (FAR struct smart_struct_s *)inode->i_private;
 #endif
 
+  smart_semtake(dev);
+
+#ifdef CONFIG_MTD_SMART_MOUNT_CHECKPOINT
+  ret = smart_ckpt_modify(dev);
+  if (ret < 0)
+    {
+      smart_semgive(dev);
+      return ret;
+    }
+#endif
+
   /* I think maybe we need to lock on a mutex here */
 
   /* Get the aligned block.  Here is is assumed: (1) The number of R/W blocks
@@ -850,6 +1101,7 @@ static ssize_t smart_write(FAR struct inode *inode,
 
               /* Unlock the mutex if we add one */
 
+              smart_semgive(dev);
               return ret;
             }
         }
@@ -879,6 +1131,7 @@ static ssize_t smart_write(FAR struct inode *inode,
 
           /* Unlock the mutex if we add one */
 
+          smart_semgive(dev);
           return -EIO;
         }
 
@@ -890,6 +1143,7 @@ static ssize_t smart_write(FAR struct inode *inode,
       alignedblock += mtdBlksPerErase;
     }
 
+  smart_semgive(dev);
   return nsectors;
 }
 #endif /* CONFIG_FS_WRITABLE */
@@ -1032,9 +1286,13 @@ static int smart_setsectorsize(FAR struct smart_struct_s *dev, uint16_t size)
       dev->sBitMap = NULL;
     }
 
-  dev->cache_entries = 0;
-  dev->cache_lastlog = 0xFFFF;
-  dev->cache_nextbirth = 0;
+#ifdef CONFIG_MTD_SMART_MAP_CHECKPOINT
+  if (dev->mapdir != NULL)
+    {
+      smart_free(dev, dev->mapdir);
+      dev->mapdir = NULL;
+    }
+#endif
 #endif
 
   if (dev->rwbuffer != NULL)
@@ -1051,6 +1309,14 @@ static int smart_setsectorsize(FAR struct smart_struct_s *dev, uint16_t size)
     }
 #endif
 
+#ifdef CONFIG_MTD_SMART_BGGC
+  if (dev->gcstamp != NULL)
+    {
+      smart_free(dev, dev->gcstamp);
+      dev->gcstamp = NULL;
+    }
+#endif
+
   /* Allocate a virtual to physical sector map buffer.  Also allocate
    * the storage space for releasecount and freecounts.
    */
@@ -1120,7 +1386,7 @@ static int smart_setsectorsize(FAR struct smart_struct_s *dev, uint16_t size)
   if (dev->sCache == NULL)
     {
       dev->sCache = (FAR struct smart_cache_s *) smart_malloc(dev,
-        CONFIG_MTD_SMART_SECTOR_CACHE_SIZE * sizeof(struct smart_cache_s) +
+        SMART_CACHE_SLOTS * sizeof(struct smart_cache_s) +
         allocsize, "Sector Cache");
     }
 
@@ -1130,7 +1396,7 @@ static int smart_setsectorsize(FAR struct smart_struct_s *dev, uint16_t size)
       goto errexit;
     }
 
-  dev->releasecount = (FAR uint8_t *) dev->sCache + (CONFIG_MTD_SMART_SECTOR_CACHE_SIZE *
+  dev->releasecount = (FAR uint8_t *) dev->sCache + (SMART_CACHE_SLOTS *
       sizeof(struct smart_cache_s));
 
 #ifdef CONFIG_MTD_SMART_PACK_COUNTS
@@ -1151,8 +1417,33 @@ static int smart_setsectorsize(FAR struct smart_struct_s *dev, uint16_t size)
   dev->freecount = dev->releasecount + dev->neraseblocks;
 #endif
 
+#ifdef CONFIG_MTD_SMART_MAP_CHECKPOINT
+  /* The map checkpoint lives in the logical sectors at the top of the
+   * volume, one map chunk per sector.
+   */
+
+  dev->mapentries = (size - sizeof(struct smart_sect_header_s) -
+                     SMART_MAP_HDRSIZE) / sizeof(uint16_t);
+  dev->mapchunks = (totalsectors + dev->mapentries - 1) / dev->mapentries;
+  dev->mapfirst = totalsectors - dev->mapchunks;
+  dev->mapdir = (FAR uint16_t *) smart_malloc(dev, dev->mapchunks *
+                sizeof(uint16_t), "Map directory");
+  if (dev->mapdir == NULL)
+    {
+      fdbg("Error allocating SMART map directory\n");
+      goto errexit;
+    }
+#endif
+
+  smart_cache_reset(dev);
 #endif  /* CONFIG_MTD_SMART_MINIMIZE_RAM */
 
+#ifdef CONFIG_MTD_SMART_MOUNT_CHECKPOINT
+  /* The free and release counts are saved as one blob in the checkpoint */
+
+  dev->countsize = allocsize;
+#endif
+
 #ifdef CONFIG_MTD_SMART_SECTOR_ERASE_DEBUG
   /* Allocate a buffer to hold the erase counts */
 
@@ -1187,6 +1478,23 @@ static int smart_setsectorsize(FAR struct smart_struct_s *dev, uint16_t size)
   dev->uneven_wearcount = 0;
 #endif
 
+#ifdef CONFIG_MTD_SMART_BGGC
+  /* Allocate the erase block ages for the background collector */
+
+  dev->gcstamp = (FAR uint16_t *) smart_malloc(dev, dev->neraseblocks *
+      sizeof(uint16_t), "GC ages");
+  if (!dev->gcstamp)
+    {
+      fdbg("Error allocating garbage collection ages\n");
+      goto errexit;
+    }
+
+  memset(dev->gcstamp, 0, dev->neraseblocks * sizeof(uint16_t));
+  dev->gcclock = 0;
+  dev->gclowfree = totalsectors * CONFIG_MTD_SMART_BGGC_LOWFREE / 100;
+  dev->gchighfree = totalsectors * CONFIG_MTD_SMART_BGGC_HIGHFREE / 100;
+#endif
+
   /* Allocate a read/write buffer */
 
   dev->rwbuffer = (FAR char *) smart_malloc(dev, size, "RW Buffer");
@@ -1219,6 +1527,13 @@ errexit:
     {
       smart_free(dev, dev->sCache);
     }
+
+#ifdef CONFIG_MTD_SMART_MAP_CHECKPOINT
+  if (dev->mapdir)
+    {
+      smart_free(dev, dev->mapdir);
+    }
+#endif
 #endif
 
 #ifdef CONFIG_MTD_SMART_WEAR_LEVEL
@@ -1263,6 +1578,11 @@ static ssize_t smart_bytewrite(FAR struct smart_struct_s *dev, size_t offset,
       /* Use the MTD's write method to write individual bytes */
 
       ret = dev->mtd->write(dev->mtd, offset, nbytes, buffer);
+      if (ret < 0)
+        {
+          fdbg("Error %d writing to device\n", -ret);
+          goto errout;
+        }
     }
   else
 #endif
@@ -1310,219 +1630,655 @@ errout:
 }
 
 /****************************************************************************
- * Name: smart_add_sector_to_cache
+ * Name: smart_cache_reset
  *
- * Description: Adds a logical to physical sector maaping to the sector
- *              map cache.  The cache is used to minimize RAM by eliminating
- *              a one-to-one mapping of all logical sectors and only keeping
- *              a fixed number of mappings per the
- *              CONFIG_MTD_SMART_SECTOR_CACHE_SIZE parameter.  Sectors are
- *              automatically managed and removed based on the time since
- *              they were accessed last.
+ * Description: Empties the sector cache and forgets the location of the map
+ *              checkpoint chunks.
  *
  ****************************************************************************/
 
 #ifdef CONFIG_MTD_SMART_MINIMIZE_RAM
-static int smart_add_sector_to_cache(FAR struct smart_struct_s *dev,
-            uint16_t logical, uint16_t physical, int line)
+static void smart_cache_reset(FAR struct smart_struct_s *dev)
 {
-  uint16_t    index, x;
-  uint16_t    oldest;
+  uint16_t  x;
 
-  /* If we aren't full yet, just add the sector to the end of the list */
-
-  index = 1;
-  if (dev->cache_entries < CONFIG_MTD_SMART_SECTOR_CACHE_SIZE)
+  for (x = 0; x < SMART_CACHE_SLOTS; x++)
     {
-      index = dev->cache_entries++;
+      dev->sCache[x].logical = SMART_CACHE_EMPTY;
     }
-  else
-    {
-      /* Cache is full.  We must find the least accessed entry and replace it */
 
-      oldest = 0xFFFF;
-      for (x = 0; x < CONFIG_MTD_SMART_SECTOR_CACHE_SIZE; x++)
-        {
-          /* Never replace cache entries for system sectors */
+  dev->cache_entries = 0;
+  dev->cache_lastlog = 0xFFFF;
+  dev->cache_hand = 0;
 
-          if (dev->sCache[x].logical < SMART_FIRST_ALLOC_SECTOR)
-            continue;
+#ifdef CONFIG_MTD_SMART_MAP_CHECKPOINT
+  for (x = 0; x < dev->mapchunks; x++)
+    {
+      dev->mapdir[x] = 0xFFFF;
+    }
 
-          /* If the hit count is zero, then choose this entry */
+  dev->cache_dirty = 0;
+  dev->mapvalid = dev->mapfirst > SMART_FIRST_ALLOC_SECTOR;
+  dev->mapbusy = false;
+#endif
+}
+#endif
 
-          if (dev->sCache[x].birth < oldest)
-            {
-              oldest = dev->sCache[x].birth;
-              index = x;
-            }
-        }
-    }
+/****************************************************************************
+ * Name: smart_cache_hash
+ *
+ * Description: Returns the home slot of a logical sector in the sector
+ *              cache hash table.  Multiplicative (Fibonacci) hashing spreads
+ *              runs of consecutive logical sectors over the whole table.
+ *
+ ****************************************************************************/
 
-  /* Now add the sector at index */
+#ifdef CONFIG_MTD_SMART_MINIMIZE_RAM
+static inline uint16_t smart_cache_hash(uint16_t logical)
+{
+  return (uint16_t)(((uint32_t)(uint16_t)(logical * 40503u) *
+                     SMART_CACHE_SLOTS) >> 16);
+}
+#endif
 
-  dev->sCache[index].logical = logical;
-  dev->sCache[index].physical = physical;
-  dev->sCache[index].birth = dev->cache_nextbirth++;
-  dev->cache_lastlog = logical;
-  dev->cache_lastphys = physical;
-  if (dev->debuglevel > 1)
-    {
-      dbg("Add Cache sector:  Log=%d, Phys=%d at index %d from line %d\n",
-          logical, physical, index, line);
-    }
+/****************************************************************************
+ * Name: smart_cache_find
+ *
+ * Description: Returns the cache slot holding the logical sector, or -1 if
+ *              the sector is not cached.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_MTD_SMART_MINIMIZE_RAM
+static int smart_cache_find(FAR struct smart_struct_s *dev, uint16_t logical)
+{
+  uint16_t  slot;
 
-  /* Test if the birthdays need to be adjusted */
+  /* The table always has empty slots, so the probe sequence terminates */
 
-  if (oldest >= CONFIG_MTD_SMART_SECTOR_CACHE_SIZE + 1024)
+  slot = smart_cache_hash(logical);
+  while (dev->sCache[slot].logical != SMART_CACHE_EMPTY)
     {
-      for (x = 0; x < dev->cache_entries; x++)
+      if (dev->sCache[slot].logical == logical)
         {
-          dev->sCache[x].birth -= 1024;
+          return slot;
         }
 
-      dev->cache_nextbirth -= 1024;
+      if (++slot == SMART_CACHE_SLOTS)
+        {
+          slot = 0;
+        }
     }
 
-  return index;
+  return -1;
 }
 #endif
 
 /****************************************************************************
- * Name: smart_cache_lookup
+ * Name: smart_cache_remove
  *
- * Description: Perform a cache lookup for the requested logical sector.
- *              If the sector is in the cache, then update the hitcount and
- *              return the physical mapping.  If a cache miss occurs, then
- *              the routine will scan the volume to find the logical sector
- *              and add / replace a cache entry with the newly located sector.
+ * Description: Removes the entry in the given cache slot.  Following
+ *              entries of the same probe sequence are shifted back into
+ *              the hole so that lookups never need tombstones.
  *
  ****************************************************************************/
 
 #ifdef CONFIG_MTD_SMART_MINIMIZE_RAM
-static uint16_t smart_cache_lookup(FAR struct smart_struct_s *dev, uint16_t logical)
+static void smart_cache_remove(FAR struct smart_struct_s *dev, uint16_t slot)
 {
-  int       ret;
-  uint16_t  block, sector;
-  uint16_t  x, physical, logicalsector;
-  struct    smart_sect_header_s header;
-  size_t    readaddress;
+  uint16_t  next;
+  uint16_t  home;
 
-  physical = 0xFFFF;
-
-  /* Test if searching for the last sector used */
-
-  if (logical == dev->cache_lastlog)
+#ifdef CONFIG_MTD_SMART_MAP_CHECKPOINT
+  if (dev->sCache[slot].flags & SMART_CACHE_DIRTY)
     {
-      return dev->cache_lastphys;
+      dev->cache_dirty--;
     }
+#endif
 
-  /* First search for the entry in the cache */
-
-  for (x = 0; x < dev->cache_entries; x++)
+  next = slot;
+  for (; ; )
     {
-      if (dev->sCache[x].logical == logical)
+      if (++next == SMART_CACHE_SLOTS)
         {
-          /* Entry found in the cache.  Grab the physical mapping. */
+          next = 0;
+        }
 
-          physical = dev->sCache[x].physical;
+      if (dev->sCache[next].logical == SMART_CACHE_EMPTY)
+        {
           break;
         }
-    }
-
-  /* If the entry wasn't found in the cache, then we must search the volume
-   * for it and add it to the cache.
-   */
 
-  if (physical == 0xFFFF)
-    {
-      /* Now scan the MTD device.  Instead of scanning start to end, we
-       * span the erase blocks and read one sector from each at a time.
-       * this helps speed up the search on volumes that aren't full
-       * because of sector allocation scheme will use the lower sector
-       * numbers in each erase block first.
+      /* The entry may move into the hole unless its home slot lies
+       * (cyclically) after the hole.
        */
 
-      for (sector = 0; sector < dev->sectorsPerBlk && physical == 0xFFFF; sector++)
+      home = smart_cache_hash(dev->sCache[next].logical);
+      if ((next > slot && (home <= slot || home > next)) ||
+          (next < slot && home <= slot && home > next))
         {
-          /* Now scan across each erase block */
-
-          for (block = 0; block < dev->geo.neraseblocks; block++)
-            {
-              /* Calculate the read address for this sector */
-
-              readaddress = block * dev->erasesize +
-                  sector * CONFIG_MTD_SMART_SECTOR_SIZE;
-
-              /* Read the header for this sector */
-
-              ret = MTD_READ(dev->mtd, readaddress,
-                  sizeof(struct smart_sect_header_s), (FAR uint8_t *) &header);
-              if (ret != sizeof(struct smart_sect_header_s))
-                {
-                  goto err_out;
-                }
-
-              /* Get the logical sector number for this physical sector */
-
-              logicalsector = *((FAR uint16_t *) header.logicalsector);
-#if CONFIG_SMARTFS_ERASEDSTATE == 0x00
-              if (logicalsector == 0)
-                {
-                  continue;
-                }
-#endif
-
-              /* Test if this sector has been committed */
-
-              if ((header.status & SMART_STATUS_COMMITTED) ==
-                      (CONFIG_SMARTFS_ERASEDSTATE & SMART_STATUS_COMMITTED))
-                {
-                  continue;
-                }
-
-              /* Test if this sector has been release and skip it if it has */
-
-              if ((header.status & SMART_STATUS_RELEASED) !=
-                      (CONFIG_SMARTFS_ERASEDSTATE & SMART_STATUS_RELEASED))
-                {
-                  continue;
-                }
-
-              if ((header.status & SMART_STATUS_VERBITS) != SMART_STATUS_VERSION)
-                {
-                  continue;
-                }
-
-              /* Test if this is the sector we are looking for */
-
-              if (logicalsector == logical)
-                {
-                  /* This is the sector we are looking for!  Add it to the cache */
-
-                  physical = block * dev->sectorsPerBlk + sector;
-                  smart_add_sector_to_cache(dev, logical, physical, __LINE__);
-                  break;
-                }
-            }
+          dev->sCache[slot] = dev->sCache[next];
+          slot = next;
         }
     }
 
-  /* Update the last logical sector found variable */
-
-  dev->cache_lastlog = logical;
-  dev->cache_lastphys = physical;
-
-err_out:
-  return physical;
+  dev->sCache[slot].logical = SMART_CACHE_EMPTY;
+  dev->cache_entries--;
 }
 #endif
 
 /****************************************************************************
- * Name: smart_update_cache
+ * Name: smart_cache_victim
  *
- * Description: Updates a cache entry (if present) replacing the logical
- *              sector's physical sector mapping with the new one provided.
- *              This does not affect the hit count.
+ * Description: Selects a cache entry to be replaced using the CLOCK
+ *              algorithm:  the hand sweeps the table, giving every entry
+ *              referenced since the last sweep a second chance.  Entries
+ *              for the reserved system sectors are never replaced, and
+ *              dirty entries only if dirtyok is set.  Returns -1 if there
+ *              is no candidate.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_MTD_SMART_MINIMIZE_RAM
+static int smart_cache_victim(FAR struct smart_struct_s *dev, bool dirtyok)
+{
+  FAR struct smart_cache_s *entry;
+  uint32_t  x;
+  uint16_t  slot;
+
+  for (x = 0; x < 2 * SMART_CACHE_SLOTS; x++)
+    {
+      slot = dev->cache_hand;
+      if (++dev->cache_hand == SMART_CACHE_SLOTS)
+        {
+          dev->cache_hand = 0;
+        }
+
+      entry = &dev->sCache[slot];
+      if (entry->logical == SMART_CACHE_EMPTY ||
+          entry->logical < SMART_FIRST_ALLOC_SECTOR)
+        {
+          continue;
+        }
+
+      if (entry->flags & SMART_CACHE_REF)
+        {
+          entry->flags &= ~SMART_CACHE_REF;
+          continue;
+        }
+
+      if (!dirtyok && (entry->flags & SMART_CACHE_DIRTY))
+        {
+          continue;
+        }
+
+      return slot;
+    }
+
+  return -1;
+}
+#endif
+
+/****************************************************************************
+ * Name: smart_cache_insert
+ *
+ * Description: Adds a mapping for a logical sector that is not yet in the
+ *              cache, replacing an older entry if the cache is full.  A
+ *              dirty mapping may replace another dirty one (which then is
+ *              simply missing from the map checkpoint), a clean one may
+ *              not.  Returns the slot used or -1.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_MTD_SMART_MINIMIZE_RAM
+static int smart_cache_insert(FAR struct smart_struct_s *dev, uint16_t logical,
+                              uint16_t physical, uint8_t flags)
+{
+  int       slot;
+
+  if (dev->cache_entries >= CONFIG_MTD_SMART_SECTOR_CACHE_SIZE)
+    {
+      slot = smart_cache_victim(dev, false);
+#ifdef CONFIG_MTD_SMART_MAP_CHECKPOINT
+      if (slot < 0 && (flags & SMART_CACHE_DIRTY))
+        {
+          slot = smart_cache_victim(dev, true);
+        }
+#endif
+
+      if (slot < 0)
+        {
+          return -1;
+        }
+
+      smart_cache_remove(dev, slot);
+    }
+
+  slot = smart_cache_hash(logical);
+  while (dev->sCache[slot].logical != SMART_CACHE_EMPTY)
+    {
+      if (++slot == SMART_CACHE_SLOTS)
+        {
+          slot = 0;
+        }
+    }
+
+  dev->sCache[slot].logical = logical;
+  dev->sCache[slot].physical = physical;
+  dev->sCache[slot].flags = flags;
+  dev->cache_entries++;
+
+#ifdef CONFIG_MTD_SMART_MAP_CHECKPOINT
+  if (flags & SMART_CACHE_DIRTY)
+    {
+      dev->cache_dirty++;
+    }
+#endif
+
+  return slot;
+}
+#endif
+
+/****************************************************************************
+ * Name: smart_cache_setphys
+ *
+ * Description: Changes the physical sector of a cached entry.  The entry
+ *              becomes dirty if the mapping differs from the one in the map
+ *              checkpoint.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_MTD_SMART_MINIMIZE_RAM
+static void smart_cache_setphys(FAR struct smart_struct_s *dev, uint16_t slot,
+                                uint16_t physical, uint8_t flags)
+{
+  FAR struct smart_cache_s *entry = &dev->sCache[slot];
+
+  if (entry->physical == physical)
+    {
+      return;
+    }
+
+  entry->physical = physical;
+
+#ifdef CONFIG_MTD_SMART_MAP_CHECKPOINT
+  if ((flags & SMART_CACHE_DIRTY) && !(entry->flags & SMART_CACHE_DIRTY))
+    {
+      entry->flags |= SMART_CACHE_DIRTY;
+      dev->cache_dirty++;
+    }
+#endif
+}
+#endif
+
+/****************************************************************************
+ * Name: smart_cache_dirtyflag
+ *
+ * Description: Returns SMART_CACHE_DIRTY if a new mapping for the logical
+ *              sector must eventually be written to the map checkpoint.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_MTD_SMART_MINIMIZE_RAM
+static inline uint8_t smart_cache_dirtyflag(FAR struct smart_struct_s *dev,
+                                            uint16_t logical)
+{
+#ifdef CONFIG_MTD_SMART_MAP_CHECKPOINT
+  if (dev->mapvalid && logical >= SMART_FIRST_ALLOC_SECTOR)
+    {
+      return SMART_CACHE_DIRTY;
+    }
+#endif
+
+  return 0;
+}
+#endif
+
+/****************************************************************************
+ * Name: smart_add_sector_to_cache
+ *
+ * Description: Adds a logical to physical sector maaping to the sector
+ *              map cache.  The cache is used to minimize RAM by eliminating
+ *              a one-to-one mapping of all logical sectors and only keeping
+ *              a fixed number of mappings per the
+ *              CONFIG_MTD_SMART_SECTOR_CACHE_SIZE parameter.  Sectors are
+ *              automatically replaced using the CLOCK algorithm when the
+ *              cache is full.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_MTD_SMART_MINIMIZE_RAM
+static int smart_add_sector_to_cache(FAR struct smart_struct_s *dev,
+            uint16_t logical, uint16_t physical, int line)
+{
+  int       index;
+  uint8_t   flags;
+
+#ifdef CONFIG_MTD_SMART_MAP_CHECKPOINT
+  /* The map chunks themselves are tracked in the map directory */
+
+  if (dev->mapvalid && logical >= dev->mapfirst)
+    {
+      dev->mapdir[logical - dev->mapfirst] = physical;
+      return 0;
+    }
+#endif
+
+  flags = smart_cache_dirtyflag(dev, logical);
+  index = smart_cache_find(dev, logical);
+  if (index >= 0)
+    {
+      smart_cache_setphys(dev, index, physical, flags);
+      dev->sCache[index].flags |= SMART_CACHE_REF;
+    }
+  else
+    {
+      index = smart_cache_insert(dev, logical, physical,
+                                 flags | SMART_CACHE_REF);
+    }
+
+  dev->cache_lastlog = logical;
+  dev->cache_lastphys = physical;
+  if (dev->debuglevel > 1)
+    {
+      dbg("Add Cache sector:  Log=%d, Phys=%d at index %d from line %d\n",
+          logical, physical, index, line);
+    }
+
+  return index;
+}
+#endif
+
+/****************************************************************************
+ * Name: smart_map_lookup
+ *
+ * Description: Looks up a logical sector in the map checkpoint on the
+ *              device.  The map entry is only a hint, so the header of the
+ *              physical sector it names is checked to still hold the
+ *              current copy of the logical sector.  Returns 0xFFFF if the
+ *              map can't answer.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_MTD_SMART_MAP_CHECKPOINT
+static uint16_t smart_map_lookup(FAR struct smart_struct_s *dev,
+                                 uint16_t logical)
+{
+  struct    smart_sect_header_s header;
+  uint16_t  chunk;
+  uint16_t  physical;
+  size_t    readaddress;
+  int       ret;
+
+  if (!dev->mapvalid)
+    {
+      return 0xFFFF;
+    }
+
+  chunk = logical / dev->mapentries;
+  if (dev->mapdir[chunk] == 0xFFFF)
+    {
+      return 0xFFFF;
+    }
+
+  /* Read the map entry */
+
+  readaddress = (size_t) dev->mapdir[chunk] * dev->mtdBlksPerSector *
+      dev->geo.blocksize + sizeof(struct smart_sect_header_s) +
+      SMART_MAP_HDRSIZE + (logical % dev->mapentries) * sizeof(uint16_t);
+
+  ret = MTD_READ(dev->mtd, readaddress, sizeof(uint16_t),
+                 (FAR uint8_t *) &physical);
+  if (ret != sizeof(uint16_t) || physical == 0xFFFF ||
+      physical >= (uint32_t) dev->neraseblocks * dev->sectorsPerBlk)
+    {
+      return 0xFFFF;
+    }
+
+  /* Validate the sector it points to */
+
+  readaddress = (size_t) physical * dev->mtdBlksPerSector *
+      dev->geo.blocksize;
+
+  ret = MTD_READ(dev->mtd, readaddress, sizeof(struct smart_sect_header_s),
+                 (FAR uint8_t *) &header);
+  if (ret != sizeof(struct smart_sect_header_s) ||
+      *((FAR uint16_t *) header.logicalsector) != logical ||
+      (header.status & SMART_STATUS_COMMITTED) ==
+          (CONFIG_SMARTFS_ERASEDSTATE & SMART_STATUS_COMMITTED) ||
+      (header.status & SMART_STATUS_RELEASED) !=
+          (CONFIG_SMARTFS_ERASEDSTATE & SMART_STATUS_RELEASED) ||
+      (header.status & SMART_STATUS_VERBITS) != SMART_STATUS_VERSION)
+    {
+      return 0xFFFF;
+    }
+
+  return physical;
+}
+#endif
+
+/****************************************************************************
+ * Name: smart_map_validate
+ *
+ * Description: Checks the signature of the map chunks found by the scan.
+ *              A volume written without the map checkpoint may hold file
+ *              data in those logical sectors, in which case the checkpoint
+ *              is not used.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_MTD_SMART_MAP_CHECKPOINT
+static void smart_map_validate(FAR struct smart_struct_s *dev)
+{
+  uint8_t   buffer[sizeof(struct smart_sect_header_s) + SMART_MAP_HDRSIZE];
+  FAR struct smart_sect_header_s *header;
+  FAR uint8_t *sig;
+  size_t    readaddress;
+  uint16_t  chunk;
+  int       ret;
+
+  header = (FAR struct smart_sect_header_s *) buffer;
+  sig = &buffer[sizeof(struct smart_sect_header_s)];
+
+  for (chunk = 0; dev->mapvalid && chunk < dev->mapchunks; chunk++)
+    {
+      if (dev->mapdir[chunk] == 0xFFFF)
+        {
+          continue;
+        }
+
+      readaddress = (size_t) dev->mapdir[chunk] * dev->mtdBlksPerSector *
+          dev->geo.blocksize;
+      ret = MTD_READ(dev->mtd, readaddress, sizeof(buffer), buffer);
+      if (ret != sizeof(buffer) ||
+          (header->status & SMART_STATUS_RELEASED) !=
+              (CONFIG_SMARTFS_ERASEDSTATE & SMART_STATUS_RELEASED) ||
+          sig[0] != SMART_MAP_SIG1 || sig[1] != SMART_MAP_SIG2 ||
+          (sig[2] | (sig[3] << 8)) != chunk)
+        {
+          fdbg("Sector %d is not a map chunk, map checkpoint disabled\n",
+               dev->mapfirst + chunk);
+
+          for (chunk = 0; chunk < dev->mapchunks; chunk++)
+            {
+              dev->mapdir[chunk] = 0xFFFF;
+            }
+
+          dev->mapvalid = false;
+        }
+    }
+}
+#endif
+
+/****************************************************************************
+ * Name: smart_cache_lookup
+ *
+ * Description: Perform a cache lookup for the requested logical sector.
+ *              If the sector is in the cache, then mark it referenced and
+ *              return the physical mapping.  If a cache miss occurs, then
+ *              the routine will consult the map checkpoint or, failing
+ *              that, scan the volume to find the logical sector and add /
+ *              replace a cache entry with the newly located sector.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_MTD_SMART_MINIMIZE_RAM
+static uint16_t smart_cache_lookup(FAR struct smart_struct_s *dev, uint16_t logical)
+{
+  int       ret;
+  int       slot;
+  uint16_t  block, sector;
+  uint16_t  physical, logicalsector;
+  uint8_t   flags;
+  struct    smart_sect_header_s header;
+  size_t    readaddress;
+
+  /* Test if searching for the last sector used */
+
+  if (logical == dev->cache_lastlog)
+    {
+      return dev->cache_lastphys;
+    }
+
+  /* A logical sector that is not in use has no physical sector */
+
+  if (logical >= dev->totalsectors ||
+      !(dev->sBitMap[logical >> 3] & (1 << (logical & 0x07))))
+    {
+      return 0xFFFF;
+    }
+
+#ifdef CONFIG_MTD_SMART_MAP_CHECKPOINT
+  if (dev->mapvalid && logical >= dev->mapfirst)
+    {
+      return dev->mapdir[logical - dev->mapfirst];
+    }
+#endif
+
+  /* First search for the entry in the cache */
+
+  slot = smart_cache_find(dev, logical);
+  if (slot >= 0)
+    {
+      /* Entry found in the cache.  Grab the physical mapping. */
+
+      dev->sCache[slot].flags |= SMART_CACHE_REF;
+      physical = dev->sCache[slot].physical;
+    }
+  else
+    {
+      physical = 0xFFFF;
+      flags = SMART_CACHE_REF;
+
+#ifdef CONFIG_MTD_SMART_MAP_CHECKPOINT
+      /* Try the map checkpoint first.  A mapping found any other way is
+       * missing from it.
+       */
+
+      physical = smart_map_lookup(dev, logical);
+      if (physical == 0xFFFF)
+        {
+          flags |= smart_cache_dirtyflag(dev, logical);
+        }
+#endif
+
+      /* If we still don't know the physical sector, then we must search
+       * the volume for it.  Instead of scanning start to end, we span the
+       * erase blocks and read one sector from each at a time.  This helps
+       * speed up the search on volumes that aren't full because of sector
+       * allocation scheme will use the lower sector numbers in each erase
+       * block first.
+       */
+
+      for (sector = 0; sector < dev->sectorsPerBlk && physical == 0xFFFF; sector++)
+        {
+          /* Now scan across each erase block */
+
+          for (block = 0; block < dev->geo.neraseblocks; block++)
+            {
+              /* Calculate the read address for this sector */
+
+              readaddress = block * dev->erasesize +
+                  sector * dev->sectorsize;
+
+              /* Read the header for this sector */
+
+              ret = MTD_READ(dev->mtd, readaddress,
+                  sizeof(struct smart_sect_header_s), (FAR uint8_t *) &header);
+              if (ret != sizeof(struct smart_sect_header_s))
+                {
+                  goto err_out;
+                }
+
+              /* Get the logical sector number for this physical sector */
+
+              logicalsector = *((FAR uint16_t *) header.logicalsector);
+#if CONFIG_SMARTFS_ERASEDSTATE == 0x00
+              if (logicalsector == 0)
+                {
+                  continue;
+                }
+#endif
+
+              /* Test if this sector has been committed */
+
+              if ((header.status & SMART_STATUS_COMMITTED) ==
+                      (CONFIG_SMARTFS_ERASEDSTATE & SMART_STATUS_COMMITTED))
+                {
+                  continue;
+                }
+
+              /* Test if this sector has been release and skip it if it has */
+
+              if ((header.status & SMART_STATUS_RELEASED) !=
+                      (CONFIG_SMARTFS_ERASEDSTATE & SMART_STATUS_RELEASED))
+                {
+                  continue;
+                }
+
+              if ((header.status & SMART_STATUS_VERBITS) != SMART_STATUS_VERSION)
+                {
+                  continue;
+                }
+
+              /* Test if this is the sector we are looking for */
+
+              if (logicalsector == logical)
+                {
+                  /* This is the sector we are looking for! */
+
+                  physical = block * dev->sectorsPerBlk + sector;
+                  break;
+                }
+            }
+        }
+
+      /* Add the sector to the cache */
+
+      if (physical != 0xFFFF)
+        {
+          smart_cache_insert(dev, logical, physical, flags);
+        }
+    }
+
+  /* Update the last logical sector found variable */
+
+  dev->cache_lastlog = logical;
+  dev->cache_lastphys = physical;
+
+err_out:
+  return physical;
+}
+#endif
+
+/****************************************************************************
+ * Name: smart_update_cache
+ *
+ * Description: Updates a cache entry replacing the logical sector's
+ *              physical sector mapping with the new one provided, or
+ *              removes it if the new physical sector is 0xFFFF.  With the
+ *              map checkpoint, a moved sector that isn't cached is added
+ *              so that the new location eventually reaches the map.
  *
  ****************************************************************************/
 
@@ -1530,228 +2286,952 @@ err_out:
 static void smart_update_cache(FAR struct smart_struct_s *dev, uint16_t
     logical, uint16_t physical)
 {
-  uint16_t    x;
+  int       slot;
+  uint8_t   flags;
+
+#ifdef CONFIG_MTD_SMART_MAP_CHECKPOINT
+  if (dev->mapvalid && logical >= dev->mapfirst)
+    {
+      dev->mapdir[logical - dev->mapfirst] = physical;
+      return;
+    }
+#endif
+
+  flags = smart_cache_dirtyflag(dev, logical);
+  slot = smart_cache_find(dev, logical);
+  if (slot >= 0)
+    {
+      /* If we are freeing a sector, then remove the logical entry from
+       * the cache.  Otherwise update it's physical mapping.
+       */
+
+      if (physical == 0xFFFF)
+        {
+          smart_cache_remove(dev, slot);
+        }
+      else
+        {
+          smart_cache_setphys(dev, slot, physical, flags);
+        }
+
+      if (dev->debuglevel > 1)
+        {
+          dbg("Update Cache:  Log=%d, Phys=%d at index %d\n", logical, physical, slot);
+        }
+    }
+  else if (physical != 0xFFFF && (flags & SMART_CACHE_DIRTY))
+    {
+      /* Probably moved by garbage collection.  It has not been referenced,
+       * so it is the first candidate for replacement.
+       */
+
+      (void)smart_cache_insert(dev, logical, physical, flags);
+    }
+
+  if (dev->cache_lastlog == logical)
+    {
+      dev->cache_lastphys = physical;
+    }
+}
+#endif
+
+/****************************************************************************
+ * Name: smart_get_wear_level
+ *
+ * Description: Gets the wear level of the specified block.  Wear levels are
+ *              encoded to minimize the number of zero to one transitions,
+ *              possibly allowing updates to made on NOR devices that have
+ *              no CRC enabled.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_MTD_SMART_WEAR_LEVEL
+static uint8_t smart_get_wear_level(FAR struct smart_struct_s *dev, uint16_t block)
+{
+  uint8_t   bits;
+
+  bits = dev->wearstatus[block >> SMART_WEAR_BIT_DIVIDE];
+  if (block & 0x01)
+    {
+      /* Use the upper nibble */
+
+      bits >>= 4;
+    }
+  else
+    {
+      /* Use the lower nibble */
+
+      bits &= 0x0F;
+    }
+
+  /* Lookup and return the level using the BitToLevel map */
+
+  return gWearBitToLevelMap4[bits];
+}
+#endif
+
+/****************************************************************************
+ * Name: smart_find_wear_minmax
+ *
+ * Description: Find the minimum and maximum wear levels.  This is used when
+ *              we increment the wear level of a minimum value block so that
+ *              we can detect if a new minimum exists and perform normalization
+ *              of the wear-levels.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_MTD_SMART_WEAR_LEVEL
+static void smart_find_wear_minmax(FAR struct smart_struct_s *dev)
+{
+  uint16_t   x;
+  unsigned char level;
+
+  dev->minwearlevel = 15;
+  dev->maxwearlevel = 0;
+
+  /* Loop through all erase blocks and find min / max level */
+
+  for (x = 0; x < dev->geo.neraseblocks; x++)
+    {
+      /* Find wear level of the minimum worn block */
+
+      level = smart_get_wear_level(dev, x);
+      if (level < dev->minwearlevel)
+        {
+          dev->minwearlevel = level;
+        }
+
+      /* Find wear level of the maximum worn block */
+
+      if (level > dev->maxwearlevel)
+        {
+          dev->maxwearlevel = level;
+        }
+    }
+
+#ifdef CONFIG_MTD_SMART_SECTOR_ERASE_DEBUG
+  /* Also adjust the erase counts */
+  level = 255;
+  for (x = 0; x < dev->geo.neraseblocks; x++)
+    {
+      if (dev->erasecounts[x] < level)
+        {
+          level = dev->erasecounts[x];
+        }
+    }
+
+  if (level != 0)
+    {
+      for (x = 0; x < dev->geo.neraseblocks; x++)
+        {
+          dev->erasecounts[x] -= level;
+        }
+    }
+
+#endif
+}
+#endif
+
+/****************************************************************************
+ * Name: smart_set_wear_level
+ *
+ * Description: Sets the wear level of the specified block.  The wear level
+ *              is a 4-bit field packed 2 entries per byte and is mapped to
+ *              a bit field which minimizes the number of 0 to 1 transitions
+ *              such that entries can be updated on a NOR flash withough the
+ *              need to relocated the format sector (assuming CRC is not
+ *              enabled, in which case a relocated is needed for ANY change).
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_MTD_SMART_WEAR_LEVEL
+static int smart_set_wear_level(FAR struct smart_struct_s *dev, uint16_t block,
+                                uint8_t level)
+{
+  uint8_t   bits, oldlevel;
+
+  /* Get the old wear level to test if we need to update min / max */
+
+  oldlevel = smart_get_wear_level(dev, block);
+
+  /* Get the bit map for this wear level from the static map array */
+
+  if (level > 15)
+    {
+      dbg("Fatal Design Error!  Wear level > 15, block=%d\n", block);
+
+      /* This is a design flaw, but we still allow processing, otherwise we
+       * will corrupt the volume.  It's better to have a few blocks that are
+       * worn a bit more than to create an error condition on the volume.
+       *
+       * Set the level to the maximum value and add to the un-even wear count
+       * to keep track of the number of times this has happened.
+       */
+
+      level = 15;
+      dev->uneven_wearcount++;
+    }
+
+  bits = gWearLevelToBitMap4[level];
+
+  if (block & 0x01)
+    {
+      /* Use the upper nibble */
+
+      dev->wearstatus[block >> SMART_WEAR_BIT_DIVIDE] &= 0x0F;
+      dev->wearstatus[block >> SMART_WEAR_BIT_DIVIDE] |= bits << 4;
+    }
+  else
+    {
+      /* Use the lower nibble */
+
+      dev->wearstatus[block >> SMART_WEAR_BIT_DIVIDE] &= 0xF0;
+      dev->wearstatus[block >> SMART_WEAR_BIT_DIVIDE] |= bits;
+    }
+
+  /* Mark wear bits as dirty */
+
+  dev->wearflags |= SMART_WEARFLAGS_WRITE_NEEDED;
+
+  /* Test if min / max need to be updated */
+
+  if (oldlevel + 1 == level)
+    {
+      /* Test if max needs to be updated */
+
+      if (level > dev->maxwearlevel)
+        {
+          dev->maxwearlevel = level;
+        }
+
+      /* Test if this was the min level.  If it was, then
+       * we need to rescan for min.
+       */
+
+      if (oldlevel == dev->minwearlevel)
+        {
+          smart_find_wear_minmax(dev);
+
+          if (oldlevel != dev->minwearlevel)
+              fvdbg("##### New min wear level = %d\n", dev->minwearlevel);
+        }
+    }
+
+  return 0;
+}
+#endif
+
+/****************************************************************************
+ * Name: smart_register_rootdirs
+ *
+ * Description: Registers the block devices of the additional root
+ *              directories of a volume formatted with more than one.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_SMARTFS_MULTI_ROOT_DIRS
+static int smart_register_rootdirs(FAR struct smart_struct_s *dev)
+{
+  int       x;
+  char      devname[22];
+  FAR struct smart_multiroot_device_s *rootdirdev;
+
+  for (x = 1; x < dev->rootdirentries; x++)
+    {
+      if (dev->partname[0] != '\0')
+        {
+          snprintf(dev->rwbuffer, sizeof(devname), "/dev/smart%d%sd%d",
+                  dev->minor, dev->partname, x+1);
+        }
+      else
+        {
+          snprintf(devname, sizeof(devname), "/dev/smart%dd%d", dev->minor,
+                   x + 1);
+        }
+
+      /* Inode private data is a reference to a struct containing
+       * the SMART device structure and the root directory number.
+       */
+
+      rootdirdev = (struct smart_multiroot_device_s *)
+        smart_malloc(dev, sizeof(*rootdirdev), "Root Dir");
+      if (rootdirdev == NULL)
+        {
+          fdbg("Memory alloc failed\n");
+          return -ENOMEM;
+        }
+
+      /* Populate the rootdirdev */
+
+      rootdirdev->dev = dev;
+      rootdirdev->rootdirnum = x;
+      (void)register_blockdriver(dev->rwbuffer, &g_bops, 0, rootdirdev);
+
+      /* Inode private data is a reference to the SMART device structure */
+
+      (void)register_blockdriver(devname, &g_bops, 0, rootdirdev);
+    }
+
+  return OK;
+}
+#endif
+
+/****************************************************************************
+ * Name: smart_ckpt_datasize
+ *
+ * Description: Returns the number of data bytes in a mount checkpoint of a
+ *              volume with the given count array size, number of sectors
+ *              and sector size.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_MTD_SMART_MOUNT_CHECKPOINT
+static uint32_t smart_ckpt_datasize(uint32_t countsize, uint32_t nsectors,
+                                    uint16_t sectorsize)
+{
+  uint32_t  datasize;
+#ifdef CONFIG_MTD_SMART_MAP_CHECKPOINT
+  uint32_t  mapentries;
+#endif
+
+  /* The free and release counts come first */
+
+  datasize = countsize;
+
+#ifndef CONFIG_MTD_SMART_MINIMIZE_RAM
+  /* Then the whole logical to physical sector map */
+
+  datasize += nsectors * sizeof(uint16_t);
+#else
+  /* Then the used sector bitmap and the reserved sectors, which are always
+   * in the cache.
+   */
+
+  datasize += (nsectors + 7) >> 3;
+  datasize += SMART_FIRST_ALLOC_SECTOR * sizeof(uint16_t);
+
+#ifdef CONFIG_MTD_SMART_MAP_CHECKPOINT
+  /* Then the map directory and whether the map is in use */
+
+  mapentries = (sectorsize - sizeof(struct smart_sect_header_s) -
+                SMART_MAP_HDRSIZE) / sizeof(uint16_t);
+  datasize += (nsectors + mapentries - 1) / mapentries * sizeof(uint16_t);
+  datasize += 1;
+#endif
+#endif
+
+  return datasize;
+}
+#endif
+
+/****************************************************************************
+ * Name: smart_ckpt_fits
+ *
+ * Description: Tests if checkpoint data of the given size fits in a copy.
+ *              The data is moved in whole sectors after the header block.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_MTD_SMART_MOUNT_CHECKPOINT
+static bool smart_ckpt_fits(FAR struct smart_struct_s *dev,
+                            uint32_t datasize)
+{
+  uint32_t  nsectors;
+  uint32_t  nblocks;
+
+  nsectors = (datasize + dev->sectorsize - 1) / dev->sectorsize;
+  nblocks  = dev->ckptblocks * (dev->geo.erasesize / dev->geo.blocksize);
+
+  return 1 + nsectors * dev->mtdBlksPerSector <= nblocks;
+}
+#endif
+
+/****************************************************************************
+ * Name: smart_ckpt_reserve
+ *
+ * Description: Takes the erase blocks for the two checkpoint copies off the
+ *              end of the device, sized for the largest volume that can be
+ *              built on it with the configured sector size.  Called once
+ *              the MTD geometry is known, before anything else uses it.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_MTD_SMART_MOUNT_CHECKPOINT
+static void smart_ckpt_reserve(FAR struct smart_struct_s *dev)
+{
+  uint32_t  nsectors;
+  uint32_t  datasize;
+  uint32_t  nblocks;
+
+  dev->ckptfirst  = 0;
+  dev->ckptblocks = 0;
+  dev->ckptseq    = 0;
+  dev->ckptslot   = 0;
+  dev->ckptmods   = 0;
+  dev->ckptclean  = false;
+  dev->ckptdirty  = false;
+
+  if (dev->geo.erasesize < CONFIG_MTD_SMART_SECTOR_SIZE)
+    {
+      return;
+    }
+
+  nsectors = dev->geo.neraseblocks *
+             (dev->geo.erasesize / CONFIG_MTD_SMART_SECTOR_SIZE);
+  if (nsectors > 65536)
+    {
+      nsectors = 65536;
+    }
+
+  datasize = smart_ckpt_datasize(dev->geo.neraseblocks << 1, nsectors,
+                                 CONFIG_MTD_SMART_SECTOR_SIZE);
+  datasize = (datasize + CONFIG_MTD_SMART_SECTOR_SIZE - 1) /
+             CONFIG_MTD_SMART_SECTOR_SIZE * CONFIG_MTD_SMART_SECTOR_SIZE;
+  nblocks  = (dev->geo.blocksize + datasize + dev->geo.erasesize - 1) /
+             dev->geo.erasesize;
+
+  /* Don't give up more than an eighth of the device */
+
+  if (nblocks << 4 > dev->geo.neraseblocks)
+    {
+      fdbg("Device too small for a mount checkpoint\n");
+      return;
+    }
+
+  dev->geo.neraseblocks -= nblocks << 1;
+  dev->ckptfirst  = dev->geo.neraseblocks;
+  dev->ckptblocks = nblocks;
+}
+#endif
+
+/****************************************************************************
+ * Name: smart_ckpt_put
+ *
+ * Description: Appends data to the checkpoint copy being written.  The data
+ *              is collected in the read/write buffer and written a sector's
+ *              worth of MTD blocks at a time.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_MTD_SMART_MOUNT_CHECKPOINT
+static int smart_ckpt_put(FAR struct smart_struct_s *dev,
+                          FAR struct smart_ckpt_stream_s *stream,
+                          FAR const void *data, size_t len)
+{
+  FAR const uint8_t *src = (FAR const uint8_t *) data;
+  size_t    nbytes;
+  ssize_t   nxfrd;
+
+  stream->crc = crc32part(src, len, stream->crc);
+
+  while (len > 0)
+    {
+      nbytes = dev->sectorsize - stream->fill;
+      if (nbytes > len)
+        {
+          nbytes = len;
+        }
+
+      memcpy(&dev->rwbuffer[stream->fill], src, nbytes);
+      stream->fill += nbytes;
+      src          += nbytes;
+      len          -= nbytes;
+
+      if (stream->fill == dev->sectorsize)
+        {
+          nxfrd = MTD_BWRITE(dev->mtd, stream->block, dev->mtdBlksPerSector,
+                             (FAR uint8_t *) dev->rwbuffer);
+          if (nxfrd != dev->mtdBlksPerSector)
+            {
+              return -EIO;
+            }
+
+          stream->block += dev->mtdBlksPerSector;
+          stream->fill = 0;
+        }
+    }
+
+  return OK;
+}
+#endif
+
+/****************************************************************************
+ * Name: smart_ckpt_putend
+ *
+ * Description: Writes out the last, partially filled, sector of data.
+ *
+ ****************************************************************************/
 
-  /* Scan through all cache entries and find the logical sector entry */
+#ifdef CONFIG_MTD_SMART_MOUNT_CHECKPOINT
+static int smart_ckpt_putend(FAR struct smart_struct_s *dev,
+                             FAR struct smart_ckpt_stream_s *stream)
+{
+  ssize_t   nxfrd;
+  uint16_t  nblocks;
 
-  for (x = 0; x < dev->cache_entries; x++)
+  if (stream->fill == 0)
     {
-      if (dev->sCache[x].logical == logical)
-        {
-          /* Entry found.  Update it's physical mapping */
+      return OK;
+    }
 
-          dev->sCache[x].physical = physical;
+  nblocks = (stream->fill + dev->geo.blocksize - 1) / dev->geo.blocksize;
+  memset(&dev->rwbuffer[stream->fill], CONFIG_SMARTFS_ERASEDSTATE,
+         nblocks * dev->geo.blocksize - stream->fill);
 
-          /* If we are freeing a sector, then remove the logical entry from
-           * the cache.
-           */
+  nxfrd = MTD_BWRITE(dev->mtd, stream->block, nblocks,
+                     (FAR uint8_t *) dev->rwbuffer);
+  return nxfrd == nblocks ? OK : -EIO;
+}
+#endif
 
-          if (physical == 0xFFFF)
-            {
-                dev->sCache[x].logical = dev->sCache[dev->cache_entries-1].logical;
-                dev->sCache[x].physical = dev->sCache[dev->cache_entries-1].physical;
-                dev->cache_entries--;
-            }
+/****************************************************************************
+ * Name: smart_ckpt_get
+ *
+ * Description: Reads the next data of the checkpoint copy being loaded.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_MTD_SMART_MOUNT_CHECKPOINT
+static int smart_ckpt_get(FAR struct smart_struct_s *dev,
+                          FAR struct smart_ckpt_stream_s *stream,
+                          FAR void *data, size_t len)
+{
+  FAR uint8_t *dest = (FAR uint8_t *) data;
+  FAR uint8_t *start = dest;
+  size_t    nbytes;
+  ssize_t   nxfrd;
 
-          if (dev->debuglevel > 1)
+  while (len > 0)
+    {
+      if (stream->fill == dev->sectorsize)
+        {
+          nxfrd = MTD_BREAD(dev->mtd, stream->block, dev->mtdBlksPerSector,
+                            (FAR uint8_t *) dev->rwbuffer);
+          if (nxfrd != dev->mtdBlksPerSector)
             {
-              dbg("Update Cache:  Log=%d, Phys=%d at index %d\n", logical, physical, x);
+              return -EIO;
             }
 
-          break;
+          stream->block += dev->mtdBlksPerSector;
+          stream->fill = 0;
         }
-    }
 
-  if (dev->cache_lastlog == logical)
-    {
-      dev->cache_lastphys = physical;
+      nbytes = dev->sectorsize - stream->fill;
+      if (nbytes > len)
+        {
+          nbytes = len;
+        }
+
+      memcpy(dest, &dev->rwbuffer[stream->fill], nbytes);
+      stream->fill += nbytes;
+      dest         += nbytes;
+      len          -= nbytes;
     }
+
+  stream->crc = crc32part(start, dest - start, stream->crc);
+  return OK;
 }
 #endif
 
 /****************************************************************************
- * Name: smart_get_wear_level
+ * Name: smart_ckpt_headercrc
  *
- * Description: Gets the wear level of the specified block.  Wear levels are
- *              encoded to minimize the number of zero to one transitions,
- *              possibly allowing updates to made on NOR devices that have
- *              no CRC enabled.
+ * Description: Completes the CRC of a checkpoint with its header fields.
  *
  ****************************************************************************/
 
-#ifdef CONFIG_MTD_SMART_WEAR_LEVEL
-static uint8_t smart_get_wear_level(FAR struct smart_struct_s *dev, uint16_t block)
+#ifdef CONFIG_MTD_SMART_MOUNT_CHECKPOINT
+static inline uint32_t
+smart_ckpt_headercrc(FAR const struct smart_ckpt_header_s *header,
+                     uint32_t crc)
 {
-  uint8_t   bits;
+  return crc32part((FAR const uint8_t *) &header->seq,
+                   sizeof(struct smart_ckpt_header_s) -
+                   offsetof(struct smart_ckpt_header_s, seq), crc);
+}
+#endif
 
-  bits = dev->wearstatus[block >> SMART_WEAR_BIT_DIVIDE];
-  if (block & 0x01)
-    {
-      /* Use the upper nibble */
+/****************************************************************************
+ * Name: smart_ckpt_modify
+ *
+ * Description: Called before the volume is changed.  Marks the newest
+ *              checkpoint copy stale on the device if it is still current,
+ *              so that a mount after a power loss scans the volume.
+ *
+ ****************************************************************************/
 
-      bits >>= 4;
-    }
-  else
+#ifdef CONFIG_MTD_SMART_MOUNT_CHECKPOINT
+static int smart_ckpt_modify(FAR struct smart_struct_s *dev)
+{
+  size_t    offset;
+  uint8_t   state;
+  int       ret;
+
+  if (dev->ckptclean)
     {
-      /* Use the lower nibble */
+      offset = (dev->ckptfirst + dev->ckptslot * dev->ckptblocks) *
+               dev->geo.erasesize +
+               offsetof(struct smart_ckpt_header_s, state);
+      state = (uint8_t) ~CONFIG_SMARTFS_ERASEDSTATE;
 
-      bits &= 0x0F;
+      ret = smart_bytewrite(dev, offset, 1, &state);
+      if (ret < 0)
+        {
+          /* Get rid of both copies then.  The older copy may still have a
+           * valid CRC and would otherwise be loaded by the next mount.
+           */
+
+          fdbg("Error %d invalidating checkpoint\n", -ret);
+          ret = MTD_ERASE(dev->mtd, dev->ckptfirst, 2 * dev->ckptblocks);
+          if (ret < 0)
+            {
+              return ret;
+            }
+        }
+
+      dev->ckptclean = false;
     }
 
-  /* Lookup and return the level using the BitToLevel map */
+  dev->ckptdirty = true;
+  if (dev->ckptmods < 0xFFFF)
+    {
+      dev->ckptmods++;
+    }
 
-  return gWearBitToLevelMap4[bits];
+  return OK;
 }
 #endif
 
 /****************************************************************************
- * Name: smart_find_wear_minmax
+ * Name: smart_ckpt_write
  *
- * Description: Find the minimum and maximum wear levels.  This is used when
- *              we increment the wear level of a minimum value block so that
- *              we can detect if a new minimum exists and perform normalization
- *              of the wear-levels.
+ * Description: Writes a mount checkpoint of the volume to the older copy.
+ *              The header goes last and makes the new copy the newest.
+ *              Nothing is written if the volume has not changed since the
+ *              last checkpoint.
  *
  ****************************************************************************/
 
-#ifdef CONFIG_MTD_SMART_WEAR_LEVEL
-static void smart_find_wear_minmax(FAR struct smart_struct_s *dev)
+#ifdef CONFIG_MTD_SMART_MOUNT_CHECKPOINT
+static int smart_ckpt_write(FAR struct smart_struct_s *dev)
 {
-  uint16_t   x;
-  unsigned char level;
+  struct    smart_ckpt_header_s header;
+  struct    smart_ckpt_stream_s stream;
+  uint32_t  datasize;
+  off_t     firstblock;
+  ssize_t   nxfrd;
+  uint8_t   slot;
+  int       ret;
+#ifdef CONFIG_MTD_SMART_MINIMIZE_RAM
+  uint16_t  reserved[SMART_FIRST_ALLOC_SECTOR];
+  uint16_t  x;
+  int       index;
+#endif
 
-  dev->minwearlevel = 15;
-  dev->maxwearlevel = 0;
+  if (dev->ckptblocks == 0 || !dev->ckptdirty ||
+      dev->formatstatus != SMART_FMT_STAT_FORMATTED)
+    {
+      return OK;
+    }
 
-  /* Loop through all erase blocks and find min / max level */
+#ifdef CONFIG_MTD_SMART_ENABLE_CRC
+  /* Allocated sectors that have not been written only exist in RAM */
 
-  for (x = 0; x < dev->geo.neraseblocks; x++)
+  if (dev->allocsector != NULL)
     {
-      /* Find wear level of the minimum worn block */
+      return -EBUSY;
+    }
+#endif
 
-      level = smart_get_wear_level(dev, x);
-      if (level < dev->minwearlevel)
-        {
-          dev->minwearlevel = level;
-        }
+  datasize = smart_ckpt_datasize(dev->countsize, dev->totalsectors,
+                                 dev->sectorsize);
+  if (!smart_ckpt_fits(dev, datasize))
+    {
+      return -ENOSPC;
+    }
 
-      /* Find wear level of the maximum worn block */
+  /* Erase the older copy */
 
-      if (level > dev->maxwearlevel)
-        {
-          dev->maxwearlevel = level;
-        }
+  slot = dev->ckptslot ^ 1;
+  ret = MTD_ERASE(dev->mtd, dev->ckptfirst + slot * dev->ckptblocks,
+                  dev->ckptblocks);
+  if (ret < 0)
+    {
+      goto errout;
     }
 
-#ifdef CONFIG_MTD_SMART_SECTOR_ERASE_DEBUG
-  /* Also adjust the erase counts */
-  level = 255;
-  for (x = 0; x < dev->geo.neraseblocks; x++)
+  /* Write the data */
+
+  firstblock = (dev->ckptfirst + slot * dev->ckptblocks) *
+               (dev->geo.erasesize / dev->geo.blocksize);
+
+  stream.block = firstblock + 1;
+  stream.fill  = 0;
+  stream.crc   = 0;
+
+  ret = smart_ckpt_put(dev, &stream, dev->releasecount, dev->countsize);
+#ifndef CONFIG_MTD_SMART_MINIMIZE_RAM
+  if (ret == OK)
     {
-      if (dev->erasecounts[x] < level)
-        {
-          level = dev->erasecounts[x];
-        }
+      ret = smart_ckpt_put(dev, &stream, dev->sMap,
+                           dev->totalsectors * sizeof(uint16_t));
+    }
+#else
+  if (ret == OK)
+    {
+      ret = smart_ckpt_put(dev, &stream, dev->sBitMap,
+                           (dev->totalsectors + 7) >> 3);
     }
 
-  if (level != 0)
+  for (x = 0; x < SMART_FIRST_ALLOC_SECTOR; x++)
     {
-      for (x = 0; x < dev->geo.neraseblocks; x++)
-        {
-          dev->erasecounts[x] -= level;
-        }
+      index = smart_cache_find(dev, x);
+      reserved[x] = index < 0 ? 0xFFFF : dev->sCache[index].physical;
+    }
+
+  if (ret == OK)
+    {
+      ret = smart_ckpt_put(dev, &stream, reserved, sizeof(reserved));
+    }
+
+#ifdef CONFIG_MTD_SMART_MAP_CHECKPOINT
+  if (ret == OK)
+    {
+      ret = smart_ckpt_put(dev, &stream, dev->mapdir,
+                           dev->mapchunks * sizeof(uint16_t));
+    }
+
+  if (ret == OK)
+    {
+      ret = smart_ckpt_put(dev, &stream, &dev->mapvalid, 1);
+    }
+#endif
+#endif
+
+  if (ret == OK)
+    {
+      ret = smart_ckpt_putend(dev, &stream);
+    }
+
+  if (ret < 0)
+    {
+      goto errout;
     }
 
+  /* Now the header */
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SMART_CKPT_MAGIC, sizeof(header.magic));
+  header.state          = CONFIG_SMARTFS_ERASEDSTATE;
+  header.version        = SMART_CKPT_VERSION;
+  header.layout         = SMART_CKPT_LAYOUT;
+  header.formatversion  = dev->formatversion;
+  header.seq            = dev->ckptseq + 1;
+  header.datasize       = datasize;
+  header.sectorsize     = dev->sectorsize;
+  header.totalsectors   = dev->totalsectors;
+  header.neraseblocks   = dev->neraseblocks;
+  header.freesectors    = dev->freesectors;
+  header.releasesectors = dev->releasesectors;
+  header.namesize       = dev->namesize;
+#ifdef CONFIG_SMARTFS_MULTI_ROOT_DIRS
+  header.rootdirentries = dev->rootdirentries;
+#else
+  header.rootdirentries = 1;
 #endif
+  header.crc            = smart_ckpt_headercrc(&header, stream.crc);
+
+  memset(dev->rwbuffer, CONFIG_SMARTFS_ERASEDSTATE, dev->geo.blocksize);
+  memcpy(dev->rwbuffer, &header, sizeof(header));
+  nxfrd = MTD_BWRITE(dev->mtd, firstblock, 1, (FAR uint8_t *) dev->rwbuffer);
+  if (nxfrd != 1)
+    {
+      ret = -EIO;
+      goto errout;
+    }
+
+  dev->ckptseq   = header.seq;
+  dev->ckptslot  = slot;
+  dev->ckptclean = true;
+  dev->ckptdirty = false;
+  dev->ckptmods  = 0;
+  return OK;
+
+errout:
+  fdbg("Error %d writing checkpoint\n", -ret);
+  return ret;
 }
 #endif
 
 /****************************************************************************
- * Name: smart_set_wear_level
+ * Name: smart_ckpt_load
  *
- * Description: Sets the wear level of the specified block.  The wear level
- *              is a 4-bit field packed 2 entries per byte and is mapped to
- *              a bit field which minimizes the number of 0 to 1 transitions
- *              such that entries can be updated on a NOR flash withough the
- *              need to relocated the format sector (assuming CRC is not
- *              enabled, in which case a relocated is needed for ANY change).
+ * Description: Loads the newest mount checkpoint if it still describes the
+ *              volume.  Returns a negated errno if there is none, if it is
+ *              stale or damaged, or if it does not match the volume, and
+ *              the caller must scan the volume.
  *
  ****************************************************************************/
 
-#ifdef CONFIG_MTD_SMART_WEAR_LEVEL
-static int smart_set_wear_level(FAR struct smart_struct_s *dev, uint16_t block,
-                                uint8_t level)
+#ifdef CONFIG_MTD_SMART_MOUNT_CHECKPOINT
+static int smart_ckpt_load(FAR struct smart_struct_s *dev)
 {
-  uint8_t   bits, oldlevel;
+  struct    smart_ckpt_header_s header[2];
+  struct    smart_ckpt_stream_s stream;
+  FAR struct smart_ckpt_header_s *ckpt;
+  uint8_t   slot;
+  int       ret;
+#ifdef CONFIG_MTD_SMART_MINIMIZE_RAM
+  uint16_t  reserved[SMART_FIRST_ALLOC_SECTOR];
+  uint16_t  x;
+#endif
+#ifdef CONFIG_MTD_SMART_MAP_CHECKPOINT
+  uint8_t   mapvalid;
+#endif
 
-  /* Get the old wear level to test if we need to update min / max */
+  /* Unless the checkpoint is loaded, write one at the next opportunity */
 
-  oldlevel = smart_get_wear_level(dev, block);
+  dev->ckptclean = false;
+  dev->ckptdirty = true;
+  dev->ckptmods  = 0;
 
-  /* Get the bit map for this wear level from the static map array */
+  if (dev->ckptblocks == 0)
+    {
+      return -ENOSYS;
+    }
 
-  if (level > 15)
+  /* Find the newest copy */
+
+  for (slot = 0; slot < 2; slot++)
     {
-      dbg("Fatal Design Error!  Wear level > 15, block=%d\n", block);
+      ret = MTD_READ(dev->mtd, (dev->ckptfirst + slot * dev->ckptblocks) *
+                     dev->geo.erasesize, sizeof(struct smart_ckpt_header_s),
+                     (FAR uint8_t *) &header[slot]);
+      if (ret != sizeof(struct smart_ckpt_header_s) ||
+          memcmp(header[slot].magic, SMART_CKPT_MAGIC,
+                 sizeof(header[slot].magic)) != 0)
+        {
+          header[slot].seq = 0;
+        }
+    }
 
-      /* This is a design flaw, but we still allow processing, otherwise we
-       * will corrupt the volume.  It's better to have a few blocks that are
-       * worn a bit more than to create an error condition on the volume.
-       *
-       * Set the level to the maximum value and add to the un-even wear count
-       * to keep track of the number of times this has happened.
-       */
+  slot = header[1].seq > header[0].seq ? 1 : 0;
+  ckpt = &header[slot];
 
-      level = 15;
-      dev->uneven_wearcount++;
+  dev->ckptslot = slot;
+  dev->ckptseq  = ckpt->seq;
+
+  if (ckpt->seq == 0)
+    {
+      return -ENOENT;
     }
 
-  bits = gWearLevelToBitMap4[level];
+  if (ckpt->state != CONFIG_SMARTFS_ERASEDSTATE)
+    {
+      fvdbg("Checkpoint %d is stale\n", ckpt->seq);
+      return -ESTALE;
+    }
 
-  if (block & 0x01)
+  if (ckpt->version != SMART_CKPT_VERSION ||
+      ckpt->layout != SMART_CKPT_LAYOUT ||
+      ckpt->sectorsize != dev->sectorsize ||
+      ckpt->totalsectors != dev->totalsectors ||
+      ckpt->neraseblocks != dev->neraseblocks ||
+      ckpt->datasize != smart_ckpt_datasize(dev->countsize,
+                                            dev->totalsectors,
+                                            dev->sectorsize) ||
+      !smart_ckpt_fits(dev, ckpt->datasize))
     {
-      /* Use the upper nibble */
+      fdbg("Checkpoint %d does not match the volume\n", ckpt->seq);
+      return -EINVAL;
+    }
 
-      dev->wearstatus[block >> SMART_WEAR_BIT_DIVIDE] &= 0x0F;
-      dev->wearstatus[block >> SMART_WEAR_BIT_DIVIDE] |= bits << 4;
+  /* Read the data straight into place.  If it turns out to be damaged, the
+   * scan initializes everything again.
+   */
+
+#ifdef CONFIG_MTD_SMART_MINIMIZE_RAM
+  smart_cache_reset(dev);
+#endif
+
+  stream.block = (dev->ckptfirst + slot * dev->ckptblocks) *
+                 (dev->geo.erasesize / dev->geo.blocksize) + 1;
+  stream.fill  = dev->sectorsize;
+  stream.crc   = 0;
+
+  ret = smart_ckpt_get(dev, &stream, dev->releasecount, dev->countsize);
+#ifndef CONFIG_MTD_SMART_MINIMIZE_RAM
+  if (ret == OK)
+    {
+      ret = smart_ckpt_get(dev, &stream, dev->sMap,
+                           dev->totalsectors * sizeof(uint16_t));
     }
-  else
+#else
+  if (ret == OK)
     {
-      /* Use the lower nibble */
+      ret = smart_ckpt_get(dev, &stream, dev->sBitMap,
+                           (dev->totalsectors + 7) >> 3);
+    }
 
-      dev->wearstatus[block >> SMART_WEAR_BIT_DIVIDE] &= 0xF0;
-      dev->wearstatus[block >> SMART_WEAR_BIT_DIVIDE] |= bits;
+  if (ret == OK)
+    {
+      ret = smart_ckpt_get(dev, &stream, reserved, sizeof(reserved));
     }
 
-  /* Mark wear bits as dirty */
+#ifdef CONFIG_MTD_SMART_MAP_CHECKPOINT
+  if (ret == OK)
+    {
+      ret = smart_ckpt_get(dev, &stream, dev->mapdir,
+                           dev->mapchunks * sizeof(uint16_t));
+    }
 
-  dev->wearflags |= SMART_WEARFLAGS_WRITE_NEEDED;
+  if (ret == OK)
+    {
+      ret = smart_ckpt_get(dev, &stream, &mapvalid, 1);
+    }
+#endif
+#endif
 
-  /* Test if min / max need to be updated */
+  if (ret == OK && smart_ckpt_headercrc(ckpt, stream.crc) != ckpt->crc)
+    {
+      ret = -EBADMSG;
+    }
 
-  if (oldlevel + 1 == level)
+  if (ret < 0)
     {
-      /* Test if max needs to be updated */
+      fdbg("Error %d loading checkpoint %d\n", -ret, ckpt->seq);
+      return ret;
+    }
 
-      if (level > dev->maxwearlevel)
-        {
-          dev->maxwearlevel = level;
-        }
+  /* The checkpoint is good, take over the rest of the volume state */
 
-      /* Test if this was the min level.  If it was, then
-       * we need to rescan for min.
-       */
+  dev->formatstatus   = SMART_FMT_STAT_FORMATTED;
+  dev->formatversion  = ckpt->formatversion;
+  dev->namesize       = ckpt->namesize;
+  dev->freesectors    = ckpt->freesectors;
+  dev->releasesectors = ckpt->releasesectors;
+#ifdef CONFIG_SMARTFS_MULTI_ROOT_DIRS
+  dev->rootdirentries = ckpt->rootdirentries;
+#endif
 
-      if (oldlevel == dev->minwearlevel)
-        {
-          smart_find_wear_minmax(dev);
+#ifdef CONFIG_MTD_SMART_MINIMIZE_RAM
+#ifdef CONFIG_MTD_SMART_MAP_CHECKPOINT
+  dev->mapvalid = mapvalid != 0;
+#endif
 
-          if (oldlevel != dev->minwearlevel)
-              fvdbg("##### New min wear level = %d\n", dev->minwearlevel);
+  for (x = 0; x < SMART_FIRST_ALLOC_SECTOR; x++)
+    {
+      if (reserved[x] != 0xFFFF)
+        {
+          smart_add_sector_to_cache(dev, x, reserved[x], __LINE__);
         }
     }
+#endif
 
-  return 0;
+  dev->ckptclean = true;
+  dev->ckptdirty = false;
+  fvdbg("Loaded checkpoint %d\n", ckpt->seq);
+  return OK;
 }
 #endif
 
@@ -1781,11 +3261,6 @@ static int smart_scan(FAR struct smart_struct_s *dev)
   int       dupsector;
   uint16_t  duplogsector;
 #endif
-#ifdef CONFIG_SMARTFS_MULTI_ROOT_DIRS
-  int       x;
-  char      devname[22];
-  FAR struct smart_multiroot_device_s *rootdirdev;
-#endif
 
   fvdbg("Entry\n");
 
@@ -1839,6 +3314,25 @@ static int smart_scan(FAR struct smart_struct_s *dev)
       goto err_out;
     }
 
+#ifdef CONFIG_MTD_SMART_MOUNT_CHECKPOINT
+  /* If the checkpoint written at the last unmount or sync still describes
+   * the volume, there is no need to scan it.
+   */
+
+  if (smart_ckpt_load(dev) == OK)
+    {
+#ifdef CONFIG_SMARTFS_MULTI_ROOT_DIRS
+      ret = smart_register_rootdirs(dev);
+      if (ret < 0)
+        {
+          goto err_out;
+        }
+#endif
+
+      goto scan_done;
+    }
+#endif
+
   /* Initialize the device variables */
 
   totalsectors = dev->totalsectors;
@@ -1876,9 +3370,10 @@ static int smart_scan(FAR struct smart_struct_s *dev)
       dev->sMap[sector] = -1;
     }
 #else
-  /* Clear all logical sector used bits */
+  /* Clear all logical sector used bits and empty the cache */
 
   memset(dev->sBitMap, 0, (dev->totalsectors + 7) >> 3);
+  smart_cache_reset(dev);
 #endif
 
   /* Now scan the MTD device */
@@ -2008,41 +3503,10 @@ static int smart_scan(FAR struct smart_struct_s *dev)
            * additional block devices.
            */
 
-          for (x = 1; x < dev->rootdirentries; x++)
+          ret = smart_register_rootdirs(dev);
+          if (ret < 0)
             {
-              if (dev->partname[0] != '\0')
-                {
-                  snprintf(dev->rwbuffer, sizeof(devname), "/dev/smart%d%sd%d",
-                          dev->minor, dev->partname, x+1);
-                }
-              else
-                {
-                  snprintf(devname, sizeof(devname), "/dev/smart%dd%d", dev->minor,
-                           x + 1);
-                }
-
-              /* Inode private data is a reference to a struct containing
-               * the SMART device structure and the root directory number.
-               */
-
-              rootdirdev = (struct smart_multiroot_device_s *)
-                smart_malloc(dev, sizeof(*rootdirdev), "Root Dir");
-              if (rootdirdev == NULL)
-                {
-                  fdbg("Memory alloc failed\n");
-                  ret = -ENOMEM;
-                  goto err_out;
-                }
-
-              /* Populate the rootdirdev */
-
-              rootdirdev->dev = dev;
-              rootdirdev->rootdirnum = x;
-              ret = register_blockdriver(dev->rwbuffer, &g_bops, 0, rootdirdev);
-
-              /* Inode private data is a reference to the SMART device structure */
-
-              ret = register_blockdriver(devname, &g_bops, 0, rootdirdev);
+              goto err_out;
             }
 #endif
         }
@@ -2214,9 +3678,21 @@ static int smart_scan(FAR struct smart_struct_s *dev)
         {
           smart_add_sector_to_cache(dev, logicalsector, sector, __LINE__);
         }
+#ifdef CONFIG_MTD_SMART_MAP_CHECKPOINT
+      else if (dev->mapvalid && logicalsector >= dev->mapfirst)
+        {
+          dev->mapdir[logicalsector - dev->mapfirst] = sector;
+        }
+#endif
 #endif
     }
 
+#ifdef CONFIG_MTD_SMART_MAP_CHECKPOINT
+  /* Make sure the sectors at the top of the volume really are map chunks */
+
+  smart_map_validate(dev);
+#endif
+
 #if defined (CONFIG_MTD_SMART_WEAR_LEVEL) && (SMART_STATUS_VERSION == 1)
 #ifdef CONFIG_MTD_SMART_CONVERT_WEAR_FORMAT
 
@@ -2289,6 +3765,12 @@ static int smart_scan(FAR struct smart_struct_s *dev)
 #endif  /* CONFIG_MTD_SMART_CONVERT_WEAR_FORMAT */
 #endif  /* CONFIG_MTD_SMART_WEAR_LEVEL && SMART_STATUS_VERSION == 1 */
 
+#ifdef CONFIG_MTD_SMART_MOUNT_CHECKPOINT
+  /* A volume with a checkpoint has been scanned, and converted, before */
+
+scan_done:
+#endif
+
 #ifdef CONFIG_MTD_SMART_WEAR_LEVEL
   /* Read the wear leveling status bits */
 
@@ -2967,6 +4449,11 @@ static inline int smart_llformat(FAR struct smart_struct_s *dev, unsigned long a
 
       dev->sMap[x] = -1;
     }
+#else
+  memset(dev->sBitMap, 0, (dev->totalsectors + 7) >> 3);
+  dev->sBitMap[0] = 0x01;
+  smart_cache_reset(dev);
+  smart_add_sector_to_cache(dev, 0, 0, __LINE__);
 #endif
 
 #ifdef CONFIG_SMARTFS_MULTI_ROOT_DIRS
@@ -3576,6 +5063,9 @@ retry:
         {
           physicalsector = x;
           dev->lastallocblock = allocblock;
+#ifdef CONFIG_MTD_SMART_BGGC
+          dev->gcstamp[allocblock] = dev->gcclock++;
+#endif
           break;
         }
     }
@@ -3730,105 +5220,356 @@ errout:
  *
  ****************************************************************************/
 
-#ifdef CONFIG_MTD_SMART_WEAR_LEVEL
-static int smart_write_wearstatus(struct smart_struct_s *dev)
+#ifdef CONFIG_MTD_SMART_WEAR_LEVEL
+static int smart_write_wearstatus(struct smart_struct_s *dev)
+{
+  uint16_t  sector;
+  uint16_t  remaining, towrite;
+  struct smart_read_write_s req;
+  int       ret;
+  uint8_t   buffer[8], write_buffer = 0;
+
+  sector = 0;
+  remaining = dev->geo.neraseblocks >> 1;
+  memset(buffer, 0xFF, sizeof(buffer));
+
+#if defined(CONFIG_FS_PROCFS) && !defined(CONFIG_FS_PROCFS_EXCLUDE_SMARTFS)
+  if (dev->blockerases > 0)
+    {
+      *((uint32_t *) buffer) = dev->blockerases;
+      write_buffer = 1;
+    }
+#endif
+
+  /* Write the uneven wear count just prior to the wear bits */
+
+  if (dev->uneven_wearcount != 0)
+    {
+      *((uint32_t *) &buffer[4]) = dev->uneven_wearcount;
+      write_buffer = 1;
+    }
+
+  /* Test if we need to write either total block erase count or
+   * uneven wearcount (or both)
+   */
+
+  if (write_buffer)
+    {
+      req.logsector = sector;
+      req.offset = SMARTFS_FMT_WEAR_POS - 8;
+      req.count = sizeof(buffer);
+      req.buffer = buffer;
+      ret = smart_writesector(dev, (unsigned long) &req);
+      if (ret != OK)
+        {
+          goto errout;
+        }
+    }
+
+  /* Write all wear level bits to logical sector zero, one, two */
+
+  while (remaining)
+    {
+      /* Calculate the number of bytes to write to this sector */
+
+      towrite = remaining;
+      if (towrite > dev->sectorsize - SMARTFS_FMT_WEAR_POS)
+        {
+          towrite = dev->sectorsize - SMARTFS_FMT_WEAR_POS;
+        }
+
+      /* Setup the sector write request (we are our own client) */
+
+      req.logsector = sector;
+      req.offset = SMARTFS_FMT_WEAR_POS;
+      req.count = towrite;
+      req.buffer = &dev->wearstatus[(dev->geo.neraseblocks >> SMART_WEAR_BIT_DIVIDE) -
+                    remaining];
+
+      /* Write the sector */
+
+      ret = smart_writesector(dev, (unsigned long) &req);
+      if (ret != OK)
+        {
+          goto errout;
+        }
+
+      /* Decrement the remaining count */
+
+      remaining -= towrite;
+      if (remaining)
+        {
+          /* Data doesn't fit in a single sector.  Use the reserved sectors */
+
+          sector++;
+          if (sector >= SMART_FIRST_DIR_SECTOR)
+            {
+              /* Error, wear status bit too large! */
+              fdbg("Invalid geometry - wear level status too large\n");
+              ret = -EINVAL;
+              goto errout;
+            }
+        }
+    }
+
+  /* Now clear the NEEDS_WRITE wear status bit */
+
+  dev->wearflags &= ~SMART_WEARFLAGS_WRITE_NEEDED;
+  ret = OK;
+
+errout:
+  return ret;
+}
+#endif
+
+/****************************************************************************
+ * Name: smart_gc_victim
+ *
+ * Description: Selects the erase block for the background collector with
+ *              the cost-benefit policy of log-structured file systems:  the
+ *              space gained, weighted by how long ago the block was last
+ *              written to, against the cost of moving its live sectors.
+ *              Of two otherwise equal blocks the less worn one goes first.
+ *              Returns 0xFFFF if no block is worth collecting now.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_MTD_SMART_BGGC
+static uint16_t smart_gc_victim(FAR struct smart_struct_s *dev)
+{
+  uint32_t  score;
+  uint32_t  bestscore = 0;
+  uint16_t  victim = 0xFFFF;
+  uint16_t  released;
+  uint16_t  freecount;
+  uint16_t  live;
+  uint16_t  age;
+  uint16_t  x;
+#ifdef CONFIG_MTD_SMART_WEAR_LEVEL
+  uint8_t   level;
+#endif
+
+  for (x = 0; x < dev->neraseblocks; x++)
+    {
+      age = dev->gcclock - dev->gcstamp[x];
+      if (age > SMART_GC_MAXAGE)
+        {
+          dev->gcstamp[x] = dev->gcclock - SMART_GC_MAXAGE;
+          age = SMART_GC_MAXAGE;
+        }
+
+#ifdef CONFIG_MTD_SMART_PACK_COUNTS
+      released  = smart_get_count(dev, dev->releasecount, x);
+      freecount = smart_get_count(dev, dev->freecount, x);
+#else
+      released  = dev->releasecount[x];
+      freecount = dev->freecount[x];
+#endif
+
+      /* Skip the block being allocated from and blocks where there is
+       * little to gain.
+       */
+
+      if (x == dev->lastallocblock ||
+          released < (dev->availSectPerBlk >> 3))
+        {
+          continue;
+        }
+
+      /* The free sectors of the block are given up while it is relocated.
+       * Moving the live sectors must not eat into the free sectors that
+       * the foreground collector relies on.
+       */
+
+      live = dev->availSectPerBlk - released - freecount;
+      if (dev->freesectors <= freecount + live + dev->sectorsPerBlk + 4)
+        {
+          continue;
+        }
+
+      score = ((uint32_t) released << 8) / (dev->availSectPerBlk + live) *
+              (age + 1);
+
+#ifdef CONFIG_MTD_SMART_WEAR_LEVEL
+      level = smart_get_wear_level(dev, x);
+      if (level >= SMART_WEAR_REORG_THRESHOLD)
+        {
+          continue;
+        }
+
+      score *= SMART_WEAR_REORG_THRESHOLD - level;
+#endif
+
+      if (score > bestscore)
+        {
+          bestscore = score;
+          victim = x;
+        }
+    }
+
+  return victim;
+}
+#endif
+
+/****************************************************************************
+ * Name: smart_gc_collect
+ *
+ * Description: Collects one erase block chosen by smart_gc_victim().
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_MTD_SMART_BGGC
+static int smart_gc_collect(FAR struct smart_struct_s *dev)
+{
+  uint16_t  block;
+  int       ret;
+
+  if (dev->formatstatus != SMART_FMT_STAT_FORMATTED)
+    {
+      return -ENODEV;
+    }
+
+  block = smart_gc_victim(dev);
+  if (block == 0xFFFF)
+    {
+      return -ENOSPC;
+    }
+
+#ifdef CONFIG_MTD_SMART_MOUNT_CHECKPOINT
+  ret = smart_ckpt_modify(dev);
+  if (ret < 0)
+    {
+      return ret;
+    }
+#endif
+
+  fvdbg("Collecting block %d in the background\n", block);
+
+  ret = smart_relocate_block(dev, block);
+  if (ret < 0)
+    {
+      fdbg("Error %d collecting block %d\n", -ret, block);
+      return ret;
+    }
+
+#ifdef CONFIG_MTD_SMART_WEAR_LEVEL
+  if (dev->wearflags & SMART_WEARFLAGS_WRITE_NEEDED)
+    {
+      /* Write new wear status bits to the device */
+
+      smart_write_wearstatus(dev);
+    }
+#endif
+
+  dev->gccollected++;
+  return OK;
+}
+#endif
+
+/****************************************************************************
+ * Name: smart_gc_schedule
+ *
+ * Description: Queues the background collector if free sectors are below
+ *              the low watermark.  It runs once the device has been idle
+ *              for the configured time.  Called with exclsem held.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_MTD_SMART_BGGC
+static void smart_gc_schedule(FAR struct smart_struct_s *dev)
+{
+  if (dev->gcenable && dev->freesectors < dev->gclowfree &&
+      dev->releasesectors > 0 && work_available(&dev->gcwork))
+    {
+      (void)work_queue(LPWORK, &dev->gcwork, smart_gc_worker, dev,
+                       MSEC2TICK(dev->gcidle));
+    }
+}
+#endif
+
+/****************************************************************************
+ * Name: smart_gc_worker
+ *
+ * Description: Background collector, runs on the low priority work queue.
+ *              Collects one block per run, so that a request never waits
+ *              for more than one block relocation, and queues itself again
+ *              until the high watermark is reached.  If a request came in
+ *              meanwhile, it waits for the device to be idle again first.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_MTD_SMART_BGGC
+static void smart_gc_worker(FAR void *arg)
 {
-  uint16_t  sector;
-  uint16_t  remaining, towrite;
-  struct smart_read_write_s req;
-  int       ret;
-  uint8_t   buffer[8], write_buffer = 0;
+  FAR struct smart_struct_s *dev = (FAR struct smart_struct_s *) arg;
+  uint32_t  idle;
+  uint32_t  elapsed;
 
-  sector = 0;
-  remaining = dev->geo.neraseblocks >> 1;
-  memset(buffer, 0xFF, sizeof(buffer));
+  smart_semtake(dev);
 
-#if defined(CONFIG_FS_PROCFS) && !defined(CONFIG_FS_PROCFS_EXCLUDE_SMARTFS)
-  if (dev->blockerases > 0)
+  idle = MSEC2TICK(dev->gcidle);
+  elapsed = clock_systimer() - dev->gclast;
+  if (elapsed < idle)
     {
-      *((uint32_t *) buffer) = dev->blockerases;
-      write_buffer = 1;
+      (void)work_queue(LPWORK, &dev->gcwork, smart_gc_worker, dev,
+                       idle - elapsed);
     }
-#endif
-
-  /* Write the uneven wear count just prior to the wear bits */
-
-  if (dev->uneven_wearcount != 0)
+  else if (dev->gcenable && dev->freesectors < dev->gchighfree &&
+           smart_gc_collect(dev) == OK)
     {
-      *((uint32_t *) &buffer[4]) = dev->uneven_wearcount;
-      write_buffer = 1;
+      (void)work_queue(LPWORK, &dev->gcwork, smart_gc_worker, dev, 0);
     }
 
-  /* Test if we need to write either total block erase count or
-   * uneven wearcount (or both)
-   */
+  smart_semgive(dev);
+}
+#endif
 
-  if (write_buffer)
+/****************************************************************************
+ * Name: smart_gc_control
+ *
+ * Description: Handles BIOC_GCCTRL:  changes the background collection
+ *              settings, collects right away up to the high watermark and
+ *              returns the current settings and state.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_MTD_SMART_BGGC
+static int smart_gc_control(FAR struct smart_struct_s *dev,
+                            FAR struct smart_gcctrl_s *ctrl)
+{
+  if (ctrl == NULL)
     {
-      req.logsector = sector;
-      req.offset = SMARTFS_FMT_WEAR_POS - 8;
-      req.count = sizeof(buffer);
-      req.buffer = buffer;
-      ret = smart_writesector(dev, (unsigned long) &req);
-      if (ret != OK)
-        {
-          goto errout;
-        }
+      return -EINVAL;
     }
 
-  /* Write all wear level bits to logical sector zero, one, two */
-
-  while (remaining)
+  if (ctrl->flags & SMART_GCCTRL_CONFIG)
     {
-      /* Calculate the number of bytes to write to this sector */
-
-      towrite = remaining;
-      if (towrite > dev->sectorsize - SMARTFS_FMT_WEAR_POS)
-        {
-          towrite = dev->sectorsize - SMARTFS_FMT_WEAR_POS;
-        }
-
-      /* Setup the sector write request (we are our own client) */
-
-      req.logsector = sector;
-      req.offset = SMARTFS_FMT_WEAR_POS;
-      req.count = towrite;
-      req.buffer = &dev->wearstatus[(dev->geo.neraseblocks >> SMART_WEAR_BIT_DIVIDE) -
-                    remaining];
-
-      /* Write the sector */
-
-      ret = smart_writesector(dev, (unsigned long) &req);
-      if (ret != OK)
+      if (ctrl->highfree < ctrl->lowfree ||
+          ctrl->highfree > dev->totalsectors)
         {
-          goto errout;
+          return -EINVAL;
         }
 
-      /* Decrement the remaining count */
-
-      remaining -= towrite;
-      if (remaining)
-        {
-          /* Data doesn't fit in a single sector.  Use the reserved sectors */
-
-          sector++;
-          if (sector >= SMART_FIRST_DIR_SECTOR)
-            {
-              /* Error, wear status bit too large! */
-              fdbg("Invalid geometry - wear level status too large\n");
-              ret = -EINVAL;
-              goto errout;
-            }
-        }
+      dev->gcenable   = ctrl->enable;
+      dev->gcidle     = ctrl->idlems;
+      dev->gclowfree  = ctrl->lowfree;
+      dev->gchighfree = ctrl->highfree;
     }
 
-  /* Now clear the NEEDS_WRITE wear status bit */
-
-  dev->wearflags &= ~SMART_WEARFLAGS_WRITE_NEEDED;
-  ret = OK;
+  if (ctrl->flags & SMART_GCCTRL_RUN)
+    {
+      while (dev->freesectors < dev->gchighfree &&
+             smart_gc_collect(dev) == OK);
+    }
 
-errout:
-  return ret;
+  ctrl->enable         = dev->gcenable;
+  ctrl->idlems         = dev->gcidle;
+  ctrl->lowfree        = dev->gclowfree;
+  ctrl->highfree       = dev->gchighfree;
+  ctrl->freesectors    = dev->freesectors;
+  ctrl->releasesectors = dev->releasesectors;
+  ctrl->collected      = dev->gccollected;
+  return OK;
 }
 #endif
 
@@ -4644,10 +6385,21 @@ static inline int smart_allocsector(FAR struct smart_struct_s *dev,
   int       x;
   uint16_t  logsector = 0xFFFF; /* Logical sector number selected */
   uint16_t  physicalsector;     /* The selected physical sector */
+  uint16_t  limit;              /* End of the allocatable sectors */
 #ifndef CONFIG_MTD_SMART_ENABLE_CRC
   int       ret;
 #endif
 
+  /* The map checkpoint chunks are only allocated by the map code itself */
+
+  limit = dev->totalsectors;
+#ifdef CONFIG_MTD_SMART_MAP_CHECKPOINT
+  if (dev->mapvalid && !dev->mapbusy)
+    {
+      limit = dev->mapfirst;
+    }
+#endif
+
   /* Validate that we have enough sectors available to perform an
    * allocation.  We have to ensure we keep enough reserved sectors
    * on hand to do released sector garbage collection. */
@@ -4685,7 +6437,7 @@ static inline int smart_allocsector(FAR struct smart_struct_s *dev,
   /* Check if a specific sector is being requested and allocate that
    * sector if it isn't already in use */
 
-  if ((requested > 2) && (requested < dev->totalsectors))
+  if ((requested > 2) && (requested < limit))
     {
       /* Validate the sector is not already allocated */
 
@@ -4725,7 +6477,7 @@ static inline int smart_allocsector(FAR struct smart_struct_s *dev,
     {
       /* Loop through all sectors and find one to allocate */
 
-      for (x = SMART_FIRST_ALLOC_SECTOR; x < dev->totalsectors; x++)
+      for (x = SMART_FIRST_ALLOC_SECTOR; x < limit; x++)
         {
 #ifndef CONFIG_MTD_SMART_MINIMIZE_RAM
           if (dev->sMap[x] == (uint16_t) -1)
@@ -4880,6 +6632,7 @@ static inline int smart_freesector(FAR struct smart_struct_s *dev,
   uint16_t  physsector;
   uint16_t  block;
   struct    smart_sect_header_s  header;
+  struct    bioc_discard_s discard;
   size_t    offset;
 
   /* Check if the logical sector is within bounds */
@@ -4963,6 +6716,20 @@ static inline int smart_freesector(FAR struct smart_struct_s *dev,
   smart_update_cache(dev, logicalsector, 0xFFFF);
 #endif
 
+  /* The data following the sector header is no longer needed.  Let the MTD
+   * driver know in case it still holds some of it in a write buffer.
+   */
+
+  if (dev->mtdBlksPerSector > 1)
+    {
+      discard.bd_startsector = physsector * dev->mtdBlksPerSector + 1;
+      discard.bd_nsectors    = dev->mtdBlksPerSector - 1;
+      discard.bd_zeroed      = false;
+
+      (void)MTD_IOCTL(dev->mtd, MTDIOC_DISCARD,
+                      (unsigned long)((uintptr_t)&discard));
+    }
+
   /* If this block has only released blocks, then erase it */
 
   smart_erase_block_if_empty(dev, block, FALSE);
@@ -4973,6 +6740,201 @@ errout:
 }
 #endif /* CONFIG_FS_WRITABLE */
 
+/****************************************************************************
+ * Name: smart_map_writechunk
+ *
+ * Description: Writes the dirty cache entries that belong to one map chunk
+ *              to the map checkpoint, allocating the chunk's logical sector
+ *              when it is first needed.  The entries are clean afterwards
+ *              even if the write fails; the map only holds hints.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_MTD_SMART_MAP_CHECKPOINT
+static int smart_map_writechunk(FAR struct smart_struct_s *dev,
+                                uint16_t chunk)
+{
+  struct    smart_read_write_s req;
+  FAR struct smart_cache_s *entry;
+  FAR uint8_t *buffer;
+  FAR uint16_t *map;
+  uint16_t  first;
+  uint16_t  x;
+  int       ret;
+
+#ifdef CONFIG_MTD_SMART_MOUNT_CHECKPOINT
+  ret = smart_ckpt_modify(dev);
+  if (ret < 0)
+    {
+      return ret;
+    }
+#endif
+
+  buffer = (FAR uint8_t *) kmm_malloc(SMART_MAP_HDRSIZE +
+                                      dev->mapentries * sizeof(uint16_t));
+  if (buffer == NULL)
+    {
+      return -ENOMEM;
+    }
+
+  map = (FAR uint16_t *) &buffer[SMART_MAP_HDRSIZE];
+  first = chunk * dev->mapentries;
+
+  req.logsector = dev->mapfirst + chunk;
+  req.offset = 0;
+  req.count = SMART_MAP_HDRSIZE + dev->mapentries * sizeof(uint16_t);
+  req.buffer = buffer;
+
+  /* Lets smart_allocsector hand out the chunk's logical sector */
+
+  dev->mapbusy = true;
+
+  /* Read the current chunk, or start a new one */
+
+  ret = -ENOENT;
+  if (dev->mapdir[chunk] != 0xFFFF)
+    {
+      ret = smart_readsector(dev, (unsigned long) &req);
+    }
+
+  if (ret < 0 || buffer[0] != SMART_MAP_SIG1 || buffer[1] != SMART_MAP_SIG2)
+    {
+      memset(buffer, 0xFF, req.count);
+      buffer[0] = SMART_MAP_SIG1;
+      buffer[1] = SMART_MAP_SIG2;
+      buffer[2] = chunk & 0xFF;
+      buffer[3] = chunk >> 8;
+    }
+
+  if (dev->mapdir[chunk] == 0xFFFF)
+    {
+      ret = smart_allocsector(dev, req.logsector);
+      if (ret != req.logsector)
+        {
+          if (ret >= 0)
+            {
+              /* Should not happen:  somebody else holds the sector */
+
+              smart_freesector(dev, ret);
+              ret = -EEXIST;
+            }
+
+          goto errout;
+        }
+    }
+
+  /* Merge the dirty entries of this chunk */
+
+  for (x = 0; x < SMART_CACHE_SLOTS; x++)
+    {
+      entry = &dev->sCache[x];
+      if (entry->logical != SMART_CACHE_EMPTY &&
+          (entry->flags & SMART_CACHE_DIRTY) != 0 &&
+          entry->logical >= first &&
+          entry->logical - first < dev->mapentries)
+        {
+          map[entry->logical - first] = entry->physical;
+          entry->flags &= ~SMART_CACHE_DIRTY;
+          dev->cache_dirty--;
+        }
+    }
+
+  ret = smart_writesector(dev, (unsigned long) &req);
+
+errout:
+  dev->mapbusy = false;
+  kmm_free(buffer);
+  return ret;
+}
+#endif
+
+/****************************************************************************
+ * Name: smart_map_flush
+ *
+ * Description: Writes dirty cache entries to the map checkpoint until no
+ *              more than target of them are left, starting with the chunk
+ *              that collects the most so that every chunk write counts.
+ *              Only called at the start of a request, when writing a chunk
+ *              can not disturb an operation in progress.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_MTD_SMART_MAP_CHECKPOINT
+static int smart_map_flush(FAR struct smart_struct_s *dev, uint16_t target)
+{
+  FAR struct smart_cache_s *entry;
+  FAR uint16_t *counts;
+  uint16_t  chunk;
+  uint16_t  best = 0;
+  uint16_t  x;
+  int       ret = OK;
+
+  if (!dev->mapvalid || dev->cache_dirty <= target)
+    {
+      return OK;
+    }
+
+  counts = (FAR uint16_t *) kmm_malloc(dev->mapchunks * sizeof(uint16_t));
+  if (counts == NULL)
+    {
+      return -ENOMEM;
+    }
+
+  while (dev->cache_dirty > target)
+    {
+      /* Count the dirty entries per chunk */
+
+      memset(counts, 0, dev->mapchunks * sizeof(uint16_t));
+      best = 0;
+
+      for (x = 0; x < SMART_CACHE_SLOTS; x++)
+        {
+          entry = &dev->sCache[x];
+          if (entry->logical != SMART_CACHE_EMPTY &&
+              (entry->flags & SMART_CACHE_DIRTY) != 0)
+            {
+              chunk = entry->logical / dev->mapentries;
+              if (++counts[chunk] > counts[best])
+                {
+                  best = chunk;
+                }
+            }
+        }
+
+      if (counts[best] == 0)
+        {
+          break;
+        }
+
+      ret = smart_map_writechunk(dev, best);
+      if (ret < 0)
+        {
+          /* Give up on this batch.  Lookups fall back to scanning for the
+           * sectors whose new location was lost.
+           */
+
+          fdbg("Error %d writing map chunk %d\n", -ret, best);
+          for (x = 0; x < SMART_CACHE_SLOTS; x++)
+            {
+              dev->sCache[x].flags &= ~SMART_CACHE_DIRTY;
+            }
+
+          break;
+        }
+    }
+
+  /* The count can only be off after a failure, but keep it consistent */
+
+  if (ret < 0 || counts[best] == 0)
+    {
+      dev->cache_dirty = 0;
+    }
+
+  kmm_free(counts);
+  return ret < 0 ? ret : OK;
+}
+#endif
+
 /****************************************************************************
  * Name: smart_ioctl
  *
@@ -4998,6 +6960,39 @@ static int smart_ioctl(FAR struct inode *inode, int cmd, unsigned long arg)
   dev = (FAR struct smart_struct_s *)inode->i_private;
 #endif
 
+  smart_semtake(dev);
+
+#ifdef CONFIG_MTD_SMART_BGGC
+  /* Remember when the device was last busy */
+
+  dev->gclast = clock_systimer();
+#endif
+
+#ifdef CONFIG_MTD_SMART_MAP_CHECKPOINT
+  /* Write back some of the mappings the map checkpoint is missing before
+   * they have to be dropped from the cache.
+   */
+
+  if (dev->cache_dirty > SMART_MAP_DIRTY_HIGH)
+    {
+      (void)smart_map_flush(dev, SMART_MAP_DIRTY_LOW);
+    }
+#endif
+
+#ifdef CONFIG_MTD_SMART_MOUNT_CHECKPOINT
+  /* Requests that change the volume make the mount checkpoint stale */
+
+  if (cmd == BIOC_LLFORMAT || cmd == BIOC_ALLOCSECT ||
+      cmd == BIOC_FREESECT || cmd == BIOC_WRITESECT)
+    {
+      ret = smart_ckpt_modify(dev);
+      if (ret < 0)
+        {
+          goto ok_out;
+        }
+    }
+#endif
+
   /* Process the ioctl's we care about first, pass any we don't respond
    * to directly to the underlying MTD device.
    */
@@ -5014,7 +7009,8 @@ static int smart_ioctl(FAR struct inode *inode, int cmd, unsigned long arg)
       if (arg == 0)
         {
           fdbg("ERROR: BIOC_XIPBASE argument is NULL\n");
-          return -EINVAL;
+          ret = -EINVAL;
+          goto ok_out;
         }
 #endif
 
@@ -5081,6 +7077,37 @@ static int smart_ioctl(FAR struct inode *inode, int cmd, unsigned long arg)
       goto ok_out;
 #endif /* CONFIG_FS_WRITABLE */
 
+#if defined(CONFIG_MTD_SMART_MAP_CHECKPOINT) || \
+    defined(CONFIG_MTD_SMART_MOUNT_CHECKPOINT)
+    case BIOC_FLUSH:
+      ret = OK;
+
+#ifdef CONFIG_MTD_SMART_MAP_CHECKPOINT
+      /* Bring the map checkpoint up to date */
+
+      ret = smart_map_flush(dev, 0);
+#endif
+#ifdef CONFIG_MTD_SMART_MOUNT_CHECKPOINT
+      /* Then save the state of the volume for the next mount */
+
+      if (ret == OK)
+        {
+          ret = smart_ckpt_write(dev);
+        }
+#endif
+
+      goto ok_out;
+#endif
+
+#ifdef CONFIG_MTD_SMART_BGGC
+    case BIOC_GCCTRL:
+
+      /* Query, tune or run background garbage collection */
+
+      ret = smart_gc_control(dev, (FAR struct smart_gcctrl_s *) arg);
+      goto ok_out;
+#endif
+
 #if defined(CONFIG_FS_PROCFS) && !defined(CONFIG_FS_PROCFS_EXCLUDE_SMARTFS)
     case BIOC_GETPROCFSD:
 
@@ -5149,6 +7176,25 @@ static int smart_ioctl(FAR struct inode *inode, int cmd, unsigned long arg)
     }
 
 ok_out:
+#if defined(CONFIG_MTD_SMART_MOUNT_CHECKPOINT) && \
+    CONFIG_MTD_SMART_CHECKPOINT_INTERVAL > 0
+  /* Refresh the checkpoint now and then, so that a volume that loses power
+   * while it is idle still mounts without a full scan.
+   */
+
+  if (dev->ckptmods >= CONFIG_MTD_SMART_CHECKPOINT_INTERVAL)
+    {
+      (void)smart_ckpt_write(dev);
+    }
+#endif
+
+#ifdef CONFIG_MTD_SMART_BGGC
+  /* Collect in the background once the device has been idle for a while */
+
+  smart_gc_schedule(dev);
+#endif
+
+  smart_semgive(dev);
   return ret;
 }
 
@@ -5217,6 +7263,12 @@ int smart_initialize(int minor, FAR struct mtd_dev_s *mtd, FAR const char *partn
           goto errout;
         }
 
+#ifdef CONFIG_MTD_SMART_MOUNT_CHECKPOINT
+      /* Keep the checkpoint copies out of the volume */
+
+      smart_ckpt_reserve(dev);
+#endif
+
       /* Set the sector size to the default for now */
 
 #ifndef CONFIG_MTD_SMART_MINIMIZE_RAM
@@ -5224,6 +7276,9 @@ int smart_initialize(int minor, FAR struct mtd_dev_s *mtd, FAR const char *partn
 #else
       dev->sCache = NULL;
       dev->sBitMap = NULL;
+#ifdef CONFIG_MTD_SMART_MAP_CHECKPOINT
+      dev->mapdir = NULL;
+#endif
 #endif
       dev->rwbuffer = NULL;
 #ifdef CONFIG_MTD_SMART_SECTOR_ERASE_DEBUG
@@ -5234,6 +7289,15 @@ int smart_initialize(int minor, FAR struct mtd_dev_s *mtd, FAR const char *partn
 #endif
 #ifdef CONFIG_MTD_SMART_ENABLE_CRC
       dev->allocsector = NULL;
+#endif
+#ifdef CONFIG_MTD_SMART_BGGC
+      sem_init(&dev->exclsem, 0, 1);
+      dev->gcwork.worker = NULL;
+      dev->gcstamp = NULL;
+      dev->gclast = 0;
+      dev->gccollected = 0;
+      dev->gcidle = CONFIG_MTD_SMART_BGGC_IDLE;
+      dev->gcenable = true;
 #endif
       dev->sectorsize = 0;
       ret = smart_setsectorsize(dev, CONFIG_MTD_SMART_SECTOR_SIZE);
@@ -5348,6 +7412,9 @@ errout:
 #ifdef CONFIG_MTD_SMART_WEAR_LEVEL
   smart_free(dev, dev->wearstatus);
 #endif
+#ifdef CONFIG_MTD_SMART_BGGC
+  smart_free(dev, dev->gcstamp);
+#endif
 #ifdef CONFIG_MTD_SMART_SECTOR_ERASE_DEBUG
   smart_free(dev, dev->erasecounts);
 #endif
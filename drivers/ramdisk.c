@@ -50,6 +50,7 @@
 #include <errno.h>
 
 #include <nuttx/kmalloc.h>
+#include <nuttx/blkqueue.h>
 #include <nuttx/fs/fs.h>
 #include <nuttx/fs/ramdisk.h>
 
@@ -88,6 +89,9 @@ struct rd_struct_s
 #else
   FAR const uint8_t *rd_buffer; /* ROM disk backup memory */
 #endif
+#ifdef CONFIG_RAMDISK_BLKQUEUE
+  struct blkqueue_s rd_blkq;    /* Block request queue */
+#endif
 };
 
 /****************************************************************************
@@ -101,9 +105,13 @@ static int     rd_open(FAR struct inode *inode);
 static int     rd_close(FAR struct inode *inode);
 #endif
 
+static ssize_t rd_readsectors(FAR void *arg, FAR uint8_t *buffer,
+                 off_t start_sector, size_t nsectors);
 static ssize_t rd_read(FAR struct inode *inode, FAR unsigned char *buffer,
                  size_t start_sector, unsigned int nsectors);
 #ifdef CONFIG_FS_WRITABLE
+static ssize_t rd_writesectors(FAR void *arg, FAR const uint8_t *buffer,
+                 off_t start_sector, size_t nsectors);
 static ssize_t rd_write(FAR struct inode *inode,
                  FAR const unsigned char *buffer, size_t start_sector,
                  unsigned int nsectors);
@@ -171,6 +179,10 @@ static void rd_destroy(FAR struct rd_struct_s *dev)
     }
 #endif
 
+#ifdef CONFIG_RAMDISK_BLKQUEUE
+  blkq_uninitialize(&dev->rd_blkq);
+#endif
+
   /* And free the block driver itself */
 
   kmm_free(dev);
@@ -244,19 +256,16 @@ static int rd_close(FAR struct inode *inode)
 #endif
 
 /****************************************************************************
- * Name: rd_read
+ * Name: rd_readsectors
  *
- * Description:  Read the specified number of sectors
+ * Description:  Copy the specified sectors out of the RAM disk
  *
  ****************************************************************************/
 
-static ssize_t rd_read(FAR struct inode *inode, unsigned char *buffer,
-                       size_t start_sector, unsigned int nsectors)
+static ssize_t rd_readsectors(FAR void *arg, FAR uint8_t *buffer,
+                              off_t start_sector, size_t nsectors)
 {
-  FAR struct rd_struct_s *dev;
-
-  DEBUGASSERT(inode && inode->i_private);
-  dev = (FAR struct rd_struct_s *)inode->i_private;
+  FAR struct rd_struct_s *dev = (FAR struct rd_struct_s *)arg;
 
   fvdbg("sector: %d nsectors: %d sectorsize: %d\n",
         start_sector, dev->rd_sectsize, nsectors);
@@ -278,20 +287,39 @@ static ssize_t rd_read(FAR struct inode *inode, unsigned char *buffer,
 }
 
 /****************************************************************************
- * Name: rd_write
+ * Name: rd_read
  *
- * Description: Write the specified number of sectors
+ * Description:  Read the specified number of sectors
  *
  ****************************************************************************/
 
-#ifdef CONFIG_FS_WRITABLE
-static ssize_t rd_write(FAR struct inode *inode, const unsigned char *buffer,
-                        size_t start_sector, unsigned int nsectors)
+static ssize_t rd_read(FAR struct inode *inode, unsigned char *buffer,
+                       size_t start_sector, unsigned int nsectors)
 {
-  struct rd_struct_s *dev;
+  FAR struct rd_struct_s *dev;
 
   DEBUGASSERT(inode && inode->i_private);
-  dev = (struct rd_struct_s *)inode->i_private;
+  dev = (FAR struct rd_struct_s *)inode->i_private;
+
+#ifdef CONFIG_RAMDISK_BLKQUEUE
+  return blkq_read(&dev->rd_blkq, start_sector, nsectors, buffer);
+#else
+  return rd_readsectors(dev, buffer, start_sector, nsectors);
+#endif
+}
+
+/****************************************************************************
+ * Name: rd_writesectors
+ *
+ * Description: Copy the specified sectors into the RAM disk
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_FS_WRITABLE
+static ssize_t rd_writesectors(FAR void *arg, FAR const uint8_t *buffer,
+                               off_t start_sector, size_t nsectors)
+{
+  FAR struct rd_struct_s *dev = (FAR struct rd_struct_s *)arg;
 
   fvdbg("sector: %d nsectors: %d sectorsize: %d\n",
         start_sector, dev->rd_sectsize, nsectors);
@@ -317,6 +345,30 @@ static ssize_t rd_write(FAR struct inode *inode, const unsigned char *buffer,
 }
 #endif
 
+/****************************************************************************
+ * Name: rd_write
+ *
+ * Description: Write the specified number of sectors
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_FS_WRITABLE
+static ssize_t rd_write(FAR struct inode *inode, const unsigned char *buffer,
+                        size_t start_sector, unsigned int nsectors)
+{
+  struct rd_struct_s *dev;
+
+  DEBUGASSERT(inode && inode->i_private);
+  dev = (struct rd_struct_s *)inode->i_private;
+
+#ifdef CONFIG_RAMDISK_BLKQUEUE
+  return blkq_write(&dev->rd_blkq, start_sector, nsectors, buffer);
+#else
+  return rd_writesectors(dev, buffer, start_sector, nsectors);
+#endif
+}
+#endif
+
 /****************************************************************************
  * Name: rd_geometry
  *
@@ -359,7 +411,7 @@ static int rd_geometry(FAR struct inode *inode, struct geometry *geometry)
  * Name: rd_ioctl
  *
  * Description:
- *   Return device geometry
+ *   Return the base address of the RAM disk or discard sectors
  *
  ****************************************************************************/
 
@@ -367,21 +419,51 @@ static int rd_ioctl(FAR struct inode *inode, int cmd, unsigned long arg)
 {
   FAR struct rd_struct_s *dev;
   FAR void **ppv = (void**)((uintptr_t)arg);
+#ifdef CONFIG_FS_WRITABLE
+  FAR struct bioc_discard_s *discard;
+#endif
 
   fvdbg("Entry\n");
 
-  /* Only one ioctl command is supported */
-
   DEBUGASSERT(inode && inode->i_private);
+  dev = (FAR struct rd_struct_s *)inode->i_private;
+
   if (cmd == BIOC_XIPBASE && ppv)
     {
-      dev  = (FAR struct rd_struct_s *)inode->i_private;
       *ppv = (FAR void *)dev->rd_buffer;
 
       fvdbg("ppv: %p\n", *ppv);
       return OK;
     }
 
+#ifdef CONFIG_FS_WRITABLE
+  /* Discarded sectors are simply cleared */
+
+  else if (cmd == BIOC_DISCARD && arg != 0)
+    {
+      discard = (FAR struct bioc_discard_s *)((uintptr_t)arg);
+
+      if (!RDFLAG_IS_WRENABLED(dev->rd_flags))
+        {
+          return -EACCES;
+        }
+      else if (discard->bd_startsector >= dev->rd_nsectors ||
+               discard->bd_nsectors >
+               dev->rd_nsectors - discard->bd_startsector)
+        {
+          return -EFBIG;
+        }
+
+      fvdbg("sector: %d nsectors: %d\n",
+            discard->bd_startsector, discard->bd_nsectors);
+
+      memset(&dev->rd_buffer[discard->bd_startsector * dev->rd_sectsize], 0,
+             discard->bd_nsectors * dev->rd_sectsize);
+      discard->bd_zeroed = true;
+      return OK;
+    }
+#endif
+
   return -ENOTTY;
 }
 
@@ -478,6 +560,27 @@ int romdisk_register(int minor, uint8_t *buffer, uint32_t nsectors,
       dev->rd_flags        = rdflags & RDFLAG_USER;
 #endif
 
+#ifdef CONFIG_RAMDISK_BLKQUEUE
+      /* Set up the block request queue */
+
+      dev->rd_blkq.blocksize = sectsize;
+      dev->rd_blkq.nblocks   = nsectors;
+      dev->rd_blkq.maxblocks = CONFIG_RAMDISK_BLKQUEUE_MAXBLOCKS;
+      dev->rd_blkq.dev       = dev;
+      dev->rd_blkq.read      = rd_readsectors;
+#ifdef CONFIG_FS_WRITABLE
+      dev->rd_blkq.write     = rd_writesectors;
+#endif
+
+      ret = blkq_initialize(&dev->rd_blkq);
+      if (ret < 0)
+        {
+          fdbg("blkq_initialize failed: %d\n", -ret);
+          kmm_free(dev);
+          return ret;
+        }
+#endif
+
       /* Create a ramdisk device name */
 
       snprintf(devname, 16, "/dev/ram%d", minor);
@@ -488,6 +591,9 @@ int romdisk_register(int minor, uint8_t *buffer, uint32_t nsectors,
       if (ret < 0)
         {
           fdbg("register_blockdriver failed: %d\n", -ret);
+#ifdef CONFIG_RAMDISK_BLKQUEUE
+          blkq_uninitialize(&dev->rd_blkq);
+#endif
           kmm_free(dev);
         }
     }
@@ -70,6 +70,14 @@
 #  define CONFIG_DRVR_WRDELAY 350
 #endif
 
+/* Statistics */
+
+#ifdef CONFIG_DRVR_RWBSTATS
+#  define rwb_stat(r,f,n) ((r)->stats.f += (n))
+#else
+#  define rwb_stat(r,f,n)
+#endif
+
 /****************************************************************************
  * Private Types
  ****************************************************************************/
@@ -133,6 +141,23 @@ static inline bool rwb_overlap(off_t blockstart1, size_t nblocks1,
     }
 }
 
+/****************************************************************************
+ * Name: rwb_segbuffer
+ *
+ * Description:
+ *   Return the address of the first block of a write buffer segment.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_DRVR_WRITEBUFFER
+static inline FAR uint8_t *rwb_segbuffer(FAR struct rwbuffer_s *rwb,
+                                         FAR struct rwb_wrsegment_s *seg)
+{
+  size_t index = seg - rwb->wrseg;
+  return &rwb->wrbuffer[index * rwb->wrmaxblocks * rwb->blocksize];
+}
+#endif
+
 /****************************************************************************
  * Name: rwb_resetwrbuffer
  ****************************************************************************/
@@ -140,16 +165,24 @@ static inline bool rwb_overlap(off_t blockstart1, size_t nblocks1,
 #ifdef CONFIG_DRVR_WRITEBUFFER
 static inline void rwb_resetwrbuffer(struct rwbuffer_s *rwb)
 {
+  int i;
+
   /* We assume that the caller holds the wrsem */
 
-  rwb->wrnblocks       = 0;
-  rwb->wrblockstart    = (off_t)-1;
-  rwb->wrexpectedblock = (off_t)-1;
+  for (i = 0; i < CONFIG_DRVR_WRSEGMENTS; i++)
+    {
+      rwb->wrseg[i].nblocks    = 0;
+      rwb->wrseg[i].blockstart = (off_t)-1;
+    }
 }
 #endif
 
 /****************************************************************************
- * Name: rwb_wrflush
+ * Name: rwb_segflush
+ *
+ * Description:
+ *   Write the content of one write buffer segment to the media and mark
+ *   the segment unused.
  *
  * Assumptions:
  *   The caller holds the wrsem semaphore.
@@ -157,31 +190,134 @@ static inline void rwb_resetwrbuffer(struct rwbuffer_s *rwb)
  ****************************************************************************/
 
 #ifdef CONFIG_DRVR_WRITEBUFFER
-static void rwb_wrflush(struct rwbuffer_s *rwb)
+static int rwb_segflush(FAR struct rwbuffer_s *rwb,
+                        FAR struct rwb_wrsegment_s *seg)
 {
-  int ret;
+  ssize_t ret = OK;
 
-  fvdbg("Timeout!\n");
-
-  if (rwb->wrnblocks > 0)
+  if (seg->nblocks > 0)
     {
       fvdbg("Flushing: blockstart=0x%08lx nblocks=%d from buffer=%p\n",
-      (long)rwb->wrblockstart, rwb->wrnblocks, rwb->wrbuffer);
+            (long)seg->blockstart, seg->nblocks, rwb_segbuffer(rwb, seg));
 
       /* Flush cache.  On success, the flush method will return the number
        * of blocks written.  Anything other than the number requested is
        * an error.
        */
 
-      ret = rwb->wrflush(rwb->dev, rwb->wrbuffer, rwb->wrblockstart, rwb->wrnblocks);
-      if (ret != rwb->wrnblocks)
+      ret = rwb->wrflush(rwb->dev, rwb_segbuffer(rwb, seg), seg->blockstart,
+                         seg->nblocks);
+      if (ret != seg->nblocks)
         {
           fdbg("ERROR: Error flushing write buffer: %d\n", ret);
+          if (ret >= 0)
+            {
+              ret = -EIO;
+            }
+        }
+      else
+        {
+          rwb_stat(rwb, wrflushes, 1);
+          rwb_stat(rwb, wrblocks, seg->nblocks);
+          ret = OK;
         }
 
-      rwb_resetwrbuffer(rwb);
+      seg->nblocks    = 0;
+      seg->blockstart = (off_t)-1;
     }
 
+  return (int)ret;
+}
+#endif
+
+/****************************************************************************
+ * Name: rwb_wrflush
+ *
+ * Description:
+ *   Flush all write buffer segments.  The segments are written in
+ *   ascending block order so that the media sees one sweep rather than
+ *   jumping back and forth between regions.
+ *
+ * Assumptions:
+ *   The caller holds the wrsem semaphore.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_DRVR_WRITEBUFFER
+static int rwb_wrflush(struct rwbuffer_s *rwb)
+{
+  FAR struct rwb_wrsegment_s *lowest;
+  int result = OK;
+  int ret;
+  int i;
+
+  fvdbg("Timeout!\n");
+
+  for (; ; )
+    {
+      /* Find the buffered segment with the lowest block number */
+
+      lowest = NULL;
+      for (i = 0; i < CONFIG_DRVR_WRSEGMENTS; i++)
+        {
+          if (rwb->wrseg[i].nblocks > 0 &&
+              (lowest == NULL ||
+               rwb->wrseg[i].blockstart < lowest->blockstart))
+            {
+              lowest = &rwb->wrseg[i];
+            }
+        }
+
+      if (lowest == NULL)
+        {
+          return result;
+        }
+
+      ret = rwb_segflush(rwb, lowest);
+      if (ret < 0)
+        {
+          result = ret;
+        }
+    }
+}
+#endif
+
+/****************************************************************************
+ * Name: rwb_wrflushoverlap
+ *
+ * Description:
+ *   Flush every write buffer segment (other than 'except') that holds any
+ *   of the blocks in the range.
+ *
+ * Assumptions:
+ *   The caller holds the wrsem semaphore.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_DRVR_WRITEBUFFER
+static int rwb_wrflushoverlap(FAR struct rwbuffer_s *rwb, off_t startblock,
+                              size_t nblocks,
+                              FAR struct rwb_wrsegment_s *except)
+{
+  FAR struct rwb_wrsegment_s *seg;
+  int ret;
+  int i;
+
+  for (i = 0; i < CONFIG_DRVR_WRSEGMENTS; i++)
+    {
+      seg = &rwb->wrseg[i];
+      if (seg != except && seg->nblocks > 0 &&
+          rwb_overlap(seg->blockstart, seg->nblocks, startblock, nblocks))
+        {
+          ret = rwb_segflush(rwb, seg);
+          if (ret < 0)
+            {
+              return ret;
+            }
+        }
+    }
+
+  return OK;
 }
 #endif
 
@@ -189,6 +325,7 @@ static void rwb_wrflush(struct rwbuffer_s *rwb)
  * Name: rwb_wrtimeout
  ****************************************************************************/
 
+#ifdef CONFIG_DRVR_WRITEBUFFER
 static void rwb_wrtimeout(FAR void *arg)
 {
   /* The following assumes that the size of a pointer is 4-bytes or less */
@@ -202,14 +339,16 @@ static void rwb_wrtimeout(FAR void *arg)
    */
 
   rwb_semtake(&rwb->wrsem);
-  rwb_wrflush(rwb);
+  (void)rwb_wrflush(rwb);
   rwb_semgive(&rwb->wrsem);
 }
+#endif
 
 /****************************************************************************
  * Name: rwb_wrstarttimeout
  ****************************************************************************/
 
+#ifdef CONFIG_DRVR_WRITEBUFFER
 static void rwb_wrstarttimeout(FAR struct rwbuffer_s *rwb)
 {
   /* CONFIG_DRVR_WRDELAY provides the delay period in milliseconds. CLK_TCK
@@ -219,18 +358,32 @@ static void rwb_wrstarttimeout(FAR struct rwbuffer_s *rwb)
   int ticks = (CONFIG_DRVR_WRDELAY + CLK_TCK/2) / CLK_TCK;
   (void)work_queue(LPWORK, &rwb->work, rwb_wrtimeout, (FAR void *)rwb, ticks);
 }
+#endif
 
 /****************************************************************************
  * Name: rwb_wrcanceltimeout
  ****************************************************************************/
 
+#ifdef CONFIG_DRVR_WRITEBUFFER
 static inline void rwb_wrcanceltimeout(struct rwbuffer_s *rwb)
 {
   (void)work_cancel(LPWORK, &rwb->work);
 }
+#endif
 
 /****************************************************************************
  * Name: rwb_writebuffer
+ *
+ * Description:
+ *   Add blocks to the write buffer.  The blocks go into the segment that
+ *   already holds or immediately precedes them if the segment has room.
+ *   Otherwise a segment is (re)started for them: the full segment that
+ *   they continue, an unused segment or, if there is none, the least
+ *   recently written segment, which is flushed first.
+ *
+ * Assumptions:
+ *   The caller holds the wrsem semaphore and nblocks <= wrmaxblocks.
+ *
  ****************************************************************************/
 
 #ifdef CONFIG_DRVR_WRITEBUFFER
@@ -238,53 +391,117 @@ static ssize_t rwb_writebuffer(FAR struct rwbuffer_s *rwb,
                                off_t startblock, uint32_t nblocks,
                                FAR const uint8_t *wrbuffer)
 {
+  FAR struct rwb_wrsegment_s *target = NULL;
+  FAR struct rwb_wrsegment_s *contig = NULL;
+  FAR struct rwb_wrsegment_s *unused = NULL;
+  FAR struct rwb_wrsegment_s *oldest = NULL;
+  FAR struct rwb_wrsegment_s *seg;
+  off_t endblock = startblock + nblocks;
+  off_t segend;
   int ret;
+  int i;
 
   /* Write writebuffer Logic */
 
   rwb_wrcanceltimeout(rwb);
 
-  /* First: Should we flush out our cache? We would do that if (1) we already
-   * buffering blocks and the next block writing is not in the same sequence,
-   * or (2) the number of blocks would exceed our allocated buffer capacity
-   */
+  /* First: Is there a segment that can take these blocks as they are? */
 
-  if (((startblock != rwb->wrexpectedblock) && (rwb->wrnblocks)) ||
-      ((rwb->wrnblocks + nblocks) > rwb->wrmaxblocks))
+  for (i = 0; i < CONFIG_DRVR_WRSEGMENTS; i++)
     {
-      fvdbg("writebuffer miss, expected: %08x, given: %08x\n",
-            rwb->wrexpectedblock, startblock);
+      seg = &rwb->wrseg[i];
+      if (seg->nblocks == 0)
+        {
+          if (unused == NULL)
+            {
+              unused = seg;
+            }
 
-      /* Flush the write buffer */
+          continue;
+        }
 
-      ret = rwb->wrflush(rwb->dev, rwb->wrbuffer, rwb->wrblockstart, rwb->wrnblocks);
-      if (ret < 0)
+      segend = seg->blockstart + seg->nblocks;
+      if (startblock >= seg->blockstart && startblock <= segend &&
+          endblock <= seg->blockstart + rwb->wrmaxblocks)
         {
-          fdbg("ERROR: Error writing multiple from cache: %d\n", -ret);
-          return ret;
+          target = seg;
+          break;
         }
 
-      rwb_resetwrbuffer(rwb);
+      if (startblock == segend)
+        {
+          contig = seg;
+        }
+
+      if (oldest == NULL || (int32_t)(seg->lastuse - oldest->lastuse) < 0)
+        {
+          oldest = seg;
+        }
     }
 
-  /* writebuffer is empty? Then initialize it */
+  /* Other segments may hold older copies of some of these blocks.  Those
+   * must reach the media first or they could be written over the new data
+   * later.
+   */
+
+  ret = rwb_wrflushoverlap(rwb, startblock, nblocks, target);
+  if (ret < 0)
+    {
+      fdbg("ERROR: Error writing multiple from cache: %d\n", -ret);
+      return ret;
+    }
 
-  if (rwb->wrnblocks == 0)
+  if (target != NULL)
     {
+      /* Count blocks that are replaced before ever reaching the media */
+
+      segend = target->blockstart + target->nblocks;
+      if (segend > startblock)
+        {
+          rwb_stat(rwb, wrcoalesced,
+                   (endblock < segend ? endblock : segend) - startblock);
+        }
+
+      rwb_stat(rwb, wrhits, 1);
+    }
+  else
+    {
+      /* No.  Flush the full segment that these blocks continue, or take an
+       * unused segment, or flush the least recently written one.
+       */
+
+      fvdbg("writebuffer miss, given: %08x\n", startblock);
+
+      target = contig != NULL ? contig : unused != NULL ? unused : oldest;
+      DEBUGASSERT(target != NULL);
+
+      ret = rwb_segflush(rwb, target);
+      if (ret < 0)
+        {
+          fdbg("ERROR: Error writing multiple from cache: %d\n", -ret);
+          return ret;
+        }
+
       fvdbg("Fresh cache starting at block: 0x%08x\n", startblock);
-      rwb->wrblockstart = startblock;
+      target->blockstart = startblock;
     }
 
   /* Add data to cache */
 
   fvdbg("writebuffer: copying %d bytes from %p to %p\n",
         nblocks * rwb->blocksize, wrbuffer,
-        &rwb->wrbuffer[rwb->wrnblocks * rwb->blocksize]);
-  memcpy(&rwb->wrbuffer[rwb->wrnblocks * rwb->blocksize],
+        rwb_segbuffer(rwb, target) +
+        (startblock - target->blockstart) * rwb->blocksize);
+  memcpy(rwb_segbuffer(rwb, target) +
+         (startblock - target->blockstart) * rwb->blocksize,
          wrbuffer, nblocks * rwb->blocksize);
 
-  rwb->wrnblocks      += nblocks;
-  rwb->wrexpectedblock = rwb->wrblockstart + rwb->wrnblocks;
+  if (endblock - target->blockstart > target->nblocks)
+    {
+      target->nblocks = endblock - target->blockstart;
+    }
+
+  target->lastuse = ++rwb->wrseqno;
   rwb_wrstarttimeout(rwb);
   return nblocks;
 }
@@ -340,10 +557,18 @@ rwb_bufferread(struct rwbuffer_s *rwb,  off_t startblock,
 
 /****************************************************************************
  * Name: rwb_rhreload
+ *
+ * Description:
+ *   Reload the read-ahead buffer starting at 'startblock'.  'nneeded' is
+ *   the number of blocks the caller still needs.  A random access loads
+ *   only those blocks; while a sequential stream continues, twice the
+ *   stream length is loaded, up to the size of the read-ahead buffer.
+ *
  ****************************************************************************/
 
 #ifdef CONFIG_DRVR_READAHEAD
-static int rwb_rhreload(struct rwbuffer_s *rwb, off_t startblock)
+static int rwb_rhreload(struct rwbuffer_s *rwb, off_t startblock,
+                        size_t nneeded)
 {
   off_t  endblock;
   size_t nblocks;
@@ -356,11 +581,24 @@ static int rwb_rhreload(struct rwbuffer_s *rwb, off_t startblock)
       return -ESPIPE;
     }
 
+  /* Size the read-ahead to the sequential stream */
+
+  nblocks = 2 * rwb->rhstream;
+  if (nblocks < nneeded)
+    {
+      nblocks = nneeded;
+    }
+
+  if (nblocks > rwb->rhmaxblocks)
+    {
+      nblocks = rwb->rhmaxblocks;
+    }
+
   /* Get the block number +1 of the last block that will fit in the
    * read-ahead buffer
    */
 
-  endblock = startblock + rwb->rhmaxblocks;
+  endblock = startblock + nblocks;
 
   /* Make sure that we don't read past the end of the device */
 
@@ -385,6 +623,9 @@ static int rwb_rhreload(struct rwbuffer_s *rwb, off_t startblock)
       rwb->rhnblocks    = nblocks;
       rwb->rhblockstart = startblock;
 
+      rwb_stat(rwb, rhreloads, 1);
+      rwb_stat(rwb, rhblocks, nblocks);
+
       /* The return value is not the number of blocks we asked to be loaded. */
 
       return nblocks;
@@ -403,124 +644,148 @@ static int rwb_rhreload(struct rwbuffer_s *rwb, off_t startblock)
  ****************************************************************************/
 
 #if defined(CONFIG_DRVR_WRITEBUFFER) && defined(CONFIG_DRVR_INVALIDATE)
-int rwb_invalidate_writebuffer(FAR struct rwbuffer_s *rwb,
-                               off_t startblock, size_t blockcount)
+static int rwb_seginvalidate(FAR struct rwbuffer_s *rwb,
+                             FAR struct rwb_wrsegment_s *seg,
+                             off_t startblock, size_t blockcount)
 {
+  FAR uint8_t *segbuffer = rwb_segbuffer(rwb, seg);
+  off_t wrbend;
+  off_t invend;
   int ret;
 
-  if (rwb->wrmaxblocks > 0 && rwb->wrnblocks > 0)
+  /* Now there are five cases:
+   *
+   * 1. We invalidate nothing
+   */
+
+  wrbend = seg->blockstart + seg->nblocks;
+  invend = startblock + blockcount;
+
+  if (seg->blockstart >= invend || wrbend <= startblock)
     {
-      off_t wrbend;
-      off_t invend;
+      ret = OK;
+    }
 
-      fvdbg("startblock=%d blockcount=%p\n", startblock, blockcount);
+  /* 2. We invalidate the entire write buffer segment. */
 
-      rwb_semtake(&rwb->wrsem);
+  else if (seg->blockstart >= startblock && wrbend <= invend)
+    {
+      seg->nblocks = 0;
+      ret = OK;
+    }
 
-      /* Now there are five cases:
-       *
-       * 1. We invalidate nothing
-       */
+  /* We are going to invalidate a subset of the write buffer segment.  Three
+   * more cases to consider:
+   *
+   * 3. We invalidate a portion in the middle of the segment
+   */
 
-      wrbend = rwb->wrblockstart + rwb->wrnblocks;
-      invend = startblock + blockcount;
+  else if (seg->blockstart < startblock && wrbend > invend)
+    {
+      uint8_t *src;
+      off_t    block;
+      off_t    offset;
+      size_t   nblocks;
 
-      if (rwb->wrblockstart > invend || wrbend < startblock)
-        {
-          ret = OK;
-        }
+      /* Write the blocks at the end of the media to hardware */
 
-      /* 2. We invalidate the entire write buffer. */
+      nblocks = wrbend - invend;
+      block   = invend;
+      offset  = block - seg->blockstart;
+      src     = segbuffer + offset * rwb->blocksize;
 
-      else if (rwb->wrblockstart >= startblock && wrbend <= invend)
+      ret = rwb->wrflush(rwb->dev, src, block, nblocks);
+      if (ret < 0)
         {
-          rwb->wrnblocks = 0;
-          ret = OK;
+          fdbg("ERROR: wrflush failed: %d\n", ret);
         }
 
-      /* We are going to invalidate a subset of the write buffer.  Three
-       * more cases to consider:
-       *
-       * 2. We invalidate a portion in the middle of the write buffer
+      /* Keep the blocks at the beginning of the buffer up the
+       * start of the invalidated region.
        */
 
-      else if (rwb->wrblockstart < startblock && wrbend > invend)
+      else
         {
-          uint8_t *src;
-          off_t    block;
-          off_t    offset;
-          size_t   nblocks;
+          seg->nblocks = startblock - seg->blockstart;
+          ret = OK;
+        }
+    }
 
-          /* Write the blocks at the end of the media to hardware */
+  /* 4. We invalidate a portion at the end of the segment */
 
-          nblocks = wrbend - invend;
-          block   = invend;
-          offset  = block - rwb->wrblockstart;
-          src     = rwb->wrbuffer + offset * rwb->blocksize;
+  else if (wrbend > startblock && wrbend <= invend)
+    {
+      seg->nblocks = startblock - seg->blockstart;
+      ret = OK;
+    }
 
-          ret = rwb->wrflush(rwb->dev, src, block, nblocks);
-          if (ret < 0)
-            {
-              fdbg("ERROR: wrflush failed: %d\n", ret);
-            }
+  /* 5. We invalidate a portion at the beginning of the segment */
 
-          /* Keep the blocks at the beginning of the buffer up the
-           * start of the invalidated region.
-           */
-          else
-            {
-              rwb->wrnblocks = startblock - rwb->wrblockstart;
-              ret = OK;
-            }
-        }
+  else /* if (seg->blockstart >= startblock && wrbend > invend) */
+    {
+      uint8_t *src;
+      size_t   ninval;
+      size_t   nkeep;
 
-      /* 3. We invalidate a portion at the end of the write buffer */
+      DEBUGASSERT(seg->blockstart >= startblock && wrbend > invend);
 
-      else if (wrbend > startblock && wrbend <= invend)
-        {
-          rwb->wrnblocks = wrbend - startblock;
-          ret = OK;
-        }
+      /* Copy the data from the uninvalidated region to the beginning
+       * of the segment.
+       *
+       * First calculate the source and destination of the transfer.
+       */
 
-      /* 4. We invalidate a portion at the beginning of the write buffer */
+      ninval = invend - seg->blockstart;
+      src    = segbuffer + ninval * rwb->blocksize;
 
-      else /* if (rwb->wrblockstart >= startblock && wrbend > invend) */
-        {
-          uint8_t *src;
-          size_t   ninval;
-          size_t   nkeep;
+      /* Calculate the number of blocks we are keeping.  We keep
+       * the ones that we don't invalidate.
+       */
 
-          DEBUGASSERT(rwb->wrblockstart >= startblock && wrbend > invend);
+      nkeep  = seg->nblocks - ninval;
 
-          /* Copy the data from the uninvalidated region to the beginning
-           * of the write buffer.
-           *
-           * First calculate the source and destination of the transfer.
-           */
+      /* Then move the data that we are keeping to the beginning
+       * the segment.  The regions may overlap.
+       */
 
-          ninval = invend - rwb->wrblockstart;
-          src    = rwb->wrbuffer + ninval * rwb->blocksize;
+      memmove(segbuffer, src, nkeep * rwb->blocksize);
 
-          /* Calculate the number of blocks we are keeping.  We keep
-           * the ones that we don't invalidate.
-           */
+      /* Update the block info.  The first block is now the one just
+       * after the invalidation region and the number buffered blocks
+       * is the number that we kept.
+       */
 
-          nkeep  = rwb->wrnblocks - ninval;
+      seg->blockstart = invend;
+      seg->nblocks    = nkeep;
+      ret = OK;
+    }
 
-          /* Then move the data that we are keeping to the beginning
-           * the write buffer.
-           */
+  if (seg->nblocks == 0)
+    {
+      seg->blockstart = (off_t)-1;
+    }
 
-          memcpy(rwb->wrbuffer, src, nkeep * rwb->blocksize);
+  return ret;
+}
 
-          /* Update the block info.  The first block is now the one just
-           * after the invalidation region and the number buffered blocks
-           * is the number that we kept.
-           */
+int rwb_invalidate_writebuffer(FAR struct rwbuffer_s *rwb,
+                               off_t startblock, size_t blockcount)
+{
+  int ret = OK;
+  int i;
 
-          rwb->wrblockstart = invend;
-          rwb->wrnblocks    = nkeep;
-          ret = OK;
+  if (rwb->wrmaxblocks > 0)
+    {
+      fvdbg("startblock=%d blockcount=%p\n", startblock, blockcount);
+
+      rwb_semtake(&rwb->wrsem);
+      for (i = 0; i < CONFIG_DRVR_WRSEGMENTS && ret == OK; i++)
+        {
+          if (rwb->wrseg[i].nblocks > 0)
+            {
+              ret = rwb_seginvalidate(rwb, &rwb->wrseg[i], startblock,
+                                      blockcount);
+            }
         }
 
       rwb_semgive(&rwb->wrsem);
@@ -542,7 +807,7 @@ int rwb_invalidate_writebuffer(FAR struct rwbuffer_s *rwb,
 int rwb_invalidate_readahead(FAR struct rwbuffer_s *rwb,
                                off_t startblock, size_t blockcount)
 {
-  int ret;
+  int ret = OK;
 
   if (rwb->rhmaxblocks > 0 && rwb->rhnblocks > 0)
     {
@@ -594,7 +859,7 @@ int rwb_invalidate_readahead(FAR struct rwbuffer_s *rwb,
 
       else if (rhbend > startblock && rhbend <= invend)
         {
-          rwb->rhnblocks = rhbend - startblock;
+          rwb->rhnblocks = startblock - rwb->rhblockstart;
           ret = OK;
         }
 
@@ -647,6 +912,9 @@ int rwb_initialize(FAR struct rwbuffer_s *rwb)
   DEBUGASSERT(rwb->rhreload != NULL);
   rwb->rhbuffer = NULL;
 #endif
+#ifdef CONFIG_DRVR_RWBSTATS
+  memset(&rwb->stats, 0, sizeof(struct rwb_stats_s));
+#endif
 
 #ifdef CONFIG_DRVR_WRITEBUFFER
   if (rwb->wrmaxblocks > 0)
@@ -660,13 +928,15 @@ int rwb_initialize(FAR struct rwbuffer_s *rwb)
       /* Initialize write buffer parameters */
 
       rwb_resetwrbuffer(rwb);
+      rwb->wrseqno = 0;
 
       /* Allocate the write buffer */
 
       rwb->wrbuffer = NULL;
       if (rwb->wrmaxblocks > 0)
         {
-          allocsize     = rwb->wrmaxblocks * rwb->blocksize;
+          allocsize     = rwb->wrmaxblocks * rwb->blocksize *
+                          CONFIG_DRVR_WRSEGMENTS;
           rwb->wrbuffer = kmm_malloc(allocsize);
           if (!rwb->wrbuffer)
             {
@@ -691,6 +961,8 @@ int rwb_initialize(FAR struct rwbuffer_s *rwb)
       /* Initialize read-ahead buffer parameters */
 
       rwb_resetrhbuffer(rwb);
+      rwb->rhexpected = (off_t)-1;
+      rwb->rhstream   = 0;
 
       /* Allocate the read-ahead buffer */
 
@@ -723,6 +995,11 @@ void rwb_uninitialize(FAR struct rwbuffer_s *rwb)
   if (rwb->wrmaxblocks > 0)
     {
       rwb_wrcanceltimeout(rwb);
+      if (rwb->wrbuffer)
+        {
+          (void)rwb_wrflush(rwb);
+        }
+
       sem_destroy(&rwb->wrsem);
       if (rwb->wrbuffer)
         {
@@ -750,7 +1027,10 @@ void rwb_uninitialize(FAR struct rwbuffer_s *rwb)
 int rwb_read(FAR struct rwbuffer_s *rwb, off_t startblock, uint32_t nblocks,
              FAR uint8_t *rdbuffer)
 {
+#ifdef CONFIG_DRVR_READAHEAD
   uint32_t remaining;
+  bool reloaded;
+#endif
   int ret = OK;
 
   fvdbg("startblock=%ld nblocks=%ld rdbuffer=%p\n",
@@ -758,33 +1038,42 @@ int rwb_read(FAR struct rwbuffer_s *rwb, off_t startblock, uint32_t nblocks,
 
 #ifdef CONFIG_DRVR_WRITEBUFFER
   /* If the new read data overlaps any part of the write buffer, then
-   * flush the write data onto the physical media before reading.  We
-   * could attempt some more exotic handling -- but this simple logic
+   * flush the overlapping segments onto the physical media before reading.
+   * We could attempt some more exotic handling -- but this simple logic
    * is well-suited for simple streaming applications.
    */
 
   if (rwb->wrmaxblocks > 0)
     {
-      /* If the write buffer overlaps the block(s) requested, then flush the
-       * write buffer.
-       */
-
       rwb_semtake(&rwb->wrsem);
-      if (rwb_overlap(rwb->wrblockstart, rwb->wrnblocks, startblock, nblocks))
+      ret = rwb_wrflushoverlap(rwb, startblock, nblocks, NULL);
+      rwb_semgive(&rwb->wrsem);
+
+      if (ret < 0)
         {
-          rwb_wrflush(rwb);
+          return ret;
         }
-
-      rwb_semgive(&rwb->wrsem);
     }
 #endif
 
 #ifdef CONFIG_DRVR_READAHEAD
   if (rwb->rhmaxblocks > 0)
     {
-      /* Loop until we have read all of the requested blocks */
+      /* Track sequential read streams.  The stream length sizes the
+       * read-ahead performed by rwb_rhreload().
+       */
 
       rwb_semtake(&rwb->rhsem);
+      if (startblock != rwb->rhexpected)
+        {
+          rwb->rhstream = 0;
+        }
+
+      rwb->rhexpected = startblock + nblocks;
+
+      /* Loop until we have read all of the requested blocks */
+
+      reloaded = false;
       for (remaining = nblocks; remaining > 0; )
         {
           /* Is there anything in the read-ahead buffer? */
@@ -804,6 +1093,11 @@ int rwb_read(FAR struct rwbuffer_s *rwb, off_t startblock, uint32_t nblocks,
                       rdblocks = remaining;
                     }
 
+                  if (!reloaded)
+                    {
+                      rwb_stat(rwb, rhhits, rdblocks);
+                    }
+
                   /* Then read the data from the read-ahead buffer */
 
                   rwb_bufferread(rwb, startblock, rdblocks, &rdbuffer);
@@ -818,15 +1112,21 @@ int rwb_read(FAR struct rwbuffer_s *rwb, off_t startblock, uint32_t nblocks,
 
           if (remaining > 0)
             {
-              ret = rwb_rhreload(rwb, startblock);
+              ret = rwb_rhreload(rwb, startblock, remaining);
               if (ret < 0)
                 {
                   fdbg("ERROR: Failed to fill the read-ahead buffer: %d\n", ret);
+                  rwb->rhexpected = (off_t)-1;
+                  rwb_semgive(&rwb->rhsem);
                   return ret;
                 }
+
+              reloaded = true;
             }
         }
 
+      rwb->rhstream += nblocks;
+
       /* On success, return the number of blocks that we were requested to
        * read. This is for compatibility with the normal return of a block
        * driver read method
@@ -836,7 +1136,7 @@ int rwb_read(FAR struct rwbuffer_s *rwb, off_t startblock, uint32_t nblocks,
       ret = nblocks;
     }
   else
-#else
+#endif
     {
       /* No read-ahead buffering, (re)load the data directly into
        * the user buffer.
@@ -844,7 +1144,6 @@ int rwb_read(FAR struct rwbuffer_s *rwb, off_t startblock, uint32_t nblocks,
 
       ret = rwb->rhreload(rwb->dev, rdbuffer, startblock, nblocks);
     }
-#endif
 
   return ret;
 }
@@ -882,19 +1181,22 @@ int rwb_write(FAR struct rwbuffer_s *rwb, off_t startblock,
     {
       fvdbg("startblock=%d wrbuffer=%p\n", startblock, wrbuffer);
 
+      rwb_semtake(&rwb->wrsem);
+
       /* Use the block cache unless the buffer size is bigger than block cache */
 
       if (nblocks > rwb->wrmaxblocks)
         {
-          /* First flush the cache */
+          /* First flush any buffered copies of these blocks */
 
-          rwb_semtake(&rwb->wrsem);
-          rwb_wrflush(rwb);
-          rwb_semgive(&rwb->wrsem);
+          ret = rwb_wrflushoverlap(rwb, startblock, nblocks, NULL);
 
           /* Then transfer the data directly to the media */
 
-          ret = rwb->wrflush(rwb->dev, wrbuffer, startblock, nblocks);
+          if (ret >= 0)
+            {
+              ret = rwb->wrflush(rwb->dev, wrbuffer, startblock, nblocks);
+            }
         }
       else
         {
@@ -903,13 +1205,15 @@ int rwb_write(FAR struct rwbuffer_s *rwb, off_t startblock,
           ret = rwb_writebuffer(rwb, startblock, nblocks, wrbuffer);
         }
 
+      rwb_semgive(&rwb->wrsem);
+
       /* On success, return the number of blocks that we were requested to
        * write.  This is for compatibility with the normal return of a block
        * driver write method
        */
     }
   else
-#else
+#endif
     {
       /* No write buffer.. just pass the write operation through via the
        * flush callback.
@@ -918,10 +1222,34 @@ int rwb_write(FAR struct rwbuffer_s *rwb, off_t startblock,
       ret = rwb->wrflush(rwb->dev, wrbuffer, startblock, nblocks);
     }
 
-#endif
+  return ret;
+}
+
+/****************************************************************************
+ * Name: rwb_flush
+ *
+ * Description:
+ *   Write all buffered data to the media now rather than waiting for the
+ *   write buffer timeout.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_DRVR_WRITEBUFFER
+int rwb_flush(FAR struct rwbuffer_s *rwb)
+{
+  int ret = OK;
+
+  if (rwb->wrmaxblocks > 0)
+    {
+      rwb_semtake(&rwb->wrsem);
+      rwb_wrcanceltimeout(rwb);
+      ret = rwb_wrflush(rwb);
+      rwb_semgive(&rwb->wrsem);
+    }
 
   return ret;
 }
+#endif
 
 /****************************************************************************
  * Name: rwb_readbytes
@@ -62,6 +62,7 @@
 #include <nuttx/kmalloc.h>
 #include <nuttx/fs/fs.h>
 #include <nuttx/fs/fat.h>
+#include <nuttx/fs/ioctl.h>
 #include <nuttx/fs/dirent.h>
 
 #include "inode/inode.h"
@@ -349,6 +350,10 @@ static int fat_open(FAR struct file *filep, FAR const char *relpath,
   ff->ff_sectorsincluster = fs->fs_fatsecperclus;
   ff->ff_size             = DIR_GETFILESIZE(direntry);
 
+  /* The start cluster is the first entry in the cluster map */
+
+  fat_mapadd(ff, 0, ff->ff_startcluster);
+
   /* Attach the private date to the struct file instance */
 
   filep->f_priv = ff;
@@ -424,6 +429,17 @@ static int fat_close(FAR struct file *filep)
        * the file even when there is healthy mount.
        */
 
+      /* Release any clusters reserved with FIOC_FALLOCATE that were not
+       * used.
+       */
+
+      if ((ff->ff_bflags & FFBUFF_PREALLOC) != 0)
+        {
+          fat_semtake(fs);
+          (void)fat_trimchain(fs, ff);
+          fat_semgive(fs);
+        }
+
       /* Synchronize the file buffers and disk content; update times */
 
       ret = fat_sync(filep);
@@ -460,6 +476,10 @@ static int fat_close(FAR struct file *filep)
       fat_io_free(ff->ff_buffer, fs->fs_hwsectorsize);
     }
 
+  /* Free the cluster map */
+
+  fat_mapfree(ff);
+
   /* Then free the file structure itself. */
 
   kmm_free(ff);
@@ -572,7 +592,7 @@ static ssize_t fat_read(FAR struct file *filep, FAR char *buffer,
         {
           /* Find the next cluster in the FAT. */
 
-          cluster = fat_getcluster(fs, ff->ff_currentcluster);
+          cluster = fat_nextcluster(fs, ff, filep->f_pos, false);
           if (cluster < 2 || cluster >= fs->fs_nclusters)
             {
               ret = -EINVAL; /* Not the right error */
@@ -602,15 +622,19 @@ fat_read_restart:
            * buffer without using our tiny read buffer.
            *
            * Limit the number of sectors that we read on this time
-           * through the loop to the remaining contiguous sectors
-           * in this cluster
+           * through the loop to the remaining contiguous sectors.
+           * That is the rest of this cluster plus any physically
+           * adjacent clusters that follow it in the chain.
            */
 
-          if (nsectors > ff->ff_sectorsincluster)
+          ret = fat_contiguous(fs, ff, filep->f_pos, nsectors, false);
+          if (ret < 0)
             {
-              nsectors = ff->ff_sectorsincluster;
+              goto errout_with_semaphore;
             }
 
+          nsectors = ret;
+
           /* We are not sure of the state of the file buffer so
            * the safest thing to do is just invalidate it
            */
@@ -785,6 +809,8 @@ static ssize_t fat_write(FAR struct file *filep, FAR const char *buffer,
           ff->ff_startcluster     = fat_createchain(fs);
           ff->ff_currentcluster   = ff->ff_startcluster;
           ff->ff_sectorsincluster = fs->fs_fatsecperclus;
+
+          fat_mapadd(ff, 0, ff->ff_startcluster);
         }
 
       /* The current sector can then be determined from the currentcluster
@@ -818,7 +844,7 @@ static ssize_t fat_write(FAR struct file *filep, FAR const char *buffer,
            * move the file position back from the end of the file)
            */
 
-          cluster = fat_extendchain(fs, ff->ff_currentcluster);
+          cluster = fat_nextcluster(fs, ff, filep->f_pos, true);
 
           /* Verify the cluster number */
 
@@ -855,15 +881,19 @@ fat_write_restart:
            * buffer without using our tiny read buffer.
            *
            * Limit the number of sectors that we write on this time
-           * through the loop to the remaining contiguous sectors
-           * in this cluster
+           * through the loop to the remaining contiguous sectors.
+           * That is the rest of this cluster plus any physically
+           * adjacent clusters that follow it in the chain.
            */
 
-          if (nsectors > ff->ff_sectorsincluster)
+          ret = fat_contiguous(fs, ff, filep->f_pos, nsectors, true);
+          if (ret < 0)
             {
-              nsectors = ff->ff_sectorsincluster;
+              goto errout_with_semaphore;
             }
 
+          nsectors = ret;
+
           /* We are not sure of the state of the sector cache so the
            * safest thing to do is write back any dirty, cached sector
            * and invalidate the current cache content.
@@ -1009,6 +1039,10 @@ static off_t fat_seek(FAR struct file *filep, off_t offset, int whence)
   int32_t cluster;
   off_t position;
   unsigned int clustersize;
+#ifdef CONFIG_FAT_CLUSTERMAP
+  uint32_t index;
+  uint32_t mapped;
+#endif
   int ret;
 
   /* Sanity checks */
@@ -1108,6 +1142,7 @@ static off_t fat_seek(FAR struct file *filep, off_t offset, int whence)
         }
 
       ff->ff_startcluster = cluster;
+      fat_mapadd(ff, 0, cluster);
     }
 
   /* Move file position if necessary */
@@ -1119,6 +1154,21 @@ static off_t fat_seek(FAR struct file *filep, off_t offset, int whence)
        */
 
       clustersize = fs->fs_fatsecperclus * fs->fs_hwsectorsize;
+
+#ifdef CONFIG_FAT_CLUSTERMAP
+      /* Skip directly to the last mapped cluster at or before the
+       * requested position.
+       */
+
+      index = fat_maplookup(ff, position / clustersize, &mapped);
+      if (index > 0)
+        {
+          cluster       = mapped;
+          filep->f_pos  = index * clustersize;
+          position     -= index * clustersize;
+        }
+#endif
+
       for (; ; )
         {
           /* Skip over clusters prior to the one containing
@@ -1141,21 +1191,14 @@ static off_t fat_seek(FAR struct file *filep, off_t offset, int whence)
            * is actually written into the gap."
            */
 
-          if ((ff->ff_oflags & O_WROK) != 0)
-            {
-              /* Extend the cluster chain (fat_extendchain
-               * will follow the existing chain or add new
-               * clusters as needed.
-               */
-
-              cluster = fat_extendchain(fs, cluster);
-            }
-          else
-            {
-              /* Otherwise we can only follow the existing chain */
+          /* Extend the cluster chain if the file is open for write
+           * access (fat_extendchain will follow the existing chain or
+           * add new clusters as needed).  Otherwise we can only follow
+           * the existing chain.
+           */
 
-              cluster = fat_getcluster(fs, cluster);
-            }
+          cluster = fat_nextcluster(fs, ff, filep->f_pos + clustersize,
+                                    (ff->ff_oflags & O_WROK) != 0);
 
           if (cluster < 0)
             {
@@ -1273,6 +1316,23 @@ static int fat_ioctl(FAR struct file *filep, int cmd, unsigned long arg)
       return ret;
     }
 
+  /* Reserve contiguous space for a file that will be written */
+
+  if (cmd == FIOC_FALLOCATE)
+    {
+      if ((ff->ff_oflags & O_WROK) == 0)
+        {
+          ret = -EACCES;
+        }
+      else
+        {
+          ret = fat_reservechain(fs, ff, (off_t)arg);
+        }
+
+      fat_semgive(fs);
+      return ret;
+    }
+
   /* ioctl calls are just passed through to the contained block driver */
 
   fat_semgive(fs);
@@ -1481,6 +1541,13 @@ static int fat_dup(FAR const struct file *oldp, FAR struct file *newp)
   newff->ff_startcluster     = oldff->ff_startcluster;     /* Start cluster of file on media */
   newff->ff_currentsector    = oldff->ff_currentsector;    /* Current sector */
   newff->ff_cachesector      = 0;                          /* Sector in file buffer */
+#ifdef CONFIG_FAT_CLUSTERMAP
+  newff->ff_nextents         = 0;                          /* Cluster map (rebuilt on demand) */
+  newff->ff_maxextents       = 0;
+  newff->ff_extents          = NULL;
+
+  fat_mapadd(newff, 0, newff->ff_startcluster);
+#endif
 
   /* Attach the private date to the struct file instance */
 
@@ -1962,9 +2029,18 @@ static int fat_unbind(FAR void *handle, FAR struct inode **blkdriver,
 
   if (fs->fs_buffer)
     {
-      fat_io_free(fs->fs_buffer, fs->fs_hwsectorsize);
+      fat_io_free(fs->fs_cache[0].fc_buffer,
+                  FAT_NCACHESECTORS * fs->fs_hwsectorsize);
     }
 
+#ifdef CONFIG_FAT_FREEBITMAP
+  if (fs->fs_freemap)
+    {
+      kmm_free(fs->fs_freemap);
+    }
+#endif
+
+  fat_dirindexrelease(fs);
   sem_destroy(&fs->fs_sem);
   kmm_free(fs);
   return OK;
@@ -2174,11 +2250,11 @@ static int fat_mkdir(FAR struct inode *mountpt, FAR const char *relpath,
       goto errout_with_semaphore;
     }
 
-  /* Flush any existing, dirty data in fs_buffer (because we need
-   * it to create the directory entries.
+  /* Get a zeroed sector cache buffer for the first sector of the new
+   * directory (because we need it to create the directory entries).
    */
 
-  ret = fat_fscacheflush(fs);
+  ret = fat_fscachezero(fs, dirsector);
   if (ret < 0)
     {
       goto errout_with_semaphore;
@@ -2188,11 +2264,6 @@ static int fat_mkdir(FAR struct inode *mountpt, FAR const char *relpath,
 
   direntry = fs->fs_buffer;
 
-  /* Now erase the contents of fs_buffer */
-
-  fs->fs_currentsector = dirsector;
-  memset(direntry, 0, fs->fs_hwsectorsize);
-
   /* Now clear all sectors in the new directory cluster (except for the first) */
 
   for (i = 1; i < fs->fs_fatsecperclus; i++)
@@ -55,6 +55,63 @@
  * Pre-processor Definitions
  ****************************************************************************/
 
+/* Configuration ************************************************************/
+/* The mountpoint sector cache is divided into two pools:  One holds sectors
+ * from the (first copy of the) FAT; the other holds everything else
+ * (directory sectors, FSINFO).  A FAT chain walk then cannot evict the
+ * directory sector that is being scanned, and vice versa.
+ */
+
+#ifndef CONFIG_FAT_FATCACHE_NSECTORS
+#  define CONFIG_FAT_FATCACHE_NSECTORS 2
+#endif
+
+#ifndef CONFIG_FAT_DIRCACHE_NSECTORS
+#  define CONFIG_FAT_DIRCACHE_NSECTORS 2
+#endif
+
+#if CONFIG_FAT_FATCACHE_NSECTORS < 1
+#  error CONFIG_FAT_FATCACHE_NSECTORS must be at least 1
+#endif
+
+#if CONFIG_FAT_DIRCACHE_NSECTORS < 1
+#  error CONFIG_FAT_DIRCACHE_NSECTORS must be at least 1
+#endif
+
+#define FAT_NCACHESECTORS \
+  (CONFIG_FAT_FATCACHE_NSECTORS + CONFIG_FAT_DIRCACHE_NSECTORS)
+
+#ifdef CONFIG_FAT_CLUSTERMAP
+#  ifndef CONFIG_FAT_CLUSTERMAP_MAXEXTENTS
+#    define CONFIG_FAT_CLUSTERMAP_MAXEXTENTS 64
+#  endif
+#endif
+
+#ifdef CONFIG_FAT_DISCARD
+#  ifndef CONFIG_FAT_DISCARD_NRUNS
+#    define CONFIG_FAT_DISCARD_NRUNS 8
+#  endif
+#  if CONFIG_FAT_DISCARD_NRUNS < 1
+#    error CONFIG_FAT_DISCARD_NRUNS must be at least 1
+#  endif
+#endif
+
+#ifdef CONFIG_FAT_DIRINDEX
+#  ifndef CONFIG_FAT_DIRINDEX_NDIRS
+#    define CONFIG_FAT_DIRINDEX_NDIRS 2
+#  endif
+#  ifndef CONFIG_FAT_DIRINDEX_MAXNAMES
+#    define CONFIG_FAT_DIRINDEX_MAXNAMES 8192
+#  endif
+#  if CONFIG_FAT_DIRINDEX_NDIRS < 1
+#    error CONFIG_FAT_DIRINDEX_NDIRS must be at least 1
+#  endif
+#  if CONFIG_FAT_DIRINDEX_MAXNAMES > 65535
+#    undef CONFIG_FAT_DIRINDEX_MAXNAMES
+#    define CONFIG_FAT_DIRINDEX_MAXNAMES 65535
+#  endif
+#endif
+
 /****************************************************************************
  * These offsets describes the master boot record.
  *
@@ -276,6 +333,7 @@
 #define FFBUFF_VALID        1
 #define FFBUFF_DIRTY        2
 #define FFBUFF_MODIFIED     4
+#define FFBUFF_PREALLOC     16 /* Clusters reserved beyond the end of file */
 
 /* Mount status flags (ff_bflags) */
 
@@ -686,9 +744,9 @@
  * Name: fat_io_alloc and fat_io_free
  *
  * Description:
- *   The FAT file system allocates two I/O buffers for data transfer, each
- *   are the size of one device sector.  One of the buffers is allocated
- *   once for each FAT volume that is mounted; the other buffers are
+ *   The FAT file system allocates two kinds of I/O buffers for data
+ *   transfer.  The sector cache (FAT_NCACHESECTORS sectors) is allocated
+ *   once for each FAT volume that is mounted; a one sector buffer is
  *   allocated each time a FAT file is opened.
  *
  *   Some hardware, however, may require special DMA-capable memory in
@@ -713,6 +771,65 @@
  * Public Types
  ****************************************************************************/
 
+/* This structure describes one sector in the mountpoint sector cache.  The
+ * entry that is currently selected is mirrored by fs_buffer,
+ * fs_currentsector and fs_dirty in struct fat_mountpt_s; for that entry
+ * the fields in struct fat_mountpt_s are authoritative.
+ */
+
+struct fat_cache_s
+{
+  off_t    fc_sector;              /* The sector held in fc_buffer (-1: none) */
+  uint32_t fc_age;                 /* Time of last use (for LRU replacement) */
+  bool     fc_dirty;               /* true: fc_buffer is dirty */
+  uint8_t *fc_buffer;              /* One sector of the cache allocation */
+};
+
+/* These structures describe the in-memory name index of one directory.
+ * Each name in the directory is represented by the hashes of its long and
+ * short names and by the number of the directory entry where the name
+ * starts (counting from the first entry of the directory).  The clusters
+ * of the directory are also remembered so that an entry number can be
+ * converted to a sector without following the cluster chain.
+ */
+
+#ifdef CONFIG_FAT_DIRINDEX
+struct fat_dirname_s
+{
+  uint32_t dn_lfnhash;             /* Hash of the long file name (0: none) */
+  uint32_t dn_sfnhash;             /* Hash of the short file name (0: none) */
+  uint16_t dn_entry;               /* First directory entry of the name */
+};
+
+struct fat_dirindex_s
+{
+  off_t    di_startcluster;        /* First cluster of the directory (0: FAT12/16 root) */
+  uint32_t di_age;                 /* Time of last use (for LRU replacement) */
+  bool     di_inuse;               /* true: This entry describes a directory */
+  bool     di_valid;               /* true: The index has been built */
+  bool     di_failed;              /* true: The index could not be built */
+  uint16_t di_firstfree;           /* All entries before this one are in use */
+  uint16_t di_nnames;              /* Number of names in di_names[] */
+  uint16_t di_maxnames;            /* Allocated size of di_names[] */
+  uint16_t di_nclusters;           /* Number of clusters in di_clusters[] */
+  uint16_t di_maxclusters;         /* Allocated size of di_clusters[] */
+  struct fat_dirname_s *di_names;  /* The names in the directory */
+  uint32_t *di_clusters;           /* The cluster chain of the directory */
+};
+#endif
+
+/* This structure describes one run of contiguous clusters that has been
+ * freed and is waiting to be discarded.
+ */
+
+#ifdef CONFIG_FAT_DISCARD
+struct fat_discard_s
+{
+  uint32_t fd_cluster;             /* First cluster of the run */
+  uint32_t fd_count;               /* Number of clusters in the run */
+};
+#endif
+
 /* This structure represents the overall mountpoint state.  An instance of this
  * structure is retained as inode private data on each mountpoint that is
  * mounted with a fat32 filesystem.
@@ -745,10 +862,39 @@ struct fat_mountpt_s
   uint8_t  fs_type;                /* FSTYPE_FAT12, FSTYPE_FAT16, or FSTYPE_FAT32 */
   uint8_t  fs_fatnumfats;          /* MBR: Number of FATs (probably 2) */
   uint8_t  fs_fatsecperclus;       /* MBR: Sectors per allocation unit: 2**n, n=0..7 */
-  uint8_t *fs_buffer;              /* This is an allocated buffer to hold one sector
-                                    * from the device */
+  uint8_t  fs_cacheslot;           /* Index of the selected entry in fs_cache[] */
+  uint32_t fs_cacheage;            /* Incremented each time an entry is selected */
+  uint8_t *fs_buffer;              /* The buffer of the selected cache entry */
+  struct fat_cache_s fs_cache[FAT_NCACHESECTORS];
+#ifdef CONFIG_FAT_FREEBITMAP
+  uint32_t *fs_freemap;            /* One bit per cluster, set if in use */
+  uint32_t *fs_scanmap;            /* One bit per unit of fs_freemap, set if valid */
+  uint32_t fs_bmunitclusters;      /* Clusters in one unit of fs_freemap */
+#endif
+#ifdef CONFIG_FAT_DIRINDEX
+  uint32_t fs_dirindexage;         /* Incremented each time an index is used */
+  struct fat_dirindex_s fs_dirindex[CONFIG_FAT_DIRINDEX_NDIRS];
+#endif
+#ifdef CONFIG_FAT_DISCARD
+  bool     fs_nodiscard;           /* true: The block driver cannot discard */
+  uint8_t  fs_ndiscards;           /* Number of runs in fs_discard[] */
+  struct fat_discard_s fs_discard[CONFIG_FAT_DISCARD_NRUNS];
+#endif
 };
 
+/* This structure describes one run of contiguous clusters in the cluster
+ * chain of an open file.
+ */
+
+#ifdef CONFIG_FAT_CLUSTERMAP
+struct fat_extent_s
+{
+  uint32_t fe_index;               /* Index of the first cluster in the file */
+  uint32_t fe_cluster;             /* First cluster of the run on the media */
+  uint32_t fe_count;               /* Number of clusters in the run */
+};
+#endif
+
 /* This structure represents on open file under the mountpoint.  An instance
  * of this structure is retained as struct file specific information on each
  * opened file.
@@ -768,6 +914,11 @@ struct fat_file_s
   off_t    ff_currentsector;       /* Current sector being operated on */
   off_t    ff_cachesector;         /* Current sector in the file buffer */
   uint8_t *ff_buffer;              /* File buffer (for partial sector accesses) */
+#ifdef CONFIG_FAT_CLUSTERMAP
+  uint16_t ff_nextents;            /* Number of runs in ff_extents[] */
+  uint16_t ff_maxextents;          /* Allocated size of ff_extents[] */
+  struct fat_extent_s *ff_extents; /* Known prefix of the cluster chain */
+#endif
 };
 
 /* This structure holds the sequency of directory entries used by one
@@ -902,6 +1053,28 @@ EXTERN int32_t fat_extendchain(struct fat_mountpt_s *fs, uint32_t cluster);
 
 #define fat_createchain(fs) fat_extendchain(fs, 0)
 
+EXTERN int32_t fat_nextcluster(struct fat_mountpt_s *fs, struct fat_file_s *ff,
+                               off_t position, bool extend);
+EXTERN int    fat_contiguous(struct fat_mountpt_s *fs, struct fat_file_s *ff,
+                             off_t position, unsigned int nsectors,
+                             bool extend);
+EXTERN int    fat_reservechain(struct fat_mountpt_s *fs,
+                               struct fat_file_s *ff, off_t length);
+EXTERN int    fat_trimchain(struct fat_mountpt_s *fs, struct fat_file_s *ff);
+
+/* Per-file cluster map */
+
+#ifdef CONFIG_FAT_CLUSTERMAP
+EXTERN void   fat_mapadd(struct fat_file_s *ff, uint32_t index,
+                         uint32_t cluster);
+EXTERN uint32_t fat_maplookup(struct fat_file_s *ff, uint32_t index,
+                              uint32_t *cluster);
+EXTERN void   fat_mapfree(struct fat_file_s *ff);
+#else
+#  define fat_mapadd(ff,i,c)
+#  define fat_mapfree(ff)
+#endif
+
 /* Help for traversing directory trees and accessing directory entries */
 
 EXTERN int    fat_nextdirentry(struct fat_mountpt_s *fs, struct fs_fatdir_s *dir);
@@ -914,6 +1087,29 @@ EXTERN int    fat_allocatedirentry(struct fat_mountpt_s *fs, struct fat_dirinfo_
 EXTERN int    fat_freedirentry(struct fat_mountpt_s *fs, struct fat_dirseq_s *seq);
 EXTERN int    fat_dirname2path(struct fat_mountpt_s *fs, struct fs_dirent_s *dir);
 
+/* Directory name index */
+
+#ifdef CONFIG_FAT_DIRINDEX
+EXTERN int    fat_dirindexlookup(struct fat_mountpt_s *fs,
+                                 struct fat_dirinfo_s *dirinfo, bool sfn,
+                                 bool build);
+EXTERN int    fat_dirindexfirstfree(struct fat_mountpt_s *fs,
+                                    struct fat_dirinfo_s *dirinfo);
+EXTERN void   fat_dirindexadd(struct fat_mountpt_s *fs,
+                              struct fat_dirinfo_s *dirinfo);
+EXTERN void   fat_dirindexremove(struct fat_mountpt_s *fs,
+                                 struct fat_dirseq_s *seq);
+EXTERN void   fat_dirindexdrop(struct fat_mountpt_s *fs, off_t startcluster);
+EXTERN void   fat_dirindexrelease(struct fat_mountpt_s *fs);
+#else
+#  define fat_dirindexlookup(fs,d,s,b) (-ENOSYS)
+#  define fat_dirindexfirstfree(fs,d)  (-ENOSYS)
+#  define fat_dirindexadd(fs,d)
+#  define fat_dirindexremove(fs,s)
+#  define fat_dirindexdrop(fs,c)
+#  define fat_dirindexrelease(fs)
+#endif
+
 /* File creation and removal helpers */
 
 EXTERN int    fat_dirtruncate(struct fat_mountpt_s *fs, struct fat_dirinfo_s *dirinfo);
@@ -924,6 +1120,7 @@ EXTERN int    fat_remove(struct fat_mountpt_s *fs, const char *relpath, bool dir
 
 EXTERN int    fat_fscacheflush(struct fat_mountpt_s *fs);
 EXTERN int    fat_fscacheread(struct fat_mountpt_s *fs, off_t sector);
+EXTERN int    fat_fscachezero(struct fat_mountpt_s *fs, off_t sector);
 EXTERN int    fat_ffcacheflush(struct fat_mountpt_s *fs, struct fat_file_s *ff);
 EXTERN int    fat_ffcacheread(struct fat_mountpt_s *fs, struct fat_file_s *ff, off_t sector);
 EXTERN int    fat_ffcacheinvalidate(struct fat_mountpt_s *fs, struct fat_file_s *ff);
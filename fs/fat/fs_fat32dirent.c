@@ -790,11 +790,26 @@ static inline int fat_findalias(struct fat_mountpt_s *fs,
                                 struct fat_dirinfo_s *dirinfo)
 {
   struct fat_dirinfo_s tmpinfo;
+  int ret;
 
   /* Save the current directory info. */
 
   memcpy(&tmpinfo, dirinfo, sizeof(struct fat_dirinfo_s));
 
+  /* If the directory is indexed, only the candidate entries need to be
+   * checked.
+   */
+
+  ret = fat_dirindexlookup(fs, &tmpinfo, true, false);
+  if (ret == -ENOENT)
+    {
+      return ret;
+    }
+  else if (ret == OK)
+    {
+      return fat_findsfnentry(fs, &tmpinfo);
+    }
+
   /* Then re-initialize to the beginning of the current directory, starting
    * with the first entry.
    */
@@ -2059,10 +2074,19 @@ static int fat_putlfname(struct fat_mountpt_s *fs,
   dirinfo->dir.fd_index       = dirinfo->fd_seq.ds_lfnoffset / DIR_SIZE;
 
   /* ds_lfnoffset is the offset in the sector. However fd_index is used as
-   * index for the entire cluster. We need to add that offset
+   * index for the entire cluster (or for the entire FAT12/16 root
+   * directory). We need to add that offset
    */
 
-  startsector                 = fat_cluster2sector(fs, dirinfo->dir.fd_currcluster);
+  if (dirinfo->dir.fd_currcluster != 0)
+    {
+      startsector             = fat_cluster2sector(fs, dirinfo->dir.fd_currcluster);
+    }
+  else
+    {
+      startsector             = fs->fs_rootbase;
+    }
+
   dirinfo->dir.fd_index      += (dirinfo->dir.fd_currsector - startsector) * DIRSEC_NDIRS(fs);
 
   /* Make sure that the alias is unique in this directory */
@@ -2330,12 +2354,27 @@ int fat_finddirentry(struct fat_mountpt_s *fs, struct fat_dirinfo_s *dirinfo,
           return ret;
         }
 
+      /* If the directory is indexed, the index tells if the name is
+       * absent or else where the search should begin.
+       */
+
+#ifdef CONFIG_FAT_LFN
+      ret = fat_dirindexlookup(fs, dirinfo, dirinfo->fd_lfname[0] == '\0',
+                               terminator == '\0');
+#else
+      ret = fat_dirindexlookup(fs, dirinfo, true, terminator == '\0');
+#endif
+
       /* Is this a path segment a long or a short file.  Was a long file
        * name parsed?
        */
 
+      if (ret == -ENOENT)
+        {
+          /* The name is not in the directory */
+        }
 #ifdef CONFIG_FAT_LFN
-      if (dirinfo->fd_lfname[0] != '\0')
+      else if (dirinfo->fd_lfname[0] != '\0')
         {
           /* Yes.. Search for the sequence of long file name directory
            * entries. NOTE: As a side effect, this function returns with
@@ -2345,8 +2384,8 @@ int fat_finddirentry(struct fat_mountpt_s *fs, struct fat_dirinfo_s *dirinfo,
 
           ret = fat_findlfnentry(fs, dirinfo);
         }
-      else
 #endif
+      else
         {
           /* No.. Search for the single short file name directory entry */
 
@@ -2430,6 +2469,10 @@ int fat_allocatedirentry(struct fat_mountpt_s *fs,
   int32_t  cluster;
   int32_t  prevcluster;
   off_t    sector;
+#if defined(CONFIG_FAT_DIRINDEX) && defined(CONFIG_FAT_LFN)
+  off_t    startsector;
+  bool     indexed;
+#endif
   int      ret;
   int      i;
 
@@ -2463,6 +2506,17 @@ int fat_allocatedirentry(struct fat_mountpt_s *fs,
 
       dirinfo->dir.fd_index = 0;
 
+      /* Or, if the directory is indexed, at the first entry that may be
+       * free.
+       */
+
+#if defined(CONFIG_FAT_DIRINDEX) && defined(CONFIG_FAT_LFN)
+      startsector = dirinfo->dir.fd_currsector;
+      indexed     = (fat_dirindexfirstfree(fs, dirinfo) == OK);
+#else
+      (void)fat_dirindexfirstfree(fs, dirinfo);
+#endif
+
       /* Is this a path segment a long or a short file.  Was a long file
        * name parsed?
        */
@@ -2492,6 +2546,17 @@ int fat_allocatedirentry(struct fat_mountpt_s *fs,
 
       if (ret == OK || ret != -ENOSPC)
         {
+#if defined(CONFIG_FAT_DIRINDEX) && defined(CONFIG_FAT_LFN)
+          /* The alias check must still scan from the start of the
+           * directory.
+           */
+
+          if (ret == OK && indexed)
+            {
+              dirinfo->fd_seq.ds_startsector = startsector;
+            }
+#endif
+
           return ret;
         }
 
@@ -2520,11 +2585,18 @@ int fat_allocatedirentry(struct fat_mountpt_s *fs,
           return cluster;
         }
 
-      /* Flush out any cached data in fs_buffer.. we are going to use
-       * it to initialize the new directory cluster.
+      /* Get a zeroed sector cache buffer for the first sector of the new
+       * directory cluster.  We are going to use it to initialize the
+       * whole cluster.
        */
 
-      ret = fat_fscacheflush(fs);
+      sector = fat_cluster2sector(fs, cluster);
+      if (sector < 0)
+        {
+          return sector;
+        }
+
+      ret = fat_fscachezero(fs, sector);
       if (ret < 0)
         {
           return ret;
@@ -2532,10 +2604,6 @@ int fat_allocatedirentry(struct fat_mountpt_s *fs,
 
       /* Clear all sectors comprising the new directory cluster */
 
-      fs->fs_currentsector = fat_cluster2sector(fs, cluster);
-      memset(fs->fs_buffer, 0, fs->fs_hwsectorsize);
-
-      sector = fs->fs_currentsector;
       for (i = fs->fs_fatsecperclus; i; i--)
         {
           ret = fat_hwwrite(fs, fs->fs_buffer, sector, 1);
@@ -2572,6 +2640,10 @@ int fat_freedirentry(struct fat_mountpt_s *fs, struct fat_dirseq_s *seq)
   off_t    startsector;
   int      ret;
 
+  /* Remove the name from the directory index */
+
+  fat_dirindexremove(fs, seq);
+
   /* Set it to the cluster containing the "last" LFN entry (that appears
    * first on the media).
    */
@@ -2581,10 +2653,19 @@ int fat_freedirentry(struct fat_mountpt_s *fs, struct fat_dirseq_s *seq)
   dir.fd_index       = seq->ds_lfnoffset / DIR_SIZE;
 
   /* Remember that ds_lfnoffset is the offset in the sector and not the
-   * cluster.
+   * cluster.  In the FAT12/16 root directory, the index is relative to the
+   * start of the directory.
    */
 
-  startsector        = fat_cluster2sector(fs, dir.fd_currcluster);
+  if (dir.fd_currcluster != 0)
+    {
+      startsector    = fat_cluster2sector(fs, dir.fd_currcluster);
+    }
+  else
+    {
+      startsector    = fs->fs_rootbase;
+    }
+
   dir.fd_index      += (dir.fd_currsector - startsector) * DIRSEC_NDIRS(fs);
 
   /* Free all of the directory entries used for the sequence of long file name
@@ -2636,6 +2717,10 @@ int fat_freedirentry(struct fat_mountpt_s *fs, struct fat_dirseq_s *seq)
   uint8_t *direntry;
   int      ret;
 
+  /* Remove the name from the directory index */
+
+  fat_dirindexremove(fs, seq);
+
   /* Free the single short file name entry.
    *
    * Make sure that the sector containing the directory entry is in the
@@ -2713,9 +2798,9 @@ int fat_dirname2path(struct fat_mountpt_s *fs, struct fs_dirent_s *dir)
 
 int fat_dirnamewrite(struct fat_mountpt_s *fs, struct fat_dirinfo_s *dirinfo)
 {
-#ifdef CONFIG_FAT_LFN
   int ret;
 
+#ifdef CONFIG_FAT_LFN
   /* Is this a long file name? */
 
   if (dirinfo->fd_lfname[0] != '\0')
@@ -2737,7 +2822,15 @@ int fat_dirnamewrite(struct fat_mountpt_s *fs, struct fat_dirinfo_s *dirinfo)
    */
 #endif
 
-  return fat_putsfname(fs, dirinfo);
+  ret = fat_putsfname(fs, dirinfo);
+  if (ret == OK)
+    {
+      /* Add the new name to the directory index */
+
+      fat_dirindexadd(fs, dirinfo);
+    }
+
+  return ret;
 }
 
 /****************************************************************************
@@ -2757,9 +2850,9 @@ int fat_dirnamewrite(struct fat_mountpt_s *fs, struct fat_dirinfo_s *dirinfo)
 int fat_dirwrite(struct fat_mountpt_s *fs, struct fat_dirinfo_s *dirinfo,
                  uint8_t attributes, uint32_t fattime)
 {
-#ifdef CONFIG_FAT_LFN
   int ret;
 
+#ifdef CONFIG_FAT_LFN
   /* Does this directory entry have a long file name? */
 
   if (dirinfo->fd_lfname[0] != '\0')
@@ -2783,7 +2876,15 @@ int fat_dirwrite(struct fat_mountpt_s *fs, struct fat_dirinfo_s *dirinfo,
 
   /* Put the short file name entry data */
 
-  return fat_putsfdirentry(fs, dirinfo, attributes, fattime);
+  ret = fat_putsfdirentry(fs, dirinfo, attributes, fattime);
+  if (ret == OK)
+    {
+      /* Add the new name to the directory index */
+
+      fat_dirindexadd(fs, dirinfo);
+    }
+
+  return ret;
 }
 
 /****************************************************************************
@@ -2970,8 +3071,11 @@ int fat_remove(struct fat_mountpt_s *fs, const char *relpath, bool directory)
       return ret;
     }
 
-  /* And remove the cluster chain making up the subdirectory */
+  /* And remove the cluster chain making up the subdirectory.  Any index of
+   * it is now meaningless.
+   */
 
+  fat_dirindexdrop(fs, dircluster);
   ret = fat_removechain(fs, dircluster);
   if (ret < 0)
     {
@@ -0,0 +1,973 @@
+/****************************************************************************
+ * fs/fat/fs_fat32dirindex.c
+ *
+ *   Copyright (C) 2016 Gregory Nutt. All rights reserved.
+ *   Author: Gregory Nutt <gnutt@nuttx.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * The directory name index.
+ *
+ * Looking up a name in a FAT directory means reading the directory from
+ * the beginning and comparing every entry (reassembling long file names on
+ * the way) until the name is found.  For directories with thousands of
+ * entries this dominates the time taken by open(), stat() and file
+ * creation, since a new name must first be shown not to exist.
+ *
+ * When CONFIG_FAT_DIRINDEX is selected, a directory that is looked up
+ * repeatedly is read completely once and a hash of each name is recorded
+ * together with the number of the directory entry where the name starts.
+ * Later lookups only read the directory sectors starting at the (rare)
+ * entries whose hash matches; a name whose hash is not present cannot
+ * exist in the directory.  The index also remembers the first entry that may be
+ * free so that new directory entries do not have to be searched for from
+ * the beginning of the directory.
+ *
+ * The index is kept up to date by fat_dirwrite(), fat_dirnamewrite() and
+ * fat_freedirentry(), i.e., on every file creation, removal and rename.
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <debug.h>
+
+#include <nuttx/kmalloc.h>
+#include <nuttx/fs/fs.h>
+#include <nuttx/fs/fat.h>
+
+#include "fs_fat32.h"
+
+#ifdef CONFIG_FAT_DIRINDEX
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Directory entries are numbered with 16-bit values.  This is sufficient
+ * for any directory that follows the FAT specification (at most 65536
+ * entries).  Larger directories are simply not indexed.
+ */
+
+#define DIRINDEX_MAXENTRIES 0xffff
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: fat_dirindexhash
+ *
+ * Description:
+ *   Hash a name (FNV-1a).  Zero is reserved to mean "no name".
+ *
+ ****************************************************************************/
+
+static uint32_t fat_dirindexhash(FAR const uint8_t *name, int len)
+{
+  uint32_t hash = 2166136261u;
+
+  while (len-- > 0)
+    {
+      hash ^= *name++;
+      hash *= 16777619u;
+    }
+
+  return hash ? hash : 1;
+}
+
+/****************************************************************************
+ * Name: fat_dirindexisroot
+ *
+ * Description:
+ *   Return true if the directory starting at 'startcluster' is the root
+ *   directory.  The root directory has no '.' and '..' entries.
+ *
+ ****************************************************************************/
+
+static bool fat_dirindexisroot(FAR struct fat_mountpt_s *fs,
+                               off_t startcluster)
+{
+  if (fs->fs_type == FSTYPE_FAT32)
+    {
+      return startcluster == fs->fs_rootbase;
+    }
+
+  return startcluster == 0;
+}
+
+/****************************************************************************
+ * Name: fat_dirindexaddcluster
+ *
+ * Description:
+ *   Append a cluster to the cluster list of the directory.
+ *
+ ****************************************************************************/
+
+static int fat_dirindexaddcluster(FAR struct fat_dirindex_s *di,
+                                  uint32_t cluster)
+{
+  FAR uint32_t *clusters;
+  int newsize;
+
+  if (di->di_nclusters >= di->di_maxclusters)
+    {
+      newsize = di->di_maxclusters ? 2 * di->di_maxclusters : 4;
+      if (newsize > UINT16_MAX)
+        {
+          return -ENOMEM;
+        }
+
+      clusters = (FAR uint32_t *)
+        kmm_realloc(di->di_clusters, newsize * sizeof(uint32_t));
+      if (!clusters)
+        {
+          return -ENOMEM;
+        }
+
+      di->di_clusters    = clusters;
+      di->di_maxclusters = newsize;
+    }
+
+  di->di_clusters[di->di_nclusters++] = cluster;
+  return OK;
+}
+
+/****************************************************************************
+ * Name: fat_dirindexaddname
+ *
+ * Description:
+ *   Append a name to the index of the directory.
+ *
+ ****************************************************************************/
+
+static int fat_dirindexaddname(FAR struct fat_dirindex_s *di,
+                               uint32_t lfnhash, uint32_t sfnhash,
+                               uint16_t entry)
+{
+  FAR struct fat_dirname_s *names;
+  FAR struct fat_dirname_s *name;
+  int newsize;
+
+  if (di->di_nnames >= di->di_maxnames)
+    {
+      newsize = di->di_maxnames ? 2 * di->di_maxnames : 16;
+      if (newsize > CONFIG_FAT_DIRINDEX_MAXNAMES)
+        {
+          newsize = CONFIG_FAT_DIRINDEX_MAXNAMES;
+        }
+
+      if (newsize <= di->di_nnames)
+        {
+          return -ENOMEM;
+        }
+
+      names = (FAR struct fat_dirname_s *)
+        kmm_realloc(di->di_names, newsize * sizeof(struct fat_dirname_s));
+      if (!names)
+        {
+          return -ENOMEM;
+        }
+
+      di->di_names    = names;
+      di->di_maxnames = newsize;
+    }
+
+  name             = &di->di_names[di->di_nnames++];
+  name->dn_lfnhash = lfnhash;
+  name->dn_sfnhash = sfnhash;
+  name->dn_entry   = entry;
+  return OK;
+}
+
+/****************************************************************************
+ * Name: fat_dirindexinvalidate
+ *
+ * Description:
+ *   Discard the content of an index entry, leaving it unused.
+ *
+ ****************************************************************************/
+
+static void fat_dirindexinvalidate(FAR struct fat_dirindex_s *di)
+{
+  if (di->di_names)
+    {
+      kmm_free(di->di_names);
+    }
+
+  if (di->di_clusters)
+    {
+      kmm_free(di->di_clusters);
+    }
+
+  memset(di, 0, sizeof(struct fat_dirindex_s));
+}
+
+/****************************************************************************
+ * Name: fat_dirindexseek
+ *
+ * Description:
+ *   Set up 'dir' to access directory entry number 'entry' of the indexed
+ *   directory.  The cluster list is extended if the directory has grown.
+ *
+ ****************************************************************************/
+
+static int fat_dirindexseek(FAR struct fat_mountpt_s *fs,
+                            FAR struct fat_dirindex_s *di,
+                            unsigned int entry, FAR struct fs_fatdir_s *dir)
+{
+  unsigned int perclust;
+  unsigned int index;
+  off_t cluster;
+  int ret;
+
+  if (di->di_startcluster == 0)
+    {
+      /* The FAT12/16 root directory is a fixed group of sectors */
+
+      if (entry >= fs->fs_rootentcnt)
+        {
+          return -ENOSPC;
+        }
+
+      dir->fd_currcluster = 0;
+      dir->fd_currsector  = fs->fs_rootbase + entry / DIRSEC_NDIRS(fs);
+      dir->fd_index       = entry;
+      return OK;
+    }
+
+  perclust = DIRSEC_NDIRS(fs) * fs->fs_fatsecperclus;
+  index    = entry / perclust;
+
+  while (index >= di->di_nclusters)
+    {
+      cluster = fat_getcluster(fs, di->di_clusters[di->di_nclusters - 1]);
+      if (cluster < 2 || cluster >= fs->fs_nclusters)
+        {
+          return -ENOSPC;
+        }
+
+      ret = fat_dirindexaddcluster(di, cluster);
+      if (ret < 0)
+        {
+          return ret;
+        }
+    }
+
+  dir->fd_currcluster = di->di_clusters[index];
+  dir->fd_index       = entry - index * perclust;
+  dir->fd_currsector  = fat_cluster2sector(fs, dir->fd_currcluster) +
+                        dir->fd_index / DIRSEC_NDIRS(fs);
+  return OK;
+}
+
+/****************************************************************************
+ * Name: fat_dirindexentry
+ *
+ * Description:
+ *   Return the number of the directory entry at 'offset' in 'sector' or a
+ *   negated errno value if that entry does not belong to the indexed
+ *   directory.
+ *
+ ****************************************************************************/
+
+static int fat_dirindexentry(FAR struct fat_mountpt_s *fs,
+                             FAR struct fat_dirindex_s *di,
+                             off_t sector, unsigned int offset)
+{
+  unsigned int perclust;
+  unsigned int entry;
+  off_t cluster;
+  off_t next;
+  int index;
+
+  if (di->di_startcluster == 0)
+    {
+      if (sector < fs->fs_rootbase || sector >= fs->fs_database)
+        {
+          return -ENOENT;
+        }
+
+      entry = (sector - fs->fs_rootbase) * DIRSEC_NDIRS(fs) +
+              offset / DIR_SIZE;
+    }
+  else
+    {
+      if (sector < fs->fs_database)
+        {
+          return -ENOENT;
+        }
+
+      cluster = (sector - fs->fs_database) / fs->fs_fatsecperclus + 2;
+      for (index = 0; index < di->di_nclusters; index++)
+        {
+          if (di->di_clusters[index] == cluster)
+            {
+              break;
+            }
+        }
+
+      /* If the cluster is not known, it may have just been added to the
+       * end of the directory.
+       */
+
+      if (index >= di->di_nclusters)
+        {
+          next = fat_getcluster(fs, di->di_clusters[di->di_nclusters - 1]);
+          if (next != cluster || fat_dirindexaddcluster(di, cluster) < 0)
+            {
+              return -ENOENT;
+            }
+        }
+
+      perclust = DIRSEC_NDIRS(fs) * fs->fs_fatsecperclus;
+      entry    = index * perclust +
+                 ((sector - fs->fs_database) & (fs->fs_fatsecperclus - 1)) *
+                 DIRSEC_NDIRS(fs) + offset / DIR_SIZE;
+    }
+
+  return entry < DIRINDEX_MAXENTRIES ? (int)entry : -EFBIG;
+}
+
+/****************************************************************************
+ * Name: fat_dirindexbuild
+ *
+ * Description:
+ *   Read the whole directory and record every name in it.
+ *
+ ****************************************************************************/
+
+static int fat_dirindexbuild(FAR struct fat_mountpt_s *fs,
+                             FAR struct fat_dirindex_s *di)
+{
+  struct fs_fatdir_s dir;
+  FAR uint8_t *direntry;
+#ifdef CONFIG_FAT_LFN
+  uint8_t  lfname[LDIR_MAXLFNS * LDIR_MAXLFNCHARS];
+  uint32_t lfnhash = 0;
+  uint8_t  seqno = 0;
+  uint8_t  checksum = 0;
+  uint16_t lfnentry = 0;
+  int      offset;
+  int      len = 0;
+  int      i;
+#endif
+  unsigned int entry;
+  unsigned int minentry;
+  bool     firstfree = false;
+  int      ret;
+
+  minentry = fat_dirindexisroot(fs, di->di_startcluster) ? 0 : 2;
+
+  if (di->di_startcluster == 0)
+    {
+      dir.fd_currcluster = 0;
+      dir.fd_currsector  = fs->fs_rootbase;
+    }
+  else
+    {
+      ret = fat_dirindexaddcluster(di, di->di_startcluster);
+      if (ret < 0)
+        {
+          return ret;
+        }
+
+      dir.fd_currcluster = di->di_startcluster;
+      dir.fd_currsector  = fat_cluster2sector(fs, di->di_startcluster);
+    }
+
+  dir.fd_startcluster = di->di_startcluster;
+  dir.fd_index        = 0;
+
+  for (entry = 0; ; entry++)
+    {
+      if (entry >= DIRINDEX_MAXENTRIES)
+        {
+          return -EFBIG;
+        }
+
+      ret = fat_fscacheread(fs, dir.fd_currsector);
+      if (ret < 0)
+        {
+          return ret;
+        }
+
+      direntry = &fs->fs_buffer[DIRSEC_BYTENDX(fs, dir.fd_index)];
+
+      /* A free entry.  Nothing is found beyond the first never-used
+       * entry.
+       */
+
+      if (direntry[DIR_NAME] == DIR0_EMPTY ||
+          direntry[DIR_NAME] == DIR0_ALLEMPTY)
+        {
+          if (!firstfree)
+            {
+              di->di_firstfree = entry;
+              firstfree        = true;
+            }
+
+          if (direntry[DIR_NAME] == DIR0_ALLEMPTY)
+            {
+              break;
+            }
+
+#ifdef CONFIG_FAT_LFN
+          seqno = 0;
+#endif
+        }
+
+#ifdef CONFIG_FAT_LFN
+      /* A long file name entry.  The entries of a long file name appear in
+       * reverse order, the "last" entry first.
+       */
+
+      else if (LDIR_GETATTRIBUTES(direntry) == LDDIR_LFNATTR)
+        {
+          if ((LDIR_GETSEQ(direntry) & LDIR0_LAST) != 0)
+            {
+              /* The first entry of a new sequence */
+
+              seqno    = LDIR_GETSEQ(direntry) & LDIR0_SEQ_MASK;
+              checksum = LDIR_GETCHECKSUM(direntry);
+              lfnentry = entry;
+              len      = seqno * LDIR_MAXLFNCHARS;
+
+              if (seqno < 1 || seqno > LDIR_MAXLFNS)
+                {
+                  seqno = 0;
+                }
+            }
+          else if (seqno > 1 && LDIR_GETSEQ(direntry) == seqno - 1 &&
+                   LDIR_GETCHECKSUM(direntry) == checksum)
+            {
+              /* The next entry of the current sequence */
+
+              seqno--;
+            }
+          else
+            {
+              seqno = 0;
+            }
+
+          if (seqno > 0)
+            {
+              /* Keep the low byte of each character, as the lookup does */
+
+              offset = (seqno - 1) * LDIR_MAXLFNCHARS;
+              for (i = 0; i < LDIR_MAXLFNCHARS; i++)
+                {
+                  FAR uint8_t *chunk;
+
+                  if (i < 5)
+                    {
+                      chunk = LDIR_PTRWCHAR1_5(direntry) + 2 * i;
+                    }
+                  else if (i < 11)
+                    {
+                      chunk = LDIR_PTRWCHAR6_11(direntry) + 2 * (i - 5);
+                    }
+                  else
+                    {
+                      chunk = LDIR_PTRWCHAR12_13(direntry) + 2 * (i - 11);
+                    }
+
+                  lfname[offset + i] = *chunk;
+                }
+
+              if (seqno == 1)
+                {
+                  /* The sequence is complete.  The name ends at the first
+                   * NUL character (if any).
+                   */
+
+                  for (i = 0; i < len && lfname[i] != '\0'; i++);
+                  lfnhash = fat_dirindexhash(lfname, i);
+                }
+            }
+        }
+#endif
+
+      /* A short file name entry (volume labels are never found) */
+
+      else if ((DIR_GETATTRIBUTES(direntry) & FATATTR_VOLUMEID) == 0)
+        {
+          if (entry >= minentry)
+            {
+#ifdef CONFIG_FAT_LFN
+              if (seqno == 1)
+                {
+                  ret = fat_dirindexaddname(di, lfnhash,
+                          fat_dirindexhash(&direntry[DIR_NAME],
+                                           DIR_MAXFNAME),
+                          lfnentry);
+                }
+              else
+#endif
+                {
+                  ret = fat_dirindexaddname(di, 0,
+                          fat_dirindexhash(&direntry[DIR_NAME],
+                                           DIR_MAXFNAME),
+                          entry);
+                }
+
+              if (ret < 0)
+                {
+                  return ret;
+                }
+            }
+
+#ifdef CONFIG_FAT_LFN
+          seqno = 0;
+#endif
+        }
+
+#ifdef CONFIG_FAT_LFN
+      else
+        {
+          seqno = 0;
+        }
+#endif
+
+      /* Move to the next entry, recording the clusters of the directory */
+
+      ret = fat_nextdirentry(fs, &dir);
+      if (ret < 0)
+        {
+          /* The end of the directory */
+
+          if (!firstfree)
+            {
+              di->di_firstfree = entry + 1;
+            }
+
+          break;
+        }
+
+      if (dir.fd_currcluster != 0 &&
+          dir.fd_currcluster != di->di_clusters[di->di_nclusters - 1])
+        {
+          ret = fat_dirindexaddcluster(di, dir.fd_currcluster);
+          if (ret < 0)
+            {
+              return ret;
+            }
+        }
+    }
+
+  fvdbg("Directory %d: %d names\n", di->di_startcluster, di->di_nnames);
+  return OK;
+}
+
+/****************************************************************************
+ * Name: fat_dirindexget
+ *
+ * Description:
+ *   Return the index of the directory starting at 'startcluster'.  If
+ *   'build' is true and there is no index, one is built when the directory
+ *   is looked up for the second time while it is still remembered.  A
+ *   directory that is used only once in a while, among more directories
+ *   than there are index entries, is then searched as before instead of
+ *   being read completely again and again.  NULL is returned if the
+ *   directory is not indexed.
+ *
+ ****************************************************************************/
+
+static FAR struct fat_dirindex_s *
+fat_dirindexget(FAR struct fat_mountpt_s *fs, off_t startcluster, bool build)
+{
+  FAR struct fat_dirindex_s *di;
+  FAR struct fat_dirindex_s *victim = NULL;
+  int i;
+
+  /* Only indexes for a FAT12/16 root directory or a real cluster chain */
+
+  if ((startcluster == 0 && fs->fs_type == FSTYPE_FAT32) ||
+      (startcluster != 0 &&
+       (startcluster < 2 || startcluster >= fs->fs_nclusters)))
+    {
+      return NULL;
+    }
+
+  for (i = 0; i < CONFIG_FAT_DIRINDEX_NDIRS; i++)
+    {
+      di = &fs->fs_dirindex[i];
+      if (di->di_inuse && di->di_startcluster == startcluster)
+        {
+          di->di_age = ++fs->fs_dirindexage;
+          if (di->di_valid)
+            {
+              return di;
+            }
+
+          if (!build || di->di_failed)
+            {
+              return NULL;
+            }
+
+          /* Second lookup: Build the index.  If it cannot be built, the
+           * entry remembers that so that the directory is not read again
+           * on every lookup.
+           */
+
+          if (fat_dirindexbuild(fs, di) < 0)
+            {
+              fat_dirindexinvalidate(di);
+              di->di_startcluster = startcluster;
+              di->di_inuse        = true;
+              di->di_failed       = true;
+              di->di_age          = fs->fs_dirindexage;
+              return NULL;
+            }
+
+          di->di_valid = true;
+          return di;
+        }
+
+      /* Prefer an unused entry, otherwise the least recently used one */
+
+      if (!victim ||
+          (victim->di_inuse &&
+           (!di->di_inuse ||
+            fs->fs_dirindexage - di->di_age >
+            fs->fs_dirindexage - victim->di_age)))
+        {
+          victim = di;
+        }
+    }
+
+  /* First lookup: Only remember the directory in place of the least
+   * recently used one.
+   */
+
+  if (build)
+    {
+      fat_dirindexinvalidate(victim);
+      victim->di_startcluster = startcluster;
+      victim->di_inuse        = true;
+      victim->di_age          = ++fs->fs_dirindexage;
+    }
+
+  return NULL;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: fat_dirindexlookup
+ *
+ * Description:
+ *   Use the index of the directory described by dirinfo->dir to look up
+ *   the short name in dirinfo->fd_name (if 'sfn' is true) or the long name
+ *   in dirinfo->fd_lfname.  If 'build' is true, the index may be built.
+ *   This is done only when the last component of a path is looked up, so
+ *   that the directories leading to it do not compete for index entries.
+ *
+ * Returned Value:
+ *   OK:       dirinfo->dir has been positioned at the first entry where the
+ *             name may be found.  The normal search continues from there.
+ *   -ENOENT:  The name does not exist in the directory.
+ *   -ENOSYS:  The directory is not indexed; it must be searched.
+ *
+ ****************************************************************************/
+
+int fat_dirindexlookup(FAR struct fat_mountpt_s *fs,
+                       FAR struct fat_dirinfo_s *dirinfo, bool sfn,
+                       bool build)
+{
+  FAR struct fat_dirindex_s *di;
+  FAR struct fat_dirname_s *name;
+  struct fs_fatdir_s dir;
+  unsigned int entry;
+  uint32_t hash;
+  int i;
+
+  di = fat_dirindexget(fs, dirinfo->dir.fd_startcluster, build);
+  if (!di)
+    {
+      return -ENOSYS;
+    }
+
+#ifdef CONFIG_FAT_LFN
+  if (!sfn)
+    {
+      hash = fat_dirindexhash(dirinfo->fd_lfname,
+                              strlen((FAR char *)dirinfo->fd_lfname));
+    }
+  else
+#endif
+    {
+      hash = fat_dirindexhash(dirinfo->fd_name, DIR_MAXFNAME);
+    }
+
+  /* Find the first entry with a matching hash */
+
+  entry = DIRINDEX_MAXENTRIES + 1;
+  for (i = 0, name = di->di_names; i < di->di_nnames; i++, name++)
+    {
+      if ((sfn ? name->dn_sfnhash : name->dn_lfnhash) == hash &&
+          name->dn_entry < entry)
+        {
+          entry = name->dn_entry;
+        }
+    }
+
+  if (entry > DIRINDEX_MAXENTRIES)
+    {
+      return -ENOENT;
+    }
+
+  dir.fd_startcluster = dirinfo->dir.fd_startcluster;
+  if (fat_dirindexseek(fs, di, entry, &dir) < 0)
+    {
+      return -ENOSYS;
+    }
+
+  dirinfo->dir = dir;
+  return OK;
+}
+
+/****************************************************************************
+ * Name: fat_dirindexfirstfree
+ *
+ * Description:
+ *   If the directory described by dirinfo->dir is indexed, position
+ *   dirinfo->dir at the first entry that may be free.  All entries before
+ *   it are known to be in use.
+ *
+ * Returned Value:
+ *   OK if dirinfo->dir was repositioned; -ENOSYS otherwise.
+ *
+ ****************************************************************************/
+
+int fat_dirindexfirstfree(FAR struct fat_mountpt_s *fs,
+                          FAR struct fat_dirinfo_s *dirinfo)
+{
+  FAR struct fat_dirindex_s *di;
+  struct fs_fatdir_s dir;
+
+  di = fat_dirindexget(fs, dirinfo->dir.fd_startcluster, false);
+  if (!di)
+    {
+      return -ENOSYS;
+    }
+
+  dir.fd_startcluster = dirinfo->dir.fd_startcluster;
+  if (fat_dirindexseek(fs, di, di->di_firstfree, &dir) < 0)
+    {
+      return -ENOSYS;
+    }
+
+  dirinfo->dir = dir;
+  return OK;
+}
+
+/****************************************************************************
+ * Name: fat_dirindexadd
+ *
+ * Description:
+ *   Record the name that has just been written at the position described
+ *   by dirinfo->fd_seq in the directory described by dirinfo->dir.
+ *
+ *   The callers expect the directory sector to remain in fs_buffer, so it
+ *   is restored if following the directory cluster chain replaced it.
+ *
+ ****************************************************************************/
+
+void fat_dirindexadd(FAR struct fat_mountpt_s *fs,
+                     FAR struct fat_dirinfo_s *dirinfo)
+{
+  FAR struct fat_dirindex_s *di;
+  off_t cached = fs->fs_currentsector;
+  uint32_t lfnhash = 0;
+  int first;
+  int last;
+
+  di = fat_dirindexget(fs, dirinfo->dir.fd_startcluster, false);
+  if (!di)
+    {
+      return;
+    }
+
+  last = fat_dirindexentry(fs, di, dirinfo->fd_seq.ds_sector,
+                           dirinfo->fd_seq.ds_offset);
+  first = last;
+
+#ifdef CONFIG_FAT_LFN
+  if (dirinfo->fd_lfname[0] != '\0')
+    {
+      first   = fat_dirindexentry(fs, di, dirinfo->fd_seq.ds_lfnsector,
+                                  dirinfo->fd_seq.ds_lfnoffset);
+      lfnhash = fat_dirindexhash(dirinfo->fd_lfname,
+                                 strlen((FAR char *)dirinfo->fd_lfname));
+    }
+#endif
+
+  if (first < 0 || last < 0 ||
+      fat_dirindexaddname(di, lfnhash,
+                          fat_dirindexhash(dirinfo->fd_name, DIR_MAXFNAME),
+                          first) < 0)
+    {
+      /* Forget the index rather than let it become wrong */
+
+      fat_dirindexinvalidate(di);
+    }
+  else if (first == di->di_firstfree)
+    {
+      di->di_firstfree = last + 1;
+    }
+
+  if (fs->fs_currentsector != cached)
+    {
+      (void)fat_fscacheread(fs, cached);
+    }
+}
+
+/****************************************************************************
+ * Name: fat_dirindexremove
+ *
+ * Description:
+ *   Forget the name occupying the directory entries described by 'seq'.
+ *   This is called before the entries are freed.
+ *
+ ****************************************************************************/
+
+void fat_dirindexremove(FAR struct fat_mountpt_s *fs,
+                        FAR struct fat_dirseq_s *seq)
+{
+  FAR struct fat_dirindex_s *di;
+  off_t sector;
+  int offset;
+  int first;
+  int last;
+  int i;
+  int j;
+
+#ifdef CONFIG_FAT_LFN
+  sector = seq->ds_lfnsector;
+  offset = seq->ds_lfnoffset;
+#else
+  sector = seq->ds_sector;
+  offset = seq->ds_offset;
+#endif
+
+  /* Find the index (if any) of the directory holding the entries */
+
+  for (i = 0; i < CONFIG_FAT_DIRINDEX_NDIRS; i++)
+    {
+      di = &fs->fs_dirindex[i];
+      if (!di->di_valid)
+        {
+          continue;
+        }
+
+      first = fat_dirindexentry(fs, di, sector, offset);
+      last  = fat_dirindexentry(fs, di, seq->ds_sector, seq->ds_offset);
+      if (first < 0 || last < 0)
+        {
+          continue;
+        }
+
+      /* Remove the names starting in the freed range */
+
+      for (j = 0; j < di->di_nnames; )
+        {
+          if (di->di_names[j].dn_entry >= first &&
+              di->di_names[j].dn_entry <= last)
+            {
+              di->di_names[j] = di->di_names[--di->di_nnames];
+            }
+          else
+            {
+              j++;
+            }
+        }
+
+      if (first < di->di_firstfree)
+        {
+          di->di_firstfree = first;
+        }
+
+      return;
+    }
+}
+
+/****************************************************************************
+ * Name: fat_dirindexdrop
+ *
+ * Description:
+ *   Discard the index of a directory that is being removed.
+ *
+ ****************************************************************************/
+
+void fat_dirindexdrop(FAR struct fat_mountpt_s *fs, off_t startcluster)
+{
+  int i;
+
+  for (i = 0; i < CONFIG_FAT_DIRINDEX_NDIRS; i++)
+    {
+      if (fs->fs_dirindex[i].di_inuse &&
+          fs->fs_dirindex[i].di_startcluster == startcluster)
+        {
+          fat_dirindexinvalidate(&fs->fs_dirindex[i]);
+        }
+    }
+}
+
+/****************************************************************************
+ * Name: fat_dirindexrelease
+ *
+ * Description:
+ *   Free all directory indexes of a volume (when it is unmounted).
+ *
+ ****************************************************************************/
+
+void fat_dirindexrelease(FAR struct fat_mountpt_s *fs)
+{
+  int i;
+
+  for (i = 0; i < CONFIG_FAT_DIRINDEX_NDIRS; i++)
+    {
+      fat_dirindexinvalidate(&fs->fs_dirindex[i]);
+    }
+}
+
+#endif /* CONFIG_FAT_DIRINDEX */
@@ -59,6 +59,7 @@
 #include <nuttx/kmalloc.h>
 #include <nuttx/fs/fs.h>
 #include <nuttx/fs/fat.h>
+#include <nuttx/fs/ioctl.h>
 
 #include "inode/inode.h"
 #include "fs_fat32.h"
@@ -88,1247 +89,2337 @@
  ****************************************************************************/
 
 /****************************************************************************
- * Name: fat_checkfsinfo
+ * Name: fat_cacheselect
  *
  * Description:
- *   Read the FAT32 FSINFO sector
+ *   Make fs_cache[slot] the selected sector cache entry, i.e., the one that
+ *   is accessed through fs_buffer, fs_currentsector and fs_dirty.
  *
  ****************************************************************************/
 
-static int fat_checkfsinfo(struct fat_mountpt_s *fs)
+static void fat_cacheselect(struct fat_mountpt_s *fs, int slot)
 {
-  /* Make sure that the fsinfo sector is in the cache */
+  struct fat_cache_s *cache;
 
-  if (fat_fscacheread(fs, fs->fs_fsinfo) == OK)
-    {
-      /* Verify that this is, indeed, an FSINFO sector */
+  /* Save the state of the currently selected entry */
 
-      if (FSI_GETLEADSIG(fs->fs_buffer) == 0x41615252  &&
-          FSI_GETSTRUCTSIG(fs->fs_buffer) == 0x61417272 &&
-          FSI_GETTRAILSIG(fs->fs_buffer) == BOOT_SIGNATURE32)
-        {
-          fs->fs_fsifreecount = FSI_GETFREECOUNT(fs->fs_buffer);
-          fs->fs_fsinextfree  = FSI_GETNXTFREE(fs->fs_buffer);
-          return OK;
-        }
-    }
+  cache            = &fs->fs_cache[fs->fs_cacheslot];
+  cache->fc_sector = fs->fs_currentsector;
+  cache->fc_dirty  = fs->fs_dirty;
 
-  return -ENODEV;
+  /* Then select the new entry and mark it as the most recently used */
+
+  cache                = &fs->fs_cache[slot];
+  cache->fc_age        = ++fs->fs_cacheage;
+  fs->fs_cacheslot     = slot;
+  fs->fs_currentsector = cache->fc_sector;
+  fs->fs_dirty         = cache->fc_dirty;
+  fs->fs_buffer        = cache->fc_buffer;
 }
 
 /****************************************************************************
- * Name: fat_checkbootrecord
+ * Name: fat_cachelookup
  *
  * Description:
- *   Read a sector and verify that it is a a FAT boot record.
+ *   Find the sector cache entry that holds 'sector'.  If the sector is not
+ *   cached, return the entry to be replaced:  An unused entry if there is
+ *   one, otherwise the least recently used entry.  FAT sectors and all
+ *   other sectors are cached in separate pools.
  *
  ****************************************************************************/
 
-static int fat_checkbootrecord(struct fat_mountpt_s *fs)
+static int fat_cachelookup(struct fat_mountpt_s *fs, off_t sector,
+                           bool *hit)
 {
-  uint32_t ndatasectors;
-  uint32_t ntotalfatsects;
-  uint16_t rootdirsectors = 0;
-  bool     notfat32 = false;
+  struct fat_cache_s *cache;
+  off_t    cached;
+  uint32_t age;
+  uint32_t oldest;
+  int      victim;
+  int      first;
+  int      last;
+  int      i;
+
+  /* Select the pool */
+
+  if (sector >= fs->fs_fatbase && sector < fs->fs_fatbase + fs->fs_nfatsects)
+    {
+      first = 0;
+      last  = CONFIG_FAT_FATCACHE_NSECTORS;
+    }
+  else
+    {
+      first = CONFIG_FAT_FATCACHE_NSECTORS;
+      last  = FAT_NCACHESECTORS;
+    }
 
-  /* Verify the MBR signature at offset 510 in the sector (true even
-   * if the sector size is greater than 512.  All FAT file systems have
-   * this signature. On a FAT32 volume, the RootEntCount , FatSz16, and
-   * FatSz32 values should always be zero.  The FAT sector size should
-   * match the reported hardware sector size.
-   */
+  victim = first;
+  oldest = 0;
 
-  if (MBR_GETSIGNATURE(fs->fs_buffer) != BOOT_SIGNATURE16 ||
-      MBR_GETBYTESPERSEC(fs->fs_buffer) != fs->fs_hwsectorsize)
+  for (i = first; i < last; i++)
     {
-      fdbg("ERROR: Signature: %04x FS sectorsize: %d HW sectorsize: %d\n",
-            MBR_GETSIGNATURE(fs->fs_buffer), MBR_GETBYTESPERSEC(fs->fs_buffer),
-            fs->fs_hwsectorsize);
+      cache  = &fs->fs_cache[i];
+      cached = (i == fs->fs_cacheslot) ? fs->fs_currentsector :
+                                          cache->fc_sector;
+      if (cached == sector)
+        {
+          *hit = true;
+          return i;
+        }
 
-      return -EINVAL;
+      /* The age is relative to the current time so that it is not affected
+       * by wrap-around of fs_cacheage.  Unused entries are the oldest.
+       */
+
+      age = cached < 0 ? UINT32_MAX : fs->fs_cacheage - cache->fc_age;
+      if (age >= oldest)
+        {
+          victim = i;
+          oldest = age;
+        }
     }
 
-  /* Verify the FAT32 file system type. The determination of the file
-   * system type is based on the number of clusters on the volume:  FAT12
-   * volume has <= FAT_MAXCLUST12 (4084) clusters, a FAT16 volume has <=
-   * FAT_MAXCLUST16 (Microsoft says < 65,525) clusters, and any larger
-   * is FAT32.
-   *
-   * Get the number of 32-bit directory entries in root directory (zero
-   * for FAT32).
-   */
+  *hit = false;
+  return victim;
+}
 
-  fs->fs_rootentcnt = MBR_GETROOTENTCNT(fs->fs_buffer);
-  if (fs->fs_rootentcnt != 0)
-    {
-      notfat32       = true; /* Must be zero for FAT32 */
-      rootdirsectors = (32 * fs->fs_rootentcnt  + fs->fs_hwsectorsize - 1) / fs->fs_hwsectorsize;
-    }
+/****************************************************************************
+ * Name: fat_cacheinvalidate
+ *
+ * Description:
+ *   Discard any cached copy of sectors that have just been written to the
+ *   media from some other buffer.  Data clusters may be reused as directory
+ *   clusters (and vice versa) so this keeps the sector cache coherent with
+ *   direct sector writes.  If buffer is NULL, every cached copy in the range
+ *   is discarded.
+ *
+ ****************************************************************************/
 
-  /* Determine the number of sectors in a FAT. */
+static void fat_cacheinvalidate(struct fat_mountpt_s *fs, uint8_t *buffer,
+                                off_t sector, unsigned int nsectors)
+{
+  struct fat_cache_s *cache;
+  off_t cached;
+  int   i;
 
-  fs->fs_nfatsects = MBR_GETFATSZ16(fs->fs_buffer); /* Should be zero */
-  if (fs->fs_nfatsects)
-    {
-      notfat32 = true; /* Must be zero for FAT32 */
-    }
-  else
+  for (i = 0; i < FAT_NCACHESECTORS; i++)
     {
-      fs->fs_nfatsects = MBR_GETFATSZ32(fs->fs_buffer);
-    }
+      cache  = &fs->fs_cache[i];
+      cached = (i == fs->fs_cacheslot) ? fs->fs_currentsector :
+                                          cache->fc_sector;
 
-  if (!fs->fs_nfatsects || fs->fs_nfatsects >= fs->fs_hwnsectors)
-    {
-      fdbg("ERROR: fs_nfatsects %d fs_hwnsectors: %d\n",
-           fs->fs_nfatsects, fs->fs_hwnsectors);
+      if (cached >= sector && cached < sector + nsectors &&
+          (buffer == NULL || cache->fc_buffer !=
+           buffer + (cached - sector) * fs->fs_hwsectorsize))
+        {
+          cache->fc_sector = -1;
+          cache->fc_dirty  = false;
 
-      return -EINVAL;
+          if (i == fs->fs_cacheslot)
+            {
+              fs->fs_currentsector = -1;
+              fs->fs_dirty         = false;
+            }
+        }
     }
+}
 
-  /* Get the total number of sectors on the volume. */
+/****************************************************************************
+ * Name: fat_cachewrite
+ *
+ * Description:
+ *   Write one cached sector back to the media.  Sectors in the FAT region
+ *   are also written to each copy of the FAT.
+ *
+ ****************************************************************************/
 
-  fs->fs_fattotsec = MBR_GETTOTSEC16(fs->fs_buffer); /* Should be zero */
-  if (fs->fs_fattotsec)
-    {
-      notfat32 = true; /* Must be zero for FAT32 */
-    }
-  else
-    {
-      fs->fs_fattotsec = MBR_GETTOTSEC32(fs->fs_buffer);
-    }
+static int fat_cachewrite(struct fat_mountpt_s *fs, uint8_t *buffer,
+                          off_t sector)
+{
+  int ret;
+  int i;
 
-  if (!fs->fs_fattotsec || fs->fs_fattotsec > fs->fs_hwnsectors)
-    {
-      fdbg("ERROR: fs_fattotsec %d fs_hwnsectors: %d\n",
-           fs->fs_fattotsec, fs->fs_hwnsectors);
+  /* Write the dirty sector */
 
-      return -EINVAL;
+  ret = fat_hwwrite(fs, buffer, sector, 1);
+  if (ret < 0)
+    {
+      return ret;
     }
 
-  /* Get the total number of reserved sectors */
+  /* Does the sector lie in the FAT region? */
 
-  fs->fs_fatresvdseccount = MBR_GETRESVDSECCOUNT(fs->fs_buffer);
-  if (fs->fs_fatresvdseccount > fs->fs_hwnsectors)
+  if (sector >= fs->fs_fatbase && sector < fs->fs_fatbase + fs->fs_nfatsects)
     {
-      fdbg("ERROR: fs_fatresvdseccount %d fs_hwnsectors: %d\n",
-           fs->fs_fatresvdseccount, fs->fs_hwnsectors);
+      /* Yes, then make the change in the FAT copy as well */
 
-      return -EINVAL;
+      for (i = fs->fs_fatnumfats; i >= 2; i--)
+        {
+          sector += fs->fs_nfatsects;
+          ret = fat_hwwrite(fs, buffer, sector, 1);
+          if (ret < 0)
+            {
+              return ret;
+            }
+        }
     }
 
-  /* Get the number of FATs. This is probably two but could have other values */
+  return OK;
+}
 
-  fs->fs_fatnumfats = MBR_GETNUMFATS(fs->fs_buffer);
-  ntotalfatsects = fs->fs_fatnumfats * fs->fs_nfatsects;
+/****************************************************************************
+ * Name: fat_discardissue
+ *
+ * Description:
+ *   Discard all pending runs of freed clusters.  The caller must have
+ *   written back the sector cache so that the FAT no longer refers to the
+ *   clusters on the media.  Discarding is only advisory so failures are
+ *   not reported.
+ *
+ ****************************************************************************/
 
-  /* Get the total number of data sectors */
+#ifdef CONFIG_FAT_DISCARD
+static void fat_discardissue(struct fat_mountpt_s *fs)
+{
+  struct inode *inode = fs->fs_blkdriver;
+  struct fat_discard_s *run;
+  struct bioc_discard_s discard;
+  int ret;
+  int i;
 
-  ndatasectors = fs->fs_fattotsec - fs->fs_fatresvdseccount - ntotalfatsects - rootdirsectors;
-  if (ndatasectors > fs->fs_hwnsectors)
+  for (i = 0; i < fs->fs_ndiscards && !fs->fs_nodiscard; i++)
     {
-      fdbg("ERROR: ndatasectors %d fs_hwnsectors: %d\n",
-           ndatasectors, fs->fs_hwnsectors);
-
-      return -EINVAL;
-    }
-
-  /* Get the sectors per cluster */
+      run = &fs->fs_discard[i];
 
-  fs->fs_fatsecperclus = MBR_GETSECPERCLUS(fs->fs_buffer);
+      discard.bd_startsector = fat_cluster2sector(fs, run->fd_cluster);
+      discard.bd_nsectors    = run->fd_count * fs->fs_fatsecperclus;
+      discard.bd_zeroed      = false;
 
-  /* Calculate the number of clusters */
+      ret = -ENOTTY;
+      if (inode && inode->u.i_bops && inode->u.i_bops->ioctl)
+        {
+          ret = inode->u.i_bops->ioctl(inode, BIOC_DISCARD,
+                                       (unsigned long)((uintptr_t)&discard));
+        }
 
-  fs->fs_nclusters = ndatasectors / fs->fs_fatsecperclus;
+      if (ret == -ENOTTY)
+        {
+          /* Don't bother the block driver again */
 
-  /* Finally, the test: */
+          fs->fs_nodiscard = true;
+        }
+      else if (ret < 0)
+        {
+          fdbg("ERROR: Discard of %u clusters at %u failed: %d\n",
+               run->fd_count, run->fd_cluster, ret);
+        }
+      else
+        {
+          /* Cached copies of the discarded sectors are now stale */
 
-  if (fs->fs_nclusters <= FAT_MAXCLUST12)
-    {
-      fs->fs_fsinfo = 0;
-      fs->fs_type   = FSTYPE_FAT12;
-    }
-  else if (fs->fs_nclusters <= FAT_MAXCLUST16)
-    {
-      fs->fs_fsinfo = 0;
-      fs->fs_type   = FSTYPE_FAT16;
-    }
-  else if (!notfat32)
-    {
-      fs->fs_fsinfo = fs->fs_fatbase + MBR_GETFSINFO(fs->fs_buffer);
-      fs->fs_type   = FSTYPE_FAT32;
+          fat_cacheinvalidate(fs, NULL, discard.bd_startsector,
+                              discard.bd_nsectors);
+        }
     }
-  else
-    {
-      fdbg("ERROR: notfat32: %d fs_nclusters: %d\n",
-           notfat32, fs->fs_nclusters);
 
-      return -EINVAL;
-    }
+  fs->fs_ndiscards = 0;
+}
+#endif
 
-  /* We have what appears to be a valid FAT filesystem! Save a few more
-   * things from the boot record that we will need later.
-   */
+/****************************************************************************
+ * Name: fat_discardadd
+ *
+ * Description:
+ *   Add a run of freed clusters to the runs waiting to be discarded.  If
+ *   there is no room for another run, the sector cache is written back and
+ *   the pending runs are discarded first.
+ *
+ ****************************************************************************/
 
-  fs->fs_fatbase     += fs->fs_fatresvdseccount;
+#ifdef CONFIG_FAT_DISCARD
+static int fat_discardadd(struct fat_mountpt_s *fs, uint32_t cluster,
+                          uint32_t count)
+{
+  struct fat_discard_s *run;
+  int ret;
+  int i;
 
-  if (fs->fs_type == FSTYPE_FAT32)
+  if (fs->fs_nodiscard || count == 0)
     {
-      fs->fs_rootbase = MBR_GETROOTCLUS(fs->fs_buffer);
+      return OK;
     }
-  else
+
+  /* Extend a pending run if the clusters are adjacent to it */
+
+  for (i = 0; i < fs->fs_ndiscards; i++)
     {
-      fs->fs_rootbase = fs->fs_fatbase + ntotalfatsects;
+      run = &fs->fs_discard[i];
+      if (run->fd_cluster + run->fd_count == cluster)
+        {
+          run->fd_count += count;
+          return OK;
+        }
+      else if (cluster + count == run->fd_cluster)
+        {
+          run->fd_cluster = cluster;
+          run->fd_count  += count;
+          return OK;
+        }
     }
 
-  fs->fs_database     = fs->fs_fatbase + ntotalfatsects + fs->fs_rootentcnt / DIRSEC_NDIRS(fs);
-  fs->fs_fsifreecount = 0xffffffff;
+  /* Make room for a new run if necessary */
 
+  if (fs->fs_ndiscards >= CONFIG_FAT_DISCARD_NRUNS)
+    {
+      ret = fat_fscacheflush(fs);
+      if (ret < 0)
+        {
+          return ret;
+        }
+
+      fat_discardissue(fs);
+    }
+
+  run             = &fs->fs_discard[fs->fs_ndiscards++];
+  run->fd_cluster = cluster;
+  run->fd_count   = count;
   return OK;
 }
+#endif
 
 /****************************************************************************
- * Public Functions
- ****************************************************************************/
-
-/****************************************************************************
- * Name: fat_getuint16
+ * Name: fat_discardcancel
+ *
+ * Description:
+ *   A cluster is being allocated.  Remove it from the runs waiting to be
+ *   discarded.  If that would split a run and there is no room for another
+ *   run, the end of the run is simply not discarded.
+ *
  ****************************************************************************/
 
-uint16_t fat_getuint16(uint8_t *ptr)
+#ifdef CONFIG_FAT_DISCARD
+static void fat_discardcancel(struct fat_mountpt_s *fs, uint32_t cluster)
 {
-  /* NOTE that (1) this operation is independent of endian-ness and that (2)
-   * byte-by-byte transfer is necessary in any case because the address may be
-   * unaligned.
-   */
+  struct fat_discard_s *run;
+  uint32_t end;
+  int i;
 
-  return ((uint16_t)ptr[1] << 8) | ptr[0];
+  for (i = 0; i < fs->fs_ndiscards; i++)
+    {
+      run = &fs->fs_discard[i];
+      end = run->fd_cluster + run->fd_count;
+
+      if (cluster < run->fd_cluster || cluster >= end)
+        {
+          continue;
+        }
+
+      /* Trim the run, or split it in two */
+
+      if (cluster == run->fd_cluster)
+        {
+          run->fd_cluster++;
+          run->fd_count--;
+        }
+      else
+        {
+          run->fd_count = cluster - run->fd_cluster;
+          if (cluster + 1 < end &&
+              fs->fs_ndiscards < CONFIG_FAT_DISCARD_NRUNS)
+            {
+              fs->fs_discard[fs->fs_ndiscards].fd_cluster = cluster + 1;
+              fs->fs_discard[fs->fs_ndiscards].fd_count   = end - cluster - 1;
+              fs->fs_ndiscards++;
+            }
+        }
+
+      /* Remove the run if nothing is left of it */
+
+      if (run->fd_count == 0)
+        {
+          *run = fs->fs_discard[--fs->fs_ndiscards];
+        }
+
+      return;
+    }
 }
+#endif
 
+#ifdef CONFIG_FAT_FREEBITMAP
 /****************************************************************************
- * Name: fat_getuint32
+ * Name: fat_bmscan
+ *
+ * Description:
+ *   Bring one unit of the free cluster bitmap up to date from the FAT.  A
+ *   unit is the set of clusters described by one FAT sector (FAT16 and
+ *   FAT32) or the whole FAT (FAT12, whose entries straddle sectors).
+ *
  ****************************************************************************/
 
-uint32_t fat_getuint32(uint8_t *ptr)
+static int fat_bmscan(struct fat_mountpt_s *fs, uint32_t unit)
 {
-  /* NOTE that (1) this operation is independent of endian-ness and that (2)
-   * byte-by-byte transfer is necessary in any case because the address may be
-   * unaligned.
-   */
+  uint32_t first = unit * fs->fs_bmunitclusters;
+  uint32_t last  = first + fs->fs_bmunitclusters;
+  uint32_t cluster;
+  uint32_t next;
+  off_t    entry;
+  int      ret;
 
-  return ((uint32_t)fat_getuint16(&ptr[2]) << 16) | fat_getuint16(&ptr[0]);
-}
+  if (last > fs->fs_nclusters)
+    {
+      last = fs->fs_nclusters;
+    }
 
-/****************************************************************************
- * Name: fat_putuint16
- ****************************************************************************/
+  if (fs->fs_type != FSTYPE_FAT12)
+    {
+      ret = fat_fscacheread(fs, fs->fs_fatbase + unit);
+      if (ret < 0)
+        {
+          return ret;
+        }
+    }
 
-void fat_putuint16(FAR uint8_t *ptr, uint16_t value16)
-{
-  FAR uint8_t *val = (FAR uint8_t *)&value16;
+  for (cluster = first; cluster < last; cluster++)
+    {
+      if (cluster < 2)
+        {
+          /* The two reserved entries are never free */
 
-#ifdef CONFIG_ENDIAN_BIG
-  /* If the target is big-endian then the bytes always have to be swapped so
-   * that the representation is litle endian in the file system.
-   */
+          next = 1;
+        }
+      else if (fs->fs_type == FSTYPE_FAT16)
+        {
+          next = FAT_GETFAT16(fs->fs_buffer, 2 * (cluster - first));
+        }
+      else if (fs->fs_type == FSTYPE_FAT32)
+        {
+          next = FAT_GETFAT32(fs->fs_buffer, 4 * (cluster - first)) &
+                 0x0fffffff;
+        }
+      else
+        {
+          entry = fat_getcluster(fs, cluster);
+          if (entry < 0)
+            {
+              return entry;
+            }
 
-  ptr[0] = val[1];
-  ptr[1] = val[0];
+          next = entry;
+        }
 
-#else
-  /* Byte-by-byte transfer is still necessary because the address may be
-   * un-aligned.
-   */
+      if (next != 0)
+        {
+          fs->fs_freemap[cluster >> 5] |= (1u << (cluster & 31));
+        }
+      else
+        {
+          fs->fs_freemap[cluster >> 5] &= ~(1u << (cluster & 31));
+        }
+    }
 
-  ptr[0] = val[0];
-  ptr[1] = val[1];
-#endif
+  fs->fs_scanmap[unit >> 5] |= (1u << (unit & 31));
+  return OK;
 }
 
 /****************************************************************************
- * Name: fat_putuint32
+ * Name: fat_bmscanned
+ *
+ * Description:
+ *   Return true if the bitmap unit holding 'cluster' has been scanned.
+ *
  ****************************************************************************/
 
-void fat_putuint32(FAR uint8_t *ptr, uint32_t value32)
+static inline bool fat_bmscanned(struct fat_mountpt_s *fs, uint32_t cluster)
 {
-  FAR uint16_t *val = (FAR uint16_t *)&value32;
-
-#ifdef CONFIG_ENDIAN_BIG
-  /* If the target is big-endian then the bytes always have to be swapped so
-   * that the representation is litle endian in the file system.
-   */
-
-  fat_putuint16(&ptr[0], val[1]);
-  fat_putuint16(&ptr[2], val[0]);
-
-#else
-  /* Byte-by-byte transfer is still necessary because the address may be
-   * un-aligned.
-   */
-
-  fat_putuint16(&ptr[0], val[0]);
-  fat_putuint16(&ptr[2], val[1]);
-#endif
+  uint32_t unit = cluster / fs->fs_bmunitclusters;
+  return (fs->fs_scanmap[unit >> 5] & (1u << (unit & 31))) != 0;
 }
 
 /****************************************************************************
- * Name: fat_semtake
+ * Name: fat_bmsearch
+ *
+ * Description:
+ *   Return the first cluster in the range [lo, hi) whose bit in the free
+ *   cluster bitmap is clear, or 'hi' if there is none.  Whole words of
+ *   in-use clusters are skipped at once.
+ *
  ****************************************************************************/
 
-void fat_semtake(struct fat_mountpt_s *fs)
+static uint32_t fat_bmsearch(FAR const uint32_t *map, uint32_t lo,
+                             uint32_t hi)
 {
-  /* Take the semaphore (perhaps waiting) */
+  uint32_t word;
+  uint32_t bit;
 
-  while (sem_wait(&fs->fs_sem) != 0)
+  while (lo < hi)
     {
-      /* The only case that an error should occur here is if
-       * the wait was awakened by a signal.
-       */
+      /* Treat the bits below 'lo' in the first word as used */
 
-      ASSERT(*get_errno_ptr() == EINTR);
-    }
-}
+      word = map[lo >> 5] | ((1u << (lo & 31)) - 1);
+      if (word != 0xffffffff)
+        {
+          for (bit = 0; (word & (1u << bit)) != 0; bit++);
 
-/****************************************************************************
- * Name: fat_semgive
- ****************************************************************************/
+          lo = (lo & ~31) + bit;
+          return lo < hi ? lo : hi;
+        }
 
-void fat_semgive(struct fat_mountpt_s *fs)
-{
-   sem_post(&fs->fs_sem);
+      lo = (lo | 31) + 1;
+    }
+
+  return hi;
 }
 
 /****************************************************************************
- * Name: fat_systime2fattime
+ * Name: fat_bmfindfree
  *
  * Description:
- *   Get the system time convert to a time and and date suitable for
- *   writing into the FAT FS.
+ *   Find a free cluster using the free cluster bitmap.  The search starts
+ *   just after 'start' and wraps around to cluster 2, so that a chain that
+ *   is being extended stays as close to its last cluster as possible.
+ *   Parts of the bitmap that have not been built yet are scanned from the
+ *   FAT as the search reaches them.
  *
- *    TIME in LS 16-bits:
- *      Bits 0:4   = 2 second count (0-29 representing 0-58 seconds)
- *      Bits 5-10  = minutes (0-59)
- *      Bits 11-15 = hours (0-23)
- *    DATE in MS 16-bits
- *      Bits 0:4   = Day of month (1-31)
- *      Bits 5:8   = Month of year (1-12)
- *      Bits 9:15  = Year from 1980 (0-127 representing 1980-2107)
+ * Returned Value:
+ *   The free cluster number, zero if there is no free cluster, or a
+ *   negated errno value on failure.
  *
  ****************************************************************************/
 
-uint32_t fat_systime2fattime(void)
+static int32_t fat_bmfindfree(struct fat_mountpt_s *fs, uint32_t start)
 {
-  /* Unless you have a hardware RTC or some other to get accurate time, then
-   * there is no reason to support FAT time.
-   */
-
-#ifdef CONFIG_FS_FATTIME
-  struct timespec ts;
-  struct tm tm;
-  int ret;
+  uint32_t range[2][2];
+  uint32_t cluster;
+  uint32_t end;
+  uint32_t found;
+  int      ret;
+  int      i;
 
-  /* Get the current time in seconds and nanoseconds */
+  range[0][0] = start + 1;
+  range[0][1] = fs->fs_nclusters;
+  range[1][0] = 2;
+  range[1][1] = start + 1;
 
-  ret = clock_gettime(CLOCK_REALTIME, &ts);
-  if (ret == OK)
+  for (i = 0; i < 2; i++)
     {
-      /* Break done the seconds in date and time units */
-
-      if (gmtime_r((FAR const time_t *)&ts.tv_sec, &tm) != NULL)
+      for (cluster = range[i][0]; cluster < range[i][1]; cluster = end)
         {
-          /* FAT can only represent dates since 1980.  struct tm can
-           * represent dates since 1900.
-           */
-
-          if (tm.tm_year >= 80)
+          if (!fat_bmscanned(fs, cluster))
             {
-              uint16_t fattime;
-              uint16_t fatdate;
-
-              fattime  = (tm.tm_sec       >>  1) & 0x001f; /* Bits 0-4: 2 second count (0-29) */
-              fattime |= (tm.tm_min       <<  5) & 0x07e0; /* Bits 5-10: minutes (0-59) */
-              fattime |= (tm.tm_hour      << 11) & 0xf800; /* Bits 11-15: hours (0-23) */
+              ret = fat_bmscan(fs, cluster / fs->fs_bmunitclusters);
+              if (ret < 0)
+                {
+                  return ret;
+                }
+            }
 
-              fatdate  =  tm.tm_mday             & 0x001f; /* Bits 0-4: Day of month (1-31) */
-              fatdate |= ((tm.tm_mon+1)   <<  5) & 0x01e0; /* Bits 5-8: Month of year (1-12) */
-              fatdate |= ((tm.tm_year-80) <<  9) & 0xfe00; /* Bits 9-15: Year from 1980 */
+          end = (cluster / fs->fs_bmunitclusters + 1) * fs->fs_bmunitclusters;
+          if (end > range[i][1])
+            {
+              end = range[i][1];
+            }
 
-              return (uint32_t)fatdate << 16 | (uint32_t)fattime;
+          found = fat_bmsearch(fs->fs_freemap, cluster, end);
+          if (found < end)
+            {
+              return found;
             }
         }
     }
-#endif
 
   return 0;
 }
+#endif
 
 /****************************************************************************
- * Name: fat_fattime2systime
+ * Name: fat_checkfsinfo
  *
  * Description:
- *   Convert FAT data and time to a system time_t
- *
- *    16-bit FAT time:
- *      Bits 0:4   = 2 second count (0-29 representing 0-58 seconds)
- *      Bits 5-10  = minutes (0-59)
- *      Bits 11-15 = hours (0-23)
- *    16-bit FAT date:
- *      Bits 0:4   = Day of month (1-31)
- *      Bits 5:8   = Month of year (1-12)
- *      Bits 9:15  = Year from 1980 (0-127 representing 1980-2107)
+ *   Read the FAT32 FSINFO sector
  *
  ****************************************************************************/
 
-time_t fat_fattime2systime(uint16_t fattime, uint16_t fatdate)
+static int fat_checkfsinfo(struct fat_mountpt_s *fs)
 {
-  /* Unless you have a hardware RTC or some other to get accurate time, then
-   * there is no reason to support FAT time.
-   */
-
-#ifdef CONFIG_FS_FATTIME
-  struct tm tm;
-  unsigned int tmp;
-
-  /* Break out the date and time */
-
-  tm.tm_sec  =  (fattime & 0x001f) <<  1;       /* Bits 0-4: 2 second count (0-29) */
-  tm.tm_min  =  (fattime & 0x07e0) >>  5;       /* Bits 5-10: minutes (0-59) */
-  tm.tm_hour =  (fattime & 0xf800) >> 11;       /* Bits 11-15: hours (0-23) */
+  /* Make sure that the fsinfo sector is in the cache */
 
-  tm.tm_mday =  (fatdate & 0x001f);             /* Bits 0-4: Day of month (1-31) */
-  tmp        = ((fatdate & 0x01e0) >>  5);      /* Bits 5-8: Month of year (1-12) */
-  tm.tm_mon  =   tmp > 0 ? tmp-1 : 0;
-  tm.tm_year = ((fatdate & 0xfe00) >>  9) + 80; /* Bits 9-15: Year from 1980 */
+  if (fat_fscacheread(fs, fs->fs_fsinfo) == OK)
+    {
+      /* Verify that this is, indeed, an FSINFO sector */
 
-  /* Then convert the broken out time into seconds since the epoch */
+      if (FSI_GETLEADSIG(fs->fs_buffer) == 0x41615252  &&
+          FSI_GETSTRUCTSIG(fs->fs_buffer) == 0x61417272 &&
+          FSI_GETTRAILSIG(fs->fs_buffer) == BOOT_SIGNATURE32)
+        {
+          fs->fs_fsifreecount = FSI_GETFREECOUNT(fs->fs_buffer);
+          fs->fs_fsinextfree  = FSI_GETNXTFREE(fs->fs_buffer);
+          return OK;
+        }
+    }
 
-  return mktime(&tm);
-#else
-  return 0;
-#endif
+  return -ENODEV;
 }
 
 /****************************************************************************
- * Name: fat_mount
+ * Name: fat_checkbootrecord
  *
  * Description:
- *   This function is called only when the mountpoint is first established.
- *   It initializes the mountpoint structure and verifies that a valid FAT32
- *   filesystem is provided by the block driver.
- *
- *   The caller should hold the mountpoint semaphore
+ *   Read a sector and verify that it is a a FAT boot record.
  *
  ****************************************************************************/
 
-int fat_mount(struct fat_mountpt_s *fs, bool writeable)
+static int fat_checkbootrecord(struct fat_mountpt_s *fs)
 {
-  FAR struct inode *inode;
-  struct geometry geo;
-  int ret;
-
-  /* Assume that the mount is successful */
-
-  fs->fs_mounted = true;
+  uint32_t ndatasectors;
+  uint32_t ntotalfatsects;
+  uint16_t rootdirsectors = 0;
+  bool     notfat32 = false;
 
-  /* Check if there is media available */
+  /* Verify the MBR signature at offset 510 in the sector (true even
+   * if the sector size is greater than 512.  All FAT file systems have
+   * this signature. On a FAT32 volume, the RootEntCount , FatSz16, and
+   * FatSz32 values should always be zero.  The FAT sector size should
+   * match the reported hardware sector size.
+   */
 
-  inode = fs->fs_blkdriver;
-  if (!inode || !inode->u.i_bops || !inode->u.i_bops->geometry ||
-      inode->u.i_bops->geometry(inode, &geo) != OK || !geo.geo_available)
+  if (MBR_GETSIGNATURE(fs->fs_buffer) != BOOT_SIGNATURE16 ||
+      MBR_GETBYTESPERSEC(fs->fs_buffer) != fs->fs_hwsectorsize)
     {
-      ret = -ENODEV;
-      goto errout;
+      fdbg("ERROR: Signature: %04x FS sectorsize: %d HW sectorsize: %d\n",
+            MBR_GETSIGNATURE(fs->fs_buffer), MBR_GETBYTESPERSEC(fs->fs_buffer),
+            fs->fs_hwsectorsize);
+
+      return -EINVAL;
     }
 
-  /* Make sure that that the media is write-able (if write access is needed) */
+  /* Verify the FAT32 file system type. The determination of the file
+   * system type is based on the number of clusters on the volume:  FAT12
+   * volume has <= FAT_MAXCLUST12 (4084) clusters, a FAT16 volume has <=
+   * FAT_MAXCLUST16 (Microsoft says < 65,525) clusters, and any larger
+   * is FAT32.
+   *
+   * Get the number of 32-bit directory entries in root directory (zero
+   * for FAT32).
+   */
 
-  if (writeable && !geo.geo_writeenabled)
+  fs->fs_rootentcnt = MBR_GETROOTENTCNT(fs->fs_buffer);
+  if (fs->fs_rootentcnt != 0)
     {
-      ret = -EACCES;
-      goto errout;
+      notfat32       = true; /* Must be zero for FAT32 */
+      rootdirsectors = (32 * fs->fs_rootentcnt  + fs->fs_hwsectorsize - 1) / fs->fs_hwsectorsize;
     }
 
-  /* Save the hardware geometry */
-
-  fs->fs_hwsectorsize = geo.geo_sectorsize;
-  fs->fs_hwnsectors   = geo.geo_nsectors;
+  /* Determine the number of sectors in a FAT. */
 
-  /* Allocate a buffer to hold one hardware sector */
+  fs->fs_nfatsects = MBR_GETFATSZ16(fs->fs_buffer); /* Should be zero */
+  if (fs->fs_nfatsects)
+    {
+      notfat32 = true; /* Must be zero for FAT32 */
+    }
+  else
+    {
+      fs->fs_nfatsects = MBR_GETFATSZ32(fs->fs_buffer);
+    }
 
-  fs->fs_buffer = (FAR uint8_t *)fat_io_alloc(fs->fs_hwsectorsize);
-  if (!fs->fs_buffer)
+  if (!fs->fs_nfatsects || fs->fs_nfatsects >= fs->fs_hwnsectors)
     {
-      ret = -ENOMEM;
-      goto errout;
+      fdbg("ERROR: fs_nfatsects %d fs_hwnsectors: %d\n",
+           fs->fs_nfatsects, fs->fs_hwnsectors);
+
+      return -EINVAL;
     }
 
-  /* Search FAT boot record on the drive.  First check at sector zero.  This
-   * could be either the boot record or a partition that refers to the boot
-   * record.
-   *
-   * First read sector zero.  This will be the first access to the drive and a
-   * likely failure point.
-   */
+  /* Get the total number of sectors on the volume. */
 
-  fs->fs_fatbase = 0;
-  ret = fat_hwread(fs, fs->fs_buffer, 0, 1);
-  if (ret < 0)
+  fs->fs_fattotsec = MBR_GETTOTSEC16(fs->fs_buffer); /* Should be zero */
+  if (fs->fs_fattotsec)
     {
-      goto errout_with_buffer;
+      notfat32 = true; /* Must be zero for FAT32 */
+    }
+  else
+    {
+      fs->fs_fattotsec = MBR_GETTOTSEC32(fs->fs_buffer);
     }
 
-  ret = fat_checkbootrecord(fs);
-  if (ret != OK)
+  if (!fs->fs_fattotsec || fs->fs_fattotsec > fs->fs_hwnsectors)
     {
-      /* The contents of sector 0 is not a boot record.  It could be a DOS
-       * partition, however.  Assume it is a partition and get the offset
-       * into the partition table.  This table is at offset MBR_TABLE and is
-       * indexed by 16x the partition number.
-       */
+      fdbg("ERROR: fs_fattotsec %d fs_hwnsectors: %d\n",
+           fs->fs_fattotsec, fs->fs_hwnsectors);
 
-      int i;
-      for (i = 0; i < 4; i++)
-        {
-          /* Check if the partition exists and, if so, get the bootsector for that
-           * partition and see if we can find the boot record there.
-           */
+      return -EINVAL;
+    }
 
-          uint8_t part = PART_GETTYPE(i, fs->fs_buffer);
-          fvdbg("Partition %d, offset %d, type %d\n", i, PART_ENTRY(i), part);
+  /* Get the total number of reserved sectors */
 
-          if (part == 0)
-            {
-              fvdbg("No partition %d\n", i);
-              continue;
-            }
+  fs->fs_fatresvdseccount = MBR_GETRESVDSECCOUNT(fs->fs_buffer);
+  if (fs->fs_fatresvdseccount > fs->fs_hwnsectors)
+    {
+      fdbg("ERROR: fs_fatresvdseccount %d fs_hwnsectors: %d\n",
+           fs->fs_fatresvdseccount, fs->fs_hwnsectors);
 
-          /* There appears to be a partition, get the sector number of the
-           * partition (LBA)
-           */
+      return -EINVAL;
+    }
 
-          fs->fs_fatbase = PART_GETSTARTSECTOR(i, fs->fs_buffer);
+  /* Get the number of FATs. This is probably two but could have other values */
 
-          /* Read the new candidate boot sector */
+  fs->fs_fatnumfats = MBR_GETNUMFATS(fs->fs_buffer);
+  ntotalfatsects = fs->fs_fatnumfats * fs->fs_nfatsects;
 
-          ret = fat_hwread(fs, fs->fs_buffer, fs->fs_fatbase, 1);
-          if (ret < 0)
-            {
-              /* Failed to read the sector */
+  /* Get the total number of data sectors */
 
-              fdbg("ERROR: Failed to read sector %ld: %d\n",
-                   (long)fs->fs_fatbase, ret);
-              continue;
-            }
+  ndatasectors = fs->fs_fattotsec - fs->fs_fatresvdseccount - ntotalfatsects - rootdirsectors;
+  if (ndatasectors > fs->fs_hwnsectors)
+    {
+      fdbg("ERROR: ndatasectors %d fs_hwnsectors: %d\n",
+           ndatasectors, fs->fs_hwnsectors);
 
-          /* Check if this is a boot record */
+      return -EINVAL;
+    }
 
-          ret = fat_checkbootrecord(fs);
-          if (ret == OK)
-            {
-              /* Break out of the loop if a valid boot record is found */
+  /* Get the sectors per cluster */
 
-              fvdbg("MBR found in partition %d\n", i);
-              break;
-            }
+  fs->fs_fatsecperclus = MBR_GETSECPERCLUS(fs->fs_buffer);
 
-          /* Re-read sector 0 so that we can check the next partition */
+  /* Calculate the number of clusters */
 
-          fvdbg("Partition %d is not an MBR\n", i);
-          ret = fat_hwread(fs, fs->fs_buffer, 0, 1);
-          if (ret < 0)
-            {
-              fdbg("ERROR: Failed to re-read sector 0: %d\n", ret);
-              goto errout_with_buffer;
-            }
-        }
+  fs->fs_nclusters = ndatasectors / fs->fs_fatsecperclus;
 
-      if (i > 3)
-        {
-          fdbg("No valid MBR\n");
-          ret = -EINVAL;
-          goto errout_with_buffer;
-        }
+  /* Finally, the test: */
+
+  if (fs->fs_nclusters <= FAT_MAXCLUST12)
+    {
+      fs->fs_fsinfo = 0;
+      fs->fs_type   = FSTYPE_FAT12;
+    }
+  else if (fs->fs_nclusters <= FAT_MAXCLUST16)
+    {
+      fs->fs_fsinfo = 0;
+      fs->fs_type   = FSTYPE_FAT16;
+    }
+  else if (!notfat32)
+    {
+      fs->fs_fsinfo = fs->fs_fatbase + MBR_GETFSINFO(fs->fs_buffer);
+      fs->fs_type   = FSTYPE_FAT32;
     }
+  else
+    {
+      fdbg("ERROR: notfat32: %d fs_nclusters: %d\n",
+           notfat32, fs->fs_nclusters);
 
-  /* We have what appears to be a valid FAT filesystem! Now read the
-   * FSINFO sector (FAT32 only)
+      return -EINVAL;
+    }
+
+  /* We have what appears to be a valid FAT filesystem! Save a few more
+   * things from the boot record that we will need later.
    */
 
-  if (fs->fs_type == FSTYPE_FAT32)
-  {
-      ret = fat_checkfsinfo(fs);
-      if (ret != OK)
-      {
-        goto errout_with_buffer;
-      }
-  }
+  fs->fs_fatbase     += fs->fs_fatresvdseccount;
 
-  /* We did it! */
+  if (fs->fs_type == FSTYPE_FAT32)
+    {
+      fs->fs_rootbase = MBR_GETROOTCLUS(fs->fs_buffer);
+    }
+  else
+    {
+      fs->fs_rootbase = fs->fs_fatbase + ntotalfatsects;
+    }
 
-  fdbg("FAT%d:\n", fs->fs_type == 0 ? 12 : fs->fs_type == 1  ? 16 : 32);
-  fdbg("\tHW  sector size:     %d\n", fs->fs_hwsectorsize);
-  fdbg("\t    sectors:         %d\n", fs->fs_hwnsectors);
-  fdbg("\tFAT reserved:        %d\n", fs->fs_fatresvdseccount);
-  fdbg("\t    sectors:         %d\n", fs->fs_fattotsec);
-  fdbg("\t    start sector:    %d\n", fs->fs_fatbase);
-  fdbg("\t    root sector:     %d\n", fs->fs_rootbase);
-  fdbg("\t    root entries:    %d\n", fs->fs_rootentcnt);
-  fdbg("\t    data sector:     %d\n", fs->fs_database);
-  fdbg("\t    FSINFO sector:   %d\n", fs->fs_fsinfo);
-  fdbg("\t    Num FATs:        %d\n", fs->fs_fatnumfats);
-  fdbg("\t    FAT sectors:     %d\n", fs->fs_nfatsects);
-  fdbg("\t    sectors/cluster: %d\n", fs->fs_fatsecperclus);
-  fdbg("\t    max clusters:    %d\n", fs->fs_nclusters);
-  fdbg("\tFSI free count       %d\n", fs->fs_fsifreecount);
-  fdbg("\t    next free        %d\n", fs->fs_fsinextfree);
+  fs->fs_database     = fs->fs_fatbase + ntotalfatsects + fs->fs_rootentcnt / DIRSEC_NDIRS(fs);
+  fs->fs_fsifreecount = 0xffffffff;
 
   return OK;
-
-errout_with_buffer:
-  fat_io_free(fs->fs_buffer, fs->fs_hwsectorsize);
-  fs->fs_buffer = 0;
-
-errout:
-  fs->fs_mounted = false;
-  return ret;
 }
 
 /****************************************************************************
- * Name: fat_checkmount
- *
- * Description:
- *   Check if the mountpoint is still valid.
- *
- *   The caller should hold the mountpoint semaphore
- *
+ * Public Functions
  ****************************************************************************/
 
-int fat_checkmount(struct fat_mountpt_s *fs)
+/****************************************************************************
+ * Name: fat_getuint16
+ ****************************************************************************/
+
+uint16_t fat_getuint16(uint8_t *ptr)
 {
-  /* If the fs_mounted flag is false, then we have already handled the loss
-   * of the mount.
+  /* NOTE that (1) this operation is independent of endian-ness and that (2)
+   * byte-by-byte transfer is necessary in any case because the address may be
+   * unaligned.
    */
 
-  if (fs && fs->fs_mounted)
-    {
-      /* We still think the mount is healthy.  Check an see if this is
-       * still the case
-       */
-
-      if (fs->fs_blkdriver)
-        {
-          struct inode *inode = fs->fs_blkdriver;
-          if (inode && inode->u.i_bops && inode->u.i_bops->geometry)
-            {
-              struct geometry geo;
-              int errcode = inode->u.i_bops->geometry(inode, &geo);
-              if (errcode == OK && geo.geo_available && !geo.geo_mediachanged)
-                {
-                  return OK;
-                }
-            }
-        }
-
-      /* If we get here, the mount is NOT healthy */
-
-      fs->fs_mounted = false;
-    }
-
-  return -ENODEV;
+  return ((uint16_t)ptr[1] << 8) | ptr[0];
 }
 
 /****************************************************************************
- * Name: fat_hwread
- *
- * Description:
- *   Read the specified sector into the sector buffer
- *
+ * Name: fat_getuint32
  ****************************************************************************/
 
-int fat_hwread(struct fat_mountpt_s *fs, uint8_t *buffer,  off_t sector,
-               unsigned int nsectors)
+uint32_t fat_getuint32(uint8_t *ptr)
 {
-  int ret = -ENODEV;
-  if (fs && fs->fs_blkdriver)
-    {
+  /* NOTE that (1) this operation is independent of endian-ness and that (2)
+   * byte-by-byte transfer is necessary in any case because the address may be
+   * unaligned.
+   */
+
+  return ((uint32_t)fat_getuint16(&ptr[2]) << 16) | fat_getuint16(&ptr[0]);
+}
+
+/****************************************************************************
+ * Name: fat_putuint16
+ ****************************************************************************/
+
+void fat_putuint16(FAR uint8_t *ptr, uint16_t value16)
+{
+  FAR uint8_t *val = (FAR uint8_t *)&value16;
+
+#ifdef CONFIG_ENDIAN_BIG
+  /* If the target is big-endian then the bytes always have to be swapped so
+   * that the representation is litle endian in the file system.
+   */
+
+  ptr[0] = val[1];
+  ptr[1] = val[0];
+
+#else
+  /* Byte-by-byte transfer is still necessary because the address may be
+   * un-aligned.
+   */
+
+  ptr[0] = val[0];
+  ptr[1] = val[1];
+#endif
+}
+
+/****************************************************************************
+ * Name: fat_putuint32
+ ****************************************************************************/
+
+void fat_putuint32(FAR uint8_t *ptr, uint32_t value32)
+{
+  FAR uint16_t *val = (FAR uint16_t *)&value32;
+
+#ifdef CONFIG_ENDIAN_BIG
+  /* If the target is big-endian then the bytes always have to be swapped so
+   * that the representation is litle endian in the file system.
+   */
+
+  fat_putuint16(&ptr[0], val[1]);
+  fat_putuint16(&ptr[2], val[0]);
+
+#else
+  /* Byte-by-byte transfer is still necessary because the address may be
+   * un-aligned.
+   */
+
+  fat_putuint16(&ptr[0], val[0]);
+  fat_putuint16(&ptr[2], val[1]);
+#endif
+}
+
+/****************************************************************************
+ * Name: fat_semtake
+ ****************************************************************************/
+
+void fat_semtake(struct fat_mountpt_s *fs)
+{
+  /* Take the semaphore (perhaps waiting) */
+
+  while (sem_wait(&fs->fs_sem) != 0)
+    {
+      /* The only case that an error should occur here is if
+       * the wait was awakened by a signal.
+       */
+
+      ASSERT(*get_errno_ptr() == EINTR);
+    }
+}
+
+/****************************************************************************
+ * Name: fat_semgive
+ ****************************************************************************/
+
+void fat_semgive(struct fat_mountpt_s *fs)
+{
+   sem_post(&fs->fs_sem);
+}
+
+/****************************************************************************
+ * Name: fat_systime2fattime
+ *
+ * Description:
+ *   Get the system time convert to a time and and date suitable for
+ *   writing into the FAT FS.
+ *
+ *    TIME in LS 16-bits:
+ *      Bits 0:4   = 2 second count (0-29 representing 0-58 seconds)
+ *      Bits 5-10  = minutes (0-59)
+ *      Bits 11-15 = hours (0-23)
+ *    DATE in MS 16-bits
+ *      Bits 0:4   = Day of month (1-31)
+ *      Bits 5:8   = Month of year (1-12)
+ *      Bits 9:15  = Year from 1980 (0-127 representing 1980-2107)
+ *
+ ****************************************************************************/
+
+uint32_t fat_systime2fattime(void)
+{
+  /* Unless you have a hardware RTC or some other to get accurate time, then
+   * there is no reason to support FAT time.
+   */
+
+#ifdef CONFIG_FS_FATTIME
+  struct timespec ts;
+  struct tm tm;
+  int ret;
+
+  /* Get the current time in seconds and nanoseconds */
+
+  ret = clock_gettime(CLOCK_REALTIME, &ts);
+  if (ret == OK)
+    {
+      /* Break done the seconds in date and time units */
+
+      if (gmtime_r((FAR const time_t *)&ts.tv_sec, &tm) != NULL)
+        {
+          /* FAT can only represent dates since 1980.  struct tm can
+           * represent dates since 1900.
+           */
+
+          if (tm.tm_year >= 80)
+            {
+              uint16_t fattime;
+              uint16_t fatdate;
+
+              fattime  = (tm.tm_sec       >>  1) & 0x001f; /* Bits 0-4: 2 second count (0-29) */
+              fattime |= (tm.tm_min       <<  5) & 0x07e0; /* Bits 5-10: minutes (0-59) */
+              fattime |= (tm.tm_hour      << 11) & 0xf800; /* Bits 11-15: hours (0-23) */
+
+              fatdate  =  tm.tm_mday             & 0x001f; /* Bits 0-4: Day of month (1-31) */
+              fatdate |= ((tm.tm_mon+1)   <<  5) & 0x01e0; /* Bits 5-8: Month of year (1-12) */
+              fatdate |= ((tm.tm_year-80) <<  9) & 0xfe00; /* Bits 9-15: Year from 1980 */
+
+              return (uint32_t)fatdate << 16 | (uint32_t)fattime;
+            }
+        }
+    }
+#endif
+
+  return 0;
+}
+
+/****************************************************************************
+ * Name: fat_fattime2systime
+ *
+ * Description:
+ *   Convert FAT data and time to a system time_t
+ *
+ *    16-bit FAT time:
+ *      Bits 0:4   = 2 second count (0-29 representing 0-58 seconds)
+ *      Bits 5-10  = minutes (0-59)
+ *      Bits 11-15 = hours (0-23)
+ *    16-bit FAT date:
+ *      Bits 0:4   = Day of month (1-31)
+ *      Bits 5:8   = Month of year (1-12)
+ *      Bits 9:15  = Year from 1980 (0-127 representing 1980-2107)
+ *
+ ****************************************************************************/
+
+time_t fat_fattime2systime(uint16_t fattime, uint16_t fatdate)
+{
+  /* Unless you have a hardware RTC or some other to get accurate time, then
+   * there is no reason to support FAT time.
+   */
+
+#ifdef CONFIG_FS_FATTIME
+  struct tm tm;
+  unsigned int tmp;
+
+  /* Break out the date and time */
+
+  tm.tm_sec  =  (fattime & 0x001f) <<  1;       /* Bits 0-4: 2 second count (0-29) */
+  tm.tm_min  =  (fattime & 0x07e0) >>  5;       /* Bits 5-10: minutes (0-59) */
+  tm.tm_hour =  (fattime & 0xf800) >> 11;       /* Bits 11-15: hours (0-23) */
+
+  tm.tm_mday =  (fatdate & 0x001f);             /* Bits 0-4: Day of month (1-31) */
+  tmp        = ((fatdate & 0x01e0) >>  5);      /* Bits 5-8: Month of year (1-12) */
+  tm.tm_mon  =   tmp > 0 ? tmp-1 : 0;
+  tm.tm_year = ((fatdate & 0xfe00) >>  9) + 80; /* Bits 9-15: Year from 1980 */
+
+  /* Then convert the broken out time into seconds since the epoch */
+
+  return mktime(&tm);
+#else
+  return 0;
+#endif
+}
+
+/****************************************************************************
+ * Name: fat_mount
+ *
+ * Description:
+ *   This function is called only when the mountpoint is first established.
+ *   It initializes the mountpoint structure and verifies that a valid FAT32
+ *   filesystem is provided by the block driver.
+ *
+ *   The caller should hold the mountpoint semaphore
+ *
+ ****************************************************************************/
+
+int fat_mount(struct fat_mountpt_s *fs, bool writeable)
+{
+  FAR struct inode *inode;
+  struct geometry geo;
+#ifdef CONFIG_FAT_FREEBITMAP
+  uint32_t nmapwords;
+  uint32_t nscanwords;
+#endif
+  int ret;
+  int i;
+
+  /* Assume that the mount is successful */
+
+  fs->fs_mounted = true;
+
+  /* Check if there is media available */
+
+  inode = fs->fs_blkdriver;
+  if (!inode || !inode->u.i_bops || !inode->u.i_bops->geometry ||
+      inode->u.i_bops->geometry(inode, &geo) != OK || !geo.geo_available)
+    {
+      ret = -ENODEV;
+      goto errout;
+    }
+
+  /* Make sure that that the media is write-able (if write access is needed) */
+
+  if (writeable && !geo.geo_writeenabled)
+    {
+      ret = -EACCES;
+      goto errout;
+    }
+
+  /* Save the hardware geometry */
+
+  fs->fs_hwsectorsize = geo.geo_sectorsize;
+  fs->fs_hwnsectors   = geo.geo_nsectors;
+
+  /* Allocate the sector cache.  All entries share one allocation.  Until
+   * the mount completes, the first entry is used as a scratch buffer.
+   */
+
+  fs->fs_buffer = (FAR uint8_t *)
+    fat_io_alloc(FAT_NCACHESECTORS * fs->fs_hwsectorsize);
+  if (!fs->fs_buffer)
+    {
+      ret = -ENOMEM;
+      goto errout;
+    }
+
+  for (i = 0; i < FAT_NCACHESECTORS; i++)
+    {
+      fs->fs_cache[i].fc_sector = -1;
+      fs->fs_cache[i].fc_age    = 0;
+      fs->fs_cache[i].fc_dirty  = false;
+      fs->fs_cache[i].fc_buffer = fs->fs_buffer + i * fs->fs_hwsectorsize;
+    }
+
+  fs->fs_cacheslot     = 0;
+  fs->fs_cacheage      = 0;
+  fs->fs_currentsector = -1;
+  fs->fs_dirty         = false;
+
+  /* Search FAT boot record on the drive.  First check at sector zero.  This
+   * could be either the boot record or a partition that refers to the boot
+   * record.
+   *
+   * First read sector zero.  This will be the first access to the drive and a
+   * likely failure point.
+   */
+
+  fs->fs_fatbase = 0;
+  ret = fat_hwread(fs, fs->fs_buffer, 0, 1);
+  if (ret < 0)
+    {
+      goto errout_with_buffer;
+    }
+
+  ret = fat_checkbootrecord(fs);
+  if (ret != OK)
+    {
+      /* The contents of sector 0 is not a boot record.  It could be a DOS
+       * partition, however.  Assume it is a partition and get the offset
+       * into the partition table.  This table is at offset MBR_TABLE and is
+       * indexed by 16x the partition number.
+       */
+
+      for (i = 0; i < 4; i++)
+        {
+          /* Check if the partition exists and, if so, get the bootsector for that
+           * partition and see if we can find the boot record there.
+           */
+
+          uint8_t part = PART_GETTYPE(i, fs->fs_buffer);
+          fvdbg("Partition %d, offset %d, type %d\n", i, PART_ENTRY(i), part);
+
+          if (part == 0)
+            {
+              fvdbg("No partition %d\n", i);
+              continue;
+            }
+
+          /* There appears to be a partition, get the sector number of the
+           * partition (LBA)
+           */
+
+          fs->fs_fatbase = PART_GETSTARTSECTOR(i, fs->fs_buffer);
+
+          /* Read the new candidate boot sector */
+
+          ret = fat_hwread(fs, fs->fs_buffer, fs->fs_fatbase, 1);
+          if (ret < 0)
+            {
+              /* Failed to read the sector */
+
+              fdbg("ERROR: Failed to read sector %ld: %d\n",
+                   (long)fs->fs_fatbase, ret);
+              continue;
+            }
+
+          /* Check if this is a boot record */
+
+          ret = fat_checkbootrecord(fs);
+          if (ret == OK)
+            {
+              /* Break out of the loop if a valid boot record is found */
+
+              fvdbg("MBR found in partition %d\n", i);
+              break;
+            }
+
+          /* Re-read sector 0 so that we can check the next partition */
+
+          fvdbg("Partition %d is not an MBR\n", i);
+          ret = fat_hwread(fs, fs->fs_buffer, 0, 1);
+          if (ret < 0)
+            {
+              fdbg("ERROR: Failed to re-read sector 0: %d\n", ret);
+              goto errout_with_buffer;
+            }
+        }
+
+      if (i > 3)
+        {
+          fdbg("No valid MBR\n");
+          ret = -EINVAL;
+          goto errout_with_buffer;
+        }
+    }
+
+  /* We have what appears to be a valid FAT filesystem! Now read the
+   * FSINFO sector (FAT32 only)
+   */
+
+  if (fs->fs_type == FSTYPE_FAT32)
+  {
+      ret = fat_checkfsinfo(fs);
+      if (ret != OK)
+      {
+        goto errout_with_buffer;
+      }
+  }
+
+#ifdef CONFIG_FAT_FREEBITMAP
+  /* Allocate the free cluster bitmap and the map of which parts of it are
+   * valid.  Both start out empty and are filled in from the FAT as they
+   * are needed.
+   */
+
+  fs->fs_bmunitclusters = fs->fs_type == FSTYPE_FAT12 ? fs->fs_nclusters :
+                          fs->fs_type == FSTYPE_FAT16 ?
+                          fs->fs_hwsectorsize / 2 : fs->fs_hwsectorsize / 4;
+
+  nmapwords = (fs->fs_nclusters + 31) / 32;
+  nscanwords = ((fs->fs_nclusters + fs->fs_bmunitclusters - 1) /
+                fs->fs_bmunitclusters + 31) / 32;
+
+  fs->fs_freemap = (FAR uint32_t *)
+    kmm_zalloc((nmapwords + nscanwords) * sizeof(uint32_t));
+  if (!fs->fs_freemap)
+    {
+      ret = -ENOMEM;
+      goto errout_with_buffer;
+    }
+
+  fs->fs_scanmap = fs->fs_freemap + nmapwords;
+#endif
+
+  /* We did it! */
+
+  fdbg("FAT%d:\n", fs->fs_type == 0 ? 12 : fs->fs_type == 1  ? 16 : 32);
+  fdbg("\tHW  sector size:     %d\n", fs->fs_hwsectorsize);
+  fdbg("\t    sectors:         %d\n", fs->fs_hwnsectors);
+  fdbg("\tFAT reserved:        %d\n", fs->fs_fatresvdseccount);
+  fdbg("\t    sectors:         %d\n", fs->fs_fattotsec);
+  fdbg("\t    start sector:    %d\n", fs->fs_fatbase);
+  fdbg("\t    root sector:     %d\n", fs->fs_rootbase);
+  fdbg("\t    root entries:    %d\n", fs->fs_rootentcnt);
+  fdbg("\t    data sector:     %d\n", fs->fs_database);
+  fdbg("\t    FSINFO sector:   %d\n", fs->fs_fsinfo);
+  fdbg("\t    Num FATs:        %d\n", fs->fs_fatnumfats);
+  fdbg("\t    FAT sectors:     %d\n", fs->fs_nfatsects);
+  fdbg("\t    sectors/cluster: %d\n", fs->fs_fatsecperclus);
+  fdbg("\t    max clusters:    %d\n", fs->fs_nclusters);
+  fdbg("\tFSI free count       %d\n", fs->fs_fsifreecount);
+  fdbg("\t    next free        %d\n", fs->fs_fsinextfree);
+
+  return OK;
+
+errout_with_buffer:
+  fat_io_free(fs->fs_cache[0].fc_buffer,
+              FAT_NCACHESECTORS * fs->fs_hwsectorsize);
+  fs->fs_buffer = 0;
+
+errout:
+  fs->fs_mounted = false;
+  return ret;
+}
+
+/****************************************************************************
+ * Name: fat_checkmount
+ *
+ * Description:
+ *   Check if the mountpoint is still valid.
+ *
+ *   The caller should hold the mountpoint semaphore
+ *
+ ****************************************************************************/
+
+int fat_checkmount(struct fat_mountpt_s *fs)
+{
+  /* If the fs_mounted flag is false, then we have already handled the loss
+   * of the mount.
+   */
+
+  if (fs && fs->fs_mounted)
+    {
+      /* We still think the mount is healthy.  Check an see if this is
+       * still the case
+       */
+
+      if (fs->fs_blkdriver)
+        {
+          struct inode *inode = fs->fs_blkdriver;
+          if (inode && inode->u.i_bops && inode->u.i_bops->geometry)
+            {
+              struct geometry geo;
+              int errcode = inode->u.i_bops->geometry(inode, &geo);
+              if (errcode == OK && geo.geo_available && !geo.geo_mediachanged)
+                {
+                  return OK;
+                }
+            }
+        }
+
+      /* If we get here, the mount is NOT healthy */
+
+      fs->fs_mounted = false;
+    }
+
+  return -ENODEV;
+}
+
+/****************************************************************************
+ * Name: fat_hwread
+ *
+ * Description:
+ *   Read the specified sector into the sector buffer
+ *
+ ****************************************************************************/
+
+int fat_hwread(struct fat_mountpt_s *fs, uint8_t *buffer,  off_t sector,
+               unsigned int nsectors)
+{
+  int ret = -ENODEV;
+  if (fs && fs->fs_blkdriver)
+    {
       struct inode *inode = fs->fs_blkdriver;
       if (inode && inode->u.i_bops && inode->u.i_bops->read)
         {
-          ssize_t nSectorsRead = inode->u.i_bops->read(inode, buffer,
-                                                       sector, nsectors);
-          if (nSectorsRead == nsectors)
+          ssize_t nSectorsRead = inode->u.i_bops->read(inode, buffer,
+                                                       sector, nsectors);
+          if (nSectorsRead == nsectors)
+            {
+              ret = OK;
+            }
+          else if (nSectorsRead < 0)
+            {
+              ret = nSectorsRead;
+            }
+        }
+    }
+
+  return ret;
+}
+
+/****************************************************************************
+ * Name: fat_hwwrite
+ *
+ * Description:
+ *   Write the sector buffer to the specified sector
+ *
+ ****************************************************************************/
+
+int fat_hwwrite(struct fat_mountpt_s *fs, uint8_t *buffer, off_t sector,
+                unsigned int nsectors)
+{
+  int ret = -ENODEV;
+  if (fs && fs->fs_blkdriver)
+    {
+      struct inode *inode = fs->fs_blkdriver;
+      if (inode && inode->u.i_bops && inode->u.i_bops->write)
+        {
+          ssize_t nSectorsWritten =
+              inode->u.i_bops->write(inode, buffer, sector, nsectors);
+
+          if (nSectorsWritten == nsectors)
+            {
+              fat_cacheinvalidate(fs, buffer, sector, nsectors);
+              ret = OK;
+            }
+          else if (nSectorsWritten < 0)
+            {
+              ret = nSectorsWritten;
+            }
+        }
+    }
+
+  return ret;
+}
+
+/****************************************************************************
+ * Name: fat_cluster2sector
+ *
+ * Description:
+ *   Convert a cluster number to a start sector number
+ *
+ ****************************************************************************/
+
+off_t fat_cluster2sector(FAR struct fat_mountpt_s *fs,  uint32_t cluster)
+{
+  cluster -= 2;
+  if (cluster >= fs->fs_nclusters - 2)
+    {
+       return -EINVAL;
+    }
+  return cluster * fs->fs_fatsecperclus + fs->fs_database;
+}
+
+/****************************************************************************
+ * Name: fat_getcluster
+ *
+ * Description:
+ *   Get the next cluster start from the FAT.
+ *
+ * Return:  <0: error, 0:cluster unassigned, >=0: start sector of cluster
+ *
+ ****************************************************************************/
+
+off_t fat_getcluster(struct fat_mountpt_s *fs, uint32_t clusterno)
+{
+  /* Verify that the cluster number is within range */
+
+  if (clusterno >= 2 && clusterno < fs->fs_nclusters)
+    {
+      /* Okay.. Read the next cluster from the FAT.  The way we will do
+       * this depends on the type of FAT filesystm we are dealing with.
+       */
+
+      switch (fs->fs_type)
+        {
+          case FSTYPE_FAT12 :
+            {
+              off_t        fatsector;
+              unsigned int fatoffset;
+              unsigned int cluster;
+              unsigned int fatindex;
+
+              /* FAT12 is more complex because it has 12-bits (1.5 bytes)
+               * per FAT entry. Get the offset to the first byte:
+               */
+
+              fatoffset = (clusterno * 3) / 2;
+              fatsector = fs->fs_fatbase + SEC_NSECTORS(fs, fatoffset);
+
+              /* Read the sector at this offset */
+
+              if (fat_fscacheread(fs, fatsector) < 0)
+                {
+                  /* Read error */
+
+                  break;
+                }
+
+              /* Get the first, LS byte of the cluster from the FAT */
+
+              fatindex = fatoffset & SEC_NDXMASK(fs);
+              cluster  = fs->fs_buffer[fatindex];
+
+              /* With FAT12, the second byte of the cluster number may lie in
+               * a different sector than the first byte.
+               */
+
+              fatindex++;
+              if (fatindex >= fs->fs_hwsectorsize)
+                {
+                  fatsector++;
+                  fatindex = 0;
+
+                  if (fat_fscacheread(fs, fatsector) < 0)
+                    {
+                      /* Read error */
+
+                      break;
+                    }
+                }
+
+              /* Get the second, MS byte of the cluster for 16-bits.  The
+               * does not depend on the endian-ness of the target, but only
+               * on the fact that the byte stream is little-endian.
+               */
+
+              cluster |= (unsigned int)fs->fs_buffer[fatindex] << 8;
+
+              /* Now, pick out the correct 12 bit cluster start sector value */
+
+              if ((clusterno & 1) != 0)
+                {
+                  /* Odd.. take the MS 12-bits */
+
+                  cluster >>= 4;
+                }
+              else
+                {
+                  /* Even.. take the LS 12-bits */
+
+                  cluster &= 0x0fff;
+                }
+
+              return cluster;
+            }
+
+          case FSTYPE_FAT16 :
+            {
+              unsigned int fatoffset = 2 * clusterno;
+              off_t        fatsector = fs->fs_fatbase + SEC_NSECTORS(fs, fatoffset);
+              unsigned int fatindex  = fatoffset & SEC_NDXMASK(fs);
+
+              if (fat_fscacheread(fs, fatsector) < 0)
+                {
+                  /* Read error */
+
+                  break;
+                }
+
+              return FAT_GETFAT16(fs->fs_buffer, fatindex);
+            }
+
+          case FSTYPE_FAT32 :
+            {
+              unsigned int fatoffset = 4 * clusterno;
+              off_t        fatsector = fs->fs_fatbase + SEC_NSECTORS(fs, fatoffset);
+              unsigned int fatindex  = fatoffset & SEC_NDXMASK(fs);
+
+              if (fat_fscacheread(fs, fatsector) < 0)
+                {
+                  /* Read error */
+
+                  break;
+                }
+
+              return FAT_GETFAT32(fs->fs_buffer, fatindex) & 0x0fffffff;
+            }
+
+          default:
+              break;
+        }
+    }
+
+  /* There is no cluster information, or an error occured */
+
+  return (off_t)-EINVAL;
+}
+
+/****************************************************************************
+ * Name: fat_putcluster
+ *
+ * Description:
+ *   Write a new cluster into the FAT
+ *
+ ****************************************************************************/
+
+int fat_putcluster(struct fat_mountpt_s *fs, uint32_t clusterno,
+                   off_t nextcluster)
+{
+  /* Verify that the cluster number is within range.  Zero erases the cluster. */
+
+  if (clusterno == 0 || (clusterno >= 2 && clusterno < fs->fs_nclusters))
+    {
+      /* Okay.. Write the next cluster into the FAT.  The way we will do
+       * this depends on the type of FAT filesystem we are dealing with.
+       */
+
+      switch (fs->fs_type)
+        {
+          case FSTYPE_FAT12 :
             {
-              ret = OK;
+              off_t        fatsector;
+              unsigned int fatoffset;
+              unsigned int fatindex;
+              uint8_t      value;
+
+              /* FAT12 is more complex because it has 12-bits (1.5 bytes)
+               * per FAT entry. Get the offset to the first byte:
+               */
+
+              fatoffset = (clusterno * 3) / 2;
+              fatsector = fs->fs_fatbase + SEC_NSECTORS(fs, fatoffset);
+
+              /* Make sure that the sector at this offset is in the cache */
+
+              if (fat_fscacheread(fs, fatsector) < 0)
+                {
+                  /* Read error */
+
+                  break;
+                }
+
+              /* Get the LS byte first handling the 12-bit alignment within
+               * the 16-bits
+               */
+
+              fatindex = fatoffset & SEC_NDXMASK(fs);
+              if ((clusterno & 1) != 0)
+                {
+                  /* Save the LS four bits of the next cluster */
+
+                  value = (fs->fs_buffer[fatindex] & 0x0f) | nextcluster << 4;
+                }
+              else
+                {
+                  /* Save the LS eight bits of the next cluster */
+
+                  value = (uint8_t)nextcluster;
+                }
+
+              fs->fs_buffer[fatindex] = value;
+
+              /* With FAT12, the second byte of the cluster number may lie in
+               * a different sector than the first byte.
+               */
+
+              fatindex++;
+              if (fatindex >= fs->fs_hwsectorsize)
+                {
+                  /* Read the next sector */
+
+                  fatsector++;
+                  fatindex = 0;
+
+                  /* Set the dirty flag to make sure the sector that we
+                   * just modified is written out.
+                   */
+
+                  fs->fs_dirty = true;
+                  if (fat_fscacheread(fs, fatsector) < 0)
+                    {
+                      /* Read error */
+
+                      break;
+                    }
+                }
+
+              /* Output the MS byte first handling the 12-bit alignment within
+               * the 16-bits
+               */
+
+              if ((clusterno & 1) != 0)
+                {
+                  /* Save the MS eight bits of the next cluster */
+
+                  value = (uint8_t)(nextcluster >> 4);
+                }
+              else
+                {
+                  /* Save the MS four bits of the next cluster */
+
+                  value = (fs->fs_buffer[fatindex] & 0xf0) | ((nextcluster >> 8) & 0x0f);
+                }
+
+              fs->fs_buffer[fatindex] = value;
             }
-          else if (nSectorsRead < 0)
+          break;
+
+          case FSTYPE_FAT16 :
             {
-              ret = nSectorsRead;
+              unsigned int fatoffset = 2 * clusterno;
+              off_t        fatsector = fs->fs_fatbase + SEC_NSECTORS(fs, fatoffset);
+              unsigned int fatindex  = fatoffset & SEC_NDXMASK(fs);
+
+              if (fat_fscacheread(fs, fatsector) < 0)
+                {
+                  /* Read error */
+
+                  break;
+                }
+
+              FAT_PUTFAT16(fs->fs_buffer, fatindex, nextcluster & 0xffff);
+            }
+          break;
+
+          case FSTYPE_FAT32 :
+            {
+              unsigned int fatoffset = 4 * clusterno;
+              off_t        fatsector = fs->fs_fatbase + SEC_NSECTORS(fs, fatoffset);
+              unsigned int fatindex  = fatoffset & SEC_NDXMASK(fs);
+              uint32_t     val;
+
+              if (fat_fscacheread(fs, fatsector) < 0)
+                {
+                  /* Read error */
+
+                  break;
+                }
+
+              /* Keep the top 4 bits */
+
+              val = FAT_GETFAT32(fs->fs_buffer, fatindex) & 0xf0000000;
+              FAT_PUTFAT32(fs->fs_buffer, fatindex, val | (nextcluster & 0x0fffffff));
+            }
+          break;
+
+          default:
+            return -EINVAL;
+        }
+
+#ifdef CONFIG_FAT_DISCARD
+      /* A cluster that is allocated again must not be discarded */
+
+      if (clusterno >= 2 && nextcluster != 0 && fs->fs_ndiscards > 0)
+        {
+          fat_discardcancel(fs, clusterno);
+        }
+#endif
+
+#ifdef CONFIG_FAT_FREEBITMAP
+      /* Keep the free cluster bitmap in step with the FAT */
+
+      if (clusterno >= 2 && fat_bmscanned(fs, clusterno))
+        {
+          if (nextcluster != 0)
+            {
+              fs->fs_freemap[clusterno >> 5] |= (1u << (clusterno & 31));
+            }
+          else
+            {
+              fs->fs_freemap[clusterno >> 5] &= ~(1u << (clusterno & 31));
             }
         }
+#endif
+
+      /* Mark the modified sector as "dirty" and return success */
+
+      fs->fs_dirty = true;
+      return OK;
     }
 
-  return ret;
+  return -EINVAL;
 }
 
 /****************************************************************************
- * Name: fat_hwwrite
+ * Name: fat_removechain
  *
  * Description:
- *   Write the sector buffer to the specified sector
+ *   Remove an entire chain of clusters, starting with 'cluster'
  *
  ****************************************************************************/
 
-int fat_hwwrite(struct fat_mountpt_s *fs, uint8_t *buffer, off_t sector,
-                unsigned int nsectors)
+int fat_removechain(struct fat_mountpt_s *fs, uint32_t cluster)
 {
-  int ret = -ENODEV;
-  if (fs && fs->fs_blkdriver)
+  int32_t nextcluster;
+#ifdef CONFIG_FAT_DISCARD
+  uint32_t runstart = 0;
+  uint32_t runcount = 0;
+#endif
+  int    ret;
+
+  /* Loop while there are clusters in the chain */
+
+  while (cluster >= 2 && cluster < fs->fs_nclusters)
     {
-      struct inode *inode = fs->fs_blkdriver;
-      if (inode && inode->u.i_bops && inode->u.i_bops->write)
+      /* Get the next cluster after the current one */
+
+      nextcluster = fat_getcluster(fs, cluster);
+      if (nextcluster < 0)
         {
-          ssize_t nSectorsWritten =
-              inode->u.i_bops->write(inode, buffer, sector, nsectors);
+          /* Error! */
+          return nextcluster;
+        }
 
-          if (nSectorsWritten == nsectors)
-            {
-              ret = OK;
-            }
-          else if (nSectorsWritten < 0)
+      /* Then nullify current cluster -- removing it from the chain */
+
+      ret = fat_putcluster(fs, cluster, 0);
+      if (ret < 0)
+        {
+          return ret;
+        }
+
+      /* Update FSINFINFO data */
+
+      if (fs->fs_fsifreecount != 0xffffffff)
+        {
+          fs->fs_fsifreecount++;
+          fs->fs_fsidirty = 1;
+        }
+
+#ifdef CONFIG_FAT_DISCARD
+      /* Collect runs of contiguous clusters to be discarded */
+
+      if (runcount > 0 && cluster == runstart + runcount)
+        {
+          runcount++;
+        }
+      else
+        {
+          ret = fat_discardadd(fs, runstart, runcount);
+          if (ret < 0)
             {
-              ret = nSectorsWritten;
+              return ret;
             }
+
+          runstart = cluster;
+          runcount = 1;
         }
-    }
+#endif
 
-  return ret;
-}
+      /* Then set up to remove the next cluster */
 
-/****************************************************************************
- * Name: fat_cluster2sector
- *
- * Description:
- *   Convert a cluster number to a start sector number
- *
- ****************************************************************************/
+      cluster = nextcluster;
+  }
 
-off_t fat_cluster2sector(FAR struct fat_mountpt_s *fs,  uint32_t cluster)
-{
-  cluster -= 2;
-  if (cluster >= fs->fs_nclusters - 2)
-    {
-       return -EINVAL;
-    }
-  return cluster * fs->fs_fatsecperclus + fs->fs_database;
+#ifdef CONFIG_FAT_DISCARD
+  return fat_discardadd(fs, runstart, runcount);
+#else
+  return OK;
+#endif
 }
 
 /****************************************************************************
- * Name: fat_getcluster
+ * Name: fat_extendchain
  *
  * Description:
- *   Get the next cluster start from the FAT.
+ *   Add a new cluster to the chain following cluster (if cluster is non-
+ *   NULL).  if cluster is zero, then a new chain is created.
  *
- * Return:  <0: error, 0:cluster unassigned, >=0: start sector of cluster
+ * Return:
+ *   <0:error, 0: no free cluster, >=2: new cluster number
  *
  ****************************************************************************/
 
-off_t fat_getcluster(struct fat_mountpt_s *fs, uint32_t clusterno)
+int32_t fat_extendchain(struct fat_mountpt_s *fs, uint32_t cluster)
 {
-  /* Verify that the cluster number is within range */
+  off_t    startsector;
+  uint32_t newcluster;
+  uint32_t startcluster;
+  int      ret;
 
-  if (clusterno >= 2 && clusterno < fs->fs_nclusters)
+  /* The special value 0 is used when the new chain should start */
+
+  if (cluster == 0)
     {
-      /* Okay.. Read the next cluster from the FAT.  The way we will do
-       * this depends on the type of FAT filesystm we are dealing with.
+      /* The FSINFO NextFree entry should be a good starting point
+       * in the search for a new cluster
        */
 
-      switch (fs->fs_type)
+      startcluster = fs->fs_fsinextfree;
+      if (startcluster == 0 || startcluster >= fs->fs_nclusters)
         {
-          case FSTYPE_FAT12 :
-            {
-              off_t        fatsector;
-              unsigned int fatoffset;
-              unsigned int cluster;
-              unsigned int fatindex;
-
-              /* FAT12 is more complex because it has 12-bits (1.5 bytes)
-               * per FAT entry. Get the offset to the first byte:
-               */
+          /* But it is bad.. we have to start at the beginning */
 
-              fatoffset = (clusterno * 3) / 2;
-              fatsector = fs->fs_fatbase + SEC_NSECTORS(fs, fatoffset);
+          startcluster = 1;
+        }
+    }
+  else
+    {
+      /* We are extending an existing chain. Verify that this
+       * is a valid cluster by examining its start sector.
+       */
 
-              /* Read the sector at this offset */
+      startsector = fat_getcluster(fs, cluster);
+      if (startsector < 0)
+        {
+          /* An error occurred, return the error value */
 
-              if (fat_fscacheread(fs, fatsector) < 0)
-                {
-                  /* Read error */
+          return startsector;
+        }
+      else if (startsector < 2)
+        {
+          /* Oops.. this cluster does not exist. */
 
-                  break;
-                }
+          return 0;
+        }
+      else if (startsector < fs->fs_nclusters)
+        {
+          /* It is already followed by next cluster */
 
-              /* Get the first, LS byte of the cluster from the FAT */
+          return startsector;
+        }
 
-              fatindex = fatoffset & SEC_NDXMASK(fs);
-              cluster  = fs->fs_buffer[fatindex];
+      /* Okay.. it checks out */
 
-              /* With FAT12, the second byte of the cluster number may lie in
-               * a different sector than the first byte.
-               */
+      startcluster = cluster;
+    }
 
-              fatindex++;
-              if (fatindex >= fs->fs_hwsectorsize)
-                {
-                  fatsector++;
-                  fatindex = 0;
+#ifdef CONFIG_FAT_FREEBITMAP
+  /* Find a free cluster using the free cluster bitmap */
 
-                  if (fat_fscacheread(fs, fatsector) < 0)
-                    {
-                      /* Read error */
+  ret = fat_bmfindfree(fs, startcluster);
+  if (ret <= 0)
+    {
+      return ret;
+    }
 
-                      break;
-                    }
-                }
+  newcluster = ret;
+#else
+  /* Loop until (1) we discover that there are not free clusters
+   * (return 0), an errors occurs (return -errno), or (3) we find
+   * the next cluster (return the new cluster number).
+   */
 
-              /* Get the second, MS byte of the cluster for 16-bits.  The
-               * does not depend on the endian-ness of the target, but only
-               * on the fact that the byte stream is little-endian.
-               */
+  newcluster = startcluster;
+  for (; ; )
+    {
+      /* Examine the next cluster in the FAT */
 
-              cluster |= (unsigned int)fs->fs_buffer[fatindex] << 8;
+      newcluster++;
+      if (newcluster >= fs->fs_nclusters)
+        {
+          /* If we hit the end of the available clusters, then
+           * wrap back to the beginning because we might have
+           * started at a non-optimal place.  But don't continue
+           * past the start cluster.
+           */
 
-              /* Now, pick out the correct 12 bit cluster start sector value */
+          newcluster = 2;
+          if (newcluster > startcluster)
+            {
+              /* We are back past the starting cluster, then there
+               * is no free cluster.
+               */
 
-              if ((clusterno & 1) != 0)
-                {
-                  /* Odd.. take the MS 12-bits */
+              return 0;
+            }
+        }
 
-                  cluster >>= 4;
-                }
-              else
-                {
-                  /* Even.. take the LS 12-bits */
+      /* We have a candidate cluster.  Check if the cluster number is
+       * mapped to a group of sectors.
+       */
 
-                  cluster &= 0x0fff;
-                }
+      startsector = fat_getcluster(fs, newcluster);
+      if (startsector == 0)
+        {
+          /* Found have found a free cluster break out */
 
-              return cluster;
-            }
+          break;
+        }
+      else if (startsector < 0)
+        {
+          /* Some error occurred, return the error number */
 
-          case FSTYPE_FAT16 :
-            {
-              unsigned int fatoffset = 2 * clusterno;
-              off_t        fatsector = fs->fs_fatbase + SEC_NSECTORS(fs, fatoffset);
-              unsigned int fatindex  = fatoffset & SEC_NDXMASK(fs);
+          return startsector;
+        }
 
-              if (fat_fscacheread(fs, fatsector) < 0)
-                {
-                  /* Read error */
+      /* We wrap all the back to the starting cluster?  If so, then
+       * there are no free clusters.
+       */
 
-                  break;
-                }
+      if (newcluster == startcluster)
+        {
+          return 0;
+        }
+    }
+#endif
 
-              return FAT_GETFAT16(fs->fs_buffer, fatindex);
-            }
+  /* We get here only if we break out with an available cluster
+   * number in 'newcluster'  Now mark that cluster as in-use.
+   */
 
-          case FSTYPE_FAT32 :
-            {
-              unsigned int fatoffset = 4 * clusterno;
-              off_t        fatsector = fs->fs_fatbase + SEC_NSECTORS(fs, fatoffset);
-              unsigned int fatindex  = fatoffset & SEC_NDXMASK(fs);
+  ret = fat_putcluster(fs, newcluster, 0x0fffffff);
+  if (ret < 0)
+    {
+      /* An error occurred */
 
-              if (fat_fscacheread(fs, fatsector) < 0)
-                {
-                  /* Read error */
+      return ret;
+    }
 
-                  break;
-                }
+  /* And link if to the start cluster (if any) */
 
-              return FAT_GETFAT32(fs->fs_buffer, fatindex) & 0x0fffffff;
-            }
+  if (cluster)
+    {
+      /* There is a start cluster -- link it */
 
-          default:
-              break;
+      ret = fat_putcluster(fs, cluster, newcluster);
+      if (ret < 0)
+        {
+          return ret;
         }
     }
 
-  /* There is no cluster information, or an error occured */
+  /* And update the FINSINFO for the next time we have to search */
 
-  return (off_t)-EINVAL;
+  fs->fs_fsinextfree = newcluster;
+  if (fs->fs_fsifreecount != 0xffffffff)
+    {
+      fs->fs_fsifreecount--;
+      fs->fs_fsidirty = 1;
+    }
+
+  /* Return then number of the new cluster that was added to the chain */
+
+  return newcluster;
 }
 
 /****************************************************************************
- * Name: fat_putcluster
+ * Name: fat_nextcluster
  *
  * Description:
- *   Write a new cluster into the FAT
+ *   Get the cluster that follows ff->ff_currentcluster in the cluster chain
+ *   of an open file.  'position' is the (cluster aligned) file position at
+ *   the start of the requested cluster.  If 'extend' is true, the chain is
+ *   extended when the end is reached.
+ *
+ *   If the cluster map is enabled, it is consulted first and the result of
+ *   following the chain is recorded in it.
+ *
+ * Returned Value:
+ *   The cluster number, zero if there is no next cluster, or a negated
+ *   errno value on failure.
  *
  ****************************************************************************/
 
-int fat_putcluster(struct fat_mountpt_s *fs, uint32_t clusterno,
-                   off_t nextcluster)
+int32_t fat_nextcluster(struct fat_mountpt_s *fs, struct fat_file_s *ff,
+                        off_t position, bool extend)
 {
-  /* Verify that the cluster number is within range.  Zero erases the cluster. */
-
-  if (clusterno == 0 || (clusterno >= 2 && clusterno < fs->fs_nclusters))
+  int32_t  cluster;
+#ifdef CONFIG_FAT_CLUSTERMAP
+  uint32_t clustersize = fs->fs_fatsecperclus * fs->fs_hwsectorsize;
+  uint32_t index       = position / clustersize;
+  uint32_t mapped;
+
+  if ((position & (clustersize - 1)) == 0 &&
+      fat_maplookup(ff, index, &mapped) == index && index > 0)
     {
-      /* Okay.. Write the next cluster into the FAT.  The way we will do
-       * this depends on the type of FAT filesystem we are dealing with.
-       */
-
-      switch (fs->fs_type)
-        {
-          case FSTYPE_FAT12 :
-            {
-              off_t        fatsector;
-              unsigned int fatoffset;
-              unsigned int fatindex;
-              uint8_t      value;
-
-              /* FAT12 is more complex because it has 12-bits (1.5 bytes)
-               * per FAT entry. Get the offset to the first byte:
-               */
+      return mapped;
+    }
+#endif
 
-              fatoffset = (clusterno * 3) / 2;
-              fatsector = fs->fs_fatbase + SEC_NSECTORS(fs, fatoffset);
+  if (extend)
+    {
+      cluster = fat_extendchain(fs, ff->ff_currentcluster);
+    }
+  else
+    {
+      cluster = fat_getcluster(fs, ff->ff_currentcluster);
+    }
 
-              /* Make sure that the sector at this offset is in the cache */
+#ifdef CONFIG_FAT_CLUSTERMAP
+  if (cluster >= 2 && cluster < fs->fs_nclusters &&
+      (position & (clustersize - 1)) == 0)
+    {
+      fat_mapadd(ff, index, cluster);
+    }
+#endif
 
-              if (fat_fscacheread(fs, fatsector) < 0)
-                {
-                  /* Read error */
+  return cluster;
+}
 
-                  break;
-                }
+/****************************************************************************
+ * Name: fat_contiguous
+ *
+ * Description:
+ *   Determine how many of the next 'nsectors' sectors of an open file can
+ *   be accessed in a single transfer starting at ff->ff_currentsector.
+ *   'position' is the (sector aligned) file position of the current
+ *   sector.  While the remaining sectors in the current cluster are not
+ *   enough, the following cluster is examined (and, if 'extend' is true,
+ *   allocated) and, if it is physically adjacent, it is merged into the
+ *   current run:  ff->ff_currentcluster and ff->ff_sectorsincluster are
+ *   advanced so that the caller can continue as if the run were one large
+ *   cluster.
+ *
+ * Returned Value:
+ *   The number of contiguous sectors (at least one and no more than
+ *   'nsectors') or a negated errno value on failure.
+ *
+ ****************************************************************************/
 
-              /* Get the LS byte first handling the 12-bit alignment within
-               * the 16-bits
-               */
+int fat_contiguous(struct fat_mountpt_s *fs, struct fat_file_s *ff,
+                   off_t position, unsigned int nsectors, bool extend)
+{
+  unsigned int avail = ff->ff_sectorsincluster;
+  int32_t cluster;
 
-              fatindex = fatoffset & SEC_NDXMASK(fs);
-              if ((clusterno & 1) != 0)
-                {
-                  /* Save the LS four bits of the next cluster */
+  while (avail < nsectors)
+    {
+      /* Get the cluster that follows the current run */
 
-                  value = (fs->fs_buffer[fatindex] & 0x0f) | nextcluster << 4;
-                }
-              else
-                {
-                  /* Save the LS eight bits of the next cluster */
+      cluster = fat_nextcluster(fs, ff,
+                                position + avail * fs->fs_hwsectorsize,
+                                extend);
+      if (cluster < 0)
+        {
+          return cluster;
+        }
 
-                  value = (uint8_t)nextcluster;
-                }
+      /* Stop at the end of the chain or at the first discontinuity.  The
+       * normal cluster stepping logic will deal with either case when the
+       * current run has been consumed.
+       */
 
-              fs->fs_buffer[fatindex] = value;
+      if (cluster != ff->ff_currentcluster + 1 ||
+          cluster >= fs->fs_nclusters)
+        {
+          break;
+        }
 
-              /* With FAT12, the second byte of the cluster number may lie in
-               * a different sector than the first byte.
-               */
+      ff->ff_currentcluster    = cluster;
+      ff->ff_sectorsincluster += fs->fs_fatsecperclus;
+      avail                   += fs->fs_fatsecperclus;
+    }
 
-              fatindex++;
-              if (fatindex >= fs->fs_hwsectorsize)
-                {
-                  /* Read the next sector */
+  return avail < nsectors ? avail : nsectors;
+}
 
-                  fatsector++;
-                  fatindex = 0;
+/****************************************************************************
+ * Name: fat_reservechain
+ *
+ * Description:
+ *   Make sure that the cluster chain of an open file is long enough to hold
+ *   'length' bytes, allocating clusters as necessary.  fat_extendchain
+ *   searches upward from the last cluster of the chain so the reserved
+ *   clusters are contiguous whenever the free space allows it.  The file
+ *   size is not changed; clusters beyond the end of the file are released
+ *   again by fat_trimchain when the file is closed.
+ *
+ * Returned Value:
+ *   OK on success or a negated errno value on failure.
+ *
+ ****************************************************************************/
 
-                  /* Set the dirty flag to make sure the sector that we
-                   * just modified is written out.
-                   */
+int fat_reservechain(struct fat_mountpt_s *fs, struct fat_file_s *ff,
+                     off_t length)
+{
+  uint32_t clustersize = fs->fs_fatsecperclus * fs->fs_hwsectorsize;
+  uint32_t nclusters;
+  uint32_t index;
+  int32_t  cluster;
+  int32_t  next;
 
-                  fs->fs_dirty = true;
-                  if (fat_fscacheread(fs, fatsector) < 0)
-                    {
-                      /* Read error */
+  if (length <= 0)
+    {
+      return OK;
+    }
 
-                      break;
-                    }
-                }
+  nclusters = (length + clustersize - 1) / clustersize;
 
-              /* Output the MS byte first handling the 12-bit alignment within
-               * the 16-bits
-               */
+  /* Create the chain if the file does not yet have one */
 
-              if ((clusterno & 1) != 0)
-                {
-                  /* Save the MS eight bits of the next cluster */
+  if (ff->ff_startcluster == 0)
+    {
+      cluster = fat_createchain(fs);
+      if (cluster < 0)
+        {
+          return cluster;
+        }
+      else if (cluster == 0)
+        {
+          return -ENOSPC;
+        }
 
-                  value = (uint8_t)(nextcluster >> 4);
-                }
-              else
-                {
-                  /* Save the MS four bits of the next cluster */
+      ff->ff_startcluster   = cluster;
+      ff->ff_currentcluster = cluster;
+      ff->ff_bflags        |= (FFBUFF_MODIFIED | FFBUFF_PREALLOC);
 
-                  value = (fs->fs_buffer[fatindex] & 0xf0) | ((nextcluster >> 8) & 0x0f);
-                }
+      fat_mapadd(ff, 0, cluster);
+    }
 
-              fs->fs_buffer[fatindex] = value;
-            }
-          break;
+  /* Then follow (or extend) the chain up to the last cluster needed */
 
-          case FSTYPE_FAT16 :
+  cluster = ff->ff_startcluster;
+  for (index = 1; index < nclusters; index++)
+    {
+      next = fat_getcluster(fs, cluster);
+      if (next < 0)
+        {
+          return next;
+        }
+      else if (next < 2 || next >= fs->fs_nclusters)
+        {
+          next = fat_extendchain(fs, cluster);
+          if (next < 0)
             {
-              unsigned int fatoffset = 2 * clusterno;
-              off_t        fatsector = fs->fs_fatbase + SEC_NSECTORS(fs, fatoffset);
-              unsigned int fatindex  = fatoffset & SEC_NDXMASK(fs);
-
-              if (fat_fscacheread(fs, fatsector) < 0)
-                {
-                  /* Read error */
-
-                  break;
-                }
-
-              FAT_PUTFAT16(fs->fs_buffer, fatindex, nextcluster & 0xffff);
+              return next;
             }
-          break;
-
-          case FSTYPE_FAT32 :
+          else if (next == 0)
             {
-              unsigned int fatoffset = 4 * clusterno;
-              off_t        fatsector = fs->fs_fatbase + SEC_NSECTORS(fs, fatoffset);
-              unsigned int fatindex  = fatoffset & SEC_NDXMASK(fs);
-              uint32_t     val;
-
-              if (fat_fscacheread(fs, fatsector) < 0)
-                {
-                  /* Read error */
-
-                  break;
-                }
-
-              /* Keep the top 4 bits */
-
-              val = FAT_GETFAT32(fs->fs_buffer, fatindex) & 0xf0000000;
-              FAT_PUTFAT32(fs->fs_buffer, fatindex, val | (nextcluster & 0x0fffffff));
+              return -ENOSPC;
             }
-          break;
 
-          default:
-            return -EINVAL;
+          ff->ff_bflags |= FFBUFF_PREALLOC;
         }
 
-      /* Mark the modified sector as "dirty" and return success */
-
-      fs->fs_dirty = true;
-      return OK;
+      fat_mapadd(ff, index, next);
+      cluster = next;
     }
 
-  return -EINVAL;
+  return OK;
 }
 
 /****************************************************************************
- * Name: fat_removechain
+ * Name: fat_trimchain
  *
  * Description:
- *   Remove an entire chain of clusters, starting with 'cluster'
+ *   Release the clusters that were reserved by fat_reservechain but that
+ *   are not needed to hold the current size of the file.
+ *
+ * Returned Value:
+ *   OK on success or a negated errno value on failure.
  *
  ****************************************************************************/
 
-int fat_removechain(struct fat_mountpt_s *fs, uint32_t cluster)
+int fat_trimchain(struct fat_mountpt_s *fs, struct fat_file_s *ff)
 {
-  int32_t nextcluster;
-  int    ret;
+  uint32_t clustersize = fs->fs_fatsecperclus * fs->fs_hwsectorsize;
+  uint32_t nclusters;
+  int32_t  cluster;
+  int32_t  next;
+  int      ret;
 
-  /* Loop while there are clusters in the chain */
+  if ((ff->ff_bflags & FFBUFF_PREALLOC) == 0 || ff->ff_startcluster == 0)
+    {
+      return OK;
+    }
 
-  while (cluster >= 2 && cluster < fs->fs_nclusters)
+  ff->ff_bflags &= ~FFBUFF_PREALLOC;
+
+  /* An empty file does not own any clusters at all */
+
+  if (ff->ff_size == 0)
     {
-      /* Get the next cluster after the current one */
+      ret = fat_removechain(fs, ff->ff_startcluster);
+      ff->ff_startcluster   = 0;
+      ff->ff_currentcluster = 0;
+      ff->ff_currentsector  = 0;
+      ff->ff_bflags        |= FFBUFF_MODIFIED;
+      return ret;
+    }
 
-      nextcluster = fat_getcluster(fs, cluster);
-      if (nextcluster < 0)
-        {
-          /* Error! */
-          return nextcluster;
-        }
+  /* Find the last cluster holding file data */
 
-      /* Then nullify current cluster -- removing it from the chain */
+  nclusters = (ff->ff_size + clustersize - 1) / clustersize;
+  cluster   = ff->ff_startcluster;
 
-      ret = fat_putcluster(fs, cluster, 0);
-      if (ret < 0)
+  while (--nclusters > 0)
+    {
+      cluster = fat_getcluster(fs, cluster);
+      if (cluster < 0)
         {
-          return ret;
+          return cluster;
         }
-
-      /* Update FSINFINFO data */
-
-      if (fs->fs_fsifreecount != 0xffffffff)
+      else if (cluster < 2 || cluster >= fs->fs_nclusters)
         {
-          fs->fs_fsifreecount++;
-          fs->fs_fsidirty = 1;
+          /* The chain is already no longer than the file */
+
+          return OK;
         }
+    }
 
-      /* Then set up to remove the next cluster */
+  /* Terminate the chain there and free the rest */
 
-      cluster = nextcluster;
-  }
+  next = fat_getcluster(fs, cluster);
+  if (next < 0)
+    {
+      return next;
+    }
+  else if (next < 2 || next >= fs->fs_nclusters)
+    {
+      return OK;
+    }
 
-  return OK;
+  ret = fat_putcluster(fs, cluster, 0x0fffffff);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  return fat_removechain(fs, next);
 }
 
+#ifdef CONFIG_FAT_CLUSTERMAP
 /****************************************************************************
- * Name: fat_extendchain
+ * Name: fat_mapadd
  *
  * Description:
- *   Add a new cluster to the chain following cluster (if cluster is non-
- *   NULL).  if cluster is zero, then a new chain is created.
- *
- * Return:
- *   <0:error, 0: no free cluster, >=2: new cluster number
+ *   Record that the cluster with the given index in the file's cluster
+ *   chain is 'cluster'.  The map only describes a prefix of the chain so
+ *   the information is recorded only if it immediately follows the mapped
+ *   part.  Nothing is recorded if the map is full or cannot be grown.
  *
  ****************************************************************************/
 
-int32_t fat_extendchain(struct fat_mountpt_s *fs, uint32_t cluster)
+void fat_mapadd(struct fat_file_s *ff, uint32_t index, uint32_t cluster)
 {
-  off_t    startsector;
-  uint32_t newcluster;
-  uint32_t startcluster;
-  int      ret;
-
-  /* The special value 0 is used when the new chain should start */
+  FAR struct fat_extent_s *extents;
+  FAR struct fat_extent_s *last;
+  uint32_t mapped;
+  int newsize;
 
-  if (cluster == 0)
+  if (cluster < 2)
     {
-      /* The FSINFO NextFree entry should be a good starting point
-       * in the search for a new cluster
-       */
+      return;
+    }
 
-      startcluster = fs->fs_fsinextfree;
-      if (startcluster == 0 || startcluster >= fs->fs_nclusters)
-        {
-          /* But it is bad.. we have to start at the beginning */
+  /* Does this cluster immediately follow the mapped part of the chain? */
 
-          startcluster = 1;
-        }
+  if (ff->ff_nextents > 0)
+    {
+      last   = &ff->ff_extents[ff->ff_nextents - 1];
+      mapped = last->fe_index + last->fe_count;
     }
   else
     {
-      /* We are extending an existing chain. Verify that this
-       * is a valid cluster by examining its start sector.
-       */
-
-      startsector = fat_getcluster(fs, cluster);
-      if (startsector < 0)
-        {
-          /* An error occurred, return the error value */
-
-          return startsector;
-        }
-      else if (startsector < 2)
-        {
-          /* Oops.. this cluster does not exist. */
-
-          return 0;
-        }
-      else if (startsector < fs->fs_nclusters)
-        {
-          /* It is already followed by next cluster */
+      last   = NULL;
+      mapped = 0;
+    }
 
-          return startsector;
-        }
+  if (index != mapped)
+    {
+      return;
+    }
 
-      /* Okay.. it checks out */
+  /* Yes.. Can the last run simply be extended? */
 
-      startcluster = cluster;
+  if (last && cluster == last->fe_cluster + last->fe_count)
+    {
+      last->fe_count++;
+      return;
     }
 
-  /* Loop until (1) we discover that there are not free clusters
-   * (return 0), an errors occurs (return -errno), or (3) we find
-   * the next cluster (return the new cluster number).
-   */
+  /* No.. we need a new run */
 
-  newcluster = startcluster;
-  for (; ; )
+  if (ff->ff_nextents >= ff->ff_maxextents)
     {
-      /* Examine the next cluster in the FAT */
-
-      newcluster++;
-      if (newcluster >= fs->fs_nclusters)
+      if (ff->ff_maxextents >= CONFIG_FAT_CLUSTERMAP_MAXEXTENTS)
         {
-          /* If we hit the end of the available clusters, then
-           * wrap back to the beginning because we might have
-           * started at a non-optimal place.  But don't continue
-           * past the start cluster.
-           */
-
-          newcluster = 2;
-          if (newcluster > startcluster)
-            {
-              /* We are back past the starting cluster, then there
-               * is no free cluster.
-               */
-
-              return 0;
-            }
+          return;
         }
 
-      /* We have a candidate cluster.  Check if the cluster number is
-       * mapped to a group of sectors.
-       */
-
-      startsector = fat_getcluster(fs, newcluster);
-      if (startsector == 0)
-        {
-          /* Found have found a free cluster break out */
-
-          break;
-        }
-      else if (startsector < 0)
+      newsize = ff->ff_maxextents ? 2 * ff->ff_maxextents : 4;
+      if (newsize > CONFIG_FAT_CLUSTERMAP_MAXEXTENTS)
         {
-          /* Some error occurred, return the error number */
-
-          return startsector;
+          newsize = CONFIG_FAT_CLUSTERMAP_MAXEXTENTS;
         }
 
-      /* We wrap all the back to the starting cluster?  If so, then
-       * there are no free clusters.
-       */
-
-      if (newcluster == startcluster)
+      extents = (FAR struct fat_extent_s *)
+        kmm_realloc(ff->ff_extents, newsize * sizeof(struct fat_extent_s));
+      if (!extents)
         {
-          return 0;
+          return;
         }
+
+      ff->ff_extents    = extents;
+      ff->ff_maxextents = newsize;
     }
 
-  /* We get here only if we break out with an available cluster
-   * number in 'newcluster'  Now mark that cluster as in-use.
-   */
+  last             = &ff->ff_extents[ff->ff_nextents++];
+  last->fe_index   = index;
+  last->fe_cluster = cluster;
+  last->fe_count   = 1;
+}
 
-  ret = fat_putcluster(fs, newcluster, 0x0fffffff);
-  if (ret < 0)
-    {
-      /* An error occurred */
+/****************************************************************************
+ * Name: fat_maplookup
+ *
+ * Description:
+ *   Find the mapped cluster with the largest index that does not exceed
+ *   'index'.
+ *
+ * Returned Value:
+ *   The index of the cluster returned in 'cluster'.  Zero is returned
+ *   (and 'cluster' is not modified) if the map is empty.
+ *
+ ****************************************************************************/
 
-      return ret;
+uint32_t fat_maplookup(struct fat_file_s *ff, uint32_t index,
+                       uint32_t *cluster)
+{
+  FAR struct fat_extent_s *extent;
+  int low;
+  int high;
+  int mid;
+
+  if (ff->ff_nextents == 0)
+    {
+      return 0;
     }
 
-  /* And link if to the start cluster (if any) */
+  /* Binary search for the last run that starts at or before index.  The
+   * first run always starts at index zero.
+   */
 
-  if (cluster)
-    {
-      /* There is a start cluster -- link it */
+  low  = 0;
+  high = ff->ff_nextents - 1;
 
-      ret = fat_putcluster(fs, cluster, newcluster);
-      if (ret < 0)
+  while (low < high)
+    {
+      mid = (low + high + 1) >> 1;
+      if (ff->ff_extents[mid].fe_index <= index)
         {
-          return ret;
+          low = mid;
+        }
+      else
+        {
+          high = mid - 1;
         }
     }
 
-  /* And update the FINSINFO for the next time we have to search */
-
-  fs->fs_fsinextfree = newcluster;
-  if (fs->fs_fsifreecount != 0xffffffff)
+  extent = &ff->ff_extents[low];
+  if (index >= extent->fe_index + extent->fe_count)
     {
-      fs->fs_fsifreecount--;
-      fs->fs_fsidirty = 1;
+      index = extent->fe_index + extent->fe_count - 1;
     }
 
-  /* Return then number of the new cluster that was added to the chain */
+  *cluster = extent->fe_cluster + (index - extent->fe_index);
+  return index;
+}
 
-  return newcluster;
+/****************************************************************************
+ * Name: fat_mapfree
+ *
+ * Description:
+ *   Discard the cluster map of an open file.
+ *
+ ****************************************************************************/
+
+void fat_mapfree(struct fat_file_s *ff)
+{
+  if (ff->ff_extents)
+    {
+      kmm_free(ff->ff_extents);
+    }
+
+  ff->ff_extents    = NULL;
+  ff->ff_nextents   = 0;
+  ff->ff_maxextents = 0;
 }
+#endif
 
 /****************************************************************************
  * Name: fat_nextdirentry
@@ -1496,50 +2587,51 @@ int  fat_dirtruncate(struct fat_mountpt_s *fs, struct fat_dirinfo_s *dirinfo)
  * Name: fat_fscacheflush
  *
  * Description:
- *   Flush any dirty sector if fs_buffer as necessary
+ *   Write back all dirty sectors in the sector cache.  FAT sectors are
+ *   written before directory sectors so that a directory entry never
+ *   refers to a cluster chain that is not yet on the media.
  *
  ****************************************************************************/
 
 int fat_fscacheflush(struct fat_mountpt_s *fs)
 {
+  struct fat_cache_s *cache;
   int ret;
+  int i;
 
-  /* Check if the fs_buffer is dirty.  In this case, we will write back the
-   * contents of fs_buffer.
-   */
-
-  if (fs->fs_dirty)
+  for (i = 0; i < FAT_NCACHESECTORS; i++)
     {
-      /* Write the dirty sector */
+      /* The state of the selected entry is held in the mountpoint
+       * structure.
+       */
 
-      ret = fat_hwwrite(fs, fs->fs_buffer, fs->fs_currentsector, 1);
-      if (ret < 0)
+      if (i == fs->fs_cacheslot)
         {
-          return ret;
-        }
-
-      /* Does the sector lie in the FAT region? */
+          if (fs->fs_dirty)
+            {
+              ret = fat_cachewrite(fs, fs->fs_buffer, fs->fs_currentsector);
+              if (ret < 0)
+                {
+                  return ret;
+                }
 
-      if (fs->fs_currentsector >= fs->fs_fatbase &&
-          fs->fs_currentsector < fs->fs_fatbase + fs->fs_nfatsects)
+              fs->fs_dirty = false;
+            }
+        }
+      else
         {
-          /* Yes, then make the change in the FAT copy as well */
-          int i;
-
-          for (i = fs->fs_fatnumfats; i >= 2; i--)
+          cache = &fs->fs_cache[i];
+          if (cache->fc_dirty)
             {
-              fs->fs_currentsector += fs->fs_nfatsects;
-              ret = fat_hwwrite(fs, fs->fs_buffer, fs->fs_currentsector, 1);
+              ret = fat_cachewrite(fs, cache->fc_buffer, cache->fc_sector);
               if (ret < 0)
                 {
                   return ret;
                 }
+
+              cache->fc_dirty = false;
             }
         }
-
-      /* No longer dirty */
-
-      fs->fs_dirty = false;
     }
 
   return OK;
@@ -1549,34 +2641,55 @@ int fat_fscacheflush(struct fat_mountpt_s *fs)
  * Name: fat_fscacheread
  *
  * Description:
- *   Read the specified sector into the sector cache, flushing any existing
- *   dirty sectors as necessary.
+ *   Make the specified sector the selected sector in the sector cache,
+ *   reading it from the media if it is not already cached.  If a dirty
+ *   sector must be replaced to make room, it is written back first.
  *
  ****************************************************************************/
 
 int fat_fscacheread(struct fat_mountpt_s *fs, off_t sector)
 {
-  int ret;
+  bool hit;
+  int  slot;
+  int  ret;
 
-  /* fs->fs_currentsector holds the current sector that is buffered in
+  /* fs->fs_currentsector holds the sector that is buffered in
    * fs->fs_buffer. If the requested sector is the same as this sector, then
-   * we do nothing. Otherwise, we will have to read the new sector.
+   * we do nothing.
    */
 
-  if (fs->fs_currentsector != sector)
+  if (fs->fs_currentsector == sector)
     {
-      /* We will need to read the new sector.  First, flush the cached
-       * sector if it is dirty.
+      return OK;
+    }
+
+  /* Otherwise, find the sector in the cache or the entry to replace */
+
+  slot = fat_cachelookup(fs, sector, &hit);
+  fat_cacheselect(fs, slot);
+
+  if (!hit)
+    {
+      /* We will need to read the new sector.  First, write back the old
+       * contents of the entry if they are dirty.
        */
 
-      ret = fat_fscacheflush(fs);
-      if (ret < 0)
+      if (fs->fs_dirty)
         {
-          return ret;
+          ret = fat_cachewrite(fs, fs->fs_buffer, fs->fs_currentsector);
+          if (ret < 0)
+            {
+              return ret;
+            }
+
+          fs->fs_dirty = false;
         }
 
-      /* Then read the specified sector into the cache */
+      /* Then read the specified sector into the cache.  The entry holds
+       * nothing valid until the read succeeds.
+       */
 
+      fs->fs_currentsector = -1;
       ret = fat_hwread(fs, fs->fs_buffer, sector, 1);
       if (ret < 0)
         {
@@ -1591,6 +2704,42 @@ int fat_fscacheread(struct fat_mountpt_s *fs, off_t sector)
   return OK;
 }
 
+/****************************************************************************
+ * Name: fat_fscachezero
+ *
+ * Description:
+ *   Make the specified sector the selected sector in the sector cache but,
+ *   rather than reading it from the media, fill it with zeroes.  This is
+ *   used when a new sector (such as the first sector of a new directory
+ *   cluster) is about to be initialized.  The caller must set fs_dirty if
+ *   the sector is to be written back.
+ *
+ ****************************************************************************/
+
+int fat_fscachezero(struct fat_mountpt_s *fs, off_t sector)
+{
+  bool hit;
+  int  slot;
+  int  ret;
+
+  slot = fat_cachelookup(fs, sector, &hit);
+  fat_cacheselect(fs, slot);
+
+  if (!hit && fs->fs_dirty)
+    {
+      ret = fat_cachewrite(fs, fs->fs_buffer, fs->fs_currentsector);
+      if (ret < 0)
+        {
+          return ret;
+        }
+    }
+
+  fs->fs_currentsector = sector;
+  fs->fs_dirty         = false;
+  memset(fs->fs_buffer, 0, fs->fs_hwsectorsize);
+  return OK;
+}
+
 /****************************************************************************
  * Name: fat_ffcacheflush
  *
@@ -1735,7 +2884,12 @@ int fat_updatefsinfo(struct fat_mountpt_s *fs)
         {
           /* Create an image of the FSINFO sector in the fs_buffer */
 
-          memset(fs->fs_buffer, 0, fs->fs_hwsectorsize);
+          ret = fat_fscachezero(fs, fs->fs_fsinfo);
+          if (ret < 0)
+            {
+              return ret;
+            }
+
           FSI_PUTLEADSIG(fs->fs_buffer, 0x41615252);
           FSI_PUTSTRUCTSIG(fs->fs_buffer, 0x61417272);
           FSI_PUTFREECOUNT(fs->fs_buffer, fs->fs_fsifreecount);
@@ -1744,9 +2898,8 @@ int fat_updatefsinfo(struct fat_mountpt_s *fs)
 
           /* Then flush this to disk */
 
-          fs->fs_currentsector = fs->fs_fsinfo;
-          fs->fs_dirty         = true;
-          ret                  = fat_fscacheflush(fs);
+          fs->fs_dirty = true;
+          ret          = fat_fscacheflush(fs);
 
           /* No longer dirty */
 
@@ -1754,6 +2907,17 @@ int fat_updatefsinfo(struct fat_mountpt_s *fs)
         }
     }
 
+#ifdef CONFIG_FAT_DISCARD
+  /* The freed clusters are no longer referenced on the media.  Now they
+   * may be discarded.
+   */
+
+  if (ret == OK && fs->fs_ndiscards > 0)
+    {
+      fat_discardissue(fs);
+    }
+#endif
+
   return ret;
 }
 
@@ -1768,6 +2932,11 @@ int fat_updatefsinfo(struct fat_mountpt_s *fs)
 int fat_nfreeclusters(struct fat_mountpt_s *fs, off_t *pfreeclusters)
 {
   uint32_t nfreeclusters;
+#ifdef CONFIG_FAT_FREEBITMAP
+  uint32_t cluster;
+  uint32_t word;
+  int      ret;
+#endif
 
   /* If number of the first free cluster is valid, then just return that value. */
 
@@ -1780,6 +2949,39 @@ int fat_nfreeclusters(struct fat_mountpt_s *fs, off_t *pfreeclusters)
   /* Otherwise, we will have to count the number of free clusters */
 
   nfreeclusters = 0;
+
+#ifdef CONFIG_FAT_FREEBITMAP
+  /* Complete the free cluster bitmap and count the clear bits in it */
+
+  for (cluster = 0; cluster < fs->fs_nclusters;
+       cluster += fs->fs_bmunitclusters)
+    {
+      if (!fat_bmscanned(fs, cluster))
+        {
+          ret = fat_bmscan(fs, cluster / fs->fs_bmunitclusters);
+          if (ret < 0)
+            {
+              return ret;
+            }
+        }
+    }
+
+  for (cluster = 0; cluster < fs->fs_nclusters; cluster += 32)
+    {
+      /* Bits beyond the last cluster count as used */
+
+      word = fs->fs_freemap[cluster >> 5];
+      if (fs->fs_nclusters - cluster < 32)
+        {
+          word |= ~((1u << (fs->fs_nclusters - cluster)) - 1);
+        }
+
+      for (word = ~word; word != 0; word &= word - 1)
+        {
+          nfreeclusters++;
+        }
+    }
+#else
   if (fs->fs_type == FSTYPE_FAT12)
     {
       off_t sector;
@@ -1815,7 +3017,7 @@ int fat_nfreeclusters(struct fat_mountpt_s *fs, off_t *pfreeclusters)
 
           if (offset >= fs->fs_hwsectorsize)
             {
-              ret = fat_fscacheread(fs, fatsector++);
+              ret = fat_fscacheread(fs, fatsector);
               if (ret < 0)
                 {
                   return ret;
@@ -1852,6 +3054,7 @@ int fat_nfreeclusters(struct fat_mountpt_s *fs, off_t *pfreeclusters)
             }
         }
     }
+#endif
 
     fs->fs_fsifreecount = nfreeclusters;
     if (fs->fs_type == FSTYPE_FAT32)
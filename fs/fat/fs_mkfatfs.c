@@ -307,9 +307,31 @@ int mkfatfs(FAR const char *pathname, FAR struct fat_format_s *fmt)
   if (!var.fv_sect)
     {
       fdbg("ERROR: Failed to allocate working buffers\n");
+      ret = -ENOMEM;
       goto errout_with_driver;
     }
 
+  /* Allocate a zero-filled buffer so that many sectors can be cleared with
+   * one write.  This is only an optimization:  Without it, sectors are
+   * cleared one at a time.
+   */
+
+#if CONFIG_FAT_MKFATFS_BUFSECTORS > 1
+  var.fv_nzerosects = CONFIG_FAT_MKFATFS_BUFSECTORS;
+#ifdef CONFIG_FAT_DMAMEMORY
+  var.fv_zero = (FAR uint8_t *)
+    fat_dma_alloc(var.fv_nzerosects * var.fv_sectorsize);
+#else
+  var.fv_zero = (FAR uint8_t *)
+    kmm_malloc(var.fv_nzerosects * var.fv_sectorsize);
+#endif
+
+  if (var.fv_zero)
+    {
+      memset(var.fv_zero, 0, var.fv_nzerosects * var.fv_sectorsize);
+    }
+#endif
+
   /* Write the filesystem to media */
 
   ret = mkfatfs_writefatfs(fmt, &var);
@@ -331,6 +353,15 @@ errout:
 #endif
     }
 
+  if (var.fv_zero)
+    {
+#ifdef CONFIG_FAT_DMAMEMORY
+      fat_dma_free(var.fv_zero, var.fv_nzerosects * var.fv_sectorsize);
+#else
+      kmm_free(var.fv_zero);
+#endif
+    }
+
   /* Return any reported errors */
 
   if (ret < 0)
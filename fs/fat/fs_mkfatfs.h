@@ -42,6 +42,7 @@
 
 #include <nuttx/config.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 /****************************************************************************
  * Pre-processor Definitions
@@ -64,6 +65,12 @@
 
 #define FAT32_DEFAULT_ROOT_CLUSTER     2
 
+/* Size of the buffer used to clear multiple sectors with one write */
+
+#ifndef CONFIG_FAT_MKFATFS_BUFSECTORS
+#  define CONFIG_FAT_MKFATFS_BUFSECTORS 16
+#endif
+
 /* Macros to simplify direct block driver access */
 
 #define DEV_OPEN() \
@@ -106,6 +113,11 @@ struct fat_var_s
    uint32_t       fv_nfatsects;      /* Number of sectors in each FAT */
    uint32_t       fv_nclusters;      /* Number of clusters */
    uint8_t       *fv_sect;           /* Allocated working sector buffer */
+   uint8_t       *fv_zero;           /* Zero-filled multi-sector buffer */
+   uint16_t       fv_nzerosects;     /* Number of sectors in fv_zero */
+   bool           fv_zeroed;         /* true: Metadata area reads as zero */
+   uint32_t       fv_ndone;          /* Sectors processed so far (progress) */
+   uint32_t       fv_ntotal;         /* Sectors to process (progress) */
    const uint8_t *fv_bootcode;       /* Points to boot code to put into MBR */
 };
 
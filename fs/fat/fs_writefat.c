@@ -41,11 +41,14 @@
 
 #include <sys/types.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <string.h>
+#include <debug.h>
 #include <errno.h>
 
 #include <nuttx/fs/fs.h>
 #include <nuttx/fs/fat.h>
+#include <nuttx/fs/ioctl.h>
 #include <nuttx/fs/mkfatfs.h>
 
 #include "inode/inode.h"
@@ -56,6 +59,145 @@
  * Private Functions
  ****************************************************************************/
 
+/****************************************************************************
+ * Name: mkfatfs_progress
+ *
+ * Description:
+ *   Account for sectors that have been processed and report the progress
+ *   to the caller (if requested)
+ *
+ * Input:
+ *    fmt  - User specified format parameters
+ *    var  - Other format parameters that are not user specifiable
+ *    nsectors - The number of sectors just processed
+ *
+ * Return:
+ *    None
+ *
+ ****************************************************************************/
+
+static void mkfatfs_progress(FAR struct fat_format_s *fmt,
+                             FAR struct fat_var_s *var, uint32_t nsectors)
+{
+  var->fv_ndone += nsectors;
+  if (fmt->ff_progress)
+    {
+      fmt->ff_progress(var->fv_ndone, var->fv_ntotal);
+    }
+}
+
+/****************************************************************************
+ * Name: mkfatfs_discard
+ *
+ * Description:
+ *   Ask the block driver to discard a range of sectors
+ *
+ * Input:
+ *    var  - Other format parameters that are not user specifiable
+ *    sector - The first sector to discard
+ *    nsectors - The number of sectors to discard
+ *    zeroed - Location to return true if the sectors now read as zero
+ *
+ * Return:
+ *    Zero on success; negated errno on failure (-ENOTTY if the block
+ *    driver does not support discard)
+ *
+ ****************************************************************************/
+
+static int mkfatfs_discard(FAR struct fat_var_s *var, off_t sector,
+                           uint32_t nsectors, FAR bool *zeroed)
+{
+  struct bioc_discard_s discard;
+  int ret;
+
+  *zeroed = false;
+  if (!var->fv_inode->u.i_bops->ioctl)
+    {
+      return -ENOTTY;
+    }
+
+  discard.bd_startsector = sector;
+  discard.bd_nsectors    = nsectors;
+  discard.bd_zeroed      = false;
+
+  ret = DEV_IOCTL(BIOC_DISCARD, (unsigned long)((uintptr_t)&discard));
+  if (ret >= 0)
+    {
+      *zeroed = discard.bd_zeroed;
+    }
+
+  return ret;
+}
+
+/****************************************************************************
+ * Name: mkfatfs_zerofill
+ *
+ * Description:
+ *   Clear a range of sectors, writing as many sectors at a time as the
+ *   zero-filled buffer allows.  Nothing is written if the metadata area has
+ *   been discarded and already reads as zero.
+ *
+ * Input:
+ *    fmt  - User specified format parameters
+ *    var  - Other format parameters that are not user specifiable
+ *    sector - The first sector to clear
+ *    nsectors - The number of sectors to clear
+ *
+ * Return:
+ *    Zero on success; negated errno on failure
+ *
+ ****************************************************************************/
+
+static int mkfatfs_zerofill(FAR struct fat_format_s *fmt,
+                            FAR struct fat_var_s *var, off_t sector,
+                            uint32_t nsectors)
+{
+  FAR uint8_t *buffer;
+  uint32_t nwrite;
+  int ret;
+
+  if (var->fv_zeroed)
+    {
+      mkfatfs_progress(fmt, var, nsectors);
+      return OK;
+    }
+
+  while (nsectors > 0)
+    {
+      /* Use the multi-sector buffer if there is one; otherwise clear the
+       * working sector buffer and write one sector at a time.
+       */
+
+      if (var->fv_zero)
+        {
+          buffer = var->fv_zero;
+          nwrite = var->fv_nzerosects;
+          if (nwrite > nsectors)
+            {
+              nwrite = nsectors;
+            }
+        }
+      else
+        {
+          buffer = var->fv_sect;
+          nwrite = 1;
+          memset(buffer, 0, var->fv_sectorsize);
+        }
+
+      ret = DEV_WRITE(buffer, sector, nwrite);
+      if (ret < 0)
+        {
+          return ret;
+        }
+
+      sector   += nwrite;
+      nsectors -= nwrite;
+      mkfatfs_progress(fmt, var, nwrite);
+    }
+
+  return OK;
+}
+
 /****************************************************************************
  * Name: mkfatfs_initmbr
  *
@@ -319,7 +461,6 @@ static inline void mkfatfs_initrootdir(FAR struct fat_format_s *fmt,
 static inline int mkfatfs_writembr(FAR struct fat_format_s *fmt,
                                    FAR struct fat_var_s *var)
 {
-  int sectno;
   int ret;
 
   /* Create an image of the configured master boot record */
@@ -329,13 +470,13 @@ static inline int mkfatfs_writembr(FAR struct fat_format_s *fmt,
   /* Write the master boot record as sector zero */
 
   ret = DEV_WRITE(var->fv_sect, 0, 1);
+  if (ret >= 0)
+    {
+      mkfatfs_progress(fmt, var, 1);
 
-  /* Write all of the reserved sectors */
+      /* Clear all of the other reserved sectors */
 
-  memset(var->fv_sect, 0, var->fv_sectorsize);
-  for (sectno = 1; sectno < fmt->ff_rsvdseccount && ret >= 0; sectno++)
-    {
-      ret = DEV_WRITE(var->fv_sect, sectno, 1);
+      ret = mkfatfs_zerofill(fmt, var, 1, fmt->ff_rsvdseccount - 1);
     }
 
   /* Write FAT32-specific sectors */
@@ -390,67 +531,68 @@ static inline int mkfatfs_writefat(FAR struct fat_format_s *fmt,
 {
   off_t offset = fmt->ff_rsvdseccount;
   int fatno;
-  int sectno;
   int ret;
 
   /* Loop for each FAT copy */
 
   for (fatno = 0; fatno < fmt->ff_nfats; fatno++)
     {
-      /* Loop for each sector in the FAT */
+      /* Mark cluster allocations in sector one of each FAT */
 
-       for (sectno = 0; sectno < var->fv_nfatsects; sectno++)
-         {
-           memset(var->fv_sect, 0, var->fv_sectorsize);
+      memset(var->fv_sect, 0, var->fv_sectorsize);
+      switch (fmt->ff_fattype)
+        {
+          case 12:
+            /* Mark the first two full FAT entries -- 24 bits, 3 bytes total */
 
-          /* Mark cluster allocations in sector one of each FAT */
+            memset(var->fv_sect, 0xff, 3);
+            break;
 
-           if (sectno == 0)
-             {
-               memset(var->fv_sect, 0, var->fv_sectorsize);
-               switch (fmt->ff_fattype)
-                 {
-                   case 12:
-                     /* Mark the first two full FAT entries -- 24 bits, 3 bytes total */
+          case 16:
+            /* Mark the first two full FAT entries -- 32 bits, 4 bytes total */
 
-                     memset(var->fv_sect, 0xff, 3);
-                     break;
+            memset(var->fv_sect, 0xff, 4);
+            break;
 
-                   case 16:
-                     /* Mark the first two full FAT entries -- 32 bits, 4 bytes total */
+          case 32:
+          default: /* Shouldn't happen */
+            /* Mark the first two full FAT entries -- 64 bits, 8 bytes total */
 
-                     memset(var->fv_sect, 0xff, 4);
-                     break;
+            memset(var->fv_sect, 0xff, 8);
 
-                   case 32:
-                   default: /* Shouldn't happen */
-                     /* Mark the first two full FAT entries -- 64 bits, 8 bytes total */
+            /* Cluster 2 is used as the root directory.  Mark as EOF */
 
-                     memset(var->fv_sect, 0xff, 8);
+            var->fv_sect[8] =  0xf8;
+            memset(&var->fv_sect[9], 0xff, 3);
+            break;
+        }
 
-                     /* Cluster 2 is used as the root directory.  Mark as EOF */
+      /* Save the media type in the first byte of the FAT */
 
-                     var->fv_sect[8] =  0xf8;
-                     memset(&var->fv_sect[9], 0xff, 3);
-                     break;
-                 }
+      var->fv_sect[0] = FAT_DEFAULT_MEDIA_TYPE;
 
-               /* Save the media type in the first byte of the FAT */
+      /* Write the first FAT sector */
 
-               var->fv_sect[0] = FAT_DEFAULT_MEDIA_TYPE;
-            }
+      ret = DEV_WRITE(var->fv_sect, offset, 1);
+      if (ret < 0)
+        {
+          return ret;
+        }
+
+      mkfatfs_progress(fmt, var, 1);
+
+      /* Then clear the rest of the FAT */
+
+      ret = mkfatfs_zerofill(fmt, var, offset + 1, var->fv_nfatsects - 1);
+      if (ret < 0)
+        {
+          return ret;
+        }
+
+      offset += var->fv_nfatsects;
+    }
 
-           /* Write the FAT sector */
-
-           ret = DEV_WRITE(var->fv_sect, offset, 1);
-           if (ret < 0)
-             {
-               return ret;
-             }
-           offset++;
-         }
-     }
-   return OK;
+  return OK;
 }
 
 /****************************************************************************
@@ -473,28 +615,25 @@ static inline int mkfatfs_writerootdir(FAR struct fat_format_s *fmt,
 {
   off_t offset = fmt->ff_rsvdseccount + fmt->ff_nfats * var->fv_nfatsects;
   int ret;
-  int i;
 
   /* Write the root directory after the last FAT. This is the root directory
-   * area for FAT12/16, and the first cluster on FAT32.
+   * area for FAT12/16, and the first cluster on FAT32.  Only the first
+   * sector holds any data (the volume label).
    */
 
-  for (i = 0; i < var->fv_nrootdirsects; i++)
+  mkfatfs_initrootdir(fmt, var, 0);
+
+  ret = DEV_WRITE(var->fv_sect, offset, 1);
+  if (ret < 0)
     {
-      /* Format the next sector of the root directory */
+      return ret;
+    }
 
-      mkfatfs_initrootdir(fmt, var, i);
+  mkfatfs_progress(fmt, var, 1);
 
-      /* Write the next sector of the root directory */
+  /* Clear the remaining sectors of the root directory */
 
-      ret = DEV_WRITE(var->fv_sect, offset, 1);
-      if (ret < 0)
-        {
-          return ret;
-        }
-      offset++;
-    }
-  return 0;
+  return mkfatfs_zerofill(fmt, var, offset + 1, var->fv_nrootdirsects - 1);
 }
 
 /****************************************************************************
@@ -520,8 +659,45 @@ static inline int mkfatfs_writerootdir(FAR struct fat_format_s *fmt,
 int mkfatfs_writefatfs(FAR struct fat_format_s *fmt,
                        FAR struct fat_var_s *var)
 {
+  uint32_t datastart;
+  uint32_t ndata;
+  bool zeroed;
   int ret;
 
+  /* The metadata area (reserved sectors, FATs and root directory) is
+   * written; the data area is only discarded if so requested.
+   */
+
+  datastart = fmt->ff_rsvdseccount + fmt->ff_nfats * var->fv_nfatsects +
+              var->fv_nrootdirsects;
+  ndata     = fmt->ff_nsectors > datastart ? fmt->ff_nsectors - datastart : 0;
+
+  var->fv_ndone  = 0;
+  var->fv_ntotal = datastart;
+  if ((fmt->ff_flags & MKFATFS_FLAG_DISCARD) != 0)
+    {
+      var->fv_ntotal += ndata;
+    }
+
+  /* For a quick format, discard the metadata area first.  If the device
+   * then reads as zero there, only the sectors holding data need to be
+   * written.
+   */
+
+  var->fv_zeroed = false;
+  if ((fmt->ff_flags & MKFATFS_FLAG_QUICK) != 0)
+    {
+      ret = mkfatfs_discard(var, 0, datastart, &zeroed);
+      if (ret >= 0)
+        {
+          var->fv_zeroed = zeroed;
+        }
+      else
+        {
+          fvdbg("Discard not supported: %d\n", ret);
+        }
+    }
+
   /* Write the master boot record (also the backup and fsinfo sectors) */
 
   ret = mkfatfs_writembr(fmt, var);
@@ -539,6 +715,21 @@ int mkfatfs_writefatfs(FAR struct fat_format_s *fmt,
     {
       ret = mkfatfs_writerootdir(fmt, var);
     }
+
+  /* Discard the data area if so requested.  This is only a hint to the
+   * device, so failures are not reported.
+   */
+
+  if (ret >= 0 && (fmt->ff_flags & MKFATFS_FLAG_DISCARD) != 0)
+    {
+      if (ndata > 0 && mkfatfs_discard(var, datastart, ndata, &zeroed) < 0)
+        {
+          fvdbg("Failed to discard the data area\n");
+        }
+
+      mkfatfs_progress(fmt, var, ndata);
+    }
+
   return ret;
 }
 
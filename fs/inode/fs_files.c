@@ -55,6 +55,13 @@
  * Pre-processor Definitions
  ****************************************************************************/
 
+/* Access to the bitmap of in-use file descriptors */
+
+#define _files_setinuse(list,fd) \
+  ((list)->fl_inuse[(fd) >> 5] |= (uint32_t)1 << ((fd) & 31))
+#define _files_clrinuse(list,fd) \
+  ((list)->fl_inuse[(fd) >> 5] &= ~((uint32_t)1 << ((fd) & 31)))
+
 /****************************************************************************
  * Private Types
  ****************************************************************************/
@@ -95,6 +102,73 @@ static void _files_semtake(FAR struct filelist *list)
 
 #define _files_semgive(list) sem_post(&list->fl_sem)
 
+/****************************************************************************
+ * Name: _files_ffz
+ *
+ * Description:
+ *   Return the bit number of the least significant zero bit in 'word'.
+ *   'word' must not be all ones.
+ *
+ ****************************************************************************/
+
+static int _files_ffz(uint32_t word)
+{
+  int bit = 0;
+
+  word = ~word;
+
+  if ((word & 0x0000ffff) == 0)
+    {
+      word >>= 16;
+      bit   += 16;
+    }
+
+  if ((word & 0x000000ff) == 0)
+    {
+      word >>= 8;
+      bit   += 8;
+    }
+
+  if ((word & 0x0000000f) == 0)
+    {
+      word >>= 4;
+      bit   += 4;
+    }
+
+  if ((word & 0x00000003) == 0)
+    {
+      word >>= 2;
+      bit   += 2;
+    }
+
+  if ((word & 0x00000001) == 0)
+    {
+      bit   += 1;
+    }
+
+  return bit;
+}
+
+/****************************************************************************
+ * Name: _files_index
+ *
+ * Description:
+ *   Return the file descriptor corresponding to 'filep' if 'filep' lies in
+ *   'list'.  Otherwise, return -1.
+ *
+ ****************************************************************************/
+
+static int _files_index(FAR struct filelist *list, FAR struct file *filep)
+{
+  if (filep >= list->fl_files &&
+      filep <  &list->fl_files[CONFIG_NFILE_DESCRIPTORS])
+    {
+      return filep - list->fl_files;
+    }
+
+  return -1;
+}
+
 /****************************************************************************
  * Name: _files_close
  *
@@ -115,6 +189,14 @@ static int _files_close(FAR struct file *filep)
 
   if (inode)
     {
+#ifndef CONFIG_DISABLE_POLL
+      /* Remove the file from any epoll instance that it is registered with
+       * while its driver can still tear down the poll.
+       */
+
+      epoll_release(filep);
+#endif
+
       /* Close the file, driver, or mountpoint. */
 
       if (inode->u.i_ops && inode->u.i_ops->close)
@@ -212,6 +294,7 @@ int file_dup2(FAR struct file *filep1, FAR struct file *filep2)
 {
   FAR struct filelist *list;
   FAR struct inode *inode;
+  int fd2;
   int err;
   int ret;
 
@@ -226,6 +309,14 @@ int file_dup2(FAR struct file *filep1, FAR struct file *filep2)
 
   _files_semtake(list);
 
+  /* Get the descriptor number if the new file structure belongs to our
+   * list.  It may not (for example, when the file list of a new task is
+   * being cloned).  That is harmless:  files_allocate() will discover that
+   * the descriptor is in use and update the in-use bitmap of its list.
+   */
+
+  fd2 = _files_index(list, filep2);
+
   /* If there is already an inode contained in the new file structure,
    * close the file and release the inode.
    */
@@ -238,6 +329,11 @@ int file_dup2(FAR struct file *filep1, FAR struct file *filep2)
       goto errout_with_ret;
     }
 
+  if (fd2 >= 0)
+    {
+      _files_setinuse(list, fd2);
+    }
+
   /* Increment the reference count on the contained inode */
 
   inode = filep1->f_inode;
@@ -290,6 +386,14 @@ errout_with_inode:
   filep2->f_inode  = NULL;
 
 errout_with_ret:
+
+  /* In either case, the new file structure is no longer in use */
+
+  if (fd2 >= 0)
+    {
+      _files_clrinuse(list, fd2);
+    }
+
   err              = -ret;
   _files_semgive(list);
 
@@ -310,23 +414,52 @@ errout:
 int files_allocate(FAR struct inode *inode, int oflags, off_t pos, int minfd)
 {
   FAR struct filelist *list;
+  uint32_t word;
   int i;
 
   list = sched_getfiles();
   DEBUGASSERT(list);
 
   _files_semtake(list);
-  for (i = minfd; i < CONFIG_NFILE_DESCRIPTORS; i++)
+
+  /* Use the in-use bitmap to skip over descriptors that are known to be
+   * in use, 32 at a time.
+   */
+
+  i = minfd < 0 ? 0 : minfd;
+  while (i < CONFIG_NFILE_DESCRIPTORS)
     {
-      if (!list->fl_files[i].f_inode)
+      /* Treat the descriptors below 'i' in this word as in use */
+
+      word = list->fl_inuse[i >> 5] | (((uint32_t)1 << (i & 31)) - 1);
+      if (word == 0xffffffff)
         {
-           list->fl_files[i].f_oflags = oflags;
-           list->fl_files[i].f_pos    = pos;
-           list->fl_files[i].f_inode  = inode;
-           list->fl_files[i].f_priv   = NULL;
-           _files_semgive(list);
-           return i;
+          i = (i | 31) + 1;
+          continue;
         }
+
+      i = (i & ~31) + _files_ffz(word);
+      if (i >= CONFIG_NFILE_DESCRIPTORS)
+        {
+          break;
+        }
+
+      /* A clear bit only means that the descriptor may be free */
+
+      if (list->fl_files[i].f_inode)
+        {
+          _files_setinuse(list, i);
+          i++;
+          continue;
+        }
+
+      list->fl_files[i].f_oflags = oflags;
+      list->fl_files[i].f_pos    = pos;
+      list->fl_files[i].f_inode  = inode;
+      list->fl_files[i].f_priv   = NULL;
+      _files_setinuse(list, i);
+      _files_semgive(list);
+      return i;
     }
 
   _files_semgive(list);
@@ -365,6 +498,7 @@ int files_close(int fd)
 
   _files_semtake(list);
   ret = _files_close(&list->fl_files[fd]);
+  _files_clrinuse(list, fd);
   _files_semgive(list);
   return ret;
 }
@@ -391,6 +525,7 @@ void files_release(int fd)
       list->fl_files[fd].f_oflags  = 0;
       list->fl_files[fd].f_pos     = 0;
       list->fl_files[fd].f_inode = NULL;
+      _files_clrinuse(list, fd);
       _files_semgive(list);
     }
 }
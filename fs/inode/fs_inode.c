@@ -39,6 +39,9 @@
 
 #include <nuttx/config.h>
 
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
 #include <assert.h>
 #include <semaphore.h>
 #include <errno.h>
@@ -54,6 +57,15 @@
 
 #define NO_HOLDER (pid_t)-1;
 
+/* Lookup cache geometry */
+
+#ifdef CONFIG_FS_INODE_CACHE
+#  if (CONFIG_FS_INODE_CACHE_SIZE & (CONFIG_FS_INODE_CACHE_SIZE - 1)) != 0
+#    error CONFIG_FS_INODE_CACHE_SIZE must be a power of two
+#  endif
+#  define INODE_CACHE_MASK (CONFIG_FS_INODE_CACHE_SIZE - 1)
+#endif
+
 /****************************************************************************
  * Private Types
  ****************************************************************************/
@@ -72,12 +84,35 @@ struct inode_sem_s
   int16_t count;   /* Number of counts held */
 };
 
+/* One entry in the lookup cache.  This records the result of searching for
+ * one path segment among the children of 'parent':  'node' is the matching
+ * inode (or NULL if there is no match) and 'left' is the peer to the left
+ * of the match (or of the place where the match would be inserted).
+ */
+
+#ifdef CONFIG_FS_INODE_CACHE
+struct inode_cache_s
+{
+  FAR struct inode *parent; /* Parent inode (NULL for the top level) */
+  FAR struct inode *node;   /* The matching inode or NULL (negative entry) */
+  FAR struct inode *left;   /* The peer to the left of the match */
+  uint32_t          hash;   /* Hash of parent and path segment name */
+  bool              inuse;  /* True: This entry is valid */
+};
+#endif
+
 /****************************************************************************
  * Private Variables
  ****************************************************************************/
 
 static struct inode_sem_s g_inode_sem;
 
+#ifdef CONFIG_FS_INODE_CACHE
+/* The lookup cache.  It is protected by g_inode_sem. */
+
+static struct inode_cache_s g_inode_cache[CONFIG_FS_INODE_CACHE_SIZE];
+#endif
+
 /****************************************************************************
  * Public Data
  ****************************************************************************/
@@ -165,6 +200,178 @@ static int _inode_compare(FAR const char *fname,
     }
 }
 
+/****************************************************************************
+ * Name: _inode_peersearch
+ *
+ * Description:
+ *   Search the ordered list of peers beginning with 'node' for the path
+ *   segment 'name'.  Returns the matching inode or NULL.  In either case,
+ *   the peer to the left of the match (or of the insertion point) is
+ *   returned in 'left'.
+ *
+ ****************************************************************************/
+
+static FAR struct inode *_inode_peersearch(FAR const char *name,
+                                           FAR struct inode *node,
+                                           FAR struct inode **left)
+{
+  *left = NULL;
+
+  while (node)
+    {
+      int result = _inode_compare(name, node);
+
+      /* Case 1:  The name is less than the name of the node.
+       * Since the names are ordered, these means that there
+       * is no peer node with this name and that there can be
+       * no match in the fileystem.
+       */
+
+      if (result < 0)
+        {
+          return NULL;
+        }
+
+      /* Case 2: the name is greater than the name of the node.
+       * In this case, the name may still be in the list to the
+       * "right"
+       */
+
+      else if (result > 0)
+        {
+          *left = node;
+          node  = node->i_peer;
+        }
+
+      /* The names match */
+
+      else
+        {
+          return node;
+        }
+    }
+
+  return NULL;
+}
+
+/****************************************************************************
+ * Name: _inode_cachehash
+ *
+ * Description:
+ *   Hash the path segment 'name' (terminated by '/' or NUL) together with
+ *   the address of its parent inode.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_FS_INODE_CACHE
+static uint32_t _inode_cachehash(FAR struct inode *parent,
+                                 FAR const char *name)
+{
+  uint32_t hash = 2166136261u ^ (uint32_t)(uintptr_t)parent;
+
+  /* FNV-1a over the characters of the path segment */
+
+  while (*name && *name != '/')
+    {
+      hash = (hash ^ (uint8_t)*name++) * 16777619u;
+    }
+
+  return hash;
+}
+#endif
+
+/****************************************************************************
+ * Name: _inode_cachelookup
+ *
+ * Description:
+ *   Look up the path segment 'name' among the children of 'parent' in the
+ *   lookup cache.  Returns true on a cache hit; the result of the search
+ *   is then provided in 'node' and 'left'.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_FS_INODE_CACHE
+static bool _inode_cachelookup(FAR struct inode *parent,
+                               FAR const char *name, uint32_t hash,
+                               FAR struct inode **node,
+                               FAR struct inode **left)
+{
+  FAR struct inode_cache_s *entry = &g_inode_cache[hash & INODE_CACHE_MASK];
+  FAR struct inode *next;
+
+  if (!entry->inuse || entry->hash != hash || entry->parent != parent)
+    {
+      return false;
+    }
+
+  /* Different names may share a hash value, so the entry must be verified
+   * against the name.  A positive entry must match the name of the cached
+   * inode.
+   */
+
+  if (entry->node)
+    {
+      if (_inode_compare(name, entry->node) != 0)
+        {
+          return false;
+        }
+    }
+
+  /* A negative entry is valid if the name sorts between the left peer and
+   * the peer that follows it.
+   */
+
+  else
+    {
+      if (entry->left)
+        {
+          if (_inode_compare(name, entry->left) <= 0)
+            {
+              return false;
+            }
+
+          next = entry->left->i_peer;
+        }
+      else
+        {
+          next = parent ? parent->i_child : g_root_inode;
+        }
+
+      if (next && _inode_compare(name, next) >= 0)
+        {
+          return false;
+        }
+    }
+
+  *node = entry->node;
+  *left = entry->left;
+  return true;
+}
+#endif
+
+/****************************************************************************
+ * Name: _inode_cacheadd
+ *
+ * Description:
+ *   Save the result of a search for a path segment in the lookup cache,
+ *   replacing any previous entry in the same slot.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_FS_INODE_CACHE
+static void _inode_cacheadd(FAR struct inode *parent, uint32_t hash,
+                            FAR struct inode *node, FAR struct inode *left)
+{
+  FAR struct inode_cache_s *entry = &g_inode_cache[hash & INODE_CACHE_MASK];
+
+  entry->parent = parent;
+  entry->node   = node;
+  entry->left   = left;
+  entry->hash   = hash;
+  entry->inuse  = true;
+}
+#endif
+
 /****************************************************************************
  * Public Functions
  ****************************************************************************/
@@ -296,29 +503,25 @@ FAR struct inode *inode_search(FAR const char **path,
 
   while (node)
     {
-      int result = _inode_compare(name, node);
+      /* Search for this path segment among the peers at this level */
 
-      /* Case 1:  The name is less than the name of the node.
-       * Since the names are ordered, these means that there
-       * is no peer node with this name and that there can be
-       * no match in the fileystem.
-       */
+#ifdef CONFIG_FS_INODE_CACHE
+      uint32_t hash = _inode_cachehash(above, name);
 
-      if (result < 0)
+      if (!_inode_cachelookup(above, name, hash, &node, &left))
         {
-          node = NULL;
-          break;
+          node = _inode_peersearch(name, node, &left);
+          _inode_cacheadd(above, hash, node, left);
         }
+#else
+      node = _inode_peersearch(name, node, &left);
+#endif
 
-      /* Case 2: the name is greater than the name of the node.
-       * In this case, the name may still be in the list to the
-       * "right"
-       */
+      /* If there is no match, then there can be no match in the filesystem */
 
-      else if (result > 0)
+      if (!node)
         {
-          left = node;
-          node = node->i_peer;
+          break;
         }
 
       /* The names match */
@@ -386,6 +589,25 @@ FAR struct inode *inode_search(FAR const char **path,
   return node;
 }
 
+/****************************************************************************
+ * Name: inode_cache_invalidate
+ *
+ * Description:
+ *   Discard all entries in the lookup cache.  This must be called whenever
+ *   inodes are linked into or unlinked from the inode tree.
+ *
+ * Assumptions:
+ *   The caller holds the g_inode_sem semaphore
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_FS_INODE_CACHE
+void inode_cache_invalidate(void)
+{
+  memset(g_inode_cache, 0, sizeof(g_inode_cache));
+}
+#endif
+
 /****************************************************************************
  * Name: inode_free
  *
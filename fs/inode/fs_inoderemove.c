@@ -124,6 +124,10 @@ FAR struct inode *inode_unlink(FAR const char *path)
         }
 
       node->i_peer = NULL;
+
+      /* The shape of the tree has changed */
+
+      inode_cache_invalidate();
     }
 
   return node;
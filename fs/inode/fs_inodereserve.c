@@ -143,6 +143,10 @@ static void inode_insert(FAR struct inode *node,
       node->i_peer = g_root_inode;
       g_root_inode = node;
     }
+
+  /* The shape of the tree has changed */
+
+  inode_cache_invalidate();
 }
 
 /****************************************************************************
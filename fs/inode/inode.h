@@ -177,6 +177,24 @@ FAR struct inode *inode_search(FAR const char **path,
                                FAR struct inode **parent,
                                FAR const char **relpath);
 
+/****************************************************************************
+ * Name: inode_cache_invalidate
+ *
+ * Description:
+ *   Discard all entries in the lookup cache.  This must be called whenever
+ *   inodes are linked into or unlinked from the inode tree.
+ *
+ * Assumptions:
+ *   The caller holds the tree_sem
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_FS_INODE_CACHE
+void inode_cache_invalidate(void);
+#else
+#  define inode_cache_invalidate()
+#endif
+
 /****************************************************************************
  * Name: inode_free
  *
@@ -51,6 +51,9 @@
 
 #include <nuttx/mtd/mtd.h>
 #include <nuttx/fs/nxffs.h>
+#ifdef CONFIG_NXFFS_PACK_WORKER
+#  include <nuttx/wqueue.h>
+#endif
 
 /****************************************************************************
  * Pre-processor Definitions
@@ -265,6 +268,8 @@ struct nxffs_ofile_s
   int16_t                   crefs;     /* Reference count */
   mode_t                    oflags;    /* Open mode */
   struct nxffs_entry_s      entry;     /* Describes the NXFFS inode entry */
+  off_t                     rdblock;   /* Offset to the last data block read */
+  off_t                     rdstart;   /* File position at its first byte */
 };
 
 /* A file opened for writing require some additional information */
@@ -283,6 +288,16 @@ struct nxffs_wrfile_s
   uint32_t                  crc;        /* Accumulated data block CRC */
 };
 
+/* One entry in the in-memory index of valid inodes */
+
+#ifdef CONFIG_NXFFS_INODE_INDEX
+struct nxffs_ixentry_s
+{
+  uint32_t                  hash;      /* Hash of the inode name */
+  off_t                     hoffset;   /* FLASH offset to the inode header */
+};
+#endif
+
 /* This structure represents the overall state of on NXFFS instance. */
 
 struct nxffs_volume_s
@@ -300,7 +315,27 @@ struct nxffs_volume_s
   off_t                     cblock;    /* Starting block number in cache */
   FAR struct nxffs_ofile_s *ofiles;    /* A singly-linked list of open files */
   FAR uint8_t              *cache;     /* On cached erase block for general I/O */
+  FAR uint8_t              *cbuffer;   /* Memory for all of the cached blocks */
+  uint8_t                   cslot;     /* Index of the block at 'cache' */
+  uint32_t                  cuse;      /* Counts cache accesses */
+  off_t                     cblocks[CONFIG_NXFFS_CACHE_NBLOCKS]; /* Cached blocks */
+  uint32_t                  cused[CONFIG_NXFFS_CACHE_NBLOCKS];   /* Last access */
   FAR uint8_t              *pack;      /* A full erase block to support packing */
+#ifdef CONFIG_NXFFS_INODE_INDEX
+  bool                      ixvalid;   /* True: index holds every valid inode */
+  uint16_t                  nindex;    /* Number of entries in the index */
+  uint16_t                  ixalloc;   /* Number of entries allocated */
+  FAR struct nxffs_ixentry_s *index;   /* Index of valid inodes */
+#endif
+  struct nxffs_packstats_s  packstats; /* Volume packing statistics */
+#ifdef CONFIG_NXFFS_PACK_INCREMENTAL
+  bool                      packnone;  /* True: Packing would free nothing */
+  off_t                     packresume; /* Pad inode left by the last step */
+#ifdef CONFIG_NXFFS_PACK_WORKER
+  uint32_t                  packtime;  /* Time of the last close or unlink */
+  struct work_s             packwork;  /* Supports packing on the work queue */
+#endif
+#endif
 };
 
 /* This structure describes the state of the blocks on the NXFFS volume */
@@ -507,6 +542,26 @@ int nxffs_rdcache(FAR struct nxffs_volume_s *volume, off_t block);
 
 int nxffs_wrcache(FAR struct nxffs_volume_s *volume);
 
+/****************************************************************************
+ * Name: nxffs_invcache
+ *
+ * Description:
+ *   Discard every block in the volume cache.  This must be called after
+ *   FLASH is written without going through the cache.  Data may have moved,
+ *   so the read positions remembered for open files are discarded too.
+ *
+ * Input Parameters:
+ *   volume - Describes the current volume
+ *
+ * Returned Value:
+ *   None
+ *
+ * Defined in nxffs_cache.c
+ *
+ ****************************************************************************/
+
+void nxffs_invcache(FAR struct nxffs_volume_s *volume);
+
 /****************************************************************************
  * Name: nxffs_ioseek
  *
@@ -568,6 +623,35 @@ off_t nxffs_iotell(FAR struct nxffs_volume_s *volume);
 
 int nxffs_getc(FAR struct nxffs_volume_s *volume, uint16_t reserve);
 
+/****************************************************************************
+ * Name: nxffs_rdbuf
+ *
+ * Description:
+ *   Get the FLASH data at the current position.  This skips over bad
+ *   blocks and block headers just as nxffs_getc() does, but returns all of
+ *   the bytes that remain in the block at once so that callers scanning
+ *   FLASH need not verify the block again for every byte.  The current
+ *   position is not changed.
+ *
+ * Input Parameters:
+ *   volume - Describes the NXFFS volume.  The parameters ioblock and iooffset
+ *     in the volume structure determine the behavior of nxffs_rdbuf().
+ *   reserve - If less than this much space is available at the end of the
+ *     block, then skip to the next block.
+ *   buffer - The location to return the address of the data in the volume
+ *     cache.
+ *
+ * Returned Value:
+ *   The number of bytes at *buffer is returned on success.  Otherwise, a
+ *   negated errno indicating the nature of the failure.
+ *
+ * Defined in nxffs_cache.c
+ *
+ ****************************************************************************/
+
+int nxffs_rdbuf(FAR struct nxffs_volume_s *volume, uint16_t reserve,
+                FAR const uint8_t **buffer);
+
 /****************************************************************************
  * Name: nxffs_freeentry
  *
@@ -615,6 +699,33 @@ void nxffs_freeentry(FAR struct nxffs_entry_s *entry);
 int nxffs_nextentry(FAR struct nxffs_volume_s *volume, off_t offset,
                     FAR struct nxffs_entry_s *entry);
 
+/****************************************************************************
+ * Name: nxffs_nextinode
+ *
+ * Description:
+ *   Search for the next inode starting at the provided FLASH offset, valid
+ *   or deleted.  Packing steps use this to follow the chain of deleted
+ *   inodes that they leave behind.
+ *
+ * Input Parameters:
+ *   volume - Describes the NXFFS volume.
+ *   offset - The FLASH memory offset to begin searching.
+ *   entry  - A pointer to memory provided by the caller in which to return
+ *     the inode description.
+ *
+ * Returned Value:
+ *   Zero is returned on success. Otherwise, a negated errno is returned
+ *   that indicates the nature of the failure.
+ *
+ * Defined in nxffs_inode.c
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_NXFFS_PACK_INCREMENTAL
+int nxffs_nextinode(FAR struct nxffs_volume_s *volume, off_t offset,
+                    FAR struct nxffs_entry_s *entry);
+#endif
+
 /****************************************************************************
  * Name: nxffs_findinode
  *
@@ -666,6 +777,36 @@ int nxffs_findinode(FAR struct nxffs_volume_s *volume, FAR const char *name,
 off_t nxffs_inodeend(FAR struct nxffs_volume_s *volume,
                      FAR struct nxffs_entry_s *entry);
 
+/****************************************************************************
+ * Name: nxffs_ixhash, nxffs_ixreset, nxffs_ixadd, nxffs_ixremove,
+ *       nxffs_ixbuild, and nxffs_ixinvalidate
+ *
+ * Description:
+ *   Maintain the in-memory index that maps the hash of each inode name to
+ *   the FLASH offset of its inode header, so that nxffs_findinode() need
+ *   not scan the volume.
+ *
+ *   nxffs_ixreset() empties the index and marks it complete; the caller
+ *   then adds every valid inode.  nxffs_ixadd() and nxffs_ixremove() keep
+ *   it up to date as inodes are written and deleted.  nxffs_ixbuild()
+ *   rebuilds it by scanning the volume, and nxffs_ixinvalidate() stops
+ *   its use until then.  If more than CONFIG_NXFFS_INODE_INDEX_MAX inodes
+ *   are found, the index is discarded and lookups scan the volume.
+ *
+ * Defined in nxffs_index.c
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_NXFFS_INODE_INDEX
+uint32_t nxffs_ixhash(FAR const char *name);
+void nxffs_ixreset(FAR struct nxffs_volume_s *volume);
+void nxffs_ixadd(FAR struct nxffs_volume_s *volume, FAR const char *name,
+                 off_t hoffset);
+void nxffs_ixremove(FAR struct nxffs_volume_s *volume, off_t hoffset);
+int nxffs_ixbuild(FAR struct nxffs_volume_s *volume);
+void nxffs_ixinvalidate(FAR struct nxffs_volume_s *volume);
+#endif
+
 /****************************************************************************
  * Name: nxffs_verifyblock
  *
@@ -1059,6 +1200,42 @@ int nxffs_rminode(FAR struct nxffs_volume_s *volume, FAR const char *name);
 
 int nxffs_pack(FAR struct nxffs_volume_s *volume);
 
+/****************************************************************************
+ * Name: nxffs_packstep
+ *
+ * Description:
+ *   Pack the volume by a bounded number of erase blocks
+ *   (CONFIG_NXFFS_PACK_STEP).  Packing resumes where the previous step
+ *   stopped and the volume is valid after each step.  The step is not
+ *   taken while a file is open for writing.
+ *
+ * Input Parameters:
+ *   volume - The volume to be packed.
+ *
+ * Returned Values:
+ *   Zero on success; Otherwise, a negated errno value is returned to
+ *   indicate the nature of the failure.
+ *
+ * Name: nxffs_packcheck
+ *
+ * Description:
+ *   Called after a file is closed or removed.  If the free space at the
+ *   end of FLASH is low, take a packing step now or schedule one on the
+ *   work queue.
+ *
+ * Input Parameters:
+ *   volume - The volume that was modified.
+ *
+ * Returned Values:
+ *   None
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_NXFFS_PACK_INCREMENTAL
+int nxffs_packstep(FAR struct nxffs_volume_s *volume);
+void nxffs_packcheck(FAR struct nxffs_volume_s *volume);
+#endif
+
 /****************************************************************************
  * Standard mountpoint operation methods
  *
@@ -73,7 +73,8 @@
  * Name: nxffs_rdcache
  *
  * Description:
- *   Read one I/O block into the volume block cache memory.
+ *   Read one I/O block into the volume block cache memory.  If the block
+ *   is not cached already, it replaces the least recently used one.
  *
  * Input Parameters:
  *   volume - Describes the current volume
@@ -87,26 +88,63 @@
 
 int nxffs_rdcache(FAR struct nxffs_volume_s *volume, off_t block)
 {
+  FAR uint8_t *cache;
   size_t nxfrd;
+  int slot;
+  int i;
 
   /* Check if the requested data is already in the cache */
 
   if (block != volume->cblock)
     {
-      /* Read the specified blocks into cache */
+      /* Check the other cached blocks.  If it is not there either, pick
+       * the least recently used block to replace.
+       */
 
-      nxfrd = MTD_BREAD(volume->mtd, block, 1, volume->cache);
-      if (nxfrd != 1)
+      for (slot = 0, i = 0; i < CONFIG_NXFFS_CACHE_NBLOCKS; i++)
         {
-          fdbg("ERROR: Read block %d failed: %d\n", block, nxfrd);
-          return -EIO;
+          if (volume->cblocks[i] == block)
+            {
+              slot = i;
+              break;
+            }
+
+          if (volume->cused[i] < volume->cused[slot])
+            {
+              slot = i;
+            }
+        }
+
+      cache = &volume->cbuffer[slot * volume->geo.blocksize];
+      if (i >= CONFIG_NXFFS_CACHE_NBLOCKS)
+        {
+          /* Read the specified blocks into cache */
+
+          nxfrd = MTD_BREAD(volume->mtd, block, 1, cache);
+          if (nxfrd != 1)
+            {
+              fdbg("ERROR: Read block %d failed: %d\n", block, nxfrd);
+              volume->cblocks[slot] = (off_t)-1;
+              volume->cused[slot]   = 0;
+              if (slot == volume->cslot)
+                {
+                  volume->cblock = (off_t)-1;
+                }
+
+              return -EIO;
+            }
+
+          volume->cblocks[slot] = block;
         }
 
       /* Remember what is in the cache */
 
-      volume->cblock  = block;
+      volume->cache  = cache;
+      volume->cslot  = slot;
+      volume->cblock = block;
     }
 
+  volume->cused[volume->cslot] = ++volume->cuse;
   return OK;
 }
 
@@ -133,7 +171,12 @@ int nxffs_wrcache(FAR struct nxffs_volume_s *volume)
   nxfrd = MTD_BWRITE(volume->mtd, volume->cblock, 1, volume->cache);
   if (nxfrd != 1)
     {
+      /* The cached block no longer matches FLASH */
+
       fdbg("ERROR: Write block %d failed: %d\n", volume->cblock, nxfrd);
+      volume->cblocks[volume->cslot] = (off_t)-1;
+      volume->cused[volume->cslot]   = 0;
+      volume->cblock                 = (off_t)-1;
       return -EIO;
     }
 
@@ -142,6 +185,41 @@ int nxffs_wrcache(FAR struct nxffs_volume_s *volume)
   return OK;
 }
 
+/****************************************************************************
+ * Name: nxffs_invcache
+ *
+ * Description:
+ *   Discard every block in the volume cache.  This must be called after
+ *   FLASH is written without going through the cache.  Data may have moved,
+ *   so the read positions remembered for open files are discarded too.
+ *
+ * Input Parameters:
+ *   volume - Describes the current volume
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void nxffs_invcache(FAR struct nxffs_volume_s *volume)
+{
+  FAR struct nxffs_ofile_s *ofile;
+  int i;
+
+  for (i = 0; i < CONFIG_NXFFS_CACHE_NBLOCKS; i++)
+    {
+      volume->cblocks[i] = (off_t)-1;
+      volume->cused[i]   = 0;
+    }
+
+  volume->cblock = (off_t)-1;
+
+  for (ofile = volume->ofiles; ofile; ofile = ofile->flink)
+    {
+      ofile->rdblock = 0;
+    }
+}
+
 /****************************************************************************
  * Name: nxffs_ioseek
  *
@@ -207,6 +285,50 @@ off_t nxffs_iotell(FAR struct nxffs_volume_s *volume)
  ****************************************************************************/
 
 int nxffs_getc(FAR struct nxffs_volume_s *volume, uint16_t reserve)
+{
+  FAR const uint8_t *buffer;
+  int ret;
+
+  ret = nxffs_rdbuf(volume, reserve, &buffer);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  /* Return the character at this offset.  Note that on return,
+   * iooffset could point to the byte outside of the current block.
+   */
+
+  volume->iooffset++;
+  return (int)*buffer;
+}
+
+/****************************************************************************
+ * Name: nxffs_rdbuf
+ *
+ * Description:
+ *   Get the FLASH data at the current position.  This skips over bad
+ *   blocks and block headers just as nxffs_getc() does, but returns all of
+ *   the bytes that remain in the block at once so that callers scanning
+ *   FLASH need not verify the block again for every byte.  The current
+ *   position is not changed.
+ *
+ * Input Parameters:
+ *   volume - Describes the NXFFS volume.  The parameters ioblock and iooffset
+ *     in the volume structure determine the behavior of nxffs_rdbuf().
+ *   reserve - If less than this much space is available at the end of the
+ *     block, then skip to the next block.
+ *   buffer - The location to return the address of the data in the volume
+ *     cache.
+ *
+ * Returned Value:
+ *   The number of bytes at *buffer is returned on success.  Otherwise, a
+ *   negated errno indicating the nature of the failure.
+ *
+ ****************************************************************************/
+
+int nxffs_rdbuf(FAR struct nxffs_volume_s *volume, uint16_t reserve,
+                FAR const uint8_t **buffer)
 {
   int ret;
 
@@ -264,11 +386,6 @@ int nxffs_getc(FAR struct nxffs_volume_s *volume, uint16_t reserve)
     }
   while (ret != OK);
 
-  /* Return the character at this offset.  Note that on return,
-   * iooffset could point to the byte outside of the current block.
-   */
-
-  ret = (int)volume->cache[volume->iooffset];
-  volume->iooffset++;
-  return ret;
+  *buffer = &volume->cache[volume->iooffset];
+  return volume->geo.blocksize - volume->iooffset;
 }
@@ -0,0 +1,268 @@
+/****************************************************************************
+ * fs/nxffs/nxffs_index.c
+ *
+ *   Copyright (C) 2016 Gregory Nutt. All rights reserved.
+ *   Author: Gregory Nutt <gnutt@nuttx.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <string.h>
+#include <errno.h>
+#include <debug.h>
+
+#include <nuttx/kmalloc.h>
+
+#include "nxffs.h"
+
+#ifdef CONFIG_NXFFS_INODE_INDEX
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* The index starts with room for this many entries and doubles from there,
+ * up to CONFIG_NXFFS_INODE_INDEX_MAX.
+ */
+
+#define NXFFS_INDEX_INITIAL 16
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: nxffs_ixdiscard
+ *
+ * Description:
+ *   Give up on the index.  Inodes will be found by scanning the volume
+ *   until the index is rebuilt.
+ *
+ ****************************************************************************/
+
+static void nxffs_ixdiscard(FAR struct nxffs_volume_s *volume)
+{
+  if (volume->index)
+    {
+      kmm_free(volume->index);
+      volume->index = NULL;
+    }
+
+  volume->nindex  = 0;
+  volume->ixalloc = 0;
+  volume->ixvalid = false;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: nxffs_ixhash
+ *
+ * Description:
+ *   Return the hash of a file name that is kept in the inode index.
+ *
+ ****************************************************************************/
+
+uint32_t nxffs_ixhash(FAR const char *name)
+{
+  uint32_t hash = 2166136261u;
+
+  while (*name)
+    {
+      hash ^= (uint8_t)*name++;
+      hash *= 16777619u;
+    }
+
+  return hash;
+}
+
+/****************************************************************************
+ * Name: nxffs_ixreset
+ *
+ * Description:
+ *   Empty the inode index and mark it as complete.  The caller must then
+ *   add every valid inode on the volume.
+ *
+ ****************************************************************************/
+
+void nxffs_ixreset(FAR struct nxffs_volume_s *volume)
+{
+  volume->nindex  = 0;
+  volume->ixvalid = true;
+}
+
+/****************************************************************************
+ * Name: nxffs_ixadd
+ *
+ * Description:
+ *   Add a valid inode to the index.  If the index cannot hold it, the
+ *   index is discarded.
+ *
+ ****************************************************************************/
+
+void nxffs_ixadd(FAR struct nxffs_volume_s *volume, FAR const char *name,
+                 off_t hoffset)
+{
+  FAR struct nxffs_ixentry_s *index;
+  uint16_t ixalloc;
+
+  if (!volume->ixvalid)
+    {
+      return;
+    }
+
+  /* Make room for one more entry */
+
+  if (volume->nindex >= volume->ixalloc)
+    {
+      if (volume->ixalloc >= CONFIG_NXFFS_INODE_INDEX_MAX)
+        {
+          fvdbg("More than %d inodes, not indexed\n",
+                CONFIG_NXFFS_INODE_INDEX_MAX);
+          nxffs_ixdiscard(volume);
+          return;
+        }
+
+      ixalloc = volume->ixalloc ? 2 * volume->ixalloc : NXFFS_INDEX_INITIAL;
+      if (ixalloc > CONFIG_NXFFS_INODE_INDEX_MAX)
+        {
+          ixalloc = CONFIG_NXFFS_INODE_INDEX_MAX;
+        }
+
+      index = (FAR struct nxffs_ixentry_s *)
+        kmm_realloc(volume->index, ixalloc * sizeof(struct nxffs_ixentry_s));
+      if (!index)
+        {
+          fdbg("ERROR: Failed to grow the inode index\n");
+          nxffs_ixdiscard(volume);
+          return;
+        }
+
+      volume->index   = index;
+      volume->ixalloc = ixalloc;
+    }
+
+  volume->index[volume->nindex].hash    = nxffs_ixhash(name);
+  volume->index[volume->nindex].hoffset = hoffset;
+  volume->nindex++;
+}
+
+/****************************************************************************
+ * Name: nxffs_ixremove
+ *
+ * Description:
+ *   Remove the inode with the header at this FLASH offset from the index.
+ *
+ ****************************************************************************/
+
+void nxffs_ixremove(FAR struct nxffs_volume_s *volume, off_t hoffset)
+{
+  int i;
+
+  for (i = 0; i < volume->nindex; i++)
+    {
+      if (volume->index[i].hoffset == hoffset)
+        {
+          /* Move the last entry into its place */
+
+          volume->nindex--;
+          volume->index[i] = volume->index[volume->nindex];
+          return;
+        }
+    }
+}
+
+/****************************************************************************
+ * Name: nxffs_ixbuild
+ *
+ * Description:
+ *   Rebuild the inode index by scanning every inode on the volume.  This
+ *   is needed after packing has moved the inodes.
+ *
+ * Input Parameters:
+ *   volume - Describes the NXFFS volume
+ *
+ * Returned Value:
+ *   Zero is returned on success.  Otherwise, a negated errno is returned
+ *   and the index is left discarded.
+ *
+ ****************************************************************************/
+
+int nxffs_ixbuild(FAR struct nxffs_volume_s *volume)
+{
+  struct nxffs_entry_s entry;
+  off_t offset;
+  int ret;
+
+  nxffs_ixreset(volume);
+
+  offset = volume->inoffset;
+  while ((ret = nxffs_nextentry(volume, offset, &entry)) == OK)
+    {
+      nxffs_ixadd(volume, entry.name, entry.hoffset);
+      offset = nxffs_inodeend(volume, &entry);
+      nxffs_freeentry(&entry);
+    }
+
+  /* -ENOENT just means that the end of the inodes was reached */
+
+  if (ret != -ENOENT)
+    {
+      fdbg("ERROR: Failed to index the inodes: %d\n", -ret);
+      nxffs_ixdiscard(volume);
+      return ret;
+    }
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: nxffs_ixinvalidate
+ *
+ * Description:
+ *   Stop using the index (for example because inodes are about to move).
+ *   Lookups fall back to scanning until nxffs_ixbuild() is called.
+ *
+ ****************************************************************************/
+
+void nxffs_ixinvalidate(FAR struct nxffs_volume_s *volume)
+{
+  volume->nindex  = 0;
+  volume->ixvalid = false;
+}
+
+#endif /* CONFIG_NXFFS_INODE_INDEX */
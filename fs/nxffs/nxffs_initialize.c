@@ -194,7 +194,7 @@ int nxffs_initialize(FAR struct mtd_dev_s *mtd)
   /* Initialize the NXFFS volume structure */
 
   volume->mtd    = mtd;
-  volume->cblock = (off_t)-1;
+  nxffs_invcache(volume);
   sem_init(&volume->exclsem, 0, 1);
   sem_init(&volume->wrsem, 0, 1);
 
@@ -210,9 +210,11 @@ int nxffs_initialize(FAR struct mtd_dev_s *mtd)
       goto errout_with_volume;
     }
 
-  /* Allocate one I/O block buffer to general files system access */
+  /* Allocate the I/O block buffers for general files system access */
 
-  volume->cache = (FAR uint8_t *)kmm_malloc(volume->geo.blocksize);
+  volume->cbuffer = (FAR uint8_t *)
+    kmm_malloc(CONFIG_NXFFS_CACHE_NBLOCKS * volume->geo.blocksize);
+  volume->cache   = volume->cbuffer;
   if (!volume->cache)
     {
       fdbg("ERROR: Failed to allocate an erase block buffer\n");
@@ -324,7 +326,7 @@ int nxffs_initialize(FAR struct mtd_dev_s *mtd)
 errout_with_buffer:
   kmm_free(volume->pack);
 errout_with_cache:
-  kmm_free(volume->cache);
+  kmm_free(volume->cbuffer);
 errout_with_volume:
 #ifndef CONFIG_NXFFS_PREALLOCATED
   kmm_free(volume);
@@ -360,9 +362,11 @@ errout_with_volume:
 int nxffs_limits(FAR struct nxffs_volume_s *volume)
 {
   FAR struct nxffs_entry_s entry;
+  FAR const uint8_t *buffer;
   off_t block;
   off_t offset;
   bool noinodes = false;
+  int nbytes;
   int nerased;
   int ret;
 
@@ -376,6 +380,12 @@ int nxffs_limits(FAR struct nxffs_volume_s *volume)
       return ret;
     }
 
+#ifdef CONFIG_NXFFS_INODE_INDEX
+  /* Every valid inode found below is added to the inode index */
+
+  nxffs_ixreset(volume);
+#endif
+
   /* Then find the first valid inode in or beyond the first valid block */
 
   offset = block * volume->geo.blocksize;
@@ -409,6 +419,10 @@ int nxffs_limits(FAR struct nxffs_volume_s *volume)
       volume->inoffset = entry.hoffset;
       fvdbg("First inode at offset %d\n", volume->inoffset);
 
+#ifdef CONFIG_NXFFS_INODE_INDEX
+      nxffs_ixadd(volume, entry.name, entry.hoffset);
+#endif
+
       /* Discard this entry and set the next offset. */
 
       offset = nxffs_inodeend(volume, &entry);
@@ -421,6 +435,10 @@ int nxffs_limits(FAR struct nxffs_volume_s *volume)
     {
       while (nxffs_nextentry(volume, offset, &entry) == OK)
         {
+#ifdef CONFIG_NXFFS_INODE_INDEX
+          nxffs_ixadd(volume, entry.name, entry.hoffset);
+#endif
+
           /* Discard the entry and guess the next offset. */
 
           offset = nxffs_inodeend(volume, &entry);
@@ -435,11 +453,20 @@ int nxffs_limits(FAR struct nxffs_volume_s *volume)
    */
 
   nxffs_ioseek(volume, offset);
+  nbytes  = 0;
   nerased = 0;
   for (; ; )
     {
-      int ch = nxffs_getc(volume, 1);
-      if (ch < 0)
+      int ch;
+
+      /* Get the rest of the block once the bytes already in hand run out */
+
+      if (nbytes < 1)
+        {
+          nbytes = nxffs_rdbuf(volume, 1, &buffer);
+        }
+
+      if (nbytes < 0)
         {
           /* Failed to read the next byte... this could mean that the FLASH
            * is full?
@@ -463,13 +490,19 @@ int nxffs_limits(FAR struct nxffs_volume_s *volume)
 
           /* No?  Then it is some other failure that we do not know how to handle */
 
-          fdbg("ERROR: nxffs_getc failed: %d\n", -ch);
-          return ch;
+          fdbg("ERROR: nxffs_rdbuf failed: %d\n", -nbytes);
+          return nbytes;
         }
 
+      /* Read the next character */
+
+      ch = *buffer++;
+      nbytes--;
+      volume->iooffset++;
+
       /* Check for another erased byte */
 
-      else if (ch == CONFIG_NXFFS_ERASEDSTATE)
+      if (ch == CONFIG_NXFFS_ERASEDSTATE)
         {
           /* If we have encountered NXFFS_NERASED number of consecutive
            * erased bytes, then presume we have reached the end of valid
@@ -574,6 +607,17 @@ int nxffs_unbind(FAR void *handle, FAR struct inode **blkdriver,
       return -ENOSYS;
     }
 
-  return g_volume.ofiles ? -EBUSY : OK;
+  if (g_volume.ofiles)
+    {
+      return -EBUSY;
+    }
+
+#ifdef CONFIG_NXFFS_PACK_WORKER
+  /* Don't pack the volume after it is unmounted */
+
+  (void)work_cancel(LPWORK, &g_volume.packwork);
+#endif
+
+  return OK;
 #endif
 }
@@ -72,7 +72,8 @@
  * Name: nxffs_rdentry
  *
  * Description:
- *   Read the inode entry at this offset.  Called only from nxffs_nextentry().
+ *   Read the inode entry at this offset.  Called only from nxffs_scanentry()
+ *   and nxffs_ixfind().
  *
  * Input Parameters:
  *   volume - Describes the current volume.
@@ -80,6 +81,7 @@
  *     header is expected.
  *   entry  - A memory location to return the expanded inode header
  *     information.
+ *   deleted - True: Return deleted inodes too.
  *
  * Returned Value:
  *   Zero on success.  Otherwise, a negated errno value is returned
@@ -88,7 +90,7 @@
  ****************************************************************************/
 
 static int nxffs_rdentry(FAR struct nxffs_volume_s *volume, off_t offset,
-                         FAR struct nxffs_entry_s *entry)
+                         FAR struct nxffs_entry_s *entry, bool deleted)
 {
   struct nxffs_inode_s inode;
   uint32_t ecrc;
@@ -176,7 +178,7 @@ static int nxffs_rdentry(FAR struct nxffs_volume_s *volume, off_t offset,
    * Check the file state.
    */
 
-  if (state != INODE_STATE_FILE)
+  if (state != INODE_STATE_FILE && !deleted)
     {
       /* It is a deleted file.  But still, the data offset and the
        * start size are good so we can use this information to advance
@@ -210,59 +212,111 @@ errout:
 }
 
 /****************************************************************************
- * Public Functions
- ****************************************************************************/
-
-/****************************************************************************
- * Name: nxffs_freeentry
+ * Name: nxffs_ixfind
  *
  * Description:
- *   The inode values returned by nxffs_nextentry() include allocated memory
- *   (specifically, the file name string).  This function should be called
- *   to dispose of that memory when the inode entry is no longer needed.
- *
- *   Note that the nxffs_entry_s containing structure is not freed.  The
- *   caller may call kmm_free upon return of this function if necessary to
- *   free the entry container.
+ *   Look up an inode using the inode index.  Called only from
+ *   nxffs_findinode() when the index is valid.
  *
- * Input parameters:
- *   entry  - The entry to be freed.
+ * Input Parameters:
+ *   volume - Describes the NXFFS volume
+ *   name   - The name of the inode to find
+ *   entry  - The location to return information about the inode.
  *
  * Returned Value:
- *   None
+ *   Zero is returned on success and -ENOENT if there is no such inode.
+ *   -EAGAIN is returned if an indexed offset does not hold a valid inode;
+ *   the volume must then be scanned.  Other negated errno values indicate
+ *   the nature of the failure.
  *
  ****************************************************************************/
 
-void nxffs_freeentry(FAR struct nxffs_entry_s *entry)
+#ifdef CONFIG_NXFFS_INODE_INDEX
+static int nxffs_ixfind(FAR struct nxffs_volume_s *volume,
+                        FAR const char *name,
+                        FAR struct nxffs_entry_s *entry)
 {
-  if (entry->name)
+  uint32_t hash = nxffs_ixhash(name);
+  off_t hoffset;
+  int ret;
+  int i;
+
+  for (i = 0; i < volume->nindex; i++)
     {
-      kmm_free(entry->name);
-      entry->name = NULL;
+      if (volume->index[i].hash != hash)
+        {
+          continue;
+        }
+
+      /* Bring the block holding the inode header into the cache and
+       * check that there really is an inode header there.
+       */
+
+      hoffset = volume->index[i].hoffset;
+      nxffs_ioseek(volume, hoffset);
+      ret = nxffs_rdcache(volume, volume->ioblock);
+      if (ret < 0)
+        {
+          return ret;
+        }
+
+      if (volume->iooffset + SIZEOF_NXFFS_INODE_HDR > volume->geo.blocksize ||
+          memcmp(&volume->cache[volume->iooffset], g_inodemagic,
+                 NXFFS_MAGICSIZE) != 0)
+        {
+          return -EAGAIN;
+        }
+
+      ret = nxffs_rdentry(volume, hoffset, entry, false);
+      if (ret == -ENOMEM)
+        {
+          return ret;
+        }
+      else if (ret < 0)
+        {
+          return -EAGAIN;
+        }
+
+      /* Different names may have the same hash */
+
+      if (strcmp(name, entry->name) == 0)
+        {
+          return OK;
+        }
+
+      nxffs_freeentry(entry);
     }
+
+  return -ENOENT;
 }
+#endif
 
 /****************************************************************************
- * Name: nxffs_nextentry
+ * Name: nxffs_scanentry
  *
  * Description:
- *   Search for the next valid inode starting at the provided FLASH offset.
+ *   Search for the next inode starting at the provided FLASH offset.  This
+ *   is the common logic of nxffs_nextentry() and nxffs_nextinode().
  *
  * Input Parameters:
- *   volume - Describes the NXFFS volume.
- *   offset - The FLASH memory offset to begin searching.
- *   entry  - A pointer to memory provided by the caller in which to return
+ *   volume  - Describes the NXFFS volume.
+ *   offset  - The FLASH memory offset to begin searching.
+ *   entry   - A pointer to memory provided by the caller in which to return
  *     the inode description.
+ *   deleted - True: Return deleted inodes too.
  *
  * Returned Value:
  *   Zero is returned on success. Otherwise, a negated errno is returned
- *   that indicates the nature of the failure.
+ *   that indicates the nature of the failure.  -ENOENT is returned if
+ *   there are no further inodes on the volume.
  *
  ****************************************************************************/
 
-int nxffs_nextentry(FAR struct nxffs_volume_s *volume, off_t offset,
-                    FAR struct nxffs_entry_s *entry)
+static int nxffs_scanentry(FAR struct nxffs_volume_s *volume, off_t offset,
+                           FAR struct nxffs_entry_s *entry, bool deleted)
 {
+  FAR const uint8_t *buffer;
+  int nbytes;
   int nmagic;
   int ch;
   int nerased;
@@ -274,22 +328,45 @@ int nxffs_nextentry(FAR struct nxffs_volume_s *volume, off_t offset,
 
   /* Then begin searching */
 
+  nbytes  = 0;
   nerased = 0;
   nmagic  = 0;
   for (; ; )
     {
-      /* Read the next character */
+      /* Get the rest of the block once the bytes already in hand run out,
+       * or cannot hold the rest of an inode header.
+       */
 
-      ch = nxffs_getc(volume, SIZEOF_NXFFS_INODE_HDR - nmagic);
-      if (ch < 0)
+      if (nbytes < SIZEOF_NXFFS_INODE_HDR - nmagic)
         {
-          fdbg("ERROR: nxffs_getc failed: %d\n", -ch);
-          return ch;
+          nbytes = nxffs_rdbuf(volume, SIZEOF_NXFFS_INODE_HDR - nmagic,
+                               &buffer);
+          if (nbytes == -ENOSPC)
+            {
+              /* The end of FLASH was reached.  This happens when the volume
+               * is full:  There is no run of erased bytes after the last
+               * inode.
+               */
+
+              fvdbg("End of FLASH, no entry found\n");
+              return -ENOENT;
+            }
+          else if (nbytes < 0)
+            {
+              fdbg("ERROR: nxffs_rdbuf failed: %d\n", -nbytes);
+              return nbytes;
+            }
         }
 
+      /* Read the next character */
+
+      ch = *buffer++;
+      nbytes--;
+      volume->iooffset++;
+
       /* Check for another erased byte */
 
-      else if (ch == CONFIG_NXFFS_ERASEDSTATE)
+      if (ch == CONFIG_NXFFS_ERASEDSTATE)
         {
           /* If we have encountered NXFFS_NERASED number of consecutive
            * erased bytes, then presume we have reached the end of valid
@@ -346,15 +423,18 @@ int nxffs_nextentry(FAR struct nxffs_volume_s *volume, off_t offset,
 
               /* Try to extract the inode header from that position */
 
-              ret = nxffs_rdentry(volume, offset, entry);
+              ret = nxffs_rdentry(volume, offset, entry, deleted);
               if (ret == OK)
                 {
                   fvdbg("Found a valid fileheader, offset: %d\n", offset);
                   return OK;
                 }
 
-              /* False alarm.. keep looking */
+              /* False alarm.. keep looking from wherever nxffs_rdentry()
+               * left the volume position.
+               */
 
+              nbytes = 0;
               nmagic = 0;
             }
         }
@@ -365,6 +445,91 @@ int nxffs_nextentry(FAR struct nxffs_volume_s *volume, off_t offset,
   return -ENOENT;
 }
 
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: nxffs_freeentry
+ *
+ * Description:
+ *   The inode values returned by nxffs_nextentry() include allocated memory
+ *   (specifically, the file name string).  This function should be called
+ *   to dispose of that memory when the inode entry is no longer needed.
+ *
+ *   Note that the nxffs_entry_s containing structure is not freed.  The
+ *   caller may call kmm_free upon return of this function if necessary to
+ *   free the entry container.
+ *
+ * Input parameters:
+ *   entry  - The entry to be freed.
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void nxffs_freeentry(FAR struct nxffs_entry_s *entry)
+{
+  if (entry->name)
+    {
+      kmm_free(entry->name);
+      entry->name = NULL;
+    }
+}
+
+/****************************************************************************
+ * Name: nxffs_nextentry
+ *
+ * Description:
+ *   Search for the next valid inode starting at the provided FLASH offset.
+ *
+ * Input Parameters:
+ *   volume - Describes the NXFFS volume.
+ *   offset - The FLASH memory offset to begin searching.
+ *   entry  - A pointer to memory provided by the caller in which to return
+ *     the inode description.
+ *
+ * Returned Value:
+ *   Zero is returned on success. Otherwise, a negated errno is returned
+ *   that indicates the nature of the failure.  -ENOENT is returned if
+ *   there are no further inodes on the volume.
+ *
+ ****************************************************************************/
+
+int nxffs_nextentry(FAR struct nxffs_volume_s *volume, off_t offset,
+                    FAR struct nxffs_entry_s *entry)
+{
+  return nxffs_scanentry(volume, offset, entry, false);
+}
+
+/****************************************************************************
+ * Name: nxffs_nextinode
+ *
+ * Description:
+ *   Search for the next inode starting at the provided FLASH offset, valid
+ *   or deleted.
+ *
+ * Input Parameters:
+ *   volume - Describes the NXFFS volume.
+ *   offset - The FLASH memory offset to begin searching.
+ *   entry  - A pointer to memory provided by the caller in which to return
+ *     the inode description.
+ *
+ * Returned Value:
+ *   Zero is returned on success. Otherwise, a negated errno is returned
+ *   that indicates the nature of the failure.  -ENOENT is returned if
+ *   there are no further inodes on the volume.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_NXFFS_PACK_INCREMENTAL
+int nxffs_nextinode(FAR struct nxffs_volume_s *volume, off_t offset,
+                    FAR struct nxffs_entry_s *entry)
+{
+  return nxffs_scanentry(volume, offset, entry, true);
+}
+#endif
 /****************************************************************************
  * Name: nxffs_findinode
  *
@@ -390,6 +555,26 @@ int nxffs_findinode(FAR struct nxffs_volume_s *volume, FAR const char *name,
   off_t offset;
   int ret;
 
+#ifdef CONFIG_NXFFS_INODE_INDEX
+  /* If the index is complete, only the inodes with a matching name hash
+   * need to be looked at.
+   */
+
+  if (volume->ixvalid)
+    {
+      ret = nxffs_ixfind(volume, name, entry);
+      if (ret != -EAGAIN)
+        {
+          return ret;
+        }
+
+      /* The index did not match the FLASH.  Drop it and scan */
+
+      fdbg("ERROR: Inode index is stale\n");
+      nxffs_ixinvalidate(volume);
+    }
+#endif
+
   /* Start with the first valid inode that was discovered when the volume
    * was created (or modified after the last file system re-packing).
    */
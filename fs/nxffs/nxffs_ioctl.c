@@ -108,7 +108,7 @@ int nxffs_ioctl(FAR struct file *filep, int cmd, unsigned long arg)
       goto errout;
     }
 
-  /* Only a reformat and optimize commands are supported */
+  /* Only reformat, optimize and packing statistics commands are supported */
 
   if (cmd == FIOC_REFORMAT)
     {
@@ -136,6 +136,33 @@ int nxffs_ioctl(FAR struct file *filep, int cmd, unsigned long arg)
 
       ret = nxffs_pack(volume);
     }
+
+  else if (cmd == FIOC_PACKSTATS)
+    {
+      FAR struct nxffs_packstats_s *stats =
+        (FAR struct nxffs_packstats_s *)((uintptr_t)arg);
+
+      fvdbg("Packing statistics command\n");
+
+      if (stats == NULL)
+        {
+          ret = -EINVAL;
+          goto errout_with_semaphore;
+        }
+
+      memcpy(stats, &volume->packstats, sizeof(struct nxffs_packstats_s));
+      stats->freesize = volume->nblocks * volume->geo.blocksize -
+                        volume->froffset;
+      ret = OK;
+    }
+
+  else if (cmd == FIOC_RESETSTATS)
+    {
+      fvdbg("Reset statistics command\n");
+
+      memset(&volume->packstats, 0, sizeof(struct nxffs_packstats_s));
+      ret = OK;
+    }
   else
     {
       /* No other commands supported */
@@ -1188,6 +1188,18 @@ int nxffs_close(FAR struct file *filep)
       /* Release all resouces held by the open file */
 
       nxffs_freeofile(volume, ofile);
+
+#ifdef CONFIG_NXFFS_PACK_INCREMENTAL
+      /* Pack a little if free FLASH is running low.  This must follow
+       * nxffs_freeofile():  Until the writer's name is released, the file
+       * still looks like an active writer and would block packing.
+       */
+
+      if (ret >= 0)
+        {
+          nxffs_packcheck(volume);
+        }
+#endif
     }
   else
     {
@@ -1284,6 +1296,14 @@ int nxffs_wrinode(FAR struct nxffs_volume_s *volume,
       fdbg("ERROR: Failed to write inode header block %d: %d\n",
            volume->ioblock, -ret);
     }
+#ifdef CONFIG_NXFFS_INODE_INDEX
+  else
+    {
+      /* The inode can now be found */
+
+      nxffs_ixadd(volume, entry->name, entry->hoffset);
+    }
+#endif
 
   /* The volume is now available for other writers */
 
@@ -1314,10 +1334,14 @@ int nxffs_updateinode(FAR struct nxffs_volume_s *volume,
 {
   FAR struct nxffs_ofile_s *ofile;
 
-  /* Find the open inode structure matching this name */
+  /* Find the open inode structure matching this name.  A file open for
+   * writing is not affected:  Its new inode is not written to FLASH until
+   * the file is closed so the inode that was moved can only be the old
+   * version of the file that is being replaced.
+   */
 
   ofile = nxffs_findofile(volume, entry->name);
-  if (ofile)
+  if (ofile && (ofile->oflags & O_WROK) == 0)
     {
       /* Yes.. the file is open.  Update the FLASH offsets to inode headers */
 
@@ -48,6 +48,9 @@
 #include <debug.h>
 
 #include <nuttx/kmalloc.h>
+#ifdef CONFIG_NXFFS_PACK_WORKER
+#  include <nuttx/clock.h>
+#endif
 
 #include "nxffs.h"
 
@@ -55,6 +58,18 @@
  * Pre-processor Definitions
  ****************************************************************************/
 
+#ifdef CONFIG_NXFFS_PACK_INCREMENTAL
+#  ifndef CONFIG_NXFFS_PACK_STEP
+#    define CONFIG_NXFFS_PACK_STEP 1
+#  endif
+#  ifndef CONFIG_NXFFS_PACK_FREE
+#    define CONFIG_NXFFS_PACK_FREE 25
+#  endif
+#  ifndef CONFIG_NXFFS_PACK_IDLE
+#    define CONFIG_NXFFS_PACK_IDLE 100
+#  endif
+#endif
+
 /****************************************************************************
  * Public Types
  ****************************************************************************/
@@ -86,6 +101,10 @@ struct nxffs_pack_s
   off_t                ioblock;    /* I/O block number */
   off_t                block0;     /* First I/O block number in the erase block */
   uint16_t             iooffset;   /* I/O block offset */
+#ifdef CONFIG_NXFFS_PACK_INCREMENTAL
+  bool                 stop;       /* Stop after the inode being moved */
+  off_t                chain;      /* An inode header not yet overwritten */
+#endif
 };
 
 /****************************************************************************
@@ -182,6 +201,56 @@ static inline bool nxffs_packvalid(FAR struct nxffs_pack_s *pack)
           blkhdr->state == BLOCK_STATE_GOOD);
 }
 
+/****************************************************************************
+ * Name: nxffs_padpos
+ *
+ * Description:
+ *   A packing step that stops writes a pad inode after the last inode that
+ *   it moved (see nxffs_packpad()).  Find where the pad inode header can go
+ *   in the erase block in the pack buffer:  At the destination position if
+ *   it fits in the rest of the I/O block, otherwise at the beginning of the
+ *   next valid I/O block.
+ *
+ * Input Parameters:
+ *   volume - Describes the NXFFS volume
+ *   pack   - The volume packing state structure.
+ *
+ * Returned Values:
+ *   The FLASH offset for the pad inode header.  Zero is returned if there
+ *   is no room for it in this erase block.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_NXFFS_PACK_INCREMENTAL
+static off_t nxffs_padpos(FAR struct nxffs_volume_s *volume,
+                          FAR struct nxffs_pack_s *pack)
+{
+  FAR struct nxffs_block_s *blkhdr;
+  off_t block;
+
+  if (pack->iooffset + SIZEOF_NXFFS_INODE_HDR <= volume->geo.blocksize)
+    {
+      return nxffs_packtell(volume, pack);
+    }
+
+  for (block = pack->ioblock + 1;
+       block < pack->block0 + volume->blkper;
+       block++)
+    {
+      blkhdr = (FAR struct nxffs_block_s *)
+        &volume->pack[(block - pack->block0) * volume->geo.blocksize];
+
+      if (memcmp(blkhdr->magic, g_blockmagic, NXFFS_MAGICSIZE) == 0 &&
+          blkhdr->state == BLOCK_STATE_GOOD)
+        {
+          return block * volume->geo.blocksize + SIZEOF_NXFFS_BLOCK_HDR;
+        }
+    }
+
+  return 0;
+}
+#endif
+
 /****************************************************************************
  * Name: nxffs_mediacheck
  *
@@ -347,14 +416,22 @@ static inline int nxffs_startpos(FAR struct nxffs_volume_s *volume,
           offset  = blkentry.hoffset + SIZEOF_NXFFS_DATA_HDR + blkentry.datlen;
         }
 
-      /* Make sure there is space at this location for an inode header */
+      /* Make sure there is space at this location for an inode header.  If
+       * the data ended at the end of a block, the offset is that of the
+       * next block header.
+       */
 
       nxffs_ioseek(volume, offset);
-      if (volume->iooffset + SIZEOF_NXFFS_INODE_HDR > volume->geo.blocksize)
+      if (volume->iooffset + SIZEOF_NXFFS_INODE_HDR > volume->geo.blocksize ||
+          volume->iooffset < SIZEOF_NXFFS_BLOCK_HDR)
         {
           /* No.. not enough space here. Find the next valid block */
 
-          volume->ioblock++;
+          if (volume->iooffset >= SIZEOF_NXFFS_BLOCK_HDR)
+            {
+              volume->ioblock++;
+            }
+
           ret = nxffs_validblock(volume, &volume->ioblock);
           if (ret < 0)
             {
@@ -390,6 +467,79 @@ static inline int nxffs_startpos(FAR struct nxffs_volume_s *volume,
   return -ENOSYS;
 }
 
+/****************************************************************************
+ * Name: nxffs_packresume
+ *
+ * Description:
+ *   Packing steps sweep the volume from the beginning of FLASH to the end,
+ *   then erase the deleted inodes left at the end.  Each step resumes where
+ *   the one before it stopped, rather than at the first gap found by
+ *   nxffs_startpos().  Gaps opened behind the sweep are left for the next
+ *   one.
+ *
+ * Input Parameters:
+ *   volume   - The volume to be packed
+ *   pack     - The volume packing state structure.
+ *   froffset - On return, the FLASH offset where packing resumes.
+ *
+ * Returned Values:
+ *   Zero on success.  -ENOENT is returned if there is no sweep to resume
+ *   and -ENOSPC if no valid inodes follow the resume position.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_NXFFS_PACK_INCREMENTAL
+static int nxffs_packresume(FAR struct nxffs_volume_s *volume,
+                            FAR struct nxffs_pack_s *pack, off_t *froffset)
+{
+  struct nxffs_entry_s entry;
+  off_t offset = volume->packresume;
+  int ret;
+
+  if (offset == 0)
+    {
+      return -ENOENT;
+    }
+
+  /* Make sure that the first inode there is still a deleted one:  The pad
+   * inode left by a packing step or the first of the deleted inodes that
+   * remain at the end.
+   */
+
+  ret = nxffs_nextinode(volume, offset, &entry);
+  if (ret < 0)
+    {
+      return -ENOENT;
+    }
+
+  nxffs_freeentry(&pack->src.entry);
+  ret = nxffs_nextentry(volume, offset, &pack->src.entry);
+  if (ret == OK && pack->src.entry.hoffset == entry.hoffset)
+    {
+      nxffs_freeentry(&entry);
+      return -ENOENT;
+    }
+
+  nxffs_freeentry(&entry);
+  *froffset = offset;
+
+  if (ret < 0)
+    {
+      return -ENOSPC;
+    }
+
+  /* This is where packing resumes.  Describe the destination inode header
+   * as nxffs_startpos() does.
+   */
+
+  pack->dest.entry.name    = pack->src.entry.name;
+  pack->dest.entry.utc     = pack->src.entry.utc;
+  pack->dest.entry.datlen  = pack->src.entry.datlen;
+  pack->src.entry.name     = NULL;
+  return OK;
+}
+#endif
+
 /****************************************************************************
  * Name: nxffs_srcsetup
  *
@@ -714,6 +864,8 @@ static int nxffs_wrinodehdr(FAR struct nxffs_volume_s *volume,
         }
     }
 
+  volume->packstats.ninodes++;
+
   /* Reset the dest inode information */
 
   nxffs_freeentry(&pack->dest.entry);
@@ -955,9 +1107,16 @@ static inline int nxffs_packblock(FAR struct nxffs_volume_s *volume,
           nxffs_wrdathdr(volume, pack);
           nxffs_wrinodehdr(volume, pack);
 
-          /* Find the next valid source inode */
+          /* Find the next valid source inode.  A zero length file has no
+           * data blocks; search from its name.
+           */
 
           offset = pack->src.blkoffset + pack->src.blklen;
+          if (pack->src.blkoffset == 0)
+            {
+              offset = pack->src.entry.noffset;
+            }
+
           memset(&pack->src, 0, sizeof(struct nxffs_packstream_s));
 
           ret = nxffs_nextentry(volume, offset, &pack->src.entry);
@@ -970,6 +1129,25 @@ static inline int nxffs_packblock(FAR struct nxffs_volume_s *volume,
               return -ENOSPC;
             }
 
+#ifdef CONFIG_NXFFS_PACK_INCREMENTAL
+          /* If this packing step has done enough, stop here:  No inode is
+           * partially moved at this point.  But there must be room for the
+           * pad inode before this one.  -EAGAIN is a special value that
+           * tells nxffs_dopack() to end the step before this inode.
+           */
+
+          if (pack->stop)
+            {
+              off_t padpos = nxffs_padpos(volume, pack);
+
+              if (padpos > 0 &&
+                  padpos + SIZEOF_NXFFS_INODE_HDR <= pack->src.entry.hoffset)
+                {
+                  return -EAGAIN;
+                }
+            }
+#endif
+
           /* Setup the new source stream */
 
           ret = nxffs_srcsetup(volume, pack, pack->src.entry.doffset);
@@ -1248,181 +1426,730 @@ static inline int nxffs_packwriter(FAR struct nxffs_volume_s *volume,
 }
 
 /****************************************************************************
- * Public Functions
- ****************************************************************************/
-
-/****************************************************************************
- * Name: nxffs_pack
+ * Name: nxffs_packclean
  *
  * Description:
- *   Pack and re-write the filesystem in order to free up memory at the end
- *   of FLASH.
+ *   Once all inodes have been packed, the rest of each erase block is just
+ *   reset to the erased state.  Check if the erase block in the pack buffer
+ *   is already in that state so that it need not be erased and re-written.
  *
  * Input Parameters:
- *   volume - The volume to be packed.
+ *   volume - The volume to be packed
+ *   pack   - The volume packing state structure.
  *
  * Returned Values:
- *   Zero on success; Otherwise, a negated errno value is returned to
- *   indicate the nature of the failure.
+ *   True if re-writing the erase block would not change it.
  *
  ****************************************************************************/
 
-int nxffs_pack(FAR struct nxffs_volume_s *volume)
+static bool nxffs_packclean(FAR struct nxffs_volume_s *volume,
+                            FAR struct nxffs_pack_s *pack)
 {
-  struct nxffs_pack_s pack;
-  FAR struct nxffs_wrfile_s *wrfile;
-  off_t iooffset;
-  off_t eblock;
+  FAR uint8_t *iobuffer;
   off_t block;
-  bool packed;
+  size_t offset;
+  size_t nbytes;
   int i;
-  int ret = OK;
-
-  /* Get the offset to the first valid inode entry */
 
-  wrfile = NULL;
-  packed = false;
-
-  iooffset = nxffs_mediacheck(volume, &pack);
-  if (iooffset == 0)
+  for (i = 0, block = pack->block0, iobuffer = volume->pack;
+       i < volume->blkper;
+       i++, block++, iobuffer += volume->geo.blocksize)
     {
-      /* Offset zero is only returned if no valid blocks were found on the
-       * FLASH media or if there are no valid inode entries on the FLASH after
-       * the first valid block.  There are two possibilities:  (1) there
-       * really is nothing on the FLASH, or (2) there is a file being written
-       * to the FLASH now.
+      /* Blocks before the current I/O block are not changed.  In the
+       * current I/O block, only the bytes after the I/O offset are reset.
        */
 
-      /* Is there a writer? */
-
-      wrfile = nxffs_setupwriter(volume, &pack);
-      if (wrfile)
+      if (block < pack->ioblock)
         {
-          /* If there is a write, just set ioffset to the offset of data in
-           * first block. Setting 'packed' to true will supress normal inode
-           * packing operation.  Then we can start compacting the FLASH.
-           */
-
-          iooffset = SIZEOF_NXFFS_BLOCK_HDR;
-          packed   = true;
-          goto start_pack;
+          continue;
         }
-      else
-        {
-          /* No, there is no write in progress.  We just have an empty flash
-           * full of deleted files.  In this case, the media needs to be re-
-           * formatted.
-           */
-
-          ret = nxffs_reformat(volume);
-          if (ret == OK)
-            {
-              /* The free flash offset will be in the first valid block of
-               * the FLASH.
-               */
-
-              block = 0;
-              ret = nxffs_validblock(volume, &block);
-              if (ret == OK)
-                {
-                  /* Set to the offset past the block header in the first
-                   * valid block
-                   */
-
-                  volume->froffset =
-                    block * volume->geo.blocksize + SIZEOF_NXFFS_BLOCK_HDR;
-                }
-            }
 
-          return ret;
+      offset = block == pack->ioblock ? pack->iooffset : SIZEOF_NXFFS_BLOCK_HDR;
+      nbytes = volume->geo.blocksize - offset;
+      if (nxffs_erased(&iobuffer[offset], nbytes) < nbytes)
+        {
+          return false;
         }
     }
 
-  /* There is a valid format and valid inodes on the media.. setup up to
-   * begin the packing operation.
-   */
-
-  ret = nxffs_startpos(volume, &pack, &iooffset);
-  if (ret < 0)
-    {
-      /* This is a normal situation if the volume is full */
+  return true;
+}
 
-      if (ret == -ENOSPC)
-        {
-          /* In the case where the volume is full, nxffs_startpos() will
-           * recalculate the free FLASH offset and store it in iooffset.  There
-           * may be deleted files at the end of FLASH.  In this case, we don't
-           * have to pack any files, we simply have to erase FLASH at the end.
-           * But don't do this unless there is some particularly big FLASH
-           * savings (otherwise, we risk wearing out these final blocks).
-           */
+/****************************************************************************
+ * Name: nxffs_packpad
+ *
+ * Description:
+ *   A packing step stops with a hole between the packed data and the first
+ *   inode header ('end') after it in the erase blocks that were not re-
+ *   written.  The hole holds old copies of moved inodes, or the remains of
+ *   them.  Write a deleted "pad" inode at 'pos' in the pack buffer whose
+ *   data covers the hole:  Searches for inodes skip deleted inodes, so
+ *   nothing in the hole is ever taken for an inode, and a long run of
+ *   erased bytes in it is not taken for the end of the valid data.
+ *
+ * Input Parameters:
+ *   volume - The volume being packed
+ *   pack   - The volume packing state structure.
+ *   pos    - FLASH offset of the pad inode header (see nxffs_padpos()).
+ *   end    - FLASH offset of the end of the hole.
+ *
+ * Returned Values:
+ *   None
+ *
+ ****************************************************************************/
 
-          if (iooffset + CONFIG_NXFFS_TAILTHRESHOLD < volume->froffset)
-            {
-              /* Setting 'packed' to true will supress normal inode packing
-               * operation.
-               */
+#ifdef CONFIG_NXFFS_PACK_INCREMENTAL
+static void nxffs_packpad(FAR struct nxffs_volume_s *volume,
+                          FAR struct nxffs_pack_s *pack, off_t pos, off_t end)
+{
+  FAR struct nxffs_inode_s *inode;
+  off_t maxsize;
+  off_t doffset;
+  off_t datlen;
+  off_t nblocks;
+  off_t tell;
+  uint32_t crc;
 
-              packed = true;
+  /* If the pad goes in the next I/O block, the rest of the current I/O block
+   * is unused.
+   */
 
-              /* Writing is performed at the end of the free FLASH region.
-               * If we are not packing files, we could still need to pack
-               * the partially written file at the end of FLASH.
-               */
+  tell = nxffs_packtell(volume, pack);
+  if (pos != tell)
+    {
+      memset(&volume->pack[tell - pack->block0 * volume->geo.blocksize],
+             CONFIG_NXFFS_ERASEDSTATE, volume->geo.blocksize - pack->iooffset);
+    }
 
-              wrfile = nxffs_setupwriter(volume, &pack);
-            }
+  /* The pad inode has no name.  Pick a data length so that the end of the
+   * inode, as computed by nxffs_inodeend(), falls on or just before 'end'.
+   * The data would be split into blocks, each with its own data header.
+   */
 
-          /* Otherwise return OK.. meaning that there is nothing more we can
-           * do to recover FLASH space.
-           */
+  doffset = pos + SIZEOF_NXFFS_INODE_HDR;
+  datlen  = 0;
 
-          else
-            {
-              return OK;
-            }
-        }
-      else
+  if (end > doffset)
+    {
+      maxsize = volume->geo.blocksize - SIZEOF_NXFFS_BLOCK_HDR -
+                SIZEOF_NXFFS_DATA_HDR;
+      nblocks = (end - doffset + maxsize + SIZEOF_NXFFS_DATA_HDR - 1) /
+                (maxsize + SIZEOF_NXFFS_DATA_HDR);
+      datlen  = end - doffset - nblocks * SIZEOF_NXFFS_DATA_HDR;
+      if (datlen < 0)
         {
-          fdbg("ERROR: Failed to find a packing position: %d\n", -ret);
-          return ret;
+          datlen = 0;
         }
     }
 
-  /* Otherwise, begin pack at this src/dest block combination.  Initialize
-   * ioblock and iooffset with the position of the first inode header.  In
-   * this case, the FLASH offset to the first inode header is return in
-   * iooffset.
+  /* Format the inode header as nxffs_wrinodehdr() does, but mark it
+   * deleted.
    */
 
-start_pack:
+  inode = (FAR struct nxffs_inode_s *)
+    &volume->pack[pos - pack->block0 * volume->geo.blocksize];
 
-  pack.ioblock     = nxffs_getblock(volume, iooffset);
-  pack.iooffset    = nxffs_getoffset(volume, iooffset, pack.ioblock);
-  volume->froffset = iooffset;
+  memcpy(inode->magic, g_inodemagic, NXFFS_MAGICSIZE);
+  inode->state  = CONFIG_NXFFS_ERASEDSTATE;
+  inode->namlen = 0;
 
-  /* Then pack all erase blocks starting with the erase block that contains
-   * the ioblock and through the final erase block on the FLASH.
-   */
+  nxffs_wrle32(inode->noffs,  pos);
+  nxffs_wrle32(inode->doffs,  doffset);
+  nxffs_wrle32(inode->utc,    0);
+  nxffs_wrle32(inode->crc,    0);
+  nxffs_wrle32(inode->datlen, datlen);
 
-  for (eblock = pack.ioblock / volume->blkper;
-       eblock < volume->geo.neraseblocks;
-       eblock++)
-    {
-      /* Get the starting block number of the erase block */
+  crc = crc32((FAR const uint8_t *)inode, SIZEOF_NXFFS_INODE_HDR);
 
-      pack.block0 = eblock * volume->blkper;
+  inode->state = INODE_STATE_DELETED;
+  nxffs_wrle32(inode->crc, crc);
+}
+#endif
 
-#ifndef CONFIG_NXFFS_NAND
-      /* Read the erase block into the pack buffer.  We need to do this even
-       * if we are overwriting the entire block so that we skip over
-       * previously marked bad blocks.
-       */
+/****************************************************************************
+ * Name: nxffs_packhdr
+ *
+ * Description:
+ *   Follow the inodes, valid or deleted, from the inode header (or the end
+ *   of an inode) at 'offset' and return the first inode header at or after
+ *   'limit'.  Each inode ends before the header of the next one, so FLASH
+ *   can be cut at any such header.
+ *
+ * Input Parameters:
+ *   volume - The volume being packed
+ *   offset - Where to start following the inodes
+ *   limit  - The lowest inode header offset of interest
+ *   end    - The end of the inodes to follow
+ *
+ * Returned Values:
+ *   The FLASH offset of the first inode header at or after 'limit'; 'end'
+ *   if there is no such inode header before 'end'.
+ *
+ ****************************************************************************/
 
-      ret = MTD_BREAD(volume->mtd, pack.block0, volume->blkper, volume->pack);
-      if (ret < 0)
+#ifdef CONFIG_NXFFS_PACK_INCREMENTAL
+static off_t nxffs_packhdr(FAR struct nxffs_volume_s *volume, off_t offset,
+                           off_t limit, off_t end)
+{
+  struct nxffs_entry_s entry;
+  off_t hoffset = offset;
+
+  while (hoffset < limit)
+    {
+      if (nxffs_nextinode(volume, offset, &entry) < 0)
         {
-          fdbg("ERROR: Failed to read erase block %d: %d\n", eblock, -ret);
+          return end;
+        }
+
+      hoffset = entry.hoffset;
+      offset  = nxffs_inodeend(volume, &entry);
+      nxffs_freeentry(&entry);
+    }
+
+  return hoffset < end ? hoffset : end;
+}
+#endif
+
+/****************************************************************************
+ * Name: nxffs_packrmold
+ *
+ * Description:
+ *   A packing step has stopped.  The inodes that it moved still have valid
+ *   headers at their old locations after the pad inode.  Mark them deleted.
+ *
+ *   Until this is done, each of these inodes exists twice with the same
+ *   name and content.  An interrupted packing step can leave such
+ *   duplicates.  This is harmless:  Only the first copy is ever found, and
+ *   removing the file leaves the second one, which may then be removed
+ *   again.
+ *
+ * Input Parameters:
+ *   volume - The volume that was packed
+ *   offset - FLASH offset of the first inode header after the pad inode
+ *   end    - FLASH offset of the first inode that was not moved
+ *
+ * Returned Values:
+ *   Zero on success; Otherwise, a negated errno value is returned to
+ *   indicate the nature of the failure.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_NXFFS_PACK_INCREMENTAL
+static int nxffs_packrmold(FAR struct nxffs_volume_s *volume, off_t offset,
+                           off_t end)
+{
+  FAR struct nxffs_inode_s *inode;
+  struct nxffs_entry_s entry;
+  int ret;
+
+  /* The pack buffer was written without going through the cache */
+
+  nxffs_invcache(volume);
+
+  while (offset < end)
+    {
+      ret = nxffs_nextentry(volume, offset, &entry);
+      if (ret < 0)
+        {
+          return ret == -ENOENT ? OK : ret;
+        }
+
+      if (entry.hoffset >= end)
+        {
+          nxffs_freeentry(&entry);
+          break;
+        }
+
+      /* Change the inode state in the cached block and write it back, as
+       * nxffs_rminode() does.
+       */
+
+      nxffs_ioseek(volume, entry.hoffset);
+      ret = nxffs_rdcache(volume, volume->ioblock);
+      if (ret == OK)
+        {
+          inode = (FAR struct nxffs_inode_s *)&volume->cache[volume->iooffset];
+          inode->state = INODE_STATE_DELETED;
+          ret = nxffs_wrcache(volume);
+        }
+
+      offset = nxffs_inodeend(volume, &entry);
+      nxffs_freeentry(&entry);
+
+      if (ret < 0)
+        {
+          fdbg("ERROR: Failed to delete the old inode: %d\n", -ret);
+          return ret;
+        }
+    }
+
+  return OK;
+}
+#endif
+
+/****************************************************************************
+ * Name: nxffs_packtail
+ *
+ * Description:
+ *   All inodes are packed, but FLASH between the end of the valid data and
+ *   the free FLASH region holds only deleted inodes.  There may be more of
+ *   them than a packing step may erase, so cut off only the last part of
+ *   that region:  Find the first inode header in the last 'maxblocks'
+ *   erase blocks worth of FLASH and make it the beginning of the free FLASH
+ *   region.
+ *
+ *   The erase block holding that inode header is re-written first.  Every
+ *   inode before the header ends before it, so FLASH remains consistent if
+ *   a reset interrupts the erase blocks that follow.
+ *
+ * Input Parameters:
+ *   volume    - The volume to be packed
+ *   offset    - The end of the valid data
+ *   maxblocks - The number of erase blocks that may be erased
+ *
+ * Returned Values:
+ *   The number of erase blocks that were erased on success; Otherwise, a
+ *   negated errno value is returned to indicate the nature of the failure.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_NXFFS_PACK_INCREMENTAL
+static int nxffs_packtail(FAR struct nxffs_volume_s *volume, off_t offset,
+                          int maxblocks)
+{
+  struct nxffs_entry_s entry;
+  FAR uint8_t *iobuffer;
+  off_t froffset = volume->froffset;
+  off_t first = offset;
+  off_t target;
+  off_t cut;
+  off_t eblock;
+  off_t last;
+  off_t block;
+  size_t start;
+  size_t nbytes;
+  bool clean;
+  int neblocks = 0;
+  int ret;
+  int i;
+
+  if (froffset <= offset)
+    {
+      return 0;
+    }
+
+  /* Find where to cut:  The first inode header in the last 'maxblocks' erase
+   * blocks worth of FLASH, or the last inode header before that if there is
+   * none.
+   */
+
+  last   = (froffset - 1) / volume->geo.erasesize;
+  target = froffset - maxblocks * volume->geo.erasesize;
+  cut    = offset;
+
+  while (cut < target && nxffs_nextinode(volume, offset, &entry) == OK)
+    {
+      if (entry.hoffset >= froffset)
+        {
+          nxffs_freeentry(&entry);
+          break;
+        }
+
+      cut    = entry.hoffset;
+      offset = nxffs_inodeend(volume, &entry);
+      nxffs_freeentry(&entry);
+    }
+
+  for (eblock = cut / volume->geo.erasesize; eblock <= last; eblock++)
+    {
+      /* Read the erase block so that block headers (and bad block marks)
+       * are preserved.  Then reset each block from the cut on.
+       */
+
+      block = eblock * volume->blkper;
+      ret = MTD_BREAD(volume->mtd, block, volume->blkper, volume->pack);
+      if (ret < 0)
+        {
+          fdbg("ERROR: Failed to read erase block %d: %d\n", eblock, -ret);
+          return ret;
+        }
+
+      clean = true;
+      for (i = 0, iobuffer = volume->pack;
+           i < volume->blkper;
+           i++, block++, iobuffer += volume->geo.blocksize)
+        {
+          if ((block + 1) * volume->geo.blocksize <= cut)
+            {
+              continue;
+            }
+
+          start = SIZEOF_NXFFS_BLOCK_HDR;
+          if (block * volume->geo.blocksize + start < cut)
+            {
+              start = cut - block * volume->geo.blocksize;
+            }
+
+          nbytes = volume->geo.blocksize - start;
+          if (nxffs_erased(&iobuffer[start], nbytes) < nbytes)
+            {
+              memset(&iobuffer[start], CONFIG_NXFFS_ERASEDSTATE, nbytes);
+              clean = false;
+            }
+        }
+
+      /* Erase blocks that are clean already are left alone */
+
+      if (clean)
+        {
+          continue;
+        }
+
+      ret = MTD_ERASE(volume->mtd, eblock, 1);
+      if (ret < 0)
+        {
+          fdbg("ERROR: Failed to erase block %d: %d\n", eblock, -ret);
+          return ret;
+        }
+
+      block = eblock * volume->blkper;
+      ret = MTD_BWRITE(volume->mtd, block, volume->blkper, volume->pack);
+      if (ret < 0)
+        {
+          fdbg("ERROR: Failed to write erase block %d: %d\n", eblock, -ret);
+          return ret;
+        }
+
+      neblocks++;
+    }
+
+  /* The free FLASH region now starts at the cut */
+
+  if (cut % volume->geo.blocksize < SIZEOF_NXFFS_BLOCK_HDR)
+    {
+      cut += SIZEOF_NXFFS_BLOCK_HDR - cut % volume->geo.blocksize;
+    }
+
+  volume->froffset = cut;
+  nxffs_invcache(volume);
+
+  /* If deleted inodes remain, the next packing step goes on erasing them */
+
+  volume->packresume = cut > first ? first : 0;
+
+  fvdbg("Free FLASH at offset %d\n", volume->froffset);
+  return neblocks;
+}
+#endif
+
+/****************************************************************************
+ * Name: nxffs_packdone
+ *
+ * Description:
+ *   Bring the volume state up to date after packing.  The erase blocks
+ *   were rewritten without going through the block cache, and the first
+ *   valid inode may have moved toward the beginning of FLASH.
+ *
+ * Input Parameters:
+ *   volume - The volume that was packed
+ *
+ * Returned Values:
+ *   None
+ *
+ ****************************************************************************/
+
+static void nxffs_packdone(FAR struct nxffs_volume_s *volume)
+{
+  struct nxffs_entry_s entry;
+  off_t block;
+  int ret;
+
+  nxffs_invcache(volume);
+
+  /* Find the first valid inode again */
+
+  block = 0;
+  ret = nxffs_validblock(volume, &block);
+  if (ret == OK)
+    {
+      ret = nxffs_nextentry(volume, block * volume->geo.blocksize, &entry);
+      if (ret == OK)
+        {
+          volume->inoffset = entry.hoffset;
+          nxffs_freeentry(&entry);
+        }
+      else
+        {
+          /* No inodes (other than perhaps that of a file still being
+           * written).  Inodes are searched for from the first valid block.
+           */
+
+          volume->inoffset = block * volume->geo.blocksize;
+        }
+    }
+
+  fvdbg("First inode at offset %d\n", volume->inoffset);
+
+#ifdef CONFIG_NXFFS_INODE_INDEX
+  /* Index the inodes at their new locations */
+
+  (void)nxffs_ixbuild(volume);
+#endif
+}
+
+/****************************************************************************
+ * Name: nxffs_dopack
+ *
+ * Description:
+ *   Pack and re-write the filesystem in order to free up memory at the end
+ *   of FLASH.
+ *
+ * Input Parameters:
+ *   volume    - The volume to be packed.
+ *   maxblocks - Stop at the first inode boundary after re-writing this
+ *               many erase blocks.  Zero packs the whole volume.
+ *
+ * Returned Values:
+ *   Zero on success; Otherwise, a negated errno value is returned to
+ *   indicate the nature of the failure.
+ *
+ ****************************************************************************/
+
+static int nxffs_dopack(FAR struct nxffs_volume_s *volume, int maxblocks)
+{
+  struct nxffs_pack_s pack;
+  FAR struct nxffs_wrfile_s *wrfile;
+  off_t iooffset;
+  off_t eblock;
+  off_t block;
+#ifdef CONFIG_NXFFS_PACK_INCREMENTAL
+  off_t froffset;
+  off_t stopoff = 0;
+  off_t padoff = 0;
+#endif
+  uint32_t neblocks = 0;
+  bool packed;
+  int i;
+  int ret = OK;
+
+#ifdef CONFIG_NXFFS_PACK_INCREMENTAL
+  /* Remember where the free FLASH region was */
+
+  froffset = volume->froffset;
+
+#endif
+  /* Get the offset to the first valid inode entry */
+
+  wrfile = NULL;
+  packed = false;
+
+  iooffset = nxffs_mediacheck(volume, &pack);
+  if (iooffset == 0)
+    {
+      /* Offset zero is only returned if no valid blocks were found on the
+       * FLASH media or if there are no valid inode entries on the FLASH after
+       * the first valid block.  There are two possibilities:  (1) there
+       * really is nothing on the FLASH, or (2) there is a file being written
+       * to the FLASH now.
+       */
+
+      /* Is there a writer? */
+
+      wrfile = nxffs_setupwriter(volume, &pack);
+      if (wrfile)
+        {
+          /* If there is a write, just set ioffset to the offset of data in
+           * first block. Setting 'packed' to true will supress normal inode
+           * packing operation.  Then we can start compacting the FLASH.
+           */
+
+          iooffset = SIZEOF_NXFFS_BLOCK_HDR;
+          packed   = true;
+          goto start_pack;
+        }
+      else
+        {
+          /* No, there is no write in progress.  We just have an empty flash
+           * full of deleted files.  In this case, the media needs to be re-
+           * formatted.
+           */
+
+          ret = nxffs_reformat(volume);
+          if (ret == OK)
+            {
+              /* The free flash offset will be in the first valid block of
+               * the FLASH.
+               */
+
+              block = 0;
+              ret = nxffs_validblock(volume, &block);
+              if (ret == OK)
+                {
+                  /* Set to the offset past the block header in the first
+                   * valid block
+                   */
+
+                  volume->froffset =
+                    block * volume->geo.blocksize + SIZEOF_NXFFS_BLOCK_HDR;
+                  volume->inoffset = volume->froffset;
+                }
+
+#ifdef CONFIG_NXFFS_INODE_INDEX
+              /* There are no inodes left to index */
+
+              nxffs_ixreset(volume);
+#endif
+            }
+
+          return ret;
+        }
+    }
+
+  /* There is a valid format and valid inodes on the media.. setup up to
+   * begin the packing operation.
+   */
+
+#ifdef CONFIG_NXFFS_PACK_INCREMENTAL
+  /* A packing step continues the sweep of the last one */
+
+  ret = -ENOENT;
+  if (maxblocks > 0)
+    {
+      ret = nxffs_packresume(volume, &pack, &iooffset);
+    }
+
+  volume->packresume = 0;
+  if (ret == -ENOENT)
+#endif
+    {
+      ret = nxffs_startpos(volume, &pack, &iooffset);
+    }
+
+  if (ret < 0)
+    {
+      /* This is a normal situation if the volume is full */
+
+      if (ret == -ENOSPC)
+        {
+          /* In the case where the volume is full, nxffs_startpos() will
+           * recalculate the free FLASH offset and store it in iooffset.  There
+           * may be deleted files at the end of FLASH.  In this case, we don't
+           * have to pack any files, we simply have to erase FLASH at the end.
+           * But don't do this unless there is some particularly big FLASH
+           * savings (otherwise, we risk wearing out these final blocks).
+           */
+
+          if (iooffset + CONFIG_NXFFS_TAILTHRESHOLD < volume->froffset)
+            {
+              /* Setting 'packed' to true will supress normal inode packing
+               * operation.
+               */
+
+              packed = true;
+
+              /* Writing is performed at the end of the free FLASH region.
+               * If we are not packing files, we could still need to pack
+               * the partially written file at the end of FLASH.
+               */
+
+              wrfile = nxffs_setupwriter(volume, &pack);
+            }
+
+          /* Otherwise return OK.. meaning that there is nothing more we can
+           * do to recover FLASH space.
+           */
+
+          else
+            {
+#ifdef CONFIG_NXFFS_PACK_INCREMENTAL
+              volume->packnone = true;
+#endif
+              return OK;
+            }
+
+#ifdef CONFIG_NXFFS_PACK_INCREMENTAL
+          /* A packing step may not be able to erase the whole tail.  It
+           * erases only the end of it.
+           */
+
+          if (maxblocks > 0 && wrfile == NULL)
+            {
+              ret = nxffs_packtail(volume, iooffset, maxblocks);
+              if (ret >= 0)
+                {
+                  neblocks = ret;
+                  ret      = OK;
+                }
+
+              goto errout_with_stats;
+            }
+#endif
+        }
+      else
+        {
+          fdbg("ERROR: Failed to find a packing position: %d\n", -ret);
+          return ret;
+        }
+    }
+
+  /* Otherwise, begin pack at this src/dest block combination.  Initialize
+   * ioblock and iooffset with the position of the first inode header.  In
+   * this case, the FLASH offset to the first inode header is return in
+   * iooffset.
+   */
+
+start_pack:
+
+#ifdef CONFIG_NXFFS_INODE_INDEX
+  /* Inodes are about to move.  The index is rebuilt when packing is done */
+
+  nxffs_ixinvalidate(volume);
+#endif
+
+  pack.ioblock     = nxffs_getblock(volume, iooffset);
+  pack.iooffset    = nxffs_getoffset(volume, iooffset, pack.ioblock);
+  volume->froffset = iooffset;
+#ifdef CONFIG_NXFFS_PACK_INCREMENTAL
+  pack.chain       = iooffset;
+#endif
+
+  /* Then pack all erase blocks starting with the erase block that contains
+   * the ioblock and through the final erase block on the FLASH.
+   */
+
+  for (eblock = pack.ioblock / volume->blkper;
+       eblock < volume->geo.neraseblocks;
+       eblock++)
+    {
+      /* Get the starting block number of the erase block */
+
+      pack.block0 = eblock * volume->blkper;
+
+#ifdef CONFIG_NXFFS_PACK_INCREMENTAL
+      /* Once the budget of erase blocks has been filled, stop when the
+       * inode that spills into this erase block is finished.  Once all
+       * inodes have been packed, nothing remains past the old free FLASH
+       * region.
+       */
+
+      pack.stop = maxblocks > 0 && neblocks >= maxblocks;
+      if (maxblocks > 0 && packed && wrfile == NULL &&
+          pack.block0 * volume->geo.blocksize >= froffset)
+        {
+          break;
+        }
+#endif
+
+#ifndef CONFIG_NXFFS_NAND
+      /* Read the erase block into the pack buffer.  We need to do this even
+       * if we are overwriting the entire block so that we skip over
+       * previously marked bad blocks.
+       */
+
+      ret = MTD_BREAD(volume->mtd, pack.block0, volume->blkper, volume->pack);
+      if (ret < 0)
+        {
+          fdbg("ERROR: Failed to read erase block %d: %d\n", eblock, -ret);
           goto errout_with_pack;
         }
 
@@ -1456,6 +2183,37 @@ start_pack:
         }
 #endif
 
+      /* Once everything has been packed, the remaining erase blocks are only
+       * reset to the erased state.  Don't wear out those that already are.
+       */
+
+      if (packed && wrfile == NULL && nxffs_packclean(volume, &pack))
+        {
+          pack.ioblock  = pack.block0 + volume->blkper - 1;
+          pack.iooffset = SIZEOF_NXFFS_BLOCK_HDR;
+          volume->packstats.nskipped++;
+          continue;
+        }
+
+#ifdef CONFIG_NXFFS_PACK_INCREMENTAL
+      /* If there was no room for the pad inode at the end of the previous
+       * erase block, it goes at the beginning of this one.
+       */
+
+      if (stopoff > 0)
+        {
+          pack.ioblock  = pack.block0 - 1;
+          pack.iooffset = volume->geo.blocksize;
+          padoff        = nxffs_padpos(volume, &pack);
+          if (padoff == 0)
+            {
+              continue;
+            }
+
+          goto stop_pack;
+        }
+#endif
+
       /* Now pack each I/O block */
 
       for (i = 0, block = pack.block0, pack.iobuffer = volume->pack;
@@ -1497,6 +2255,32 @@ start_pack:
                       ret = nxffs_packblock(volume, &pack);
                       if (ret < 0)
                         {
+#ifdef CONFIG_NXFFS_PACK_INCREMENTAL
+                          /* -EAGAIN means that the step stops before the
+                           * next inode.  When everything has been packed but
+                           * deleted inodes remain past this erase block, the
+                           * step also stops and erases only the end of
+                           * them.
+                           */
+
+                          if (ret == -EAGAIN)
+                            {
+                              stopoff = pack.src.entry.hoffset;
+                              padoff  = nxffs_padpos(volume, &pack);
+                              ret     = OK;
+                              break;
+                            }
+                          else if (ret == -ENOSPC && maxblocks > 0 &&
+                                   froffset > (eblock + 1) *
+                                              volume->geo.erasesize)
+                            {
+                              stopoff = froffset;
+                              padoff  = nxffs_padpos(volume, &pack);
+                              ret     = OK;
+                              break;
+                            }
+#endif
+
                           /* The error -ENOSPC is a special value that simply
                            * means that there is nothing further to be packed.
                            */
@@ -1577,6 +2361,44 @@ start_pack:
             }
         }
 
+#ifdef CONFIG_NXFFS_PACK_INCREMENTAL
+stop_pack:
+      if (stopoff > 0 && padoff > 0)
+        {
+          /* The step stops in this erase block.  The pad inode covers the
+           * hole up to the first inode header after it.
+           */
+
+          pack.chain = nxffs_packhdr(volume, pack.chain,
+                                     padoff + SIZEOF_NXFFS_INODE_HDR,
+                                     stopoff);
+          nxffs_packpad(volume, &pack, padoff, pack.chain);
+        }
+      else if (stopoff > 0)
+        {
+          /* No room for the pad inode in this erase block.  It goes in the
+           * next one.
+           */
+
+          memset(&pack.iobuffer[pack.iooffset], CONFIG_NXFFS_ERASEDSTATE,
+                 volume->geo.blocksize - pack.iooffset);
+
+          pack.chain = nxffs_packhdr(volume, pack.chain,
+                                     (eblock + 1) * volume->geo.erasesize,
+                                     froffset);
+        }
+      else if (maxblocks > 0 && !packed)
+        {
+          /* Packing goes on in the next erase block.  Follow the inodes in
+           * FLASH past this one before it is overwritten.
+           */
+
+          pack.chain = nxffs_packhdr(volume, pack.chain,
+                                     (eblock + 1) * volume->geo.erasesize,
+                                     froffset);
+        }
+#endif
+
       /* We now have an in-memory image of how we want this erase block to
        * appear. Now it is safe to erase the block.
        */
@@ -1598,10 +2420,235 @@ start_pack:
                eblock, pack.block0, -ret);
           goto errout_with_pack;
         }
+
+      /* The cache may hold an old copy of a block in this erase block */
+
+      nxffs_invcache(volume);
+      neblocks++;
+
+#ifdef CONFIG_NXFFS_PACK_INCREMENTAL
+      /* Data is transferred from the source data block in the cache, but
+       * following the inodes may have replaced it.  Read it again.
+       */
+
+      if (maxblocks > 0 && pack.src.blkoffset > 0)
+        {
+          nxffs_ioseek(volume, pack.src.blkoffset);
+          ret = nxffs_rdcache(volume, volume->ioblock);
+          if (ret < 0)
+            {
+              fdbg("ERROR: Failed to read source block %d: %d\n",
+                   volume->ioblock, -ret);
+              goto errout_with_pack;
+            }
+        }
+#endif
+
+#ifdef CONFIG_NXFFS_PACK_INCREMENTAL
+      if (stopoff > 0 && padoff > 0)
+        {
+          /* Stop here.  Nothing beyond 'stopoff' has moved, so the free
+           * FLASH region is where it was.  Delete the old copies of the
+           * moved inodes after the pad inode.
+           */
+
+          volume->froffset = froffset;
+          ret = nxffs_packrmold(volume, pack.chain, stopoff);
+
+          /* The next step resumes at the pad inode */
+
+          if (ret >= 0 && stopoff < froffset)
+            {
+              volume->packresume = padoff;
+            }
+
+          /* If all inodes have been packed, erase the end of the deleted
+           * inodes that remain.
+           */
+
+          if (ret >= 0 && stopoff == froffset)
+            {
+              ret = nxffs_packtail(volume, padoff, maxblocks);
+              if (ret >= 0)
+                {
+                  neblocks += ret;
+                  ret       = OK;
+                }
+            }
+
+          break;
+        }
+#endif
+    }
+
+#ifdef CONFIG_NXFFS_PACK_INCREMENTAL
+  if (stopoff == 0)
+#endif
+    {
+      volume->packstats.npacks++;
     }
 
 errout_with_pack:
   nxffs_freeentry(&pack.src.entry);
   nxffs_freeentry(&pack.dest.entry);
+
+  if (ret >= 0)
+    {
+      nxffs_packdone(volume);
+    }
+
+#ifdef CONFIG_NXFFS_PACK_INCREMENTAL
+errout_with_stats:
+#endif
+  volume->packstats.neblocks += neblocks;
+  if (neblocks > volume->packstats.maxeblocks)
+    {
+      volume->packstats.maxeblocks = neblocks;
+    }
+
   return ret;
 }
+
+/****************************************************************************
+ * Name: nxffs_packneeded
+ *
+ * Description:
+ *   Check if the free space at the end of FLASH is low enough that the
+ *   volume should be packed a little.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_NXFFS_PACK_INCREMENTAL
+static bool nxffs_packneeded(FAR struct nxffs_volume_s *volume)
+{
+  off_t size = volume->nblocks * volume->geo.blocksize;
+
+  return !volume->packnone &&
+         size - volume->froffset < size / 100 * CONFIG_NXFFS_PACK_FREE;
+}
+#endif
+
+/****************************************************************************
+ * Name: nxffs_packworker
+ *
+ * Description:
+ *   Take packing steps on the low priority work queue while the volume is
+ *   idle.  Each run takes one step so that file system operations never
+ *   wait for more than one step.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_NXFFS_PACK_WORKER
+static void nxffs_packworker(FAR void *arg)
+{
+  FAR struct nxffs_volume_s *volume = (FAR struct nxffs_volume_s *)arg;
+  uint32_t idle = MSEC2TICK(CONFIG_NXFFS_PACK_IDLE);
+  uint32_t elapsed;
+  int ret;
+
+  ret = sem_wait(&volume->exclsem);
+  if (ret != OK)
+    {
+      (void)work_queue(LPWORK, &volume->packwork, nxffs_packworker, volume,
+                       idle);
+      return;
+    }
+
+  /* Wait until nothing has been closed or removed for the idle time */
+
+  elapsed = clock_systimer() - volume->packtime;
+  if (elapsed < idle)
+    {
+      (void)work_queue(LPWORK, &volume->packwork, nxffs_packworker, volume,
+                       idle - elapsed);
+    }
+
+  /* A file open for writing will schedule the worker again when it is
+   * closed, so -EBUSY needs no action here.
+   */
+
+  else if (nxffs_packneeded(volume) && nxffs_packstep(volume) == OK &&
+           nxffs_packneeded(volume))
+    {
+      (void)work_queue(LPWORK, &volume->packwork, nxffs_packworker, volume,
+                       0);
+    }
+
+  sem_post(&volume->exclsem);
+}
+#endif
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: nxffs_pack
+ *
+ * Description:
+ *   Pack and re-write the filesystem in order to free up memory at the end
+ *   of FLASH.
+ *
+ * Input Parameters:
+ *   volume - The volume to be packed.
+ *
+ * Returned Values:
+ *   Zero on success; Otherwise, a negated errno value is returned to
+ *   indicate the nature of the failure.
+ *
+ ****************************************************************************/
+
+int nxffs_pack(FAR struct nxffs_volume_s *volume)
+{
+  return nxffs_dopack(volume, 0);
+}
+
+/****************************************************************************
+ * Name: nxffs_packstep
+ *
+ * Description:
+ *   Pack the volume by a bounded number of erase blocks.  See nxffs.h.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_NXFFS_PACK_INCREMENTAL
+int nxffs_packstep(FAR struct nxffs_volume_s *volume)
+{
+  /* Files being written are packed only by nxffs_pack() */
+
+  if (nxffs_findwriter(volume) != NULL)
+    {
+      return -EBUSY;
+    }
+
+  volume->packstats.nsteps++;
+  return nxffs_dopack(volume, CONFIG_NXFFS_PACK_STEP);
+}
+#endif
+
+/****************************************************************************
+ * Name: nxffs_packcheck
+ *
+ * Description:
+ *   Take or schedule a packing step if FLASH is running low.  See nxffs.h.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_NXFFS_PACK_INCREMENTAL
+void nxffs_packcheck(FAR struct nxffs_volume_s *volume)
+{
+#ifdef CONFIG_NXFFS_PACK_WORKER
+  volume->packtime = clock_systimer();
+  if (nxffs_packneeded(volume) && work_available(&volume->packwork))
+    {
+      (void)work_queue(LPWORK, &volume->packwork, nxffs_packworker, volume,
+                       MSEC2TICK(CONFIG_NXFFS_PACK_IDLE));
+    }
+#else
+  if (nxffs_packneeded(volume))
+    {
+      (void)nxffs_packstep(volume);
+    }
+#endif
+}
+#endif
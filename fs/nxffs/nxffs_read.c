@@ -78,16 +78,20 @@
  *   are not easily mapped to FLASH offsets due to intervening block and
  *   data headers.
  *
+ *   The search begins at the data block found by the last seek if the
+ *   desired position is not before it, so that reading a file sequentially
+ *   does not search all of its data blocks again for every read.
+ *
  * Input Parameters:
  *   volume   - Describes the current volume
- *   entry    - Describes the open inode
+ *   ofile    - Describes the open file
  *   fpos     - The desired file position
  *   blkentry - Describes the block entry that we are positioned in
  *
  ****************************************************************************/
 
 static ssize_t nxffs_rdseek(FAR struct nxffs_volume_s *volume,
-                            FAR struct nxffs_entry_s *entry,
+                            FAR struct nxffs_ofile_s *ofile,
                             off_t fpos,
                             FAR struct nxffs_blkentry_s *blkentry)
 {
@@ -100,7 +104,7 @@ static ssize_t nxffs_rdseek(FAR struct nxffs_volume_s *volume,
    * the inode
    */
 
-  offset = entry->doffset;
+  offset = ofile->entry.doffset;
   if (offset == 0)
     {
       /* Zero length files will have no data blocks */
@@ -108,9 +112,15 @@ static ssize_t nxffs_rdseek(FAR struct nxffs_volume_s *volume,
       return -ENOSPC;
     }
 
+  datend = 0;
+  if (ofile->rdblock > 0 && fpos >= ofile->rdstart)
+    {
+      offset = ofile->rdblock;
+      datend = ofile->rdstart;
+    }
+
   /* Loop until we read the data block containing the desired position */
 
-  datend = 0;
   do
     {
       /* Check if the next data block contains the sought after file position */
@@ -133,6 +143,11 @@ static ssize_t nxffs_rdseek(FAR struct nxffs_volume_s *volume,
     }
   while (datend <= fpos);
 
+  /* Remember where this data block is for the next seek */
+
+  ofile->rdblock = blkentry->hoffset;
+  ofile->rdstart = datstart;
+
   /* Return the offset to the data within the current data block */
 
   blkentry->foffset = fpos - datstart;
@@ -214,7 +229,7 @@ ssize_t nxffs_read(FAR struct file *filep, FAR char *buffer, size_t buflen)
 
       /* Seek to the current file offset */
 
-      ret = nxffs_rdseek(volume, &ofile->entry, filep->f_pos, &blkentry);
+      ret = nxffs_rdseek(volume, ofile, filep->f_pos, &blkentry);
       if (ret < 0)
         {
           fdbg("ERROR: nxffs_rdseek failed: %d\n", -ret);
@@ -273,6 +288,8 @@ errout:
 int nxffs_nextblock(FAR struct nxffs_volume_s *volume, off_t offset,
                     FAR struct nxffs_blkentry_s *blkentry)
 {
+  FAR const uint8_t *buffer;
+  int nbytes;
   int nmagic;
   int ch;
   int nerased;
@@ -291,23 +308,36 @@ int nxffs_nextblock(FAR struct nxffs_volume_s *volume, off_t offset,
 
   /* Then begin searching */
 
+  nbytes  = 0;
   nerased = 0;
   nmagic  = 0;
 
   for (; ; )
     {
-      /* Read the next character */
+      /* Get the rest of the block once the bytes already in hand run out,
+       * or cannot hold the rest of a data block header.
+       */
 
-      ch = nxffs_getc(volume, SIZEOF_NXFFS_DATA_HDR - nmagic);
-      if (ch < 0)
+      if (nbytes < SIZEOF_NXFFS_DATA_HDR - nmagic)
         {
-          fdbg("ERROR: nxffs_getc failed: %d\n", -ch);
-          return ch;
+          nbytes = nxffs_rdbuf(volume, SIZEOF_NXFFS_DATA_HDR - nmagic,
+                               &buffer);
+          if (nbytes < 0)
+            {
+              fdbg("ERROR: nxffs_rdbuf failed: %d\n", -nbytes);
+              return nbytes;
+            }
         }
 
+      /* Read the next character */
+
+      ch = *buffer++;
+      nbytes--;
+      volume->iooffset++;
+
       /* Check for another erased byte */
 
-      else if (ch == CONFIG_NXFFS_ERASEDSTATE)
+      if (ch == CONFIG_NXFFS_ERASEDSTATE)
         {
           /* If we have encountered NXFFS_NERASED number of consecutive
            * erased bytes, then presume we have reached the end of valid
@@ -380,6 +410,7 @@ int nxffs_nextblock(FAR struct nxffs_volume_s *volume, off_t offset,
                */
 
               nxffs_ioseek(volume, blkentry->hoffset + NXFFS_MAGICSIZE);
+              nbytes = 0;
               nmagic = 0;
             }
         }
@@ -290,8 +290,11 @@ int nxffs_reformat(FAR struct nxffs_volume_s *volume)
 {
   int ret;
 
-  /* Erase and reformat the entire volume */
+  /* Erase and reformat the entire volume.  This does not go through the
+   * volume cache, so nothing that it holds will be valid.
+   */
 
+  nxffs_invcache(volume);
   ret = nxffs_format(volume);
   if (ret < 0)
     {
@@ -145,6 +145,21 @@ int nxffs_rminode(FAR struct nxffs_volume_s *volume, FAR const char *name)
       fdbg("ERROR: Failed to write block %d: %d\n",
            volume->ioblock, ret);
     }
+#ifdef CONFIG_NXFFS_INODE_INDEX
+  else
+    {
+      nxffs_ixremove(volume, entry.hoffset);
+    }
+#endif
+
+#ifdef CONFIG_NXFFS_PACK_INCREMENTAL
+  /* There is something to be gained from packing again */
+
+  if (ret >= 0)
+    {
+      volume->packnone = false;
+    }
+#endif
 
 errout_with_entry:
   nxffs_freeentry(&entry);
@@ -183,6 +198,13 @@ int nxffs_unlink(FAR struct inode *mountpt, FAR const char *relpath)
 
   ret = nxffs_rminode(volume, relpath);
 
+#ifdef CONFIG_NXFFS_PACK_INCREMENTAL
+  if (ret >= 0)
+    {
+      nxffs_packcheck(volume);
+    }
+#endif
+
   sem_post(&volume->exclsem);
 errout:
   return ret;
@@ -511,9 +511,19 @@ ssize_t nxffs_write(FAR struct file *filep, FAR const char *buffer, size_t bufle
             }
         }
 
-      /* Seek to the FLASH block containing the data block */
+      /* Seek to the FLASH block containing the data block.  Other files
+       * may have been read since the last write, so make sure that it is
+       * the block in the cache.
+       */
 
       nxffs_ioseek(volume, wrfile->doffset);
+      ret = nxffs_rdcache(volume, volume->ioblock);
+      if (ret < 0)
+        {
+          fdbg("ERROR: Failed to read data block %d: %d\n",
+               volume->ioblock, -ret);
+          goto errout_with_semaphore;
+        }
 
       /* Verify that the FLASH data that was previously written is still intact */
 
@@ -810,9 +820,20 @@ int nxffs_wrblkhdr(FAR struct nxffs_volume_s *volume,
   FAR struct nxffs_data_s *dathdr;
   int ret;
 
-  /* Write the data block header to memory */
+  /* Write the data block header to memory.  Data appended since the last
+   * nxffs_wrcache() may be only in the cache, but nxffs_rdcache() never
+   * reads a block again while it is cached.
+   */
 
   nxffs_ioseek(volume, wrfile->doffset);
+  ret = nxffs_rdcache(volume, volume->ioblock);
+  if (ret < 0)
+    {
+      fdbg("ERROR: Failed to read data block %d: %d\n",
+           volume->ioblock, -ret);
+      goto errout;
+    }
+
   dathdr = (FAR struct nxffs_data_s *)&volume->cache[volume->iooffset];
   memcpy(dathdr->magic, g_datamagic, NXFFS_MAGICSIZE);
   nxffs_wrle32(dathdr->crc, 0);
@@ -78,6 +78,7 @@
 extern const struct procfs_operations proc_operations;
 extern const struct procfs_operations cpuload_operations;
 extern const struct procfs_operations uptime_operations;
+extern const struct procfs_operations irqs_operations;
 
 /* This is not good.  These are implemented in drivers/mtd.  Having to
  * deal with them here is not a good coupling.
@@ -112,6 +113,10 @@ static const struct procfs_entry_s g_procfsentries[] =
   { "cpuload",          &cpuload_operations },
 #endif
 
+#if defined(CONFIG_SCHED_IRQMONITOR) && !defined(CONFIG_FS_PROCFS_EXCLUDE_IRQS)
+  { "irqs",             &irqs_operations },
+#endif
+
 #if defined(CONFIG_FS_SMARTFS) && !defined(CONFIG_FS_PROCFS_EXCLUDE_SMARTFS)
 //{ "fs/smartfs",       &smartfs_procfsoperations },
   { "fs/smartfs**",     &smartfs_procfsoperations },
@@ -396,9 +401,21 @@ static ssize_t procfs_write(FAR struct file *filep, FAR const char *buffer,
 
 static int procfs_ioctl(FAR struct file *filep, int cmd, unsigned long arg)
 {
+  FAR struct procfs_file_s *handler;
+
   fvdbg("cmd: %d arg: %08lx\n", cmd, arg);
 
-  /* No IOCTL commands supported */
+  /* Recover our private data from the struct file instance */
+
+  handler = (FAR struct procfs_file_s *)filep->f_priv;
+  DEBUGASSERT(handler);
+
+  /* Call the handler's ioctl routine, if it has one */
+
+  if (handler->procfsentry->ops->ioctl)
+    {
+      return handler->procfsentry->ops->ioctl(filep, cmd, arg);
+    }
 
   return -ENOTTY;
 }
@@ -126,7 +126,9 @@ const struct procfs_operations cpuload_operations =
   NULL,              /* readdir */
   NULL,              /* rewinddir */
 
-  cpuload_stat        /* stat */
+  cpuload_stat,       /* stat */
+
+  NULL                /* ioctl */
 };
 
 /****************************************************************************
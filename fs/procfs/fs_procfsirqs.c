@@ -0,0 +1,414 @@
+/****************************************************************************
+ * fs/procfs/fs_procfsirqs.c
+ *
+ *   Copyright (C) 2016 Gregory Nutt. All rights reserved.
+ *   Author: Gregory Nutt <gnutt@nuttx.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <sys/types.h>
+#include <sys/statfs.h>
+#include <sys/stat.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <assert.h>
+#include <errno.h>
+#include <debug.h>
+
+#include <nuttx/irq.h>
+#include <nuttx/kmalloc.h>
+#include <nuttx/fs/fs.h>
+#include <nuttx/fs/ioctl.h>
+#include <nuttx/fs/procfs.h>
+
+#if !defined(CONFIG_DISABLE_MOUNTPOINT) && defined(CONFIG_FS_PROCFS)
+#if defined(CONFIG_SCHED_IRQMONITOR) && !defined(CONFIG_FS_PROCFS_EXCLUDE_IRQS)
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+/* The widest value of an unsigned long in decimal */
+
+#if ULONG_MAX > 0xffffffffUL
+#  define IRQS_ULONGLEN 20
+#else
+#  define IRQS_ULONGLEN 10
+#endif
+
+/* 64-bit totals can only be printed if the C library supports it */
+
+#if defined(CONFIG_HAVE_LONG_LONG) && defined(CONFIG_LIBC_LONG_LONG)
+#  define IRQS_TOTALFMT "%12llu"
+#  define IRQS_TOTAL(t) ((unsigned long long)(t))
+#  define IRQS_TOTALLEN 20
+#else
+#  define IRQS_TOTALFMT "%12lu"
+#  define IRQS_TOTAL(t) ((unsigned long)(t))
+#  define IRQS_TOTALLEN (IRQS_ULONGLEN > 12 ? IRQS_ULONGLEN : 12)
+#endif
+
+/* Determines the size of an intermediate buffer that must be large enough
+ * to handle the longest line generated by this logic, including the
+ * newline and the NUL terminator.  The header line is 60 characters.  A
+ * data line holds the IRQ number, the COUNT, TOTAL, MAX, and AVG fields
+ * and one field for each histogram bucket, each preceded by a space.
+ */
+
+#define IRQS_HDRLEN  (60 + 2)
+#define IRQS_DATALEN (3 + 1 + IRQS_ULONGLEN + 1 + IRQS_TOTALLEN + 2 + \
+                      (2 + CONFIG_SCHED_IRQMONITOR_NBUCKETS) * \
+                      (1 + IRQS_ULONGLEN))
+#define IRQS_LINELEN (IRQS_DATALEN > IRQS_HDRLEN ? IRQS_DATALEN : IRQS_HDRLEN)
+
+/* Clamp the length reported by snprintf() to what was actually stored,
+ * always leaving room for the final newline.
+ */
+
+#define IRQS_MAXLINE (IRQS_LINELEN - 2)
+#define IRQS_CLAMP(n) ((n) > IRQS_MAXLINE ? IRQS_MAXLINE : (n))
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+/* This structure describes one open "file" */
+
+struct irqs_file_s
+{
+  struct procfs_file_s  base;   /* Base open file structure */
+  char line[IRQS_LINELEN];      /* Pre-allocated buffer for formatted lines */
+};
+
+/****************************************************************************
+ * Private Function Prototypes
+ ****************************************************************************/
+
+/* File system methods */
+
+static int     irqs_open(FAR struct file *filep, FAR const char *relpath,
+                 int oflags, mode_t mode);
+static int     irqs_close(FAR struct file *filep);
+static ssize_t irqs_read(FAR struct file *filep, FAR char *buffer,
+                 size_t buflen);
+static int     irqs_dup(FAR const struct file *oldp,
+                 FAR struct file *newp);
+static int     irqs_stat(FAR const char *relpath, FAR struct stat *buf);
+static int     irqs_ioctl(FAR struct file *filep, int cmd,
+                 unsigned long arg);
+
+/****************************************************************************
+ * Private Variables
+ ****************************************************************************/
+
+/****************************************************************************
+ * Public Data
+ ****************************************************************************/
+
+/* See fs_mount.c -- this structure is explicitly externed there.
+ * We use the old-fashioned kind of initializers so that this will compile
+ * with any compiler.
+ */
+
+const struct procfs_operations irqs_operations =
+{
+  irqs_open,          /* open */
+  irqs_close,         /* close */
+  irqs_read,          /* read */
+  NULL,               /* write */
+
+  irqs_dup,           /* dup */
+
+  NULL,               /* opendir */
+  NULL,               /* closedir */
+  NULL,               /* readdir */
+  NULL,               /* rewinddir */
+
+  irqs_stat,          /* stat */
+
+  irqs_ioctl          /* ioctl */
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: irqs_open
+ ****************************************************************************/
+
+static int irqs_open(FAR struct file *filep, FAR const char *relpath,
+                     int oflags, mode_t mode)
+{
+  FAR struct irqs_file_s *attr;
+
+  fvdbg("Open '%s'\n", relpath);
+
+  /* PROCFS is read-only.  Any attempt to open with any kind of write
+   * access is not permitted.  The statistics may be cleared with the
+   * FIOC_RESETSTATS ioctl command.
+   */
+
+  if ((oflags & O_WRONLY) != 0 || (oflags & O_RDONLY) == 0)
+    {
+      fdbg("ERROR: Only O_RDONLY supported\n");
+      return -EACCES;
+    }
+
+  /* "irqs" is the only acceptable value for the relpath */
+
+  if (strcmp(relpath, "irqs") != 0)
+    {
+      fdbg("ERROR: relpath is '%s'\n", relpath);
+      return -ENOENT;
+    }
+
+  /* Allocate a container to hold the file attributes */
+
+  attr = (FAR struct irqs_file_s *)kmm_zalloc(sizeof(struct irqs_file_s));
+  if (!attr)
+    {
+      fdbg("ERROR: Failed to allocate file attributes\n");
+      return -ENOMEM;
+    }
+
+  /* Save the attributes as the open-specific state in filep->f_priv */
+
+  filep->f_priv = (FAR void *)attr;
+  return OK;
+}
+
+/****************************************************************************
+ * Name: irqs_close
+ ****************************************************************************/
+
+static int irqs_close(FAR struct file *filep)
+{
+  FAR struct irqs_file_s *attr;
+
+  /* Recover our private data from the struct file instance */
+
+  attr = (FAR struct irqs_file_s *)filep->f_priv;
+  DEBUGASSERT(attr);
+
+  /* Release the file attributes structure */
+
+  kmm_free(attr);
+  filep->f_priv = NULL;
+  return OK;
+}
+
+/****************************************************************************
+ * Name: irqs_read
+ *
+ * Description:
+ *   Generate one header line followed by one line for each IRQ that has
+ *   been dispatched at least once:
+ *
+ *     IRQ COUNT TOTAL MAX AVG HIST[0] ... HIST[NBUCKETS-1]
+ *
+ ****************************************************************************/
+
+static ssize_t irqs_read(FAR struct file *filep, FAR char *buffer,
+                         size_t buflen)
+{
+  FAR struct irqs_file_s *attr;
+  struct irqmon_s stats;
+  size_t remaining;
+  size_t linesize;
+  size_t copysize;
+  size_t totalsize;
+  off_t offset;
+  int irq;
+  int i;
+
+  fvdbg("buffer=%p buflen=%d\n", buffer, (int)buflen);
+
+  /* Recover our private data from the struct file instance */
+
+  attr = (FAR struct irqs_file_s *)filep->f_priv;
+  DEBUGASSERT(attr);
+
+  remaining = buflen;
+  totalsize = 0;
+  offset    = filep->f_pos;
+
+  /* Generate the header line */
+
+  linesize  = snprintf(attr->line, IRQS_LINELEN, "%3s %10s %12s %10s %10s %s\n",
+                       "IRQ", "COUNT", "TOTAL", "MAX", "AVG", "HISTOGRAM");
+  linesize  = IRQS_CLAMP(linesize);
+  copysize  = procfs_memcpy(attr->line, linesize, buffer, remaining, &offset);
+
+  totalsize += copysize;
+  buffer    += copysize;
+  remaining -= copysize;
+
+  /* Then one line for each active IRQ */
+
+  for (irq = 0; irq < NR_IRQS && totalsize < buflen; irq++)
+    {
+      if (irq_getstats(irq, &stats) < 0 || stats.count == 0)
+        {
+          continue;
+        }
+
+      linesize = snprintf(attr->line, IRQS_MAXLINE + 1,
+                          "%3d %10lu " IRQS_TOTALFMT " %10lu %10lu",
+                          irq, (unsigned long)stats.count,
+                          IRQS_TOTAL(stats.total), (unsigned long)stats.max,
+                          (unsigned long)(stats.total / stats.count));
+      linesize = IRQS_CLAMP(linesize);
+
+      for (i = 0; i < CONFIG_SCHED_IRQMONITOR_NBUCKETS; i++)
+        {
+          linesize += snprintf(&attr->line[linesize],
+                               IRQS_MAXLINE + 1 - linesize,
+                               " %lu", (unsigned long)stats.hist[i]);
+          linesize  = IRQS_CLAMP(linesize);
+        }
+
+      attr->line[linesize++] = '\n';
+      copysize   = procfs_memcpy(attr->line, linesize, buffer, remaining,
+                                 &offset);
+
+      totalsize += copysize;
+      buffer    += copysize;
+      remaining -= copysize;
+    }
+
+  /* Update the file offset */
+
+  filep->f_pos += totalsize;
+  return totalsize;
+}
+
+/****************************************************************************
+ * Name: irqs_dup
+ *
+ * Description:
+ *   Duplicate open file data in the new file structure.
+ *
+ ****************************************************************************/
+
+static int irqs_dup(FAR const struct file *oldp, FAR struct file *newp)
+{
+  FAR struct irqs_file_s *oldattr;
+  FAR struct irqs_file_s *newattr;
+
+  fvdbg("Dup %p->%p\n", oldp, newp);
+
+  /* Recover our private data from the old struct file instance */
+
+  oldattr = (FAR struct irqs_file_s *)oldp->f_priv;
+  DEBUGASSERT(oldattr);
+
+  /* Allocate a new container to hold the task and attribute selection */
+
+  newattr = (FAR struct irqs_file_s *)kmm_malloc(sizeof(struct irqs_file_s));
+  if (!newattr)
+    {
+      fdbg("ERROR: Failed to allocate file attributes\n");
+      return -ENOMEM;
+    }
+
+  /* The copy the file attributes from the old attributes to the new */
+
+  memcpy(newattr, oldattr, sizeof(struct irqs_file_s));
+
+  /* Save the new attributes in the new file structure */
+
+  newp->f_priv = (FAR void *)newattr;
+  return OK;
+}
+
+/****************************************************************************
+ * Name: irqs_stat
+ *
+ * Description: Return information about a file or directory
+ *
+ ****************************************************************************/
+
+static int irqs_stat(FAR const char *relpath, FAR struct stat *buf)
+{
+  /* "irqs" is the only acceptable value for the relpath */
+
+  if (strcmp(relpath, "irqs") != 0)
+    {
+      fdbg("ERROR: relpath is '%s'\n", relpath);
+      return -ENOENT;
+    }
+
+  /* "irqs" is the name for a read-only file */
+
+  buf->st_mode    = S_IFREG | S_IROTH | S_IRGRP | S_IRUSR;
+  buf->st_size    = 0;
+  buf->st_blksize = 0;
+  buf->st_blocks  = 0;
+  return OK;
+}
+
+/****************************************************************************
+ * Name: irqs_ioctl
+ *
+ * Description:
+ *   FIOC_RESETSTATS clears the statistics of all IRQs.
+ *
+ ****************************************************************************/
+
+static int irqs_ioctl(FAR struct file *filep, int cmd, unsigned long arg)
+{
+  fvdbg("cmd: %d arg: %08lx\n", cmd, arg);
+
+  switch (cmd)
+    {
+      case FIOC_RESETSTATS:
+        irq_resetstats();
+        return OK;
+
+      default:
+        return -ENOTTY;
+    }
+}
+
+#endif /* CONFIG_SCHED_IRQMONITOR && !CONFIG_FS_PROCFS_EXCLUDE_IRQS */
+#endif /* !CONFIG_DISABLE_MOUNTPOINT && CONFIG_FS_PROCFS */
@@ -212,7 +212,9 @@ const struct procfs_operations proc_operations =
   proc_readdir,       /* readdir */
   proc_rewinddir,     /* rewinddir */
 
-  proc_stat           /* stat */
+  proc_stat,          /* stat */
+
+  NULL                /* ioctl */
 };
 
 /* These structures provide information about every node */
@@ -128,7 +128,9 @@ const struct procfs_operations uptime_operations =
   NULL,              /* readdir */
   NULL,              /* rewinddir */
 
-  uptime_stat        /* stat */
+  uptime_stat,       /* stat */
+
+  NULL               /* ioctl */
 };
 
 /****************************************************************************
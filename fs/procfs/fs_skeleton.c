@@ -146,7 +146,9 @@ const struct procfs_operations skel_procfsoperations =
   skel_readdir,    /* readdir */
   skel_rewinddir,  /* rewinddir */
 
-  skel_stat        /* stat */
+  skel_stat,       /* stat */
+
+  NULL             /* ioctl */
 };
 
 /****************************************************************************
@@ -384,11 +384,25 @@ static ssize_t romfs_read(FAR struct file *filep, FAR char *buffer,
       buflen = bytesleft;
     }
 
-  /* Loop until either (1) all data has been transferred, or (2) an
-   * error occurs.
+  /* In XIP mode, the file data is contiguous in directly accessible
+   * memory.  Copy all of it at once:  Sector boundaries do not matter.
    */
 
   readsize = 0;
+  if (rm->rm_xipbase)
+    {
+      memcpy(userbuffer,
+             &rm->rm_xipbase[rf->rf_startoffset + filep->f_pos], buflen);
+
+      filep->f_pos += buflen;
+      readsize      = buflen;
+      buflen        = 0;
+    }
+
+  /* Otherwise, loop until either (1) all data has been transferred, or (2)
+   * an error occurs.
+   */
+
   while (buflen > 0)
     {
       /* Get the first sector and index to read from. */
@@ -1043,6 +1057,7 @@ static int romfs_unbind(FAR void *handle, FAR struct inode **blkdriver,
           kmm_free(rm->rm_buffer);
         }
 
+      romfs_dirindexrelease(rm);
       sem_destroy(&rm->rm_sem);
       kmm_free(rm);
       return OK;
@@ -125,10 +125,44 @@
 
 #define ROMF_MAX_LINKS 64
 
+/* Directory index configuration */
+
+#ifdef CONFIG_FS_ROMFS_DIRINDEX
+#  ifndef CONFIG_FS_ROMFS_DIRINDEX_BUDGET
+#    define CONFIG_FS_ROMFS_DIRINDEX_BUDGET 16384
+#  endif
+#endif
+
 /****************************************************************************
  * Public Types
  ****************************************************************************/
 
+/* These structures describe the in-memory index of one directory.  Each
+ * file or directory in the directory is represented by the hash of its name
+ * and by the offset to its file header.  The mode, info and size values
+ * are those of the entry at the end of any chain of hard links so that the
+ * links do not have to be followed again.  The names are sorted by hash.
+ */
+
+#ifdef CONFIG_FS_ROMFS_DIRINDEX
+struct romfs_dirname_s
+{
+  uint32_t rn_hash;                 /* Hash of the name of the entry */
+  uint32_t rn_offset;               /* File header offset | resolved mode bits */
+  uint32_t rn_info;                 /* Directory: First entry; file: file header */
+  uint32_t rn_size;                 /* Size (if file) */
+};
+
+struct romfs_dirindex_s
+{
+  FAR struct romfs_dirindex_s *ri_flink; /* Next index, in order of last use */
+  uint32_t ri_diroffset;            /* Offset to the first entry of the directory */
+  uint32_t ri_nnames;               /* Number of names in ri_names[] */
+  bool     ri_failed;               /* true: The directory could not be indexed */
+  FAR struct romfs_dirname_s *ri_names; /* The names in the directory */
+};
+#endif
+
 /* This structure represents the overall mountpoint state.  An instance of this
  * structure is retained as inode private data on each mountpoint that is
  * mounted with a fat32 filesystem.
@@ -149,6 +183,10 @@ struct romfs_mountpt_s
   uint32_t rm_cachesector;          /* Current sector in the rm_buffer */
   uint8_t *rm_xipbase;              /* Base address of directly accessible media */
   uint8_t *rm_buffer;               /* Device sector buffer, allocated if rm_xipbase==0 */
+#ifdef CONFIG_FS_ROMFS_DIRINDEX
+  size_t   rm_dirindexsize;         /* RAM used by all directory indexes */
+  FAR struct romfs_dirindex_s *rm_dirindex; /* Indexes, most recent first */
+#endif
 };
 
 /* This structure represents on open file under the mountpoint.  An instance
@@ -203,6 +241,8 @@ extern "C"
 
 void romfs_semtake(FAR struct romfs_mountpt_s *rm);
 void romfs_semgive(FAR struct romfs_mountpt_s *rm);
+uint32_t romfs_devread32(FAR struct romfs_mountpt_s *rm, int ndx);
+int16_t romfs_devcacheread(FAR struct romfs_mountpt_s *rm, uint32_t offset);
 int  romfs_hwread(FAR struct romfs_mountpt_s *rm, FAR uint8_t *buffer,
        uint32_t sector, unsigned int nsectors);
 int  romfs_filecacheread(FAR struct romfs_mountpt_s *rm,
@@ -223,6 +263,18 @@ int  romfs_parsefilename(FAR struct romfs_mountpt_s *rm, uint32_t offset,
 int  romfs_datastart(FAR struct romfs_mountpt_s *rm, uint32_t offset,
        FAR uint32_t *start);
 
+/* Directory index */
+
+#ifdef CONFIG_FS_ROMFS_DIRINDEX
+int  romfs_dirindexlookup(FAR struct romfs_mountpt_s *rm,
+       FAR const char *entryname, int entrylen,
+       FAR struct romfs_dirinfo_s *dirinfo);
+void romfs_dirindexrelease(FAR struct romfs_mountpt_s *rm);
+#else
+#  define romfs_dirindexlookup(rm,n,l,d) (-ENOSYS)
+#  define romfs_dirindexrelease(rm)
+#endif
+
 #undef EXTERN
 #if defined(__cplusplus)
 }
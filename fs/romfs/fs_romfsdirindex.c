@@ -0,0 +1,525 @@
+/****************************************************************************
+ * fs/romfs/fs_romfsdirindex.c
+ *
+ *   Copyright (C) 2016 Gregory Nutt. All rights reserved.
+ *   Author: Gregory Nutt <gnutt@nuttx.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * The directory index.
+ *
+ * A ROMFS directory is a linked list of file headers.  Finding a name means
+ * following that list from the first header, reading every header and
+ * name (and following any hard links) until the name is found.  In
+ * directories with thousands of entries this dominates the time taken by
+ * open(), stat() and opendir().
+ *
+ * When CONFIG_FS_ROMFS_DIRINDEX is selected, a directory is read completely
+ * the first time that it is searched.  The hash of each name is recorded,
+ * together with the offset to its file header and the mode, info and size
+ * values found at the end of any hard links.  Later searches only read the
+ * header and name of the (rare) entries whose hash matches.  A name whose
+ * hash is not present cannot exist in the directory.
+ *
+ * The volume is read-only, so an index never becomes stale.  The total RAM
+ * used by the indexes of a volume is limited to
+ * CONFIG_FS_ROMFS_DIRINDEX_BUDGET bytes.  The least recently used indexes
+ * are discarded to stay within that budget.
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <debug.h>
+
+#include <nuttx/kmalloc.h>
+#include <nuttx/fs/dirent.h>
+
+#include "fs_romfs.h"
+
+#ifdef CONFIG_FS_ROMFS_DIRINDEX
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* The RAM used by an index with 'n' names */
+
+#define DIRINDEX_SIZE(n) \
+  (sizeof(struct romfs_dirindex_s) + (n) * sizeof(struct romfs_dirname_s))
+
+/* The largest number of names that fits into the budget */
+
+#define DIRINDEX_MAXNAMES \
+  ((CONFIG_FS_ROMFS_DIRINDEX_BUDGET - sizeof(struct romfs_dirindex_s)) / \
+   sizeof(struct romfs_dirname_s))
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: romfs_dirindexhash
+ *
+ * Description:
+ *   Hash a name (FNV-1a).
+ *
+ ****************************************************************************/
+
+static uint32_t romfs_dirindexhash(FAR const char *name, int len)
+{
+  uint32_t hash = 2166136261u;
+
+  while (len-- > 0)
+    {
+      hash ^= (uint8_t)*name++;
+      hash *= 16777619u;
+    }
+
+  return hash;
+}
+
+/****************************************************************************
+ * Name: romfs_dirindexcompare
+ *
+ * Description:
+ *   qsort() comparison function:  Order names by hash, then by offset.
+ *
+ ****************************************************************************/
+
+static int romfs_dirindexcompare(FAR const void *a, FAR const void *b)
+{
+  FAR const struct romfs_dirname_s *na;
+  FAR const struct romfs_dirname_s *nb;
+
+  na = (FAR const struct romfs_dirname_s *)a;
+  nb = (FAR const struct romfs_dirname_s *)b;
+
+  if (na->rn_hash != nb->rn_hash)
+    {
+      return na->rn_hash < nb->rn_hash ? -1 : 1;
+    }
+
+  if (na->rn_offset != nb->rn_offset)
+    {
+      return na->rn_offset < nb->rn_offset ? -1 : 1;
+    }
+
+  return 0;
+}
+
+/****************************************************************************
+ * Name: romfs_dirindexbuild
+ *
+ * Description:
+ *   Read the whole directory starting at ri->ri_diroffset and record every
+ *   file and directory in it.  This follows the same rules as
+ *   romfs_searchdir() so that the index finds exactly what a search of the
+ *   directory would find.
+ *
+ ****************************************************************************/
+
+static int romfs_dirindexbuild(FAR struct romfs_mountpt_s *rm,
+                               FAR struct romfs_dirindex_s *ri)
+{
+  FAR struct romfs_dirname_s *names;
+  FAR struct romfs_dirname_s *name;
+  char     entryname[NAME_MAX+1];
+  uint32_t maxnames = 0;
+  uint32_t newsize;
+  uint32_t offset;
+  uint32_t linkoffset;
+  uint32_t next;
+  uint32_t mode;
+  uint32_t info;
+  uint32_t size;
+  int16_t  ndx;
+  int      ret;
+
+  offset = ri->ri_diroffset;
+  do
+    {
+      /* Get the offset to the next entry of this directory */
+
+      ndx = romfs_devcacheread(rm, offset);
+      if (ndx < 0)
+        {
+          return ndx;
+        }
+
+      next = romfs_devread32(rm, ndx + ROMFS_FHDR_NEXT) & RFNEXT_OFFSETMASK;
+
+      /* Get the entry at the end of any hard links */
+
+      ret = romfs_parsedirentry(rm, offset, &linkoffset, &mode, &info,
+                                &size);
+      if (ret < 0)
+        {
+          return ret;
+        }
+
+      /* Only files and directories can be found by romfs_searchdir() */
+
+      if (IS_DIRECTORY(mode) || IS_FILE(mode))
+        {
+          if (ri->ri_nnames >= maxnames)
+            {
+              if (maxnames >= DIRINDEX_MAXNAMES)
+                {
+                  return -E2BIG;
+                }
+
+              newsize = maxnames ? 2 * maxnames : 16;
+              if (newsize > DIRINDEX_MAXNAMES)
+                {
+                  newsize = DIRINDEX_MAXNAMES;
+                }
+
+              names = (FAR struct romfs_dirname_s *)
+                kmm_realloc(ri->ri_names,
+                            newsize * sizeof(struct romfs_dirname_s));
+              if (!names)
+                {
+                  return -ENOMEM;
+                }
+
+              ri->ri_names = names;
+              maxnames     = newsize;
+            }
+
+          ret = romfs_parsefilename(rm, offset, entryname);
+          if (ret < 0)
+            {
+              return ret;
+            }
+
+          name            = &ri->ri_names[ri->ri_nnames++];
+          name->rn_hash   = romfs_dirindexhash(entryname, strlen(entryname));
+          name->rn_offset = offset | (mode & RFNEXT_ALLMODEMASK);
+          name->rn_info   = IS_DIRECTORY(mode) ? info : linkoffset;
+          name->rn_size   = size;
+        }
+
+      offset = next;
+    }
+  while (next != 0);
+
+  /* Release the unused part of the allocation */
+
+  if (ri->ri_nnames == 0)
+    {
+      if (ri->ri_names)
+        {
+          kmm_free(ri->ri_names);
+          ri->ri_names = NULL;
+        }
+    }
+  else if (ri->ri_nnames < maxnames)
+    {
+      names = (FAR struct romfs_dirname_s *)
+        kmm_realloc(ri->ri_names,
+                    ri->ri_nnames * sizeof(struct romfs_dirname_s));
+      if (names)
+        {
+          ri->ri_names = names;
+        }
+    }
+
+  /* Sort the names by hash so that they can be found by binary search */
+
+  qsort(ri->ri_names, ri->ri_nnames, sizeof(struct romfs_dirname_s),
+        romfs_dirindexcompare);
+  return OK;
+}
+
+/****************************************************************************
+ * Name: romfs_dirindexfree
+ *
+ * Description:
+ *   Free the least recently used index.
+ *
+ ****************************************************************************/
+
+static void romfs_dirindexfree(FAR struct romfs_mountpt_s *rm)
+{
+  FAR struct romfs_dirindex_s *prev = NULL;
+  FAR struct romfs_dirindex_s *ri;
+
+  ri = rm->rm_dirindex;
+  if (!ri)
+    {
+      return;
+    }
+
+  while (ri->ri_flink)
+    {
+      prev = ri;
+      ri   = ri->ri_flink;
+    }
+
+  if (prev)
+    {
+      prev->ri_flink = NULL;
+    }
+  else
+    {
+      rm->rm_dirindex = NULL;
+    }
+
+  rm->rm_dirindexsize -= DIRINDEX_SIZE(ri->ri_nnames);
+  if (ri->ri_names)
+    {
+      kmm_free(ri->ri_names);
+    }
+
+  kmm_free(ri);
+}
+
+/****************************************************************************
+ * Name: romfs_dirindexget
+ *
+ * Description:
+ *   Return the index of the directory whose first entry is at 'diroffset',
+ *   building it if necessary.  The index becomes the most recently used.
+ *
+ ****************************************************************************/
+
+static FAR struct romfs_dirindex_s *
+romfs_dirindexget(FAR struct romfs_mountpt_s *rm, uint32_t diroffset)
+{
+  FAR struct romfs_dirindex_s *prev;
+  FAR struct romfs_dirindex_s *ri;
+  int ret;
+
+  /* Is there already an index for this directory? */
+
+  for (prev = NULL, ri = rm->rm_dirindex;
+       ri && ri->ri_diroffset != diroffset;
+       prev = ri, ri = ri->ri_flink);
+
+  if (ri)
+    {
+      /* Yes.. move it to the head of the list */
+
+      if (prev)
+        {
+          prev->ri_flink  = ri->ri_flink;
+          ri->ri_flink    = rm->rm_dirindex;
+          rm->rm_dirindex = ri;
+        }
+
+      return ri;
+    }
+
+  /* No.. build one */
+
+  ri = (FAR struct romfs_dirindex_s *)
+    kmm_zalloc(sizeof(struct romfs_dirindex_s));
+  if (!ri)
+    {
+      return NULL;
+    }
+
+  ri->ri_diroffset = diroffset;
+  ret = romfs_dirindexbuild(rm, ri);
+  if (ret < 0)
+    {
+      /* The directory is too large for the budget, memory is short, or the
+       * directory could not be read.  Remember that so that the directory
+       * is not read again each time it is searched; it will simply be
+       * searched as before.
+       */
+
+      fvdbg("Directory at %08x not indexed: %d\n", diroffset, ret);
+
+      if (ri->ri_names)
+        {
+          kmm_free(ri->ri_names);
+          ri->ri_names = NULL;
+        }
+
+      ri->ri_nnames = 0;
+      ri->ri_failed = true;
+    }
+
+  /* Discard the least recently used indexes to stay within the budget */
+
+  while (rm->rm_dirindex &&
+         rm->rm_dirindexsize + DIRINDEX_SIZE(ri->ri_nnames) >
+         CONFIG_FS_ROMFS_DIRINDEX_BUDGET)
+    {
+      romfs_dirindexfree(rm);
+    }
+
+  rm->rm_dirindexsize += DIRINDEX_SIZE(ri->ri_nnames);
+  ri->ri_flink         = rm->rm_dirindex;
+  rm->rm_dirindex      = ri;
+  return ri;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: romfs_dirindexlookup
+ *
+ * Description:
+ *   Search the directory beginning at dirinfo->rd_dir.fr_firstoffset for
+ *   entryname using the index of that directory.  On success, dirinfo is
+ *   set up just as by romfs_searchdir().
+ *
+ * Returned Value:
+ *   OK if the name was found, -ENOENT if it is not in the directory,
+ *   -ENOSYS if the directory could not be indexed (it must then be searched
+ *   in the usual way), or another negated errno value on a read failure.
+ *
+ ****************************************************************************/
+
+int romfs_dirindexlookup(FAR struct romfs_mountpt_s *rm,
+                         FAR const char *entryname, int entrylen,
+                         FAR struct romfs_dirinfo_s *dirinfo)
+{
+  FAR struct romfs_dirindex_s *ri;
+  FAR struct romfs_dirname_s *name;
+  char     filename[NAME_MAX+1];
+  uint32_t hash;
+  uint32_t offset;
+  uint32_t next;
+  uint32_t lo;
+  uint32_t hi;
+  uint32_t mid;
+  int16_t  ndx;
+  int      ret;
+
+  ri = romfs_dirindexget(rm, dirinfo->rd_dir.fr_firstoffset);
+  if (!ri || ri->ri_failed)
+    {
+      return -ENOSYS;
+    }
+
+  /* Find the first name with a matching hash */
+
+  hash = romfs_dirindexhash(entryname, entrylen);
+  lo   = 0;
+  hi   = ri->ri_nnames;
+
+  while (lo < hi)
+    {
+      mid = (lo + hi) >> 1;
+      if (ri->ri_names[mid].rn_hash < hash)
+        {
+          lo = mid + 1;
+        }
+      else
+        {
+          hi = mid;
+        }
+    }
+
+  /* Then check the names of all entries with that hash */
+
+  for (; lo < ri->ri_nnames && ri->ri_names[lo].rn_hash == hash; lo++)
+    {
+      name   = &ri->ri_names[lo];
+      offset = name->rn_offset & RFNEXT_OFFSETMASK;
+
+      ndx = romfs_devcacheread(rm, offset);
+      if (ndx < 0)
+        {
+          return ndx;
+        }
+
+      next = romfs_devread32(rm, ndx + ROMFS_FHDR_NEXT);
+
+      ret = romfs_parsefilename(rm, offset, filename);
+      if (ret < 0)
+        {
+          return ret;
+        }
+
+      if (memcmp(entryname, filename, entrylen) == 0 &&
+          strlen(filename) == entrylen)
+        {
+          /* Found it -- return the resolved values, as romfs_checkentry()
+           * would have.
+           */
+
+          if (IS_DIRECTORY(name->rn_offset))
+            {
+              dirinfo->rd_dir.fr_firstoffset = name->rn_info;
+              dirinfo->rd_dir.fr_curroffset  = name->rn_info;
+              dirinfo->rd_size               = 0;
+            }
+          else
+            {
+              dirinfo->rd_dir.fr_curroffset  = name->rn_info;
+              dirinfo->rd_size               = name->rn_size;
+            }
+
+          dirinfo->rd_next = (next & RFNEXT_OFFSETMASK) |
+                             (name->rn_offset & RFNEXT_ALLMODEMASK);
+          return OK;
+        }
+    }
+
+  return -ENOENT;
+}
+
+/****************************************************************************
+ * Name: romfs_dirindexrelease
+ *
+ * Description:
+ *   Free all directory indexes of the volume (when it is unmounted).
+ *
+ ****************************************************************************/
+
+void romfs_dirindexrelease(FAR struct romfs_mountpt_s *rm)
+{
+  while (rm->rm_dirindex)
+    {
+      romfs_dirindexfree(rm);
+    }
+
+  DEBUGASSERT(rm->rm_dirindexsize == 0);
+}
+
+#endif /* CONFIG_FS_ROMFS_DIRINDEX */
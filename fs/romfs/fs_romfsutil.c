@@ -104,7 +104,7 @@ static inline uint32_t romfs_swap32(uint32_t value)
  *
  ****************************************************************************/
 
-static uint32_t romfs_devread32(struct romfs_mountpt_s *rm, int ndx)
+uint32_t romfs_devread32(struct romfs_mountpt_s *rm, int ndx)
 {
   /* Extract the value */
 
@@ -311,6 +311,14 @@ static inline int romfs_searchdir(struct romfs_mountpt_s *rm,
   int16_t  ndx;
   int      ret;
 
+  /* Use the directory index if there is one (or if one can be built) */
+
+  ret = romfs_dirindexlookup(rm, entryname, entrylen, dirinfo);
+  if (ret != -ENOSYS)
+    {
+      return ret;
+    }
+
   /* Then loop through the current directory until the directory
    * with the matching name is found.  Or until all of the entries
    * the directory have been examined.
@@ -842,6 +850,16 @@ int romfs_parsedirentry(struct romfs_mountpt_s *rm, uint32_t offset,
       return ret;
     }
 
+  /* The sector cache now holds the real file header, which may be in a
+   * different sector.
+   */
+
+  ndx = romfs_devcacheread(rm, *poffset);
+  if (ndx < 0)
+    {
+      return ndx;
+    }
+
   /* Because everything is chunked and aligned to 16-bit boundaries,
    * we know that most the basic node info fits into the sector.  The
    * associated name may not, however.
@@ -201,6 +201,17 @@
 #  define CONFIG_SMARTFS_DIRDEPTH 8
 #endif
 
+/* Directory cache */
+
+#ifdef CONFIG_SMARTFS_DIRCACHE
+#  ifndef CONFIG_SMARTFS_DIRCACHE_DIRS
+#    define CONFIG_SMARTFS_DIRCACHE_DIRS 4
+#  endif
+#  ifndef CONFIG_SMARTFS_DIRCACHE_ENTRIES
+#    define CONFIG_SMARTFS_DIRCACHE_ENTRIES 512
+#  endif
+#endif
+
 /* Buffer flags (when CRC enabled) */
 
 #define SMARTFS_BFLAG_DIRTY       0x01    /* Set if data changed in the sector */
@@ -284,6 +295,45 @@ struct smartfs_chain_header_s
 };
 #endif
 
+/* This structure describes one active entry of a cached directory:  a hash
+ * of the entry name and where the entry is stored in the directory's sector
+ * chain.
+ */
+
+#ifdef CONFIG_SMARTFS_DIRCACHE
+struct smartfs_dcentry_s
+{
+  uint16_t          hash;         /* Hash of the entry name */
+  uint16_t          sector;       /* Sector holding the entry */
+  uint16_t          offset;       /* Offset of the entry in the sector */
+};
+
+/* This structure caches the active entries of one directory so that a name
+ * can be found without reading the whole sector chain of the directory.
+ */
+
+struct smartfs_dircache_s
+{
+  uint16_t          dirsector;    /* 1st sector of the directory, 0 if unused */
+  uint16_t          nentries;     /* Number of entries cached */
+  uint16_t          maxentries;   /* Number of entries allocated */
+  uint16_t          stamp;        /* When the directory was last used */
+  FAR struct smartfs_dcentry_s *entries;
+};
+
+/* This structure remembers the last position reached in the sector chain
+ * of a file, so that finding the length of the file and seeking in it can
+ * resume from there instead of from the 1st sector.
+ */
+
+struct smartfs_chainpos_s
+{
+  uint16_t          firstsector;  /* 1st sector of the file, 0 if unused */
+  uint16_t          sector;       /* A sector in the chain of the file */
+  uint32_t          pos;          /* File position of that sector's data */
+};
+#endif
+
 /* This structure describes the state of one open file.  This structure
  * is protected by the volume semaphore.
  */
@@ -294,6 +344,12 @@ struct smartfs_ofile_s
 #ifdef CONFIG_SMARTFS_USE_SECTOR_BUFFER
   uint8_t*                  buffer;     /* Sector buffer to reduce writes */
   uint8_t                   bflags;     /* Buffer flags */
+#endif
+#ifdef CONFIG_SMARTFS_WRITE_COMBINE
+  uint8_t                  *wcbuffer;   /* Copy of wcsector up to curroffset,
+                                         * including appended data not yet
+                                         * written (NULL if opened read only) */
+  uint16_t                  wcsector;   /* Sector held in wcbuffer */
 #endif
   int16_t                   crefs;      /* Reference count */
   mode_t                    oflags;     /* Open mode */
@@ -327,6 +383,11 @@ struct smartfs_mountpt_s
   char                       *fs_rwbuffer;  /* Read/Write working buffer */
   char                       *fs_workbuffer;/* Working buffer */
   uint8_t                     fs_rootsector;/* Root directory sector num */
+#ifdef CONFIG_SMARTFS_DIRCACHE
+  uint16_t                    fs_dcstamp;   /* Directory cache use counter */
+  struct smartfs_chainpos_s   fs_chainpos;  /* Last file chain position */
+  struct smartfs_dircache_s   fs_dircache[CONFIG_SMARTFS_DIRCACHE_DIRS];
+#endif
 };
 
 /****************************************************************************
@@ -371,6 +432,17 @@ int smartfs_countdirentries(struct smartfs_mountpt_s *fs,
 int smartfs_truncatefile(struct smartfs_mountpt_s *fs,
         struct smartfs_entry_s *entry, FAR struct smartfs_ofile_s *sf);
 
+#ifdef CONFIG_SMARTFS_DIRCACHE
+void smartfs_dircache_remove(struct smartfs_mountpt_s *fs,
+        uint16_t dirsector, uint16_t sector, uint16_t offset);
+
+void smartfs_chainpos_save(struct smartfs_mountpt_s *fs,
+        uint16_t firstsector, uint16_t sector, uint32_t pos);
+
+void smartfs_chainpos_drop(struct smartfs_mountpt_s *fs,
+        uint16_t firstsector);
+#endif
+
 uint16_t smartfs_rdle16(FAR const void *val);
 
 void smartfs_wrle16(void *dest, uint16_t val);
@@ -196,7 +196,9 @@ const struct procfs_operations smartfs_procfsoperations =
   smartfs_readdir,    /* readdir */
   smartfs_rewinddir,  /* rewinddir */
 
-  smartfs_stat        /* stat */
+  smartfs_stat,       /* stat */
+
+  NULL                /* ioctl */
 };
 
 /****************************************************************************
@@ -213,6 +213,23 @@ static int smartfs_open(FAR struct file *filep, const char *relpath,
   sf->bflags = 0;
 #endif  /* CONFIG_SMARTFS_USE_SECTOR_BUFFER */
 
+#ifdef CONFIG_SMARTFS_WRITE_COMBINE
+  /* Allocate a buffer to collect appended data if opened for writing */
+
+  sf->wcbuffer = NULL;
+  sf->wcsector = SMARTFS_ERASEDSTATE_16BIT;
+  if ((oflags & O_WROK) != 0)
+    {
+      sf->wcbuffer = (uint8_t *) kmm_malloc(fs->fs_llformat.availbytes);
+      if (sf->wcbuffer == NULL)
+        {
+          kmm_free(sf);
+          ret = -ENOMEM;
+          goto errout_with_semaphore;
+        }
+    }
+#endif
+
   sf->entry.name = NULL;
   ret = smartfs_finddirentry(fs, &sf->entry, relpath, &parentdirsector,
                              &filename);
@@ -349,6 +366,13 @@ errout_with_buffer:
       sf->entry.name = NULL;
     }
 
+#ifdef CONFIG_SMARTFS_WRITE_COMBINE
+  if (sf->wcbuffer)
+    {
+      kmm_free(sf->wcbuffer);
+    }
+#endif
+
   kmm_free(sf);
 
 errout_with_semaphore:
@@ -451,6 +475,13 @@ static int smartfs_close(FAR struct file *filep)
     }
 #endif
 
+#ifdef CONFIG_SMARTFS_WRITE_COMBINE
+  if (sf->wcbuffer)
+    {
+      kmm_free(sf->wcbuffer);
+    }
+#endif
+
   kmm_free(sf);
 
 okout:
@@ -563,6 +594,11 @@ static ssize_t smartfs_read(FAR struct file *filep, char *buffer, size_t buflen)
           sf->currsector = SMARTFS_NEXTSECTOR(header);
           sf->curroffset = sizeof(struct smartfs_chain_header_s);
 
+#ifdef CONFIG_SMARTFS_DIRCACHE
+          smartfs_chainpos_save(fs, sf->entry.firstsector, sf->currsector,
+                                sf->filepos);
+#endif
+
           /* Test if at end of data */
 
           if (sf->currsector == SMARTFS_ERASEDSTATE_16BIT)
@@ -596,6 +632,9 @@ static int smartfs_sync_internal(struct smartfs_mountpt_s *fs,
 {
   struct smart_read_write_s readwrite;
   struct smartfs_chain_header_s *header;
+#ifdef CONFIG_SMARTFS_WRITE_COMBINE
+  uint16_t used;
+#endif
   int ret = OK;
 
 #ifdef CONFIG_SMARTFS_USE_SECTOR_BUFFER
@@ -629,6 +668,48 @@ static int smartfs_sync_internal(struct smartfs_mountpt_s *fs,
       sf->byteswritten = 0;
       sf->bflags = 0;
     }
+#elif defined(CONFIG_SMARTFS_WRITE_COMBINE)
+
+  /* Test if there is appended data in the buffer that has not been
+   * written yet.  It is written together with the start of the sector
+   * (rewritten unchanged) so that the used bytes field and any new
+   * chain link go out in the same write.
+   */
+
+  if (sf->byteswritten > 0)
+    {
+      fvdbg("Syncing sector %d\n", sf->currsector);
+
+      /* Update the header with the number of bytes written */
+
+      header = (struct smartfs_chain_header_s *) sf->wcbuffer;
+      used = *((uint16_t *) header->used);
+      if (*((uint16_t *) header->used) == SMARTFS_ERASEDSTATE_16BIT)
+        {
+          *((uint16_t *) header->used) = sf->byteswritten;
+        }
+      else
+        {
+          *((uint16_t *) header->used) += sf->byteswritten;
+        }
+
+      readwrite.logsector = sf->currsector;
+      readwrite.offset = 0;
+      readwrite.count = sf->curroffset;
+      readwrite.buffer = sf->wcbuffer;
+      ret = FS_IOCTL(fs, BIOC_WRITESECT, (unsigned long) &readwrite);
+      if (ret < 0)
+        {
+          fdbg("Error %d writing sector %d data\n", ret, sf->currsector);
+
+          /* Keep the data so that the write can be retried */
+
+          *((uint16_t *) header->used) = used;
+          goto errout;
+        }
+
+      sf->byteswritten = 0;
+    }
 #else  /* CONFIG_SMARTFS_USE_SECTOR_BUFFER */
 
   /* Test if we have written bytes to the current sector that
@@ -734,6 +815,17 @@ static ssize_t smartfs_write(FAR struct file *filep, const char *buffer,
       goto errout_with_semaphore;
     }
 
+#ifdef CONFIG_SMARTFS_DIRCACHE
+  /* Writing before the remembered chain position may change the used
+   * byte counts of the sectors leading up to it.
+   */
+
+  if (sf->filepos <= fs->fs_chainpos.pos)
+    {
+      smartfs_chainpos_drop(fs, sf->entry.firstsector);
+    }
+#endif
+
   /* First test if we are overwriting an existing location or writing to
    * a new one. */
 
@@ -771,6 +863,12 @@ static ssize_t smartfs_write(FAR struct file *filep, const char *buffer,
 
       if (readwrite.count > 0)
         {
+#ifdef CONFIG_SMARTFS_WRITE_COMBINE
+          /* The buffered copy of the sector becomes stale */
+
+          sf->wcsector = SMARTFS_ERASEDSTATE_16BIT;
+#endif
+
           ret = FS_IOCTL(fs, BIOC_WRITESECT, (unsigned long) &readwrite);
           if (ret < 0)
             {
@@ -830,6 +928,36 @@ static ssize_t smartfs_write(FAR struct file *filep, const char *buffer,
       memcpy(&sf->buffer[sf->curroffset], &buffer[byteswritten], readwrite.count);
       sf->bflags |= SMARTFS_BFLAG_DIRTY;
 
+#elif defined(CONFIG_SMARTFS_WRITE_COMBINE)
+      /* Before buffering data for a sector, read in what is already in
+       * it so that the sector can later be written from its start.
+       */
+
+      if (sf->wcsector != sf->currsector)
+        {
+          readwrite.logsector = sf->currsector;
+          readwrite.offset = 0;
+          readwrite.count = sf->curroffset;
+          readwrite.buffer = sf->wcbuffer;
+          ret = FS_IOCTL(fs, BIOC_READSECT, (unsigned long) &readwrite);
+          if (ret < 0)
+            {
+              fdbg("Error %d reading sector %d data\n", ret, sf->currsector);
+              goto errout_with_semaphore;
+            }
+
+          sf->wcsector = sf->currsector;
+        }
+
+      readwrite.count = fs->fs_llformat.availbytes - sf->curroffset;
+      if (readwrite.count > buflen)
+        {
+          readwrite.count = buflen;
+        }
+
+      memcpy(&sf->wcbuffer[sf->curroffset], &buffer[byteswritten],
+             readwrite.count);
+
 #else  /* CONFIG_SMARTFS_USE_SECTOR_BUFFER */
       readwrite.offset = sf->curroffset;
       readwrite.logsector = sf->currsector;
@@ -909,6 +1037,64 @@ static ssize_t smartfs_write(FAR struct file *filep, const char *buffer,
           memset(sf->buffer, CONFIG_SMARTFS_ERASEDSTATE, fs->fs_llformat.availbytes);
           header->type = SMARTFS_DIRENT_TYPE_FILE;
         }
+#elif defined(CONFIG_SMARTFS_WRITE_COMBINE)
+
+      /* A full sector is held until more data follows it, so that the
+       * link to the next sector can be written along with it.
+       */
+
+      if (sf->curroffset == fs->fs_llformat.availbytes && buflen > 0)
+        {
+          ret = FS_IOCTL(fs, BIOC_ALLOCSECT, 0xFFFF);
+          if (ret < 0)
+            {
+              fdbg("Error %d allocating new sector\n", ret);
+              goto errout_with_semaphore;
+            }
+
+          header = (struct smartfs_chain_header_s *) sf->wcbuffer;
+          *((uint16_t *) header->nextsector) = (uint16_t) ret;
+
+          if (sf->byteswritten > 0)
+            {
+              /* Write the data, used bytes and chain link in one go */
+
+              ret = smartfs_sync_internal(fs, sf);
+            }
+          else
+            {
+              /* The data is already on the FLASH.  Just add the link */
+
+              readwrite.logsector = sf->currsector;
+              readwrite.offset = offsetof(struct smartfs_chain_header_s,
+                nextsector);
+              readwrite.buffer = (uint8_t *) header->nextsector;
+              readwrite.count = sizeof(uint16_t);
+              ret = FS_IOCTL(fs, BIOC_WRITESECT, (unsigned long) &readwrite);
+            }
+
+          if (ret < 0)
+            {
+              fdbg("Error %d writing next sector\n", ret);
+              *((uint16_t *) header->nextsector) = SMARTFS_ERASEDSTATE_16BIT;
+              goto errout_with_semaphore;
+            }
+
+          if (sf->currsector == SMARTFS_NEXTSECTOR(header))
+            {
+              /* Error allocating logical sector! */
+
+              fdbg("Error - duplicate logical sector %d\n", sf->currsector);
+            }
+
+          /* Continue in the new (still erased) sector */
+
+          sf->currsector = SMARTFS_NEXTSECTOR(header);
+          sf->curroffset = sizeof(struct smartfs_chain_header_s);
+          memset(sf->wcbuffer, CONFIG_SMARTFS_ERASEDSTATE,
+                 sizeof(struct smartfs_chain_header_s));
+          sf->wcsector = sf->currsector;
+        }
 #else  /* CONFIG_SMARTFS_USE_SECTOR_BUFFER */
 
       if (sf->curroffset == fs->fs_llformat.availbytes)
@@ -1072,6 +1258,17 @@ static off_t smartfs_seek_internal(struct smartfs_mountpt_s *fs,
       sf->filepos = 0;
     }
 
+#ifdef CONFIG_SMARTFS_DIRCACHE
+  /* Start from the remembered position in the chain if that is closer */
+
+  if (fs->fs_chainpos.firstsector == sf->entry.firstsector &&
+      fs->fs_chainpos.pos > sf->filepos && fs->fs_chainpos.pos <= newpos)
+    {
+      sf->currsector = fs->fs_chainpos.sector;
+      sf->filepos = fs->fs_chainpos.pos;
+    }
+#endif
+
   header = (struct smartfs_chain_header_s *) fs->fs_rwbuffer;
   while ((sf->currsector != SMARTFS_ERASEDSTATE_16BIT) &&
       (sf->filepos + fs->fs_llformat.availbytes -
@@ -1096,6 +1293,11 @@ static off_t smartfs_seek_internal(struct smartfs_mountpt_s *fs,
       sf->filepos += SMARTFS_USED(header);
     }
 
+#ifdef CONFIG_SMARTFS_DIRCACHE
+  smartfs_chainpos_save(fs, sf->entry.firstsector, sf->currsector,
+                        sf->filepos);
+#endif
+
 #ifdef CONFIG_SMARTFS_USE_SECTOR_BUFFER
 
   /* When using sector buffering, we must read in the last buffer to our
@@ -1210,6 +1412,14 @@ static int smartfs_sync(FAR struct file *filep)
   smartfs_semtake(fs);
 
   ret = smartfs_sync_internal(fs, sf);
+  if (ret >= 0)
+    {
+      /* Let the block driver bring its own state on the media up to date.
+       * Not every driver supports this, so the result is ignored.
+       */
+
+      (void)FS_IOCTL(fs, BIOC_FLUSH, 0);
+    }
 
   smartfs_semgive(fs);
   return ret;
@@ -2035,6 +2245,11 @@ int smartfs_rename(struct inode *mountpt, const char *oldrelpath,
           fdbg("Error %d writing flag bytes for sector %d\n", ret, readwrite.logsector);
           goto errout_with_semaphore;
         }
+
+#ifdef CONFIG_SMARTFS_DIRCACHE
+      smartfs_dircache_remove(fs, oldentry.dfirst, oldentry.dsector,
+                              oldentry.doffset);
+#endif
     }
   else
     {
@@ -60,6 +60,10 @@
  * Pre-processor Definitions
  ****************************************************************************/
 
+/* Value of nentries marking a directory that is too big to be cached */
+
+#define SMARTFS_DIRCACHE_TOOBIG   0xFFFF
+
 /****************************************************************************
  * Private Types
  ****************************************************************************/
@@ -85,6 +89,380 @@ static struct smartfs_mountpt_s *g_mounthead = NULL;
  * Private Functions
  ****************************************************************************/
 
+/****************************************************************************
+ * Name: smartfs_isactive
+ *
+ * Description: Tests if a directory entry is in use and active.
+ *
+ ****************************************************************************/
+
+static bool smartfs_isactive(FAR struct smartfs_entry_header_s *entry)
+{
+  uint16_t flags;
+
+#ifdef CONFIG_SMARTFS_ALIGNED_ACCESS
+  flags = smartfs_rdle16(&entry->flags);
+#else
+  flags = entry->flags;
+#endif
+
+  return ((flags & SMARTFS_DIRENT_EMPTY) !=
+          (SMARTFS_ERASEDSTATE_16BIT & SMARTFS_DIRENT_EMPTY)) &&
+         ((flags & SMARTFS_DIRENT_ACTIVE) ==
+          (SMARTFS_ERASEDSTATE_16BIT & SMARTFS_DIRENT_ACTIVE));
+}
+
+/****************************************************************************
+ * Name: smartfs_namehash
+ *
+ * Description: Hashes an entry name (FNV-1a folded to 16 bits).  Like the
+ *              name compare, only the first namesize characters count.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_SMARTFS_DIRCACHE
+static uint16_t smartfs_namehash(FAR struct smartfs_mountpt_s *fs,
+                                 FAR const char *name)
+{
+  uint32_t hash = 2166136261u;
+  uint16_t x;
+
+  for (x = 0; x < fs->fs_llformat.namesize && name[x] != '\0'; x++)
+    {
+      hash ^= (uint8_t) name[x];
+      hash *= 16777619u;
+    }
+
+  return (uint16_t) (hash ^ (hash >> 16));
+}
+#endif
+
+/****************************************************************************
+ * Name: smartfs_dircache_find
+ *
+ * Description: Returns the cache of the directory starting at dirsector,
+ *              or NULL if the directory is not cached.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_SMARTFS_DIRCACHE
+static FAR struct smartfs_dircache_s *
+smartfs_dircache_find(FAR struct smartfs_mountpt_s *fs, uint16_t dirsector)
+{
+  int x;
+
+  for (x = 0; x < CONFIG_SMARTFS_DIRCACHE_DIRS; x++)
+    {
+      if (fs->fs_dircache[x].dirsector == dirsector)
+        {
+          return &fs->fs_dircache[x];
+        }
+    }
+
+  return NULL;
+}
+#endif
+
+/****************************************************************************
+ * Name: smartfs_dircache_append
+ *
+ * Description: Adds an entry to a directory cache, growing it as needed.
+ *              If the directory has too many entries to be cached, it is
+ *              marked as not cacheable and -ENOMEM returned.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_SMARTFS_DIRCACHE
+static int smartfs_dircache_append(FAR struct smartfs_dircache_s *dc,
+                                   uint16_t hash, uint16_t sector,
+                                   uint16_t offset)
+{
+  FAR struct smartfs_dcentry_s *entries;
+  uint16_t maxentries;
+
+  if (dc->nentries == dc->maxentries)
+    {
+      maxentries = dc->maxentries == 0 ? 16 : dc->maxentries << 1;
+      if (maxentries > CONFIG_SMARTFS_DIRCACHE_ENTRIES)
+        {
+          maxentries = CONFIG_SMARTFS_DIRCACHE_ENTRIES;
+        }
+
+      entries = NULL;
+      if (maxentries > dc->maxentries)
+        {
+          entries = (FAR struct smartfs_dcentry_s *)
+            kmm_realloc(dc->entries, maxentries *
+                        sizeof(struct smartfs_dcentry_s));
+        }
+
+      if (entries == NULL)
+        {
+          kmm_free(dc->entries);
+          dc->entries = NULL;
+          dc->maxentries = 0;
+          dc->nentries = SMARTFS_DIRCACHE_TOOBIG;
+          return -ENOMEM;
+        }
+
+      dc->entries = entries;
+      dc->maxentries = maxentries;
+    }
+
+  dc->entries[dc->nentries].hash = hash;
+  dc->entries[dc->nentries].sector = sector;
+  dc->entries[dc->nentries].offset = offset;
+  dc->nentries++;
+  return OK;
+}
+#endif
+
+/****************************************************************************
+ * Name: smartfs_dircache_get
+ *
+ * Description: Returns the cache of the directory starting at dirsector.
+ *              If the directory is not cached yet, it is read into the
+ *              least recently used cache slot.  Returns NULL if the
+ *              directory cannot be cached; it then stays in its slot as
+ *              not cacheable so that it is not read again in vain.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_SMARTFS_DIRCACHE
+static FAR struct smartfs_dircache_s *
+smartfs_dircache_get(FAR struct smartfs_mountpt_s *fs, uint16_t dirsector)
+{
+  FAR struct smartfs_dircache_s  *dc;
+  FAR struct smartfs_entry_header_s *entry;
+  FAR struct smartfs_chain_header_s *header;
+  struct smart_read_write_s       readwrite;
+  uint16_t                        entrysize;
+  uint16_t                        offset;
+  uint16_t                        sector;
+  int                             ret;
+  int                             x;
+
+  fs->fs_dcstamp++;
+  dc = smartfs_dircache_find(fs, dirsector);
+  if (dc != NULL)
+    {
+      dc->stamp = fs->fs_dcstamp;
+      return dc->nentries == SMARTFS_DIRCACHE_TOOBIG ? NULL : dc;
+    }
+
+  /* Not cached.  Take an unused slot or the least recently used one. */
+
+  dc = &fs->fs_dircache[0];
+  for (x = 1; x < CONFIG_SMARTFS_DIRCACHE_DIRS && dc->dirsector != 0; x++)
+    {
+      if (fs->fs_dircache[x].dirsector == 0 ||
+          (uint16_t) (fs->fs_dcstamp - fs->fs_dircache[x].stamp) >
+          (uint16_t) (fs->fs_dcstamp - dc->stamp))
+        {
+          dc = &fs->fs_dircache[x];
+        }
+    }
+
+  dc->dirsector = dirsector;
+  dc->nentries = 0;
+  dc->stamp = fs->fs_dcstamp;
+
+  /* Read the directory's sector chain and add all active entries */
+
+  entrysize = sizeof(struct smartfs_entry_header_s) + fs->fs_llformat.namesize;
+  header = (struct smartfs_chain_header_s *) fs->fs_rwbuffer;
+  sector = dirsector;
+  while (sector != SMARTFS_ERASEDSTATE_16BIT)
+    {
+      readwrite.logsector = sector;
+      readwrite.count = fs->fs_llformat.availbytes;
+      readwrite.buffer = (uint8_t *) fs->fs_rwbuffer;
+      readwrite.offset = 0;
+      ret = FS_IOCTL(fs, BIOC_READSECT, (unsigned long) &readwrite);
+      if (ret < 0)
+        {
+          dc->dirsector = 0;
+          return NULL;
+        }
+
+      offset = sizeof(struct smartfs_chain_header_s);
+      while (offset + entrysize < readwrite.count)
+        {
+          entry = (struct smartfs_entry_header_s *) &fs->fs_rwbuffer[offset];
+          if (smartfs_isactive(entry))
+            {
+              ret = smartfs_dircache_append(dc,
+                      smartfs_namehash(fs, entry->name), sector, offset);
+              if (ret < 0)
+                {
+                  return NULL;
+                }
+            }
+
+          offset += entrysize;
+        }
+
+      sector = SMARTFS_NEXTSECTOR(header);
+    }
+
+  return dc;
+}
+#endif
+
+/****************************************************************************
+ * Name: smartfs_dircache_add
+ *
+ * Description: Adds a newly created entry to the cache of its directory.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_SMARTFS_DIRCACHE
+static void smartfs_dircache_add(FAR struct smartfs_mountpt_s *fs,
+                                 uint16_t dirsector, FAR const char *name,
+                                 uint16_t sector, uint16_t offset)
+{
+  FAR struct smartfs_dircache_s *dc;
+
+  dc = smartfs_dircache_find(fs, dirsector);
+  if (dc != NULL && dc->nentries != SMARTFS_DIRCACHE_TOOBIG)
+    {
+      (void)smartfs_dircache_append(dc, smartfs_namehash(fs, name),
+                                    sector, offset);
+    }
+}
+#endif
+
+/****************************************************************************
+ * Name: smartfs_dircache_drop
+ *
+ * Description: Removes a directory from the cache.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_SMARTFS_DIRCACHE
+static void smartfs_dircache_drop(FAR struct smartfs_mountpt_s *fs,
+                                  uint16_t dirsector)
+{
+  FAR struct smartfs_dircache_s *dc;
+
+  dc = smartfs_dircache_find(fs, dirsector);
+  if (dc != NULL)
+    {
+      dc->dirsector = 0;
+    }
+}
+#endif
+
+/****************************************************************************
+ * Name: smartfs_searchdir
+ *
+ * Description: Searches the directory starting at dirsector for an active
+ *              entry with the given name.  If found, the sector holding
+ *              the entry and its offset are returned and the entry is in
+ *              fs_rwbuffer at that same offset.
+ *
+ ****************************************************************************/
+
+static int smartfs_searchdir(FAR struct smartfs_mountpt_s *fs,
+                             uint16_t dirsector, FAR const char *name,
+                             FAR uint16_t *sector, FAR uint16_t *offset)
+{
+  FAR struct smartfs_entry_header_s *entry;
+  FAR struct smartfs_chain_header_s *header;
+  struct smart_read_write_s       readwrite;
+  uint16_t                        entrysize;
+  int                             ret;
+#ifdef CONFIG_SMARTFS_DIRCACHE
+  FAR struct smartfs_dircache_s  *dc;
+  uint16_t                        hash;
+  uint16_t                        x;
+#endif
+
+  entrysize = sizeof(struct smartfs_entry_header_s) + fs->fs_llformat.namesize;
+
+#ifdef CONFIG_SMARTFS_DIRCACHE
+  /* With the directory cached, only the entries whose name hash matches
+   * have to be read.
+   */
+
+  dc = smartfs_dircache_get(fs, dirsector);
+  if (dc != NULL)
+    {
+      hash = smartfs_namehash(fs, name);
+      for (x = 0; x < dc->nentries; x++)
+        {
+          if (dc->entries[x].hash != hash)
+            {
+              continue;
+            }
+
+          readwrite.logsector = dc->entries[x].sector;
+          readwrite.offset = dc->entries[x].offset;
+          readwrite.count = entrysize;
+          readwrite.buffer = (uint8_t *) &fs->fs_rwbuffer[readwrite.offset];
+          ret = FS_IOCTL(fs, BIOC_READSECT, (unsigned long) &readwrite);
+          if (ret < 0)
+            {
+              return ret;
+            }
+
+          entry = (struct smartfs_entry_header_s *) readwrite.buffer;
+          if (smartfs_isactive(entry) &&
+              strncmp(entry->name, name, fs->fs_llformat.namesize) == 0)
+            {
+              *sector = readwrite.logsector;
+              *offset = readwrite.offset;
+              return OK;
+            }
+        }
+
+      return -ENOENT;
+    }
+#endif
+
+  /* Read each sector in the directory's chain and compare the names */
+
+#if CONFIG_SMARTFS_ERASEDSTATE == 0xFF
+  while (dirsector != 0xFFFF)
+#else
+  while (dirsector != 0)
+#endif
+    {
+      readwrite.logsector = dirsector;
+      readwrite.count = fs->fs_llformat.availbytes;
+      readwrite.buffer = (uint8_t *)fs->fs_rwbuffer;
+      readwrite.offset = 0;
+      ret = FS_IOCTL(fs, BIOC_READSECT, (unsigned long) &readwrite);
+      if (ret < 0)
+        {
+          return ret;
+        }
+
+      /* Point to next sector in chain */
+
+      header = (struct smartfs_chain_header_s *) fs->fs_rwbuffer;
+      dirsector = SMARTFS_NEXTSECTOR(header);
+
+      /* Search for the entry */
+
+      *offset = sizeof(struct smartfs_chain_header_s);
+      while (*offset < readwrite.count)
+        {
+          entry = (struct smartfs_entry_header_s *) &fs->fs_rwbuffer[*offset];
+          if (smartfs_isactive(entry) &&
+              strncmp(entry->name, name, fs->fs_llformat.namesize) == 0)
+            {
+              *sector = readwrite.logsector;
+              return OK;
+            }
+
+          *offset += entrysize;
+        }
+    }
+
+  return -ENOENT;
+}
+
 /****************************************************************************
  * Public Functions
  ****************************************************************************/
@@ -369,6 +747,9 @@ int smartfs_unmount(struct smartfs_mountpt_s *fs)
   int           count = 0;
   int           found = FALSE;
 #endif
+#ifdef CONFIG_SMARTFS_DIRCACHE
+  int           x;
+#endif
 
 #if defined(CONFIG_SMARTFS_MULTI_ROOT_DIRS) || \
   (defined(CONFIG_FS_PROCFS) && !defined(CONFIG_FS_PROCFS_EXCLUDE_SMARTFS))
@@ -479,6 +860,19 @@ int smartfs_unmount(struct smartfs_mountpt_s *fs)
   kmm_free(fs->fs_workbuffer);
 #endif
 
+#ifdef CONFIG_SMARTFS_DIRCACHE
+  /* Free the directory cache */
+
+  for (x = 0; x < CONFIG_SMARTFS_DIRCACHE_DIRS; x++)
+    {
+      if (fs->fs_dircache[x].entries != NULL)
+        {
+          kmm_free(fs->fs_dircache[x].entries);
+          fs->fs_dircache[x].entries = NULL;
+        }
+    }
+#endif
+
   return ret;
 }
 
@@ -509,7 +903,7 @@ int smartfs_finddirentry(struct smartfs_mountpt_s *fs,
   uint16_t    depth = 0;
   uint16_t    dirstack[CONFIG_SMARTFS_DIRDEPTH];
   uint16_t    dirsector;
-  uint16_t    entrysize;
+  uint16_t    dsector;
   uint16_t    offset;
   struct      smartfs_chain_header_s *header;
   struct      smart_read_write_s readwrite;
@@ -518,7 +912,6 @@ int smartfs_finddirentry(struct smartfs_mountpt_s *fs,
   /* Initialize directory level zero as the root sector */
 
   dirstack[0] = fs->fs_rootsector;
-  entrysize = sizeof(struct smartfs_entry_header_s) + fs->fs_llformat.namesize;
 
   /* Test if this is a request for the root directory */
 
@@ -595,216 +988,138 @@ int smartfs_finddirentry(struct smartfs_mountpt_s *fs,
         {
           /* Search for the entry in the current directory */
 
-          dirsector = dirstack[depth];
-
-          /* Read the directory */
-
-          offset = 0xFFFF;
-
-#if CONFIG_SMARTFS_ERASEDSTATE == 0xFF
-          while (dirsector != 0xFFFF)
-#else
-          while (dirsector != 0)
-#endif
+          ret = smartfs_searchdir(fs, dirstack[depth], fs->fs_workbuffer,
+                                  &dsector, &offset);
+          if (ret == OK)
             {
-              /* Read the next directory in the chain */
-
-              readwrite.logsector = dirsector;
-              readwrite.count = fs->fs_llformat.availbytes;
-              readwrite.buffer = (uint8_t *)fs->fs_rwbuffer;
-              readwrite.offset = 0;
-              ret = FS_IOCTL(fs, BIOC_READSECT, (unsigned long) &readwrite);
-              if (ret < 0)
-                {
-                  goto errout;
-                }
+              /* We found it!  If this is the last segment entry, then
+               * report the entry.  If it isn't the last entry, then
+               * validate it is a directory entry and open it and continue
+               * searching.
+               */
 
-              /* Point to next sector in chain */
-
-              header = (struct smartfs_chain_header_s *) fs->fs_rwbuffer;
-              dirsector = SMARTFS_NEXTSECTOR(header);
-
-              /* Search for the entry */
-
-              offset = sizeof(struct smartfs_chain_header_s);
               entry = (struct smartfs_entry_header_s *) &fs->fs_rwbuffer[offset];
-              while (offset < readwrite.count)
+              if (*ptr == '\0')
                 {
-                  /* Test if this entry is valid and active */
+                  /* We are at the last segment.  Report the entry */
+
+                  /* Fill in the entry */
 
 #ifdef CONFIG_SMARTFS_ALIGNED_ACCESS
-                  if (((smartfs_rdle16(&entry->flags) & SMARTFS_DIRENT_EMPTY) ==
-                      (SMARTFS_ERASEDSTATE_16BIT & SMARTFS_DIRENT_EMPTY)) ||
-                      ((smartfs_rdle16(&entry->flags) & SMARTFS_DIRENT_ACTIVE) !=
-                      (SMARTFS_ERASEDSTATE_16BIT & SMARTFS_DIRENT_ACTIVE)))
+                  direntry->firstsector = smartfs_rdle16(&entry->firstsector);
+                  direntry->flags = smartfs_rdle16(&entry->flags);
+                  direntry->utc = smartfs_rdle32(&entry->utc);
 #else
-                  if (((entry->flags & SMARTFS_DIRENT_EMPTY) ==
-                      (SMARTFS_ERASEDSTATE_16BIT & SMARTFS_DIRENT_EMPTY)) ||
-                      ((entry->flags & SMARTFS_DIRENT_ACTIVE) !=
-                      (SMARTFS_ERASEDSTATE_16BIT & SMARTFS_DIRENT_ACTIVE)))
+                  direntry->firstsector = entry->firstsector;
+                  direntry->flags = entry->flags;
+                  direntry->utc = entry->utc;
 #endif
+                  direntry->dsector = dsector;
+                  direntry->doffset = offset;
+                  direntry->dfirst = dirstack[depth];
+                  if (direntry->name == NULL)
                     {
-                      /* This entry isn't valid, skip it */
-
-                      offset += entrysize;
-                      entry = (struct smartfs_entry_header_s *)
-                        &fs->fs_rwbuffer[offset];
-
-                      continue;
+                      direntry->name = (char *) kmm_malloc(fs->fs_llformat.namesize+1);
                     }
 
-                  /* Test if the name matches */
+                  memset(direntry->name, 0, fs->fs_llformat.namesize + 1);
+                  strncpy(direntry->name, entry->name, fs->fs_llformat.namesize);
+                  direntry->datlen = 0;
 
-                  if (strncmp(entry->name, fs->fs_workbuffer,
-                      fs->fs_llformat.namesize) == 0)
-                    {
-                      /* We found it!  If this is the last segment entry,
-                       * then report the entry.  If it isn't the last
-                       * entry, then validate it is a directory entry and
-                       * open it and continue searching.
-                       */
+                  /* Scan the file's sectors to calculate the length and perform
+                   * a rudimentary check.
+                   */
 
-                      if (*ptr == '\0')
-                        {
-                          /* We are at the last segment.  Report the entry */
+                  if ((direntry->flags & SMARTFS_DIRENT_TYPE) ==
+                      SMARTFS_DIRENT_TYPE_FILE)
+                    {
+                      dirsector = direntry->firstsector;
 
-                          /* Fill in the entry */
+#ifdef CONFIG_SMARTFS_DIRCACHE
+                      /* Resume from the remembered position in the chain */
 
-#ifdef CONFIG_SMARTFS_ALIGNED_ACCESS
-                          direntry->firstsector = smartfs_rdle16(&entry->firstsector);
-                          direntry->flags = smartfs_rdle16(&entry->flags);
-                          direntry->utc = smartfs_rdle32(&entry->utc);
-#else
-                          direntry->firstsector = entry->firstsector;
-                          direntry->flags = entry->flags;
-                          direntry->utc = entry->utc;
+                      if (fs->fs_chainpos.firstsector == dirsector)
+                        {
+                          dirsector = fs->fs_chainpos.sector;
+                          direntry->datlen = fs->fs_chainpos.pos;
+                        }
 #endif
-                          direntry->dsector = readwrite.logsector;
-                          direntry->doffset = offset;
-                          direntry->dfirst = dirstack[depth];
-                          if (direntry->name == NULL)
-                            {
-                              direntry->name = (char *) kmm_malloc(fs->fs_llformat.namesize+1);
-                            }
 
-                          memset(direntry->name, 0, fs->fs_llformat.namesize + 1);
-                          strncpy(direntry->name, entry->name, fs->fs_llformat.namesize);
-                          direntry->datlen = 0;
+                      header = (struct smartfs_chain_header_s *) fs->fs_rwbuffer;
+                      readwrite.count = sizeof(struct smartfs_chain_header_s);
+                      readwrite.buffer = (uint8_t *)fs->fs_rwbuffer;
+                      readwrite.offset = 0;
 
-                          /* Scan the file's sectors to calculate the length and perform
-                           * a rudimentary check.
-                           */
+                      while (dirsector != SMARTFS_ERASEDSTATE_16BIT)
+                        {
+                          /* Read the next sector of the file */
 
-#ifdef CONFIG_SMARTFS_ALIGNED_ACCESS
-                          if ((smartfs_rdle16(&entry->flags) & SMARTFS_DIRENT_TYPE) ==
-                              SMARTFS_DIRENT_TYPE_FILE)
+                          readwrite.logsector = dirsector;
+                          ret = FS_IOCTL(fs, BIOC_READSECT, (unsigned long) &readwrite);
+                          if (ret < 0)
                             {
-                              dirsector = smartfs_rdle16(&entry->firstsector);
-#else
-                          if ((entry->flags & SMARTFS_DIRENT_TYPE) ==
-                              SMARTFS_DIRENT_TYPE_FILE)
-                            {
-                              dirsector = entry->firstsector;
-#endif
-                              readwrite.count = sizeof(struct smartfs_chain_header_s);
-                              readwrite.buffer = (uint8_t *)fs->fs_rwbuffer;
-                              readwrite.offset = 0;
-
-                              while (dirsector != SMARTFS_ERASEDSTATE_16BIT)
-                                {
-                                  /* Read the next sector of the file */
-
-                                  readwrite.logsector = dirsector;
-                                  ret = FS_IOCTL(fs, BIOC_READSECT, (unsigned long) &readwrite);
-                                  if (ret < 0)
-                                    {
-                                      fdbg("Error in sector chain at %d!\n", dirsector);
-                                      break;
-                                    }
-
-                                  /* Add used bytes to the total and point to next sector */
-
-                                  if (*((uint16_t *) header->used) != SMARTFS_ERASEDSTATE_16BIT)
-                                    {
-                                      direntry->datlen += *((uint16_t *) header->used);
-                                    }
-
-                                  dirsector = SMARTFS_NEXTSECTOR(header);
-                                }
+                              fdbg("Error in sector chain at %d!\n", dirsector);
+                              break;
                             }
 
-                          *parentdirsector = dirstack[depth];
-                          *filename = segment;
-                          ret = OK;
-                          goto errout;
-                        }
-                      else
-                        {
-                          /* Validate it's a directory */
+                          /* Add used bytes to the total and point to next sector */
 
-#ifdef CONFIG_SMARTFS_ALIGNED_ACCESS
-                          if ((smartfs_rdle16(&entry->flags) & SMARTFS_DIRENT_TYPE) !=
-                              SMARTFS_DIRENT_TYPE_DIR)
-#else
-                          if ((entry->flags & SMARTFS_DIRENT_TYPE) !=
-                              SMARTFS_DIRENT_TYPE_DIR)
-#endif
+                          if (*((uint16_t *) header->used) != SMARTFS_ERASEDSTATE_16BIT)
                             {
-                                /* Not a directory!  Report the error */
-
-                                ret = -ENOTDIR;
-                                goto errout;
+                              direntry->datlen += *((uint16_t *) header->used);
                             }
 
-                          /* "Push" the directory and continue searching */
+                          dirsector = SMARTFS_NEXTSECTOR(header);
+                        }
+                    }
 
-                          if (depth >= CONFIG_SMARTFS_DIRDEPTH - 1)
-                            {
-                              /* Directory depth too big */
+                  *parentdirsector = dirstack[depth];
+                  *filename = segment;
+                  ret = OK;
+                  goto errout;
+                }
 
-                              ret = -ENAMETOOLONG;
-                              goto errout;
-                            }
+              /* Validate it's a directory */
 
 #ifdef CONFIG_SMARTFS_ALIGNED_ACCESS
-                          dirstack[++depth] = smartfs_rdle16(&entry->firstsector);
+              if ((smartfs_rdle16(&entry->flags) & SMARTFS_DIRENT_TYPE) !=
+                  SMARTFS_DIRENT_TYPE_DIR)
 #else
-                          dirstack[++depth] = entry->firstsector;
+              if ((entry->flags & SMARTFS_DIRENT_TYPE) !=
+                  SMARTFS_DIRENT_TYPE_DIR)
 #endif
-                          segment = ptr + 1;
-                          break;
-                        }
-                    }
-
-                  /* Not this entry.  Skip to the next one */
+                {
+                  /* Not a directory!  Report the error */
 
-                  offset += entrysize;
-                  entry = (struct smartfs_entry_header_s *)
-                    &fs->fs_rwbuffer[offset];
+                  ret = -ENOTDIR;
+                  goto errout;
                 }
 
-              /* Test if a directory entry was found and break if it was */
+              /* "Push" the directory and continue searching */
 
-              if (offset < readwrite.count)
+              if (depth >= CONFIG_SMARTFS_DIRDEPTH - 1)
                 {
-                  break;
+                  /* Directory depth too big */
+
+                  ret = -ENAMETOOLONG;
+                  goto errout;
                 }
-            }
 
-          /* If we found a dir entry, then continue searching */
+#ifdef CONFIG_SMARTFS_ALIGNED_ACCESS
+              dirstack[++depth] = smartfs_rdle16(&entry->firstsector);
+#else
+              dirstack[++depth] = entry->firstsector;
+#endif
 
-          if (offset < readwrite.count)
-            {
               /* Update the segment pointer */
 
-              if (*ptr != '\0')
-                {
-                  ptr++;
-                }
-
-              segment = ptr;
+              segment = ptr + 1;
               continue;
             }
+          else if (ret != -ENOENT)
+            {
+              goto errout;
+            }
 
           /* Entry not found!  Report the error.  Also, if this is the last
            * segment, then report the parent directory sector.
@@ -1071,6 +1386,10 @@ int smartfs_createentry(FAR struct smartfs_mountpt_s *fs,
       goto errout;
     }
 
+#ifdef CONFIG_SMARTFS_DIRCACHE
+  smartfs_dircache_add(fs, parentdirsector, filename, psector, offset);
+#endif
+
   /* Now fill in the entry */
 
   direntry->firstsector = nextsector;
@@ -1159,6 +1478,13 @@ int smartfs_deleteentry(struct smartfs_mountpt_s *fs,
       ret = FS_IOCTL(fs, BIOC_FREESECT, sector);
     }
 
+#ifdef CONFIG_SMARTFS_DIRCACHE
+  /* The sectors may be reused for other files or directories */
+
+  smartfs_chainpos_drop(fs, entry->firstsector);
+  smartfs_dircache_drop(fs, entry->firstsector);
+#endif
+
   /* Remove the entry from the directory tree */
 
   readwrite.logsector = entry->dsector;
@@ -1201,6 +1527,10 @@ int smartfs_deleteentry(struct smartfs_mountpt_s *fs,
       goto errout;
     }
 
+#ifdef CONFIG_SMARTFS_DIRCACHE
+  smartfs_dircache_remove(fs, entry->dfirst, entry->dsector, entry->doffset);
+#endif
+
   /* Test if any entries in this sector are being used */
 
   if ((entry->dsector != fs->fs_rootsector) &&
@@ -1415,6 +1745,10 @@ int smartfs_truncatefile(struct smartfs_mountpt_s *fs,
   struct smartfs_chain_header_s  *header;
   struct smart_read_write_s       readwrite;
 
+#ifdef CONFIG_SMARTFS_DIRCACHE
+  smartfs_chainpos_drop(fs, entry->firstsector);
+#endif
+
   /* Walk through the directory's sectors and count entries */
 
   nextsector = entry->firstsector;
@@ -1524,6 +1858,80 @@ errout:
   return ret;
 }
 
+/****************************************************************************
+ * Name: smartfs_dircache_remove
+ *
+ * Description: Removes the entry stored at sector,offset from the cache of
+ *              the directory starting at dirsector.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_SMARTFS_DIRCACHE
+void smartfs_dircache_remove(struct smartfs_mountpt_s *fs,
+        uint16_t dirsector, uint16_t sector, uint16_t offset)
+{
+  FAR struct smartfs_dircache_s *dc;
+  uint16_t x;
+
+  dc = smartfs_dircache_find(fs, dirsector);
+  if (dc == NULL || dc->nentries == SMARTFS_DIRCACHE_TOOBIG)
+    {
+      return;
+    }
+
+  for (x = 0; x < dc->nentries; x++)
+    {
+      if (dc->entries[x].sector == sector && dc->entries[x].offset == offset)
+        {
+          dc->entries[x] = dc->entries[--dc->nentries];
+          break;
+        }
+    }
+}
+#endif
+
+/****************************************************************************
+ * Name: smartfs_chainpos_save
+ *
+ * Description: Remembers that the data of the given sector in the chain of
+ *              the file starting at firstsector begins at file position
+ *              pos.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_SMARTFS_DIRCACHE
+void smartfs_chainpos_save(struct smartfs_mountpt_s *fs,
+        uint16_t firstsector, uint16_t sector, uint32_t pos)
+{
+  if (sector != SMARTFS_ERASEDSTATE_16BIT)
+    {
+      fs->fs_chainpos.firstsector = firstsector;
+      fs->fs_chainpos.sector = sector;
+      fs->fs_chainpos.pos = pos;
+    }
+}
+#endif
+
+/****************************************************************************
+ * Name: smartfs_chainpos_drop
+ *
+ * Description: Forgets the remembered chain position if it belongs to the
+ *              file starting at firstsector.  Must be called whenever the
+ *              sectors before that position change.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_SMARTFS_DIRCACHE
+void smartfs_chainpos_drop(struct smartfs_mountpt_s *fs,
+        uint16_t firstsector)
+{
+  if (fs->fs_chainpos.firstsector == firstsector)
+    {
+      fs->fs_chainpos.firstsector = 0;
+    }
+}
+#endif
+
 /****************************************************************************
  * Name: smartfs_get_first_mount
  *
@@ -33,6 +33,7 @@
  *
  ****************************************************************************/
 
+
 /****************************************************************************
  * Included Files
  ****************************************************************************/
@@ -42,14 +43,324 @@
 #include <sys/epoll.h>
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <poll.h>
+#include <semaphore.h>
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <assert.h>
 #include <debug.h>
 
+#include <nuttx/clock.h>
+#include <nuttx/semaphore.h>
+#include <nuttx/fs/fs.h>
+#include <nuttx/net/net.h>
+
+#include <arch/irq.h>
+
 #ifndef CONFIG_DISABLE_POLL
 
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Event flags that select the epoll mode and are not passed to drivers */
+
+#define EPOLL_MODEMASK      (EPOLLET | EPOLLONESHOT)
+
+/* Internal state kept in the flags field of struct epoll_event.  The mode
+ * bits (EPOLLET and EPOLLONESHOT) are also kept there.
+ */
+
+#define EPOLL_FLAG_ARMED    0x01  /* The poll is set up with the driver */
+#define EPOLL_FLAG_REARM    0x02  /* Re-arm before the next wait */
+#define EPOLL_FLAG_SOCKET   0x04  /* obj refers to a struct socket */
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+/* All epoll instances, so that a descriptor can be removed from each of
+ * them when it is closed.  The semaphore protects the list and the
+ * registration slots of every instance on it.
+ */
+
+static FAR struct epoll_head *g_epoll_list;
+static sem_t g_epoll_sem = SEM_INITIALIZER(1);
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: epoll_semtake and epoll_semgive
+ *
+ * Description:
+ *   Get and release exclusive access to the epoll instances.
+ *
+ ****************************************************************************/
+
+static void epoll_semtake(void)
+{
+  /* Take the semaphore (perhaps waiting) */
+
+  while (sem_wait(&g_epoll_sem) != 0)
+    {
+      /* The only case that an error should occur here is if the wait was
+       * awakened by a signal.
+       */
+
+      ASSERT(get_errno() == EINTR);
+    }
+}
+
+#define epoll_semgive() sem_post(&g_epoll_sem)
+
+/****************************************************************************
+ * Name: epoll_bind
+ *
+ * Description:
+ *   Look up the open file or socket that 'fd' refers to.  The poll is set
+ *   up and torn down through that object rather than through the
+ *   descriptor, so that it can be torn down by epoll_release() and
+ *   epoll_close() from any context.
+ *
+ ****************************************************************************/
+
+static int epoll_bind(FAR struct epoll_event *epev, int fd)
+{
+#if CONFIG_NFILE_DESCRIPTORS > 0
+  FAR struct file *filep;
+#endif
+
+  epev->flags &= ~EPOLL_FLAG_SOCKET;
+
+#if CONFIG_NFILE_DESCRIPTORS > 0
+  if ((unsigned int)fd < CONFIG_NFILE_DESCRIPTORS)
+    {
+      filep = fs_getfilep(fd);
+      if (filep == NULL || filep->f_inode == NULL)
+        {
+          return -EBADF;
+        }
+
+      epev->obj = filep;
+      return OK;
+    }
+#endif
+
+#if defined(CONFIG_NET) && CONFIG_NSOCKET_DESCRIPTORS > 0
+  if ((unsigned int)fd < CONFIG_NFILE_DESCRIPTORS + CONFIG_NSOCKET_DESCRIPTORS)
+    {
+      FAR struct socket *psock = sockfd_socket(fd);
+
+      if (psock == NULL || psock->s_crefs <= 0)
+        {
+          return -EBADF;
+        }
+
+      epev->obj    = psock;
+      epev->flags |= EPOLL_FLAG_SOCKET;
+      return OK;
+    }
+#endif
+
+  return -EBADF;
+}
+
+/****************************************************************************
+ * Name: epoll_poll
+ *
+ * Description:
+ *   Set up or tear down the poll of one registration with the driver of
+ *   its open file or socket.
+ *
+ ****************************************************************************/
+
+static int epoll_poll(FAR struct epoll_event *epev, bool setup)
+{
+  FAR struct pollfd *fds = (FAR struct pollfd *)epev;
+#if CONFIG_NFILE_DESCRIPTORS > 0
+  FAR struct file *filep;
+  FAR struct inode *inode;
+#endif
+
+#if defined(CONFIG_NET) && CONFIG_NSOCKET_DESCRIPTORS > 0
+  if ((epev->flags & EPOLL_FLAG_SOCKET) != 0)
+    {
+      return psock_poll((FAR struct socket *)epev->obj, fds, setup);
+    }
+#endif
+
+#if CONFIG_NFILE_DESCRIPTORS > 0
+  filep = (FAR struct file *)epev->obj;
+  inode = filep->f_inode;
+  if (inode != NULL && inode->u.i_ops != NULL && inode->u.i_ops->poll)
+    {
+      return (int)inode->u.i_ops->poll(filep, fds, setup);
+    }
+#endif
+
+  return -ENOSYS;
+}
+
+/****************************************************************************
+ * Name: epoll_arm
+ *
+ * Description:
+ *   Set up the poll for one registered descriptor with its driver.  If the
+ *   descriptor is already ready, the driver will set revents and post the
+ *   epoll semaphore immediately.
+ *
+ ****************************************************************************/
+
+static int epoll_arm(FAR struct epoll_head *eph, FAR struct epoll_event *epev)
+{
+  int ret;
+
+  epev->sem     = &eph->sem;
+  epev->revents = 0;
+  epev->priv    = NULL;
+
+  ret = epoll_poll(epev, true);
+  if (ret >= 0)
+    {
+      epev->flags |= EPOLL_FLAG_ARMED;
+    }
+
+  return ret;
+}
+
+/****************************************************************************
+ * Name: epoll_disarm
+ *
+ * Description:
+ *   Tear down the poll for one registered descriptor.
+ *
+ ****************************************************************************/
+
+static void epoll_disarm(FAR struct epoll_event *epev)
+{
+  if ((epev->flags & EPOLL_FLAG_ARMED) != 0)
+    {
+      (void)epoll_poll(epev, false);
+      epev->flags &= ~(EPOLL_FLAG_ARMED | EPOLL_FLAG_REARM);
+    }
+}
+
+/****************************************************************************
+ * Name: epoll_find
+ *
+ * Description:
+ *   Return the registration slot for 'fd' or NULL if 'fd' is not
+ *   registered.
+ *
+ ****************************************************************************/
+
+static FAR struct epoll_event *epoll_find(FAR struct epoll_head *eph, int fd)
+{
+  int i;
+
+  for (i = 0; i < eph->size; i++)
+    {
+      if (eph->evs[i].data.fd == fd)
+        {
+          return &eph->evs[i];
+        }
+    }
+
+  return NULL;
+}
+
+/****************************************************************************
+ * Name: epoll_remove
+ *
+ * Description:
+ *   Tear down the poll of one registration and free its slot.
+ *
+ ****************************************************************************/
+
+static void epoll_remove(FAR struct epoll_head *eph,
+                         FAR struct epoll_event *epev)
+{
+  epoll_disarm(epev);
+  epev->data.fd = -1;
+  epev->obj     = NULL;
+  epev->flags   = 0;
+  eph->occupied--;
+}
+
+/****************************************************************************
+ * Name: epoll_collect
+ *
+ * Description:
+ *   Move up to 'maxevents' pending events into the caller's 'evs' array.
+ *   Level-triggered entries that are reported are marked to be re-armed
+ *   before the next wait so that their driver re-evaluates their state;
+ *   one-shot entries are disarmed until they are modified with
+ *   EPOLL_CTL_MOD.
+ *
+ ****************************************************************************/
+
+static int epoll_collect(FAR struct epoll_head *eph,
+                         FAR struct epoll_event *evs, int maxevents)
+{
+  FAR struct epoll_event *epev;
+  pollevent_t revents;
+  irqstate_t flags;
+  int nevents = 0;
+  int index;
+  int i;
+
+  /* Start where the previous scan left off so that busy descriptors near
+   * the beginning of the list cannot starve the others.
+   */
+
+  index = eph->next;
+  for (i = 0; i < eph->size && nevents < maxevents; i++)
+    {
+      epev = &eph->evs[index];
+      if (++index >= eph->size)
+        {
+          index = 0;
+        }
+
+      if (epev->data.fd < 0 || (epev->flags & EPOLL_FLAG_ARMED) == 0)
+        {
+          continue;
+        }
+
+      /* Drivers may set revents from interrupt handlers */
+
+      flags         = irqsave();
+      revents       = epev->revents;
+      epev->revents = 0;
+      irqrestore(flags);
+
+      if (revents == 0)
+        {
+          continue;
+        }
+
+      evs[nevents].data.fd = epev->data.fd;
+      evs[nevents].events  = revents;
+      nevents++;
+
+      if ((epev->flags & EPOLLONESHOT) != 0)
+        {
+          epoll_disarm(epev);
+        }
+      else if ((epev->flags & EPOLLET) == 0)
+        {
+          epev->flags |= EPOLL_FLAG_REARM;
+        }
+    }
+
+  eph->next = index;
+  return nevents;
+}
+
 /****************************************************************************
  * Public Functions
  ****************************************************************************/
@@ -58,21 +369,59 @@
  * Name: epoll_create
  *
  * Description:
+ *   Create an epoll instance with room for 'size' descriptors.
  *
  * Input Parameters:
+ *   size - The maximum number of descriptors that may be registered
  *
  * Returned Value:
+ *   A handle to the epoll instance on success; a negated errno value on
+ *   failure.
  *
  ****************************************************************************/
 
 int epoll_create(int size)
 {
-  FAR struct epoll_head *eph =
-    (FAR struct epoll_head *)malloc(sizeof(struct epoll_head));
+  FAR struct epoll_head *eph;
+  int i;
 
-  eph->size = size;
+  if (size <= 0)
+    {
+      return -EINVAL;
+    }
+
+  eph = (FAR struct epoll_head *)malloc(sizeof(struct epoll_head));
+  if (eph == NULL)
+    {
+      return -ENOMEM;
+    }
+
+  eph->evs = (FAR struct epoll_event *)
+    malloc(sizeof(struct epoll_event) * size);
+
+  if (eph->evs == NULL)
+    {
+      free(eph);
+      return -ENOMEM;
+    }
+
+  eph->size     = size;
   eph->occupied = 0;
-  eph->evs = malloc(sizeof(struct epoll_event) * eph->size);
+  eph->next     = 0;
+  sem_init(&eph->sem, 0, 0);
+
+  /* A negative descriptor marks an unused slot */
+
+  memset(eph->evs, 0, sizeof(struct epoll_event) * size);
+  for (i = 0; i < size; i++)
+    {
+      eph->evs[i].data.fd = -1;
+    }
+
+  epoll_semtake();
+  eph->flink   = g_epoll_list;
+  g_epoll_list = eph;
+  epoll_semgive();
 
   return (int)eph;
 }
@@ -81,17 +430,47 @@ int epoll_create(int size)
  * Name: epoll_close
  *
  * Description:
+ *   Release an epoll instance, tearing down the polls of all descriptors
+ *   that are still registered.
  *
  * Input Parameters:
+ *   epfd - The epoll instance returned by epoll_create()
  *
  * Returned Value:
+ *   None
  *
  ****************************************************************************/
 
 void epoll_close(int epfd)
 {
-  struct epoll_head *eph = (struct epoll_head *)epfd;
+  FAR struct epoll_head *eph = (FAR struct epoll_head *)epfd;
+  FAR struct epoll_head **pprev;
+  int i;
+
+  epoll_semtake();
 
+  for (pprev = &g_epoll_list; *pprev != NULL; pprev = &(*pprev)->flink)
+    {
+      if (*pprev == eph)
+        {
+          *pprev = eph->flink;
+          break;
+        }
+    }
+
+  /* No driver may keep a reference to the slots or to the semaphore */
+
+  for (i = 0; i < eph->size; i++)
+    {
+      if (eph->evs[i].data.fd >= 0)
+        {
+          epoll_remove(eph, &eph->evs[i]);
+        }
+    }
+
+  epoll_semgive();
+
+  sem_destroy(&eph->sem);
   free(eph->evs);
   free(eph);
 }
@@ -100,16 +479,39 @@ void epoll_close(int epfd)
  * Name: epoll_ctl
  *
  * Description:
+ *   Add, modify, or remove a descriptor in the epoll instance.  The poll is
+ *   set up with the descriptor's driver once, when it is added, and torn
+ *   down when it is removed.  Closing a descriptor removes it from every
+ *   epoll instance.
+ *
+ *   In addition to the poll events, EPOLLET (edge-triggered: report an
+ *   event only when the driver signals a change) and EPOLLONESHOT (report
+ *   one event, then disable the descriptor until EPOLL_CTL_MOD) may be
+ *   requested.
  *
  * Input Parameters:
+ *   epfd - The epoll instance returned by epoll_create()
+ *   op   - EPOLL_CTL_ADD, EPOLL_CTL_MOD, or EPOLL_CTL_DEL
+ *   fd   - The file or socket descriptor
+ *   ev   - The events of interest (not used by EPOLL_CTL_DEL)
  *
  * Returned Value:
+ *   Zero (OK) on success; a negated errno value on failure.
  *
  ****************************************************************************/
 
 int epoll_ctl(int epfd, int op, int fd, struct epoll_event *ev)
 {
   FAR struct epoll_head *eph = (FAR struct epoll_head *)epfd;
+  FAR struct epoll_event *epev;
+  int ret;
+
+  if (fd < 0)
+    {
+      return -EBADF;
+    }
+
+  epoll_semtake();
 
   switch (op)
     {
@@ -117,98 +519,242 @@ int epoll_ctl(int epfd, int op, int fd, struct epoll_event *ev)
         fvdbg("%08x CTL ADD(%d): fd=%d ev=%08x\n",
               epfd, eph->occupied, fd, ev->events);
 
-        eph->evs[eph->occupied].events = ev->events | POLLERR | POLLHUP;
-        eph->evs[eph->occupied++].data.fd = fd;
-        return 0;
+        if (epoll_find(eph, fd) != NULL)
+          {
+            ret = -EEXIST;
+            break;
+          }
+
+        epev = epoll_find(eph, -1);
+        if (epev == NULL)
+          {
+            ret = -ENOMEM;
+            break;
+          }
+
+        epev->events = (ev->events & ~EPOLL_MODEMASK) | POLLERR | POLLHUP;
+        epev->flags  = ev->events & EPOLL_MODEMASK;
+
+        ret = epoll_bind(epev, fd);
+        if (ret >= 0)
+          {
+            ret = epoll_arm(eph, epev);
+          }
+
+        if (ret < 0)
+          {
+            epev->obj   = NULL;
+            epev->flags = 0;
+            break;
+          }
+
+        epev->data.fd = fd;
+        eph->occupied++;
+        break;
 
       case EPOLL_CTL_DEL:
-        {
-          int i;
-
-          for (i = 0; i < eph->occupied; i++)
-            {
-              if (eph->evs[i].data.fd == fd)
-                {
-                  if (i != eph->occupied-1)
-                    {
-                      memmove(&eph->evs[i], &eph->evs[i + 1],
-                              eph->occupied - i);
-                    }
-
-                  eph->occupied--;
-                  return 0;
-                }
-            }
+        epev = epoll_find(eph, fd);
+        if (epev == NULL)
+          {
+            ret = -ENOENT;
+            break;
+          }
 
-          return -ENOENT;
-        }
+        epoll_remove(eph, epev);
+        ret = OK;
+        break;
 
       case EPOLL_CTL_MOD:
-        {
-          int i;
-
-          fvdbg("%08x CTL MOD(%d): fd=%d ev=%08x\n",
-                epfd, eph->occupied, fd, ev->events);
-
-          for (i = 0; i < eph->occupied; i++)
-            {
-              if (eph->evs[i].data.fd == fd)
-                {
-                  eph->evs[i].events = ev->events | POLLERR | POLLHUP;
-                  return 0;
-                }
-            }
+        fvdbg("%08x CTL MOD(%d): fd=%d ev=%08x\n",
+              epfd, eph->occupied, fd, ev->events);
 
-          return -ENOENT;
-        }
+        epev = epoll_find(eph, fd);
+        if (epev == NULL)
+          {
+            ret = -ENOENT;
+            break;
+          }
+
+        /* Re-arm with the new event set.  This also re-enables one-shot
+         * descriptors.
+         */
+
+        epoll_disarm(epev);
+        epev->events = (ev->events & ~EPOLL_MODEMASK) | POLLERR | POLLHUP;
+        epev->flags  = (epev->flags & EPOLL_FLAG_SOCKET) |
+                       (ev->events & EPOLL_MODEMASK);
+        ret = epoll_arm(eph, epev);
+        break;
+
+      default:
+        ret = -EINVAL;
+        break;
     }
 
-  return -EINVAL;
+  epoll_semgive();
+  return ret;
 }
 
 /****************************************************************************
  * Name: epoll_wait
  *
  * Description:
+ *   Wait for events on the descriptors registered with the epoll instance.
+ *   Only the descriptors that have pending events are returned.  The cost
+ *   of a wait does not depend upon the driver poll setup of idle
+ *   descriptors; only the level-triggered descriptors that were reported
+ *   by the previous wait are re-polled.  A wait therefore costs a scan of
+ *   the registration array plus one driver poll teardown and setup for
+ *   each such descriptor, rather than a setup and teardown for every
+ *   registered descriptor as poll() needs.
  *
  * Input Parameters:
+ *   epfd      - The epoll instance returned by epoll_create()
+ *   evs       - The location to return the events
+ *   maxevents - The maximum number of events to return
+ *   timeout   - The maximum time to wait in milliseconds.  Zero means to
+ *               return immediately; a negative value means to wait
+ *               indefinitely.
  *
  * Returned Value:
+ *   The number of events returned in 'evs'; zero on a timeout; a negated
+ *   errno value on failure.
  *
  ****************************************************************************/
 
 int epoll_wait(int epfd, FAR struct epoll_event *evs, int maxevents,
                int timeout)
 {
-  int i;
-  int rc;
   FAR struct epoll_head *eph = (FAR struct epoll_head *)epfd;
+  FAR struct epoll_event *epev;
+  uint32_t start;
+  uint32_t delay;
+  int nevents;
+  int ret;
+  int i;
 
-  rc = poll((FAR struct pollfd *)eph->evs, eph->occupied, timeout);
+  if (evs == NULL || maxevents <= 0)
+    {
+      return -EINVAL;
+    }
 
-  if (rc <= 0)
+  /* Level-triggered descriptors reported by the previous wait are polled
+   * again:  If they are still ready, the driver will set revents at once.
+   */
+
+  epoll_semtake();
+  for (i = 0; i < eph->size; i++)
     {
-      if (rc < 0)
+      epev = &eph->evs[i];
+      if ((epev->flags & EPOLL_FLAG_REARM) != 0)
         {
-          fdbg("%08x poll fail: %d for %d, %d msecs\n",
-               epfd, rc, eph->occupied, timeout);
-
-          for (i = 0; i < eph->occupied; i++)
+          epoll_disarm(epev);
+          ret = epoll_arm(eph, epev);
+          if (ret < 0)
             {
-              fdbg("%02d: fd=%d\n", i, eph->evs[i].data.fd);
+              fdbg("%08x re-arm fail: %d for fd=%d\n",
+                   epfd, ret, epev->data.fd);
             }
         }
+    }
+
+  epoll_semgive();
+
+  /* A positive timeout shorter than one tick still waits for one tick */
+
+  delay = MSEC2TICK(timeout);
+  if (delay == 0)
+    {
+      delay = 1;
+    }
+
+  start = clock_systimer();
+  for (; ; )
+    {
+      /* Discard stale semaphore counts.  Any event that is posted after
+       * this point will either be found by the following scan or will wake
+       * up the wait below.
+       */
+
+      while (sem_trywait(&eph->sem) == 0);
+
+      epoll_semtake();
+      nevents = epoll_collect(eph, evs, maxevents);
+      epoll_semgive();
+
+      if (nevents > 0 || timeout == 0)
+        {
+          return nevents;
+        }
 
-      return rc;
+      /* Wait for a driver to post an event, for a signal, or for the
+       * timeout to elapse.
+       */
+
+      if (timeout > 0)
+        {
+          ret = sem_tickwait(&eph->sem, start, delay);
+        }
+      else
+        {
+          ret = sem_wait(&eph->sem) < 0 ? -get_errno() : OK;
+        }
+
+      if (ret < 0)
+        {
+          /* Return zero in the event of a timeout.  EINTR is the only other
+           * error expected in normal operation.
+           */
+
+          return ret == -ETIMEDOUT ? 0 : ret;
+        }
     }
+}
 
-  for (i = 0; i < rc; i++)
+/****************************************************************************
+ * Name: epoll_release
+ *
+ * Description:
+ *   Remove an open file or socket from every epoll instance that it is
+ *   registered with.  This is called when the file or socket is closed,
+ *   before its driver is closed.
+ *
+ * Input Parameters:
+ *   obj - The struct file or struct socket that is being closed
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void epoll_release(FAR void *obj)
+{
+  FAR struct epoll_head *eph;
+  FAR struct epoll_event *epev;
+  int i;
+
+  /* Nothing to do if no epoll instance exists */
+
+  if (g_epoll_list == NULL)
     {
-      evs[i].data.fd = (pollevent_t)eph->evs[i].data.fd;
-      evs[i].events = (pollevent_t)eph->evs[i].revents;
+      return;
+    }
+
+  epoll_semtake();
+  for (eph = g_epoll_list; eph != NULL; eph = eph->flink)
+    {
+      for (i = 0; i < eph->size; i++)
+        {
+          epev = &eph->evs[i];
+          if (epev->data.fd >= 0 && epev->obj == obj)
+            {
+              fvdbg("%08x release fd=%d\n", (int)eph, epev->data.fd);
+              epoll_remove(eph, epev);
+            }
+        }
     }
 
-  return rc;
+  epoll_semgive();
 }
 
 #endif /* CONFIG_DISABLE_POLL */
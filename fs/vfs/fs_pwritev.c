@@ -0,0 +1,152 @@
+/****************************************************************************
+ * fs/vfs/fs_pwritev.c
+ *
+ *   Copyright (C) 2016 Gregory Nutt. All rights reserved.
+ *   Author: Gregory Nutt <gnutt@nuttx.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <nuttx/fs/fs.h>
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: file_pwritev
+ *
+ * Description:
+ *   Equivalent to the standard pwritev function except that is accepts a
+ *   struct file instance instead of a file descriptor.
+ *
+ ****************************************************************************/
+
+ssize_t file_pwritev(FAR struct file *filep, FAR const struct iovec *iov,
+                     int iovcnt, off_t offset)
+{
+  off_t savepos;
+  off_t pos;
+  ssize_t ret;
+  int errcode;
+
+  /* Perform the seek to the current position.  This will not move the
+   * file pointer, but will return its current setting
+   */
+
+  savepos = file_seek(filep, 0, SEEK_CUR);
+  if (savepos == (off_t)-1)
+    {
+      /* file_seek might fail if this if the media is not seekable */
+
+      return ERROR;
+    }
+
+  /* Then seek to the correct position in the file */
+
+  pos = file_seek(filep, offset, SEEK_SET);
+  if (pos == (off_t)-1)
+    {
+      /* This might fail is the offset is beyond the end of file */
+
+      return ERROR;
+    }
+
+  /* Then perform the vectored write operation */
+
+  ret = file_writev(filep, iov, iovcnt);
+  errcode = get_errno();
+
+  /* Restore the file position */
+
+  pos = file_seek(filep, savepos, SEEK_SET);
+  if (pos == (off_t)-1 && ret >= 0)
+    {
+      /* This really should not fail */
+
+      return ERROR;
+    }
+
+  set_errno(errcode);
+  return ret;
+}
+
+/****************************************************************************
+ * Name: pwritev
+ *
+ * Description:
+ *   The pwritev() function performs the same action as writev(), except
+ *   that it transfers data at the given position in the file without
+ *   changing the file pointer.  An attempt to perform a pwritev() on a file
+ *   that is incapable of seeking results in an error.
+ *
+ * Parameters:
+ *   fd       File descriptor
+ *   iov      The array of the buffers providing the data
+ *   iovcnt   The number of elements in iov[]
+ *   offset   The file offset
+ *
+ * Return:
+ *   See writev() return values.
+ *
+ ****************************************************************************/
+
+ssize_t pwritev(int fd, FAR const struct iovec *iov, int iovcnt, off_t offset)
+{
+  FAR struct file *filep;
+
+  /* Get the file structure corresponding to the file descriptor. */
+
+  filep = fs_getfilep(fd);
+  if (!filep)
+    {
+      /* The errno value has already been set */
+
+      return (ssize_t)ERROR;
+    }
+
+  /* Let file_pwritev do the real work */
+
+  return file_pwritev(filep, iov, iovcnt, offset);
+}
@@ -0,0 +1,321 @@
+/****************************************************************************
+ * fs/vfs/fs_readv.c
+ *
+ *   Copyright (C) 2016 Gregory Nutt. All rights reserved.
+ *   Author: Gregory Nutt <gnutt@nuttx.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <errno.h>
+
+#include <nuttx/kmalloc.h>
+#include <nuttx/fs/fs.h>
+#include <nuttx/net/net.h>
+
+#include "inode/inode.h"
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: readv_check
+ *
+ * Description:
+ *   Verify that the I/O vector is usable:  The number of elements must be
+ *   in the range 0..IOV_MAX and the total transfer size must be
+ *   representable as an ssize_t.
+ *
+ * Returned Value:
+ *   Zero (OK) on success; a negated errno value on failure.
+ *
+ ****************************************************************************/
+
+static int readv_check(FAR const struct iovec *iov, int iovcnt)
+{
+  size_t total = 0;
+  int i;
+
+  if (iovcnt < 0 || iovcnt > IOV_MAX || (iov == NULL && iovcnt > 0))
+    {
+      return -EINVAL;
+    }
+
+  for (i = 0; i < iovcnt; i++)
+    {
+      if (iov[i].iov_len > (size_t)SSIZE_MAX - total)
+        {
+          return -EINVAL;
+        }
+
+      total += iov[i].iov_len;
+    }
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: readv_socket
+ *
+ * Description:
+ *   Receive into an I/O vector from a socket with a single call to recv().
+ *
+ *   A stream socket receives into the first non-empty element only:  A
+ *   second recv() could block even though data has already been received.
+ *   A datagram is received into a temporary buffer and then scattered over
+ *   the elements so that it is not truncated to the first element.
+ *
+ ****************************************************************************/
+
+#if defined(CONFIG_NET) && CONFIG_NSOCKET_DESCRIPTORS > 0
+static ssize_t readv_socket(int sockfd, FAR const struct iovec *iov,
+                            int iovcnt)
+{
+  FAR struct socket *psock;
+  FAR uint8_t *buffer;
+  size_t total;
+  size_t ncopy;
+  ssize_t nrecvd;
+  ssize_t offset;
+  int ret;
+  int i;
+
+  ret = readv_check(iov, iovcnt);
+  if (ret < 0)
+    {
+      set_errno(-ret);
+      return ERROR;
+    }
+
+  psock = sockfd_socket(sockfd);
+  if (psock == NULL)
+    {
+      set_errno(EBADF);
+      return ERROR;
+    }
+
+  /* Find the first non-empty element and the total size */
+
+  for (i = 0, total = 0; i < iovcnt; i++)
+    {
+      total += iov[i].iov_len;
+    }
+
+  for (i = 0; i < iovcnt && iov[i].iov_len == 0; i++);
+
+  if (i >= iovcnt)
+    {
+      return 0;
+    }
+
+  if (psock->s_type == SOCK_STREAM || iov[i].iov_len == total)
+    {
+      return recv(sockfd, iov[i].iov_base, iov[i].iov_len, 0);
+    }
+
+  /* No datagram is larger than 64KB */
+
+  if (total > UINT16_MAX)
+    {
+      total = UINT16_MAX;
+    }
+
+  buffer = (FAR uint8_t *)kmm_malloc(total);
+  if (buffer == NULL)
+    {
+      set_errno(ENOMEM);
+      return ERROR;
+    }
+
+  nrecvd = recv(sockfd, buffer, total, 0);
+  for (offset = 0; offset < nrecvd; i++)
+    {
+      ncopy = nrecvd - offset;
+      if (ncopy > iov[i].iov_len)
+        {
+          ncopy = iov[i].iov_len;
+        }
+
+      memcpy(iov[i].iov_base, &buffer[offset], ncopy);
+      offset += ncopy;
+    }
+
+  kmm_free(buffer);
+  return nrecvd;
+}
+#endif
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: file_readv
+ *
+ * Description:
+ *   Equivalent to the standard readv() function except that is accepts a
+ *   struct file instance instead of a file descriptor.  Each I/O vector
+ *   element is filled in turn with a call to file_read().  The transfer
+ *   stops at the first short read (end-of-file or no more data available).
+ *   For a character driver (or pipe), it also stops after the first element
+ *   that receives data because reading the next element might block.  Used
+ *   by readv() and preadv().
+ *
+ ****************************************************************************/
+
+#if CONFIG_NFILE_DESCRIPTORS > 0
+ssize_t file_readv(FAR struct file *filep, FAR const struct iovec *iov,
+                   int iovcnt)
+{
+  ssize_t ntotal;
+  ssize_t nread;
+  int ret;
+  int i;
+
+  ret = readv_check(iov, iovcnt);
+  if (ret < 0)
+    {
+      set_errno(-ret);
+      return ERROR;
+    }
+
+  for (i = 0, ntotal = 0; i < iovcnt; i++)
+    {
+      if (iov[i].iov_len == 0)
+        {
+          continue;
+        }
+
+      nread = file_read(filep, iov[i].iov_base, iov[i].iov_len);
+      if (nread < 0)
+        {
+          /* Report the error only if nothing has been transferred yet.
+           * Otherwise, return the partial count; the error will be seen
+           * again on the next access.
+           */
+
+          return ntotal > 0 ? ntotal : nread;
+        }
+
+      ntotal += nread;
+      if ((size_t)nread < iov[i].iov_len || INODE_IS_DRIVER(filep->f_inode))
+        {
+          break;
+        }
+    }
+
+  return ntotal;
+}
+#endif
+
+/****************************************************************************
+ * Name: readv
+ *
+ * Description:
+ *   The readv() function is equivalent to read(), except that it places
+ *   the input data into the iovcnt buffers specified by the members of the
+ *   iov array: iov[0], iov[1], ..., iov[iovcnt-1].  Each buffer is filled
+ *   completely before proceeding to the next.
+ *
+ *   NOTE: Like pread(), this is implemented in the kernel rather than in
+ *   libc so that a vectored transfer costs one system call rather than
+ *   one per buffer.
+ *
+ * Parameters:
+ *   fd       File (or socket) descriptor to read from
+ *   iov      The array of buffers to receive the data
+ *   iovcnt   The number of elements in iov[]
+ *
+ * Return:
+ *   The number of bytes read on success, 0 on an end-of-file condition, or
+ *   -1 on failure with errno set appropriately.  See read() return values.
+ *   In addition:
+ *
+ *   EINVAL
+ *     iovcnt is less than zero or greater than IOV_MAX, or the sum of the
+ *     iov_len values overflows an ssize_t.
+ *
+ ****************************************************************************/
+
+ssize_t readv(int fd, FAR const struct iovec *iov, int iovcnt)
+{
+#if CONFIG_NFILE_DESCRIPTORS > 0
+  FAR struct file *filep;
+#endif
+
+  /* Did we get a valid file descriptor? */
+
+#if CONFIG_NFILE_DESCRIPTORS > 0
+  if ((unsigned int)fd >= CONFIG_NFILE_DESCRIPTORS)
+#endif
+    {
+      /* No.. If networking is enabled, receive as read() would */
+
+#if defined(CONFIG_NET) && CONFIG_NSOCKET_DESCRIPTORS > 0
+      return readv_socket(fd, iov, iovcnt);
+#else
+      /* No networking... it is a bad descriptor in any event */
+
+      set_errno(EBADF);
+      return ERROR;
+#endif
+    }
+
+#if CONFIG_NFILE_DESCRIPTORS > 0
+  /* The descriptor is in a valid range to file descriptor... do the
+   * read.  First, get the file structure.
+   */
+
+  filep = fs_getfilep(fd);
+  if (!filep)
+    {
+      /* The errno value has already been set */
+
+      return ERROR;
+    }
+
+  /* Then let file_readv do all of the work */
+
+  return file_readv(filep, iov, iovcnt);
+#endif
+}
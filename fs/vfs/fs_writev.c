@@ -0,0 +1,246 @@
+/****************************************************************************
+ * fs/vfs/fs_writev.c
+ *
+ *   Copyright (C) 2016 Gregory Nutt. All rights reserved.
+ *   Author: Gregory Nutt <gnutt@nuttx.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <limits.h>
+#include <errno.h>
+
+#include <nuttx/fs/fs.h>
+#include <nuttx/net/net.h>
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: writev_check
+ *
+ * Description:
+ *   Verify that the I/O vector is usable:  The number of elements must be
+ *   in the range 0..IOV_MAX and the total transfer size must be
+ *   representable as an ssize_t.
+ *
+ * Returned Value:
+ *   Zero (OK) on success; a negated errno value on failure.
+ *
+ ****************************************************************************/
+
+static int writev_check(FAR const struct iovec *iov, int iovcnt)
+{
+  size_t total = 0;
+  int i;
+
+  if (iovcnt < 0 || iovcnt > IOV_MAX || (iov == NULL && iovcnt > 0))
+    {
+      return -EINVAL;
+    }
+
+  for (i = 0; i < iovcnt; i++)
+    {
+      if (iov[i].iov_len > (size_t)SSIZE_MAX - total)
+        {
+          return -EINVAL;
+        }
+
+      total += iov[i].iov_len;
+    }
+
+  return OK;
+}
+
+/****************************************************************************
+ * Name: writev_socket
+ *
+ * Description:
+ *   Send an I/O vector on a socket with a single call to psock_sendv().
+ *   On a TCP stream, the outgoing segments are gathered directly from the
+ *   vector elements; on a datagram socket, the elements form one datagram.
+ *
+ ****************************************************************************/
+
+#if defined(CONFIG_NET) && CONFIG_NSOCKET_DESCRIPTORS > 0
+static ssize_t writev_socket(int sockfd, FAR const struct iovec *iov,
+                             int iovcnt)
+{
+  int ret;
+
+  ret = writev_check(iov, iovcnt);
+  if (ret < 0)
+    {
+      set_errno(-ret);
+      return ERROR;
+    }
+
+  return psock_sendv(sockfd_socket(sockfd), iov, iovcnt, 0);
+}
+#endif
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: file_writev
+ *
+ * Description:
+ *   Equivalent to the standard writev() function except that is accepts a
+ *   struct file instance instead of a file descriptor.  Each I/O vector
+ *   element is written in turn with a call to file_write().  The transfer
+ *   stops at the first short write.  Used by writev() and pwritev().
+ *
+ ****************************************************************************/
+
+#if CONFIG_NFILE_DESCRIPTORS > 0
+ssize_t file_writev(FAR struct file *filep, FAR const struct iovec *iov,
+                    int iovcnt)
+{
+  ssize_t ntotal;
+  ssize_t nwritten;
+  int ret;
+  int i;
+
+  ret = writev_check(iov, iovcnt);
+  if (ret < 0)
+    {
+      set_errno(-ret);
+      return ERROR;
+    }
+
+  for (i = 0, ntotal = 0; i < iovcnt; i++)
+    {
+      if (iov[i].iov_len == 0)
+        {
+          continue;
+        }
+
+      nwritten = file_write(filep, iov[i].iov_base, iov[i].iov_len);
+      if (nwritten < 0)
+        {
+          /* Report the error only if nothing has been transferred yet.
+           * Otherwise, return the partial count; the error will be seen
+           * again on the next access.
+           */
+
+          return ntotal > 0 ? ntotal : nwritten;
+        }
+
+      ntotal += nwritten;
+      if ((size_t)nwritten < iov[i].iov_len)
+        {
+          break;
+        }
+    }
+
+  return ntotal;
+}
+#endif
+
+/****************************************************************************
+ * Name: writev
+ *
+ * Description:
+ *   The writev() function is equivalent to write(), except that it gathers
+ *   the output data from the iovcnt buffers specified by the members of
+ *   the iov array: iov[0], iov[1], ..., iov[iovcnt-1].  Each buffer is
+ *   written completely before proceeding to the next.
+ *
+ *   NOTE: Like pwrite(), this is implemented in the kernel rather than in
+ *   libc so that a vectored transfer costs one system call rather than
+ *   one per buffer.
+ *
+ * Parameters:
+ *   fd       File (or socket) descriptor to write to
+ *   iov      The array of buffers providing the data
+ *   iovcnt   The number of elements in iov[]
+ *
+ * Return:
+ *   The number of bytes written on success or -1 on failure with errno set
+ *   appropriately.  See write() return values.  In addition:
+ *
+ *   EINVAL
+ *     iovcnt is less than zero or greater than IOV_MAX, or the sum of the
+ *     iov_len values overflows an ssize_t.
+ *
+ ****************************************************************************/
+
+ssize_t writev(int fd, FAR const struct iovec *iov, int iovcnt)
+{
+#if CONFIG_NFILE_DESCRIPTORS > 0
+  FAR struct file *filep;
+#endif
+
+  /* Did we get a valid file descriptor? */
+
+#if CONFIG_NFILE_DESCRIPTORS > 0
+  if ((unsigned int)fd >= CONFIG_NFILE_DESCRIPTORS)
+#endif
+    {
+      /* Write to a socket descriptor is equivalent to send with flags == 0 */
+
+#if defined(CONFIG_NET) && CONFIG_NSOCKET_DESCRIPTORS > 0
+      return writev_socket(fd, iov, iovcnt);
+#else
+      set_errno(EBADF);
+      return ERROR;
+#endif
+    }
+
+#if CONFIG_NFILE_DESCRIPTORS > 0
+  /* The descriptor is in the right range to be a file descriptor... write
+   * to the file.
+   */
+
+  filep = fs_getfilep(fd);
+  if (!filep)
+    {
+      /* The errno value has already been set */
+
+      return ERROR;
+    }
+
+  /* Perform the write operation using the file descriptor as an index */
+
+  return file_writev(filep, iov, iovcnt);
+#endif
+}
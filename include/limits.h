@@ -214,6 +214,10 @@
 #define AIO_LISTIO_MAX _POSIX_AIO_LISTIO_MAX
 #define AIO_MAX        _POSIX_AIO_MAX
 
+/* Maximum number of I/O vector elements for readv() and writev() */
+
+#define IOV_MAX        16
+
 /* Required for POSIX message passing */
 
 #define MQ_OPEN_MAX    _POSIX_MQ_OPEN_MAX
@@ -1318,6 +1318,26 @@ void up_disable_irq(int irq);
 int up_prioritize_irq(int irq, int priority);
 #endif
 
+/****************************************************************************
+ * Name: up_perf_gettime
+ *
+ * Description:
+ *   Return the current value of a free-running, platform-specific timer.
+ *   This timer is used to measure the execution time of interrupt handlers
+ *   when interrupt monitoring is enabled.  The timer should run at a rate
+ *   high enough to resolve the duration of short interrupt handlers (the
+ *   CPU cycle counter is ideal).  The 32-bit value is permitted to wrap
+ *   around.
+ *
+ *   This function may be called from interrupt handling logic and must
+ *   not block.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_SCHED_IRQMONITOR
+uint32_t up_perf_gettime(void);
+#endif
+
 /****************************************************************************
  * Tickless OS Support.
  *
@@ -109,6 +109,7 @@ struct elf_loadinfo_s
   size_t            textsize;    /* Size of the ELF .text memory allocation */
   size_t            datasize;    /* Size of the ELF .bss/.data memory allocation */
   off_t             filelen;     /* Length of the entire ELF file */
+  FAR const uint8_t *filbase;    /* In-place mapping of the file (or NULL) */
   Elf32_Ehdr        ehdr;        /* Buffered ELF file header */
   FAR Elf32_Shdr    *shdr;       /* Buffered ELF section headers */
   uint8_t           *iobuffer;   /* File I/O buffer */
@@ -0,0 +1,191 @@
+/****************************************************************************
+ * include/nuttx/blkqueue.h
+ *
+ *   Copyright (C) 2016 Gregory Nutt. All rights reserved.
+ *   Author: Gregory Nutt <gnutt@nuttx.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#ifndef __INCLUDE_NUTTX_BLKQUEUE_H
+#define __INCLUDE_NUTTX_BLKQUEUE_H
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <semaphore.h>
+#include <nuttx/wqueue.h>
+
+#ifdef CONFIG_DRVR_BLKQUEUE
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+/* Data transfer callouts.  These must be provided by the block driver.
+ * They are called one at a time, on the worker thread or on a thread
+ * waiting in blkq_read() or blkq_write(), and have the same semantics as
+ * the block driver read and write methods.
+ */
+
+typedef ssize_t (*blkqread_t)(FAR void *dev, FAR uint8_t *buffer,
+                              off_t startblock, size_t nblocks);
+typedef ssize_t (*blkqwrite_t)(FAR void *dev, FAR const uint8_t *buffer,
+                               off_t startblock, size_t nblocks);
+
+/* One block transfer request.  The request structure belongs to the
+ * submitter and must remain valid until the completion callback has been
+ * called.
+ */
+
+struct blkq_req_s;
+typedef CODE void (*blkqcallback_t)(FAR struct blkq_req_s *req);
+
+struct blkq_req_s
+{
+  /* These values must be provided by the submitter */
+
+  off_t         startblock;      /* First block to transfer */
+  size_t        nblocks;         /* Number of blocks to transfer */
+  FAR uint8_t  *buffer;          /* Data buffer */
+  bool          write;           /* true: Write request */
+  blkqcallback_t callback;       /* Completion callback (dispatch context) */
+  FAR void     *priv;            /* For use by the submitter */
+
+  /* Set on completion: the number of blocks transferred or a negated
+   * errno value.
+   */
+
+  ssize_t       result;
+
+  /* Private to the block queue */
+
+  FAR struct blkq_req_s *flink;  /* Supports a singly linked list */
+};
+
+/* This structure holds the state of the request queue.  In typical usage,
+ * an instance of this structure is declared within each block driver
+ * status structure and the block driver read and write methods are
+ * implemented with blkq_read() and blkq_write().  Tasks that want to
+ * overlap computation with I/O use blkq_submit() directly.
+ *
+ *  struct foo_dev_s
+ *  {
+ *    ...
+ *    struct blkqueue_s blkq;
+ *    ...
+ *  };
+ *
+ *  ... [Setup blocksize, nblocks, maxblocks, dev, read, write] ...
+ *  ret = blkq_initialize(&priv->blkq);
+ */
+
+struct blkqueue_s
+{
+  /********************************************************************/
+  /* These values must be provided by the user prior to calling
+   * blkq_initialize()
+   */
+
+  uint16_t      blocksize;       /* The size of one block */
+  size_t        nblocks;         /* The total number blocks supported */
+  uint16_t      maxblocks;       /* Largest merged transfer (0: no merging) */
+  FAR void     *dev;             /* Device state passed to callout functions */
+  blkqread_t    read;            /* Callout to read blocks */
+  blkqwrite_t   write;           /* Callout to write blocks (may be NULL) */
+
+  /********************************************************************/
+  /* The user should never modify any of the remaining fields */
+
+  sem_t         exclsem;         /* Enforces exclusive access to the queue */
+  struct work_s work;            /* Dispatch work */
+  bool          busy;            /* true: Dispatch work is queued */
+  bool          running;         /* true: Some thread is dispatching */
+  off_t         head;            /* Block following the last transfer */
+  FAR struct blkq_req_s *pending;   /* Requests sorted by start block */
+  FAR struct blkq_req_s *deferred;  /* Requests waiting for an overlapping
+                                     * pending request (FIFO order) */
+  FAR uint8_t  *mergebuf;        /* Buffer for merged transfers */
+
+  /* Statistics (informative only) */
+
+  uint32_t      nrequests;       /* Number of requests completed */
+  uint32_t      ntransfers;      /* Number of driver transfers */
+};
+
+/****************************************************************************
+ * Public Data
+ ****************************************************************************/
+
+#undef EXTERN
+#if defined(__cplusplus)
+#define EXTERN extern "C"
+extern "C"
+{
+#else
+#define EXTERN extern
+#endif
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+/* Queue initialization */
+
+int blkq_initialize(FAR struct blkqueue_s *blkq);
+void blkq_uninitialize(FAR struct blkqueue_s *blkq);
+
+/* Asynchronous transfers */
+
+int blkq_submit(FAR struct blkqueue_s *blkq, FAR struct blkq_req_s *req);
+
+/* Synchronous transfers (block driver read/write methods) */
+
+ssize_t blkq_read(FAR struct blkqueue_s *blkq, off_t startblock,
+                  size_t nblocks, FAR uint8_t *buffer);
+ssize_t blkq_write(FAR struct blkqueue_s *blkq, off_t startblock,
+                   size_t nblocks, FAR const uint8_t *buffer);
+
+#undef EXTERN
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* CONFIG_DRVR_BLKQUEUE */
+#endif /* __INCLUDE_NUTTX_BLKQUEUE_H */
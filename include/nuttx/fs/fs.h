@@ -116,6 +116,17 @@ struct geometry
   size_t geo_sectorsize;   /* Size of one sector */
 };
 
+/* This structure describes a range of sectors to be discarded with the
+ * BIOC_DISCARD ioctl command.
+ */
+
+struct bioc_discard_s
+{
+  size_t bd_startsector;   /* First sector to discard */
+  size_t bd_nsectors;      /* Number of sectors to discard */
+  bool   bd_zeroed;        /* Returned true: The sectors now read as zero */
+};
+
 /* This structure is provided by block devices when they register with the
  * system.  It is used by file systems to perform filesystem transfers.  It
  * differs from the normal driver vtable in several ways -- most notably in
@@ -276,12 +287,19 @@ struct file
   void             *f_priv;     /* Per file driver private data */
 };
 
-/* This defines a list of files indexed by the file descriptor */
+/* This defines a list of files indexed by the file descriptor.  fl_inuse
+ * is a bitmap with one bit per descriptor that is used to accelerate the
+ * search for a free descriptor:  A set bit means that the descriptor is
+ * in use; a clear bit means that the descriptor may be free.
+ */
 
 #if CONFIG_NFILE_DESCRIPTORS > 0
+#define FILELIST_NWORDS ((CONFIG_NFILE_DESCRIPTORS + 31) >> 5)
+
 struct filelist
 {
   sem_t   fl_sem;               /* Manage access to the file list */
+  uint32_t fl_inuse[FILELIST_NWORDS]; /* Bitmap of in-use descriptors */
   struct file fl_files[CONFIG_NFILE_DESCRIPTORS];
 };
 #endif
@@ -796,6 +814,67 @@ ssize_t file_pwrite(FAR struct file *filep, FAR const void *buf,
                     size_t nbytes, off_t offset);
 #endif
 
+/* fs/fs_readv.c ************************************************************/
+/****************************************************************************
+ * Name: file_readv
+ *
+ * Description:
+ *   Equivalent to the standard readv() function except that is accepts a
+ *   struct file instance instead of a file descriptor.
+ *
+ ****************************************************************************/
+
+#if CONFIG_NFILE_DESCRIPTORS > 0
+struct iovec;
+ssize_t file_readv(FAR struct file *filep, FAR const struct iovec *iov,
+                   int iovcnt);
+#endif
+
+/* fs/fs_writev.c ***********************************************************/
+/****************************************************************************
+ * Name: file_writev
+ *
+ * Description:
+ *   Equivalent to the standard writev() function except that is accepts a
+ *   struct file instance instead of a file descriptor.
+ *
+ ****************************************************************************/
+
+#if CONFIG_NFILE_DESCRIPTORS > 0
+ssize_t file_writev(FAR struct file *filep, FAR const struct iovec *iov,
+                    int iovcnt);
+#endif
+
+/* fs/fs_preadv.c ***********************************************************/
+/****************************************************************************
+ * Name: file_preadv
+ *
+ * Description:
+ *   Equivalent to the standard preadv() function except that is accepts a
+ *   struct file instance instead of a file descriptor.
+ *
+ ****************************************************************************/
+
+#if CONFIG_NFILE_DESCRIPTORS > 0
+ssize_t file_preadv(FAR struct file *filep, FAR const struct iovec *iov,
+                    int iovcnt, off_t offset);
+#endif
+
+/* fs/fs_pwritev.c **********************************************************/
+/****************************************************************************
+ * Name: file_pwritev
+ *
+ * Description:
+ *   Equivalent to the standard pwritev() function except that is accepts a
+ *   struct file instance instead of a file descriptor.
+ *
+ ****************************************************************************/
+
+#if CONFIG_NFILE_DESCRIPTORS > 0
+ssize_t file_pwritev(FAR struct file *filep, FAR const struct iovec *iov,
+                     int iovcnt, off_t offset);
+#endif
+
 /* fs/fs_lseek.c ************************************************************/
 /****************************************************************************
  * Name: file_seek
@@ -864,6 +943,28 @@ int file_vfcntl(FAR struct file *filep, int cmd, va_list ap);
 int file_poll(int fd, FAR struct pollfd *fds, bool setup);
 #endif
 
+/* fs/fs_epoll.c ************************************************************/
+/****************************************************************************
+ * Function: epoll_release
+ *
+ * Description:
+ *   Remove an open file or socket from every epoll instance that it is
+ *   registered with.  This is called when the file or socket is closed,
+ *   before its driver is closed, so that no driver is left holding a poll
+ *   setup for a descriptor that no longer exists.
+ *
+ * Input Parameters:
+ *   obj - The struct file or struct socket that is being closed
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+#if CONFIG_NFILE_DESCRIPTORS > 0 && !defined(CONFIG_DISABLE_POLL)
+void epoll_release(FAR void *obj);
+#endif
+
 /* drivers/dev_null.c *******************************************************/
 /****************************************************************************
  * Name: devnull_register
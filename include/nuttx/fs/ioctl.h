@@ -135,6 +135,20 @@
 #define FIONWRITE       _FIOC(0x0006)     /* IN:  Location to return value (int *)
                                            * OUT: Bytes writable to this fd
                                            */
+#define FIOC_RESETSTATS _FIOC(0x0007)     /* IN:  None
+                                           * OUT: None.  Statistics reported by
+                                           *      this fd are cleared.
+                                           */
+#define FIOC_FALLOCATE  _FIOC(0x0008)     /* IN:  Number of bytes (off_t) from the
+                                           *      start of the file to reserve
+                                           * OUT: None.  Storage is allocated (as
+                                           *      contiguously as possible) but
+                                           *      the file size is unchanged.
+                                           */
+#define FIOC_PACKSTATS  _FIOC(0x0009)     /* IN:  Pointer to struct
+                                           *      nxffs_packstats_s
+                                           * OUT: Volume packing statistics
+                                           */
 
 /* NuttX file system ioctl definitions **************************************/
 
@@ -217,6 +231,23 @@
                                            *      the block with specific debug
                                            *      command and data.
                                            * OUT: None.  */
+#define BIOC_DISCARD    _BIOC(0x000C)     /* Discard the content of a range of
+                                           * sectors (TRIM/erase).  The sectors
+                                           * hold undefined data afterward.
+                                           * IN:  Pointer to struct bioc_discard_s
+                                           *      giving the range.
+                                           * OUT: bd_zeroed is set if the
+                                           *      sectors now read as zero. */
+#define BIOC_FLUSH      _BIOC(0x000D)     /* Write any cached (write-behind)
+                                           * data to the media.
+                                           * IN:  None
+                                           * OUT: None */
+#define BIOC_GCCTRL     _BIOC(0x000E)     /* Control background garbage
+                                           * collection.
+                                           * IN:  Pointer to struct
+                                           *      smart_gcctrl_s
+                                           * OUT: The same structure holding
+                                           *      the current settings. */
 
 /* NuttX MTD driver ioctl definitions ***************************************/
 
@@ -41,6 +41,8 @@
  ****************************************************************************/
 
 #include <nuttx/config.h>
+#include <nuttx/compiler.h>
+
 #include <stdint.h>
 
 /****************************************************************************
@@ -57,6 +59,17 @@
 #define MKFATFS_DEFAULT_HIDSEC       0     /* No hidden sectors */
 #define MKFATFS_DEFAULT_VOLUMEID     0     /* No volume ID */
 #define MKFATFS_DEFAULT_NSECTORS     0     /* 0: Use all sectors on device */
+#define MKFATFS_DEFAULT_FLAGS        0     /* 0: Write all metadata sectors */
+#define MKFATFS_DEFAULT_PROGRESS     NULL  /* No progress reporting */
+
+/* Values for ff_flags */
+
+#define MKFATFS_FLAG_QUICK           (1 << 0) /* Discard the metadata area
+                                               * first and do not write zeros
+                                               * if the device reports that
+                                               * discarded sectors read as
+                                               * zero */
+#define MKFATFS_FLAG_DISCARD         (1 << 1) /* Also discard the data area */
 
 #define FAT_FORMAT_INITIALIZER \
 { \
@@ -69,7 +82,9 @@
   MKFATFS_DEFAULT_RSVDSECCOUNT, \
   MKFATFS_DEFAULT_HIDSEC, \
   MKFATFS_DEFAULT_VOLUMEID, \
-  MKFATFS_DEFAULT_NSECTORS \
+  MKFATFS_DEFAULT_NSECTORS, \
+  MKFATFS_DEFAULT_FLAGS, \
+  MKFATFS_DEFAULT_PROGRESS \
 }
 
 /****************************************************************************
@@ -92,6 +107,13 @@ struct fat_format_s
    uint32_t ff_hidsec;          /* Count of hidden sectors preceding fat */
    uint32_t ff_volumeid;        /* FAT volume id */
    uint32_t ff_nsectors;        /* Number of sectors from device to use: 0: Use all */
+   uint8_t  ff_flags;           /* See MKFATFS_FLAG_* definitions */
+
+   /* If not NULL, called as the format proceeds with the number of sectors
+    * processed so far and the total number of sectors to process.
+    */
+
+   CODE void (*ff_progress)(uint32_t nsectors, uint32_t ntotal);
 };
 
 /****************************************************************************
@@ -41,6 +41,10 @@
  ****************************************************************************/
 
 #include <nuttx/config.h>
+
+#include <sys/types.h>
+#include <stdint.h>
+
 #include <nuttx/fs/fs.h>
 
 /****************************************************************************
@@ -85,6 +89,16 @@
 #  define CONFIG_NXFFS_TAILTHRESHOLD (8*1024)
 #endif
 
+/* The number of I/O blocks held in the volume cache. */
+
+#ifndef CONFIG_NXFFS_CACHE_NBLOCKS
+#  define CONFIG_NXFFS_CACHE_NBLOCKS 1
+#endif
+
+#if CONFIG_NXFFS_CACHE_NBLOCKS < 1 || CONFIG_NXFFS_CACHE_NBLOCKS > 255
+#  error "CONFIG_NXFFS_CACHE_NBLOCKS must be in the range 1-255"
+#endif
+
 /* At present, only a single pre-allocated NXFFS volume is supported.  This
  * is because here can be only a single NXFFS volume mounted at any time.
  * This has to do with the fact that we bind to an MTD driver (instead of a
@@ -107,6 +121,25 @@
 #  endif
 #endif
 
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+/* Volume packing statistics returned by the FIOC_PACKSTATS ioctl command.
+ * The counts are cleared by FIOC_RESETSTATS.
+ */
+
+struct nxffs_packstats_s
+{
+  uint32_t npacks;     /* Number of times packing reached the end of FLASH */
+  uint32_t nsteps;     /* Number of incremental packing steps */
+  uint32_t ninodes;    /* Number of inodes moved */
+  uint32_t neblocks;   /* Number of erase blocks erased and re-written */
+  uint32_t nskipped;   /* Number of erase blocks that were already erased */
+  uint32_t maxeblocks; /* Most erase blocks re-written by one call */
+  off_t    freesize;   /* Bytes available at the end of FLASH */
+};
+
 /****************************************************************************
  * Public Function Prototypes
  ****************************************************************************/
@@ -89,6 +89,10 @@ struct procfs_operations
   /* Operations on paths */
 
   int     (*stat)(FAR const char *relpath, FAR struct stat *buf);
+
+  /* Optional open-file-specific ioctl method (may be NULL) */
+
+  int     (*ioctl)(FAR struct file *filep, int cmd, unsigned long arg);
 };
 
 /* Procfs handler prototypes ************************************************/
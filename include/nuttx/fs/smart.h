@@ -45,6 +45,7 @@
 
 #include <sys/types.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 /****************************************************************************
  * Pre-processor Definitions
@@ -55,6 +56,11 @@
 #define SMART_FMT_ISFORMATTED   0x01
 #define SMART_FMT_HASBYTEWRITE  0x02
 
+/* Flags for the BIOC_GCCTRL ioctl */
+
+#define SMART_GCCTRL_CONFIG     0x01  /* Apply the settings given */
+#define SMART_GCCTRL_RUN        0x02  /* Collect up to the high watermark */
+
 /****************************************************************************
  * Public Types
  ****************************************************************************/
@@ -89,6 +95,24 @@ struct smart_read_write_s
   const uint8_t *buffer;  /* Pointer to the data to write */
 };
 
+/* The following defines the background garbage collection settings and
+ * state exchanged via the BIOC_GCCTRL ioctl.  The watermarks are counts
+ * of free sectors:  collection starts below lowfree once the device has
+ * been idle for idlems milliseconds and stops at highfree.
+ */
+
+struct smart_gcctrl_s
+{
+  uint8_t  flags;           /* SMART_GCCTRL_* flags (see above) */
+  bool     enable;          /* Background collection enabled */
+  uint16_t idlems;          /* Idle time before collecting */
+  uint16_t lowfree;         /* Low free sector watermark */
+  uint16_t highfree;        /* High free sector watermark */
+  uint16_t freesectors;     /* OUT: Number of free sectors */
+  uint16_t releasesectors;  /* OUT: Number of released sectors */
+  uint32_t collected;       /* OUT: Blocks collected in the background */
+};
+
 /* The following defines the procfs data exchange interface between the
  * SMART MTD and FS layers.
  */
@@ -41,6 +41,7 @@
  ****************************************************************************/
 
 #ifndef __ASSEMBLY__
+# include <stdint.h>
 # include <assert.h>
 #endif
 
@@ -69,6 +70,25 @@ typedef int (*xcpt_t)(int irq, FAR void *context);
 
 #include <arch/irq.h>
 
+/* This structure holds the interrupt statistics that are collected by
+ * irq_dispatch() for each IRQ when CONFIG_SCHED_IRQMONITOR is enabled.
+ * All times are in units of the timer used by up_perf_gettime().
+ */
+
+#if defined(CONFIG_SCHED_IRQMONITOR) && !defined(__ASSEMBLY__)
+struct irqmon_s
+{
+  uint32_t count;                   /* Number of times the IRQ was dispatched */
+  uint32_t max;                     /* Longest handler execution time */
+#ifdef CONFIG_HAVE_LONG_LONG
+  uint64_t total;                   /* Accumulated handler execution time */
+#else
+  uint32_t total;                   /* Accumulated handler execution time */
+#endif
+  uint32_t hist[CONFIG_SCHED_IRQMONITOR_NBUCKETS]; /* Execution time histogram */
+};
+#endif
+
 /****************************************************************************
  * Public Data
  ****************************************************************************/
@@ -97,6 +117,38 @@ extern "C"
 
 int irq_attach(int irq, xcpt_t isr);
 
+/****************************************************************************
+ * Name: irq_getstats
+ *
+ * Description:
+ *   Return a snapshot of the interrupt statistics collected for 'irq'.
+ *
+ * Input Parameters:
+ *   irq   - The IRQ number of interest
+ *   stats - The location to return the statistics
+ *
+ * Returned Value:
+ *   OK (0) on success; a negated errno value on failure.  The only reason
+ *   that this function can fail is if 'irq' is not a valid IRQ number.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_SCHED_IRQMONITOR
+int irq_getstats(int irq, FAR struct irqmon_s *stats);
+#endif
+
+/****************************************************************************
+ * Name: irq_resetstats
+ *
+ * Description:
+ *   Clear the interrupt statistics collected for all IRQs.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_SCHED_IRQMONITOR
+void irq_resetstats(void);
+#endif
+
 #undef EXTERN
 #ifdef __cplusplus
 }
@@ -79,6 +79,12 @@
                                            *      0=Use normal memory region
                                            *      1=Use alternate/extended memory
                                            * OUT: None */
+#define MTDIOC_DISCARD    _MTDIOC(0x0008) /* IN:  Pointer to struct
+                                           *      bioc_discard_s giving a range
+                                           *      of R/W blocks whose content
+                                           *      is no longer needed.
+                                           * OUT: bd_zeroed is set if the
+                                           *      blocks now read as zero */
 
 /* Macros to hide implementation */
 
@@ -641,6 +641,32 @@ int psock_connect(FAR struct socket *psock, FAR const struct sockaddr *addr,
 ssize_t psock_send(FAR struct socket *psock, const void *buf, size_t len,
                    int flags);
 
+/****************************************************************************
+ * Function: psock_sendv
+ *
+ * Description:
+ *   Send the data described by an I/O vector on a connected socket.  This
+ *   is the gather form of psock_send():  On a TCP stream, the elements are
+ *   gathered directly into the outgoing segments; on a datagram socket,
+ *   they are sent as a single datagram.
+ *
+ * Parameters:
+ *   psock    An instance of the internal socket structure.
+ *   iov      I/O vector describing the data to send
+ *   iovcnt   Number of elements in the I/O vector
+ *   flags    Send flags
+ *
+ * Returned Value:
+ *   On success, returns the number of characters sent.  On  error,
+ *   -1 is returned, and errno is set appropriately.  See psock_send() for
+ *   the list of errors.
+ *
+ ****************************************************************************/
+
+struct iovec; /* Forward reference. Defined in nuttx/include/sys/uio.h */
+ssize_t psock_sendv(FAR struct socket *psock, FAR const struct iovec *iov,
+                    int iovcnt, int flags);
+
 /****************************************************************************
  * Function: psock_sendto
  *
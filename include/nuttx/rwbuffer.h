@@ -53,6 +53,17 @@
  * Pre-processor Definitions
  ****************************************************************************/
 
+/* Configuration ************************************************************/
+/* CONFIG_DRVR_WRSEGMENTS - The number of independent write buffer segments.
+ *   Each segment buffers up to wrmaxblocks contiguous blocks so that
+ *   writers to several distant regions of the media do not flush each
+ *   other's buffered data.
+ */
+
+#ifndef CONFIG_DRVR_WRSEGMENTS
+#  define CONFIG_DRVR_WRSEGMENTS 1
+#endif
+
 /****************************************************************************
  * Public Types
  ****************************************************************************/
@@ -67,6 +78,34 @@ typedef ssize_t (*rwbreload_t)(FAR void *dev, FAR uint8_t *buffer,
 typedef ssize_t (*rwbflush_t)(FAR void *dev, FAR const uint8_t *buffer,
                               off_t startblock, size_t nblocks);
 
+/* One segment of the write buffer.  Segments never hold the same block. */
+
+#ifdef CONFIG_DRVR_WRITEBUFFER
+struct rwb_wrsegment_s
+{
+  off_t         blockstart;      /* First block in the segment */
+  uint16_t      nblocks;         /* Number of blocks buffered (0=unused) */
+  uint32_t      lastuse;         /* Write sequence number of the last write */
+};
+#endif
+
+/* Buffering statistics.  These are informative only and may be read or
+ * cleared by the owner of the rwbuffer_s structure at any time.
+ */
+
+#ifdef CONFIG_DRVR_RWBSTATS
+struct rwb_stats_s
+{
+  uint32_t      rhhits;          /* Blocks read from the read-ahead buffer */
+  uint32_t      rhreloads;       /* Number of read-ahead buffer reloads */
+  uint32_t      rhblocks;        /* Number of blocks reloaded */
+  uint32_t      wrhits;          /* Writes added to a buffered segment */
+  uint32_t      wrcoalesced;     /* Blocks re-written while still buffered */
+  uint32_t      wrflushes;       /* Number of write buffer flush transfers */
+  uint32_t      wrblocks;        /* Number of blocks flushed */
+};
+#endif
+
 /* This structure holds the state of the buffers.  In typical usage,
  * an instance of this structure is declared within each block driver
  * status structure like:
@@ -110,7 +149,8 @@ struct rwbuffer_s
    */
 
 #ifdef CONFIG_DRVR_WRITEBUFFER
-  uint16_t      wrmaxblocks;     /* The number of blocks to buffer in memory */
+  uint16_t      wrmaxblocks;     /* The number of blocks to buffer in memory
+                                  * (per write buffer segment) */
 #endif
 #ifdef CONFIG_DRVR_READAHEAD
   uint16_t      rhmaxblocks;     /* The number of blocks to buffer in memory */
@@ -138,10 +178,9 @@ struct rwbuffer_s
 #ifdef CONFIG_DRVR_WRITEBUFFER
   sem_t         wrsem;           /* Enforces exclusive access to the write buffer */
   struct work_s work;            /* Delayed work to flush buffer after a delay with no activity */
-  uint8_t      *wrbuffer;        /* Allocated write buffer */
-  uint16_t      wrnblocks;       /* Number of blocks in write buffer */
-  off_t         wrblockstart;    /* First block in write buffer */
-  off_t         wrexpectedblock; /* Next block expected */
+  uint8_t      *wrbuffer;        /* Allocated write buffer (all segments) */
+  uint32_t      wrseqno;         /* Sequence number of the last write */
+  struct rwb_wrsegment_s wrseg[CONFIG_DRVR_WRSEGMENTS];
 #endif
 
   /* This is the state of the read-ahead buffering */
@@ -151,6 +190,12 @@ struct rwbuffer_s
   uint8_t      *rhbuffer;        /* Allocated read-ahead buffer */
   uint16_t      rhnblocks;       /* Number of blocks in read-ahead buffer */
   off_t         rhblockstart;    /* First block in read-ahead buffer */
+  off_t         rhexpected;      /* Next block of a sequential read stream */
+  size_t        rhstream;        /* Length of the sequential stream (blocks) */
+#endif
+
+#ifdef CONFIG_DRVR_RWBSTATS
+  struct rwb_stats_s stats;      /* Buffering statistics */
 #endif
 };
 
@@ -184,6 +229,12 @@ ssize_t rwb_write(FAR struct rwbuffer_s *rwb,
                   off_t startblock, size_t blockcount,
                   FAR const uint8_t *wrbuffer);
 
+/* Write buffer flush */
+
+#ifdef CONFIG_DRVR_WRITEBUFFER
+int rwb_flush(FAR struct rwbuffer_s *rwb);
+#endif
+
 /* Character oriented transfers */
 
 #ifdef CONFIG_DRVR_READBYTES
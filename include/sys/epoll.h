@@ -40,7 +40,9 @@
  * Included Files
  ****************************************************************************/
 
+#include <stdint.h>
 #include <poll.h>
+#include <semaphore.h>
 
 /****************************************************************************
  * Pre-processor Definitions
@@ -74,6 +76,10 @@ enum EPOLL_EVENTS
 #define EPOLLERR EPOLLERR
     EPOLLHUP = POLLHUP,
 #define EPOLLHUP EPOLLHUP
+    EPOLLONESHOT = 0x40,
+#define EPOLLONESHOT EPOLLONESHOT
+    EPOLLET = 0x80,
+#define EPOLLET EPOLLET
   };
 
 typedef union poll_data
@@ -81,6 +87,11 @@ typedef union poll_data
   int          fd;       /* The descriptor being polled */
 } epoll_data_t;
 
+/* NOTE: The beginning of this structure must be identical to struct pollfd.
+ * Each registered descriptor is set up with its driver as a struct pollfd
+ * once, by epoll_ctl(), and remains set up until it is removed.
+ */
+
 struct epoll_event
 {
   epoll_data_t data;
@@ -88,13 +99,18 @@ struct epoll_event
   pollevent_t  events;   /* The input event flags */
   pollevent_t  revents;  /* The output event flags */
   FAR void    *priv;     /* For use by drivers */
+  FAR void    *obj;      /* Used internally by epoll: File or socket */
+  uint8_t      flags;    /* Used internally by epoll */
 };
 
 struct epoll_head
 {
-  int size;
-  int occupied;
-  FAR struct epoll_event *evs;
+  FAR struct epoll_head *flink; /* Next epoll instance */
+  int size;                     /* Number of registration slots */
+  int occupied;                 /* Number of slots in use */
+  int next;                     /* Slot at which the next scan begins */
+  sem_t sem;                    /* Posted by drivers when events occur */
+  FAR struct epoll_event *evs;  /* Registration slots */
 };
 
 /****************************************************************************
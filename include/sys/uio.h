@@ -36,6 +36,14 @@
 #ifndef __INCLUDE_SYS_UIO_H
 #define __INCLUDE_SYS_UIO_H
 
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <sys/types.h>
+
 /****************************************************************************
  * Public Types
  ****************************************************************************/
@@ -50,9 +58,20 @@ struct iovec
  * Public Function Prototypes
  ****************************************************************************/
 
-#if 0 /* Not implemented */
-ssize_t readv(int, const struct iovec *, int);
-ssize_t writev(int, const struct iovec *, int);
+#if defined(__cplusplus)
+extern "C"
+{
+#endif
+
+ssize_t readv(int fd, FAR const struct iovec *iov, int iovcnt);
+ssize_t writev(int fd, FAR const struct iovec *iov, int iovcnt);
+ssize_t preadv(int fd, FAR const struct iovec *iov, int iovcnt,
+               off_t offset);
+ssize_t pwritev(int fd, FAR const struct iovec *iov, int iovcnt,
+                off_t offset);
+
+#if defined(__cplusplus)
+}
 #endif
 
 #endif /* __INCLUDE_SYS_UIO_H */
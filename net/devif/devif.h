@@ -461,6 +461,30 @@ void devif_iob_send(FAR struct net_driver_s *dev, FAR struct iob_s *buf,
                     unsigned int len, unsigned int offset);
 #endif
 
+/****************************************************************************
+ * Name: devif_iov_send
+ *
+ * Description:
+ *   Called from socket logic in response to a xmit or poll request from the
+ *   the network interface driver.
+ *
+ *   This is identical to calling devif_send() except that the data is
+ *   gathered from an I/O vector, starting 'offset' bytes into the vector,
+ *   rather than taken from a flat buffer.
+ *
+ * Assumptions:
+ *   Called from the interrupt level or, at a minimum, with interrupts
+ *   disabled.
+ *
+ ****************************************************************************/
+
+#if defined(CONFIG_NET_TCP) && !defined(CONFIG_NET_TCP_WRITE_BUFFERS)
+struct iovec;
+void devif_iov_send(FAR struct net_driver_s *dev,
+                    FAR const struct iovec *iov, int iovcnt,
+                    unsigned int len, unsigned int offset);
+#endif
+
 /****************************************************************************
  * Name: devif_pkt_send
  *
@@ -0,0 +1,115 @@
+/****************************************************************************
+ * net/devif/devif_iovsend.c
+ *
+ *   Copyright (C) 2016 Gregory Nutt. All rights reserved.
+ *   Author: Gregory Nutt <gnutt@nuttx.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <sys/uio.h>
+#include <string.h>
+#include <assert.h>
+#include <debug.h>
+
+#include <nuttx/net/netdev.h>
+
+#include "devif/devif.h"
+
+#if defined(CONFIG_NET_TCP) && !defined(CONFIG_NET_TCP_WRITE_BUFFERS)
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: devif_iov_send
+ *
+ * Description:
+ *   Called from socket logic in response to a xmit or poll request from the
+ *   the network interface driver.
+ *
+ *   This is identical to calling devif_send() except that the data is
+ *   gathered from an I/O vector, starting 'offset' bytes into the vector,
+ *   rather than taken from a flat buffer.
+ *
+ * Assumptions:
+ *   Called from the interrupt level or, at a minimum, with interrupts
+ *   disabled.
+ *
+ ****************************************************************************/
+
+void devif_iov_send(FAR struct net_driver_s *dev,
+                    FAR const struct iovec *iov, int iovcnt,
+                    unsigned int len, unsigned int offset)
+{
+  FAR uint8_t *dest;
+  unsigned int remaining;
+  unsigned int ncopy;
+  int i;
+
+  DEBUGASSERT(dev && iov && len > 0 && len < NET_DEV_MTU(dev));
+
+  /* Skip over the elements that have already been sent */
+
+  for (i = 0; i < iovcnt && offset >= iov[i].iov_len; i++)
+    {
+      offset -= iov[i].iov_len;
+    }
+
+  /* Then copy from each remaining element into the device buffer */
+
+  dest      = dev->d_appdata;
+  remaining = len;
+
+  for (; i < iovcnt && remaining > 0; i++)
+    {
+      ncopy = iov[i].iov_len - offset;
+      if (ncopy > remaining)
+        {
+          ncopy = remaining;
+        }
+
+      memcpy(dest, (FAR const uint8_t *)iov[i].iov_base + offset, ncopy);
+      dest      += ncopy;
+      remaining -= ncopy;
+      offset     = 0;
+    }
+
+  DEBUGASSERT(remaining == 0);
+  dev->d_sndlen = len;
+}
+
+#endif /* CONFIG_NET_TCP && !CONFIG_NET_TCP_WRITE_BUFFERS */
@@ -49,6 +49,7 @@
 #include <assert.h>
 
 #include <arch/irq.h>
+#include <nuttx/fs/fs.h>
 #include <nuttx/net/net.h>
 #include <nuttx/net/netdev.h>
 #include <nuttx/net/tcp.h>
@@ -524,6 +525,12 @@ int psock_close(FAR struct socket *psock)
       goto errout;
     }
 
+#if CONFIG_NFILE_DESCRIPTORS > 0 && !defined(CONFIG_DISABLE_POLL)
+  /* Remove the socket from any epoll instance that it is registered with */
+
+  epoll_release(psock);
+#endif
+
   /* We perform the uIP close operation only if this is the last count on
    * the socket. (actually, I think the socket crefs only takes the values
    * 0 and 1 right now).
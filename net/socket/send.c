@@ -41,8 +41,13 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <stdint.h>
+#include <string.h>
 #include <errno.h>
 
+#include <nuttx/kmalloc.h>
+
 #include "tcp/tcp.h"
 #include "udp/udp.h"
 #include "pkt/pkt.h"
@@ -207,6 +212,136 @@ ssize_t psock_send(FAR struct socket *psock, FAR const void *buf, size_t len,
   return ret;
 }
 
+/****************************************************************************
+ * Function: psock_sendv
+ *
+ * Description:
+ *   Send the data described by an I/O vector on a connected socket.  This
+ *   is the gather form of psock_send() used by writev().
+ *
+ *   On a TCP stream socket, the vector is handed to the TCP send logic as
+ *   a whole and each outgoing segment is gathered directly from the
+ *   elements.  On a datagram socket, the elements are gathered into a
+ *   temporary buffer so that they form one datagram.  Other stream sockets
+ *   send the elements in turn, stopping at the first short transfer.
+ *
+ * Parameters:
+ *   psock    An instance of the internal socket structure.
+ *   iov      I/O vector describing the data to send
+ *   iovcnt   Number of elements in the I/O vector
+ *   flags    Send flags
+ *
+ * Returned Value:
+ *   On success, returns the number of characters sent.  On  error,
+ *   -1 is returned, and errno is set appropriately.  See psock_send() for
+ *   the list of errors.
+ *
+ * Assumptions:
+ *   The I/O vector has already been validated by the caller.
+ *
+ ****************************************************************************/
+
+ssize_t psock_sendv(FAR struct socket *psock, FAR const struct iovec *iov,
+                    int iovcnt, int flags)
+{
+  FAR uint8_t *buffer;
+  size_t total;
+  size_t offset;
+  ssize_t ntotal;
+  ssize_t nsent;
+  int i;
+
+  if (psock == NULL || psock->s_crefs <= 0)
+    {
+      set_errno(EBADF);
+      return ERROR;
+    }
+
+#ifdef CONFIG_NET_TCP
+  /* A TCP stream:  Let the TCP send logic gather the elements itself */
+
+  if (psock->s_type == SOCK_STREAM
+#ifdef CONFIG_NET_LOCAL_STREAM
+      && psock->s_domain != PF_LOCAL
+#endif
+     )
+    {
+      return psock_tcp_sendv(psock, iov, iovcnt);
+    }
+#endif
+
+  for (i = 0, total = 0; i < iovcnt; i++)
+    {
+      total += iov[i].iov_len;
+    }
+
+  if (total == 0)
+    {
+      return 0;
+    }
+
+  /* If all of the data is in one element, then send it directly */
+
+  for (i = 0; i < iovcnt && iov[i].iov_len < total; i++);
+
+  if (i < iovcnt)
+    {
+      return psock_send(psock, iov[i].iov_base, total, flags);
+    }
+
+  /* Any other stream:  Send each element in turn */
+
+  if (psock->s_type == SOCK_STREAM)
+    {
+      for (i = 0, ntotal = 0; i < iovcnt; i++)
+        {
+          if (iov[i].iov_len == 0)
+            {
+              continue;
+            }
+
+          nsent = psock_send(psock, iov[i].iov_base, iov[i].iov_len, flags);
+          if (nsent < 0)
+            {
+              return ntotal > 0 ? ntotal : nsent;
+            }
+
+          ntotal += nsent;
+          if ((size_t)nsent < iov[i].iov_len)
+            {
+              break;
+            }
+        }
+
+      return ntotal;
+    }
+
+  /* A datagram:  Gather the elements.  No datagram is larger than 64KB. */
+
+  if (total > UINT16_MAX)
+    {
+      set_errno(EMSGSIZE);
+      return ERROR;
+    }
+
+  buffer = (FAR uint8_t *)kmm_malloc(total);
+  if (buffer == NULL)
+    {
+      set_errno(ENOMEM);
+      return ERROR;
+    }
+
+  for (i = 0, offset = 0; i < iovcnt; i++)
+    {
+      memcpy(&buffer[offset], iov[i].iov_base, iov[i].iov_len);
+      offset += iov[i].iov_len;
+    }
+
+  nsent = psock_send(psock, buffer, total, flags);
+  kmm_free(buffer);
+  return nsent;
+}
+
 /****************************************************************************
  * Function: send
  *
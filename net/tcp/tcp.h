@@ -110,7 +110,8 @@
 #  define WRB_NRTX(wrb)           ((wrb)->wb_nrtx)
 #  define WRB_IOB(wrb)            ((wrb)->wb_iob)
 #  define WRB_COPYOUT(wrb,dest,n) (iob_copyout(dest,(wrb)->wb_iob,(n),0))
-#  define WRB_COPYIN(wrb,src,n)   (iob_copyin((wrb)->wb_iob,src,(n),0,false))
+#  define WRB_APPEND(wrb,src,n) \
+     (iob_copyin((wrb)->wb_iob,src,(n),WRB_PKTLEN(wrb),false))
 
 #  define WRB_TRIM(wrb,n) \
   do { (wrb)->wb_iob = iob_trimhead((wrb)->wb_iob,(n)); } while (0)
@@ -1143,6 +1144,32 @@ struct socket;
 ssize_t psock_tcp_send(FAR struct socket *psock, FAR const void *buf,
                        size_t len);
 
+/****************************************************************************
+ * Function: psock_tcp_sendv
+ *
+ * Description:
+ *   The psock_tcp_sendv() call may be used only when the TCP socket is in a
+ *   connected state (so that the intended recipient is known).  It is
+ *   identical to psock_tcp_send() except that the data is gathered from an
+ *   I/O vector and sent as one continuous stream with a single send
+ *   operation.
+ *
+ * Parameters:
+ *   psock    An instance of the internal socket structure.
+ *   iov      I/O vector describing the data to send
+ *   iovcnt   Number of elements in the I/O vector
+ *
+ * Returned Value:
+ *   On success, returns the number of characters sent.  On  error,
+ *   -1 is returned, and errno is set appropriately.  See psock_tcp_send()
+ *   for the list of errors.
+ *
+ ****************************************************************************/
+
+struct iovec;
+ssize_t psock_tcp_sendv(FAR struct socket *psock,
+                        FAR const struct iovec *iov, int iovcnt);
+
 /****************************************************************************
  * Function: tcp_wrbuffer_initialize
  *
@@ -52,6 +52,7 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 #include <stdint.h>
 #include <stdbool.h>
@@ -871,16 +872,18 @@ static inline void send_txnotify(FAR struct socket *psock,
  ****************************************************************************/
 
 /****************************************************************************
- * Function: psock_tcp_send
+ * Function: psock_tcp_sendv
  *
  * Description:
- *   psock_tcp_send() call may be used only when the TCP socket is in a
- *   connected state (so that the intended recipient is known).
+ *   psock_tcp_sendv() call may be used only when the TCP socket is in a
+ *   connected state (so that the intended recipient is known).  All of the
+ *   data described by the I/O vector is gathered into a single write
+ *   buffer so that it is queued, segmented and retransmitted as one unit.
  *
  * Parameters:
  *   psock    An instance of the internal socket structure.
- *   buf      Data to send
- *   len      Length of data to send
+ *   iov      I/O vector describing the data to send
+ *   iovcnt   Number of elements in the I/O vector
  *
  * Returned Value:
  *   On success, returns the number of characters sent.  On  error,
@@ -927,15 +930,17 @@ static inline void send_txnotify(FAR struct socket *psock,
  *
  ****************************************************************************/
 
-ssize_t psock_tcp_send(FAR struct socket *psock, FAR const void *buf,
-                       size_t len)
+ssize_t psock_tcp_sendv(FAR struct socket *psock,
+                        FAR const struct iovec *iov, int iovcnt)
 {
   FAR struct tcp_conn_s *conn;
   FAR struct tcp_wrbuffer_s *wrb;
   net_lock_t save;
   ssize_t    result = 0;
+  size_t     len;
   int        err;
   int        ret = OK;
+  int        i;
 
   if (!psock || psock->s_crefs <= 0)
     {
@@ -989,9 +994,12 @@ ssize_t psock_tcp_send(FAR struct socket *psock, FAR const void *buf,
     }
 #endif /* CONFIG_NET_ARP_SEND || CONFIG_NET_ICMPv6_NEIGHBOR */
 
-  /* Dump the incoming buffer */
+  /* Get the total number of bytes to send */
 
-  BUF_DUMP("psock_tcp_send", buf, len);
+  for (i = 0, len = 0; i < iovcnt; i++)
+    {
+      len += iov[i].iov_len;
+    }
 
   /* Set the socket state to sending */
 
@@ -1043,7 +1051,20 @@ ssize_t psock_tcp_send(FAR struct socket *psock, FAR const void *buf,
 
       WRB_SEQNO(wrb) = (unsigned)-1;
       WRB_NRTX(wrb)  = 0;
-      WRB_COPYIN(wrb, (FAR uint8_t *)buf, len);
+
+      for (i = 0; i < iovcnt; i++)
+        {
+          if (iov[i].iov_len > 0)
+            {
+              /* Dump the incoming buffer */
+
+              BUF_DUMP("psock_tcp_sendv", iov[i].iov_base, iov[i].iov_len);
+
+              /* And append it to the write buffer */
+
+              WRB_APPEND(wrb, (FAR uint8_t *)iov[i].iov_base, iov[i].iov_len);
+            }
+        }
 
       /* Dump I/O buffer chain */
 
@@ -1104,4 +1125,31 @@ errout:
   return ERROR;
 }
 
+/****************************************************************************
+ * Function: psock_tcp_send
+ *
+ * Description:
+ *   psock_tcp_send() call may be used only when the TCP socket is in a
+ *   connected state (so that the intended recipient is known).
+ *
+ * Parameters:
+ *   psock    An instance of the internal socket structure.
+ *   buf      Data to send
+ *   len      Length of data to send
+ *
+ * Returned Value:
+ *   See psock_tcp_sendv().
+ *
+ ****************************************************************************/
+
+ssize_t psock_tcp_send(FAR struct socket *psock, FAR const void *buf,
+                       size_t len)
+{
+  struct iovec iov;
+
+  iov.iov_base = (FAR void *)buf;
+  iov.iov_len  = len;
+  return psock_tcp_sendv(psock, &iov, 1);
+}
+
 #endif /* CONFIG_NET && CONFIG_NET_TCP && CONFIG_NET_TCP_WRITE_BUFFERS */
@@ -43,6 +43,7 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 #include <stdint.h>
 #include <stdbool.h>
@@ -97,8 +98,9 @@ struct send_s
   FAR struct socket      *snd_sock;    /* Points to the parent socket structure */
   FAR struct devif_callback_s *snd_cb; /* Reference to callback instance */
   sem_t                   snd_sem;     /* Used to wake up the waiting thread */
-  FAR const uint8_t      *snd_buffer;  /* Points to the buffer of data to send */
-  size_t                  snd_buflen;  /* Number of bytes in the buffer to send */
+  FAR const struct iovec *snd_iov;     /* I/O vector describing the data to send */
+  int                     snd_iovcnt;  /* Number of elements in the I/O vector */
+  size_t                  snd_buflen;  /* Total number of bytes to send */
   ssize_t                 snd_sent;    /* The number of bytes sent */
   uint32_t                snd_isn;     /* Initial sequence number */
   uint32_t                snd_acked;   /* The number of bytes acked */
@@ -542,7 +544,8 @@ static uint16_t tcpsend_interrupt(FAR struct net_driver_s *dev,
            * happen until the polling cycle completes).
            */
 
-          devif_send(dev, &pstate->snd_buffer[pstate->snd_sent], sndlen);
+          devif_iov_send(dev, pstate->snd_iov, pstate->snd_iovcnt, sndlen,
+                         pstate->snd_sent);
 
           /* Check if the destination IP address is in the ARP  or Neighbor
            * table.  If not, then the send won't actually make it out... it
@@ -657,16 +660,20 @@ static inline void send_txnotify(FAR struct socket *psock,
  ****************************************************************************/
 
 /****************************************************************************
- * Function: psock_tcp_send
+ * Function: psock_tcp_sendv
  *
  * Description:
- *   psock_tcp_send() call may be used only when the TCP socket is in a
- *   connected state (so that the intended recipient is known).
+ *   psock_tcp_sendv() call may be used only when the TCP socket is in a
+ *   connected state (so that the intended recipient is known).  The data
+ *   described by the I/O vector is sent as one continuous stream:  Each
+ *   outgoing segment is gathered directly from the vector elements so that
+ *   small elements share segments and only one send operation is waited
+ *   for.
  *
  * Parameters:
  *   psock    An instance of the internal socket structure.
- *   buf      Data to send
- *   len      Length of data to send
+ *   iov      I/O vector describing the data to send
+ *   iovcnt   Number of elements in the I/O vector
  *
  * Returned Value:
  *   On success, returns the number of characters sent.  On  error,
@@ -713,14 +720,16 @@ static inline void send_txnotify(FAR struct socket *psock,
  *
  ****************************************************************************/
 
-ssize_t psock_tcp_send(FAR struct socket *psock,
-                       FAR const void *buf, size_t len)
+ssize_t psock_tcp_sendv(FAR struct socket *psock,
+                        FAR const struct iovec *iov, int iovcnt)
 {
-  FAR struct tcp_conn_s *conn = (FAR struct tcp_conn_s *)psock->s_conn;
+  FAR struct tcp_conn_s *conn;
   struct send_s state;
   net_lock_t save;
+  size_t len;
   int err;
   int ret = OK;
+  int i;
 
   /* Verify that the sockfd corresponds to valid, allocated socket */
 
@@ -779,6 +788,13 @@ ssize_t psock_tcp_send(FAR struct socket *psock,
     }
 #endif /* CONFIG_NET_ARP_SEND || CONFIG_NET_ICMPv6_NEIGHBOR */
 
+  /* Get the total number of bytes to send */
+
+  for (i = 0, len = 0; i < iovcnt; i++)
+    {
+      len += iov[i].iov_len;
+    }
+
   /* Set the socket state to sending */
 
   psock->s_flags = _SS_SETSTATE(psock->s_flags, _SF_SEND);
@@ -794,8 +810,9 @@ ssize_t psock_tcp_send(FAR struct socket *psock,
   memset(&state, 0, sizeof(struct send_s));
   (void)sem_init(&state.snd_sem, 0, 0);    /* Doesn't really fail */
   state.snd_sock      = psock;             /* Socket descriptor to use */
+  state.snd_iov       = iov;               /* I/O vector to send from */
+  state.snd_iovcnt    = iovcnt;            /* Number of vector elements */
   state.snd_buflen    = len;               /* Number of bytes to send */
-  state.snd_buffer    = buf;               /* Buffer to send from */
 
   if (len > 0)
     {
@@ -880,4 +897,31 @@ errout:
   return ERROR;
 }
 
+/****************************************************************************
+ * Function: psock_tcp_send
+ *
+ * Description:
+ *   psock_tcp_send() call may be used only when the TCP socket is in a
+ *   connected state (so that the intended recipient is known).
+ *
+ * Parameters:
+ *   psock    An instance of the internal socket structure.
+ *   buf      Data to send
+ *   len      Length of data to send
+ *
+ * Returned Value:
+ *   See psock_tcp_sendv().
+ *
+ ****************************************************************************/
+
+ssize_t psock_tcp_send(FAR struct socket *psock,
+                       FAR const void *buf, size_t len)
+{
+  struct iovec iov;
+
+  iov.iov_base = (FAR void *)buf;
+  iov.iov_len  = len;
+  return psock_tcp_sendv(psock, &iov, 1);
+}
+
 #endif /* CONFIG_NET && CONFIG_NET_TCP && !CONFIG_NET_TCP_WRITE_BUFFERS */
@@ -56,6 +56,12 @@
 
 extern FAR xcpt_t g_irqvector[NR_IRQS+1];
 
+/* Per-IRQ interrupt statistics collected by irq_dispatch() */
+
+#if defined(CONFIG_SCHED_IRQMONITOR) && NR_IRQS > 0
+extern struct irqmon_s g_irqmon[NR_IRQS];
+#endif
+
 /****************************************************************************
  * Public Data
  ****************************************************************************/
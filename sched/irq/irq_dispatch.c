@@ -49,6 +49,11 @@
  * Pre-processor Definitions
  ****************************************************************************/
 
+#ifdef CONFIG_SCHED_IRQMONITOR
+#  define IRQMON_NBUCKETS    CONFIG_SCHED_IRQMONITOR_NBUCKETS
+#  define IRQMON_BUCKETSHIFT CONFIG_SCHED_IRQMONITOR_BUCKETSHIFT
+#endif
+
 /****************************************************************************
  * Private Type Declarations
  ****************************************************************************/
@@ -65,6 +70,52 @@
  * Private Function Prototypes
  ****************************************************************************/
 
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: irq_account
+ *
+ * Description:
+ *   Update the statistics for 'irq' after its handler ran for 'elapsed'
+ *   timer counts.  Called from irq_dispatch() with interrupts disabled.
+ *
+ ****************************************************************************/
+
+#if defined(CONFIG_SCHED_IRQMONITOR) && NR_IRQS > 0
+static inline void irq_account(int irq, uint32_t elapsed)
+{
+  FAR struct irqmon_s *mon = &g_irqmon[irq];
+  uint32_t value;
+  int bucket;
+
+  mon->count++;
+  mon->total += elapsed;
+
+  if (elapsed > mon->max)
+    {
+      mon->max = elapsed;
+    }
+
+  /* Bucket 0 holds durations below (1 << IRQMON_BUCKETSHIFT); each following
+   * bucket covers twice the range of its predecessor.  The last bucket
+   * holds everything else.
+   */
+
+  value  = elapsed >> IRQMON_BUCKETSHIFT;
+  bucket = 0;
+
+  while (value != 0 && bucket < IRQMON_NBUCKETS - 1)
+    {
+      value >>= 1;
+      bucket++;
+    }
+
+  mon->hist[bucket]++;
+}
+#endif
+
 /****************************************************************************
  * Public Functions
  ****************************************************************************/
@@ -100,6 +151,20 @@ void irq_dispatch(int irq, FAR void *context)
 
   /* Then dispatch to the interrupt handler */
 
+#if defined(CONFIG_SCHED_IRQMONITOR) && NR_IRQS > 0
+  if ((unsigned)irq < NR_IRQS)
+    {
+      uint32_t start = up_perf_gettime();
+
+      vector(irq, context);
+
+      /* Unsigned subtraction handles wrap-around of the timer */
+
+      irq_account(irq, up_perf_gettime() - start);
+      return;
+    }
+#endif
+
   vector(irq, context);
 }
 
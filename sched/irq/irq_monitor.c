@@ -0,0 +1,125 @@
+/****************************************************************************
+ * sched/irq/irq_monitor.c
+ *
+ *   Copyright (C) 2016 Gregory Nutt. All rights reserved.
+ *   Author: Gregory Nutt <gnutt@nuttx.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <string.h>
+#include <errno.h>
+
+#include <nuttx/arch.h>
+#include <nuttx/irq.h>
+
+#include "irq/irq.h"
+
+#ifdef CONFIG_SCHED_IRQMONITOR
+
+/****************************************************************************
+ * Public Data
+ ****************************************************************************/
+
+/* Per-IRQ interrupt statistics.  These are updated by irq_dispatch() */
+
+#if NR_IRQS > 0
+struct irqmon_s g_irqmon[NR_IRQS];
+#endif
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: irq_getstats
+ *
+ * Description:
+ *   Return a snapshot of the interrupt statistics collected for 'irq'.
+ *
+ * Input Parameters:
+ *   irq   - The IRQ number of interest
+ *   stats - The location to return the statistics
+ *
+ * Returned Value:
+ *   OK (0) on success; a negated errno value on failure.  The only reason
+ *   that this function can fail is if 'irq' is not a valid IRQ number.
+ *
+ ****************************************************************************/
+
+int irq_getstats(int irq, FAR struct irqmon_s *stats)
+{
+#if NR_IRQS > 0
+  irqstate_t flags;
+
+  DEBUGASSERT(stats != NULL);
+
+  if ((unsigned)irq >= NR_IRQS)
+    {
+      return -EINVAL;
+    }
+
+  /* Interrupts must be disabled so that the snapshot is consistent */
+
+  flags = irqsave();
+  memcpy(stats, &g_irqmon[irq], sizeof(struct irqmon_s));
+  irqrestore(flags);
+  return OK;
+#else
+  return -EINVAL;
+#endif
+}
+
+/****************************************************************************
+ * Name: irq_resetstats
+ *
+ * Description:
+ *   Clear the interrupt statistics collected for all IRQs.
+ *
+ ****************************************************************************/
+
+void irq_resetstats(void)
+{
+#if NR_IRQS > 0
+  irqstate_t flags;
+
+  flags = irqsave();
+  memset(g_irqmon, 0, sizeof(g_irqmon));
+  irqrestore(flags);
+#endif
+}
+
+#endif /* CONFIG_SCHED_IRQMONITOR */
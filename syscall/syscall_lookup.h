@@ -169,6 +169,10 @@ SYSCALL_LOOKUP(up_assert,                 2, STUB_up_assert)
   SYSCALL_LOOKUP(write,                   3, STUB_write)
   SYSCALL_LOOKUP(pread,                   4, STUB_pread)
   SYSCALL_LOOKUP(pwrite,                  4, STUB_pwrite)
+  SYSCALL_LOOKUP(readv,                   3, STUB_readv)
+  SYSCALL_LOOKUP(writev,                  3, STUB_writev)
+  SYSCALL_LOOKUP(preadv,                  4, STUB_preadv)
+  SYSCALL_LOOKUP(pwritev,                 4, STUB_pwritev)
 #  ifdef CONFIG_FS_AIO
   SYSCALL_LOOKUP(aio_read,                1, SYS_aio_read)
   SYSCALL_LOOKUP(aio_write,               1, SYS_aio_write)